@@ -226,6 +226,10 @@ if(WITH_HETERPS)
   add_definitions(-DPADDLE_WITH_HETERPS)
 endif()
 
+if(WITH_PSCORE_SWISS_MAP)
+  add_definitions(-DPADDLE_WITH_PSCORE_SWISS_MAP)
+endif()
+
 if(WITH_BRPC_RDMA)
   add_definitions(-DPADDLE_WITH_BRPC_RDMA)
 endif()
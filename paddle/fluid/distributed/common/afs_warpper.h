@@ -66,6 +66,11 @@ class FsReadChannel {
     return 0;
   }
 
+  // reads size bytes of binary data, -1 if the file ends before
+  inline int read(char* data, size_t size) {
+    return fread(data, 1, size, _file.get()) == size ? 0 : -1;
+  }
+
  private:
   uint32_t _buffer_size;
   FsChannelConfig _config;
@@ -114,6 +119,11 @@ class FsWriteChannel {
     return write_line(data.c_str(), data.size());
   }
 
+  // writes size bytes of binary data, without a line break
+  inline int write(const char* data, size_t size) {
+    return fwrite_unlocked(data, 1, size, _file.get()) == size ? 0 : -1;
+  }
+
  private:
   uint32_t _buffer_size;
   FsChannelConfig _config;
@@ -0,0 +1,88 @@
+// Copyright (c) 2022 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+namespace paddle {
+namespace distributed {
+
+// below this many pairs a merge sort is faster than the passes of 2048
+// buckets
+static const size_t kRadixSortMinSize = 512;
+
+// Sorts the pairs by key, stably, with an LSD radix sort of 11 bit digits.
+// The histograms of all the digits are counted in one pass, and the digits
+// all the keys share, as the high bits of slot prefixed feasigns often are,
+// take no pass. The histograms and the scatter buffer are thread local and
+// kept between calls.
+template <class VALUE>
+void RadixSortByKey(std::vector<std::pair<uint64_t, VALUE>>* kvs) {
+  typedef std::pair<uint64_t, VALUE> kv_type;
+  const size_t num = kvs->size();
+  if (num < kRadixSortMinSize) {
+    std::stable_sort(kvs->begin(),
+                     kvs->end(),
+                     [](const kv_type& k1, const kv_type& k2) {
+                       return k1.first < k2.first;
+                     });
+    return;
+  }
+
+  const int kDigitBits = 11;
+  const int kDigitNum = (64 + kDigitBits - 1) / kDigitBits;
+  const size_t kBucketNum = 1 << kDigitBits;
+  const uint64_t kDigitMask = kBucketNum - 1;
+  thread_local std::vector<size_t> counts;
+  counts.assign(kDigitNum * kBucketNum, 0);
+  for (size_t i = 0; i < num; ++i) {
+    uint64_t key = (*kvs)[i].first;
+    for (int d = 0; d < kDigitNum; ++d) {
+      ++counts[d * kBucketNum + ((key >> (d * kDigitBits)) & kDigitMask)];
+    }
+  }
+
+  thread_local std::vector<kv_type> buffer;
+  buffer.resize(num);
+  kv_type* from = kvs->data();
+  kv_type* to = buffer.data();
+  for (int d = 0; d < kDigitNum; ++d) {
+    const int shift = d * kDigitBits;
+    size_t* count = &counts[d * kBucketNum];
+    if (count[(from[0].first >> shift) & kDigitMask] == num) {
+      continue;
+    }
+    size_t offset = 0;
+    for (size_t b = 0; b < kBucketNum; ++b) {
+      size_t c = count[b];
+      count[b] = offset;
+      offset += c;
+    }
+    for (size_t i = 0; i < num; ++i) {
+      to[count[(from[i].first >> shift) & kDigitMask]++] = from[i];
+    }
+    std::swap(from, to);
+  }
+  if (from != kvs->data()) {
+    std::copy(from, from + num, kvs->data());
+  }
+}
+
+}  // namespace distributed
+}  // namespace paddle
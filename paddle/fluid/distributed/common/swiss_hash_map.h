@@ -0,0 +1,319 @@
+// Copyright (c) 2022 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <new>
+#include <utility>
+
+namespace paddle {
+namespace distributed {
+
+// SwissHashMap is an open addressing hash map in the way of the SwissTable of
+// abseil. Every slot has a control byte, which holds the low 7 bits of the
+// hash of a full slot or marks the slot empty or deleted, and a lookup
+// compares the control bytes of a group of 16 slots at once, with SSE2 when
+// it is there. Keys are compared only for the slots whose 7 bits match.
+// It has the part of the mct::closed_hash_map interface that the sparse table
+// shards use. Inserts invalidate iterators, erases do not. HASH has to mix
+// its low bits well, identity hashes make long probes.
+template <class KEY, class VALUE, class HASH = std::hash<KEY>>
+class SwissHashMap {
+ public:
+  typedef std::pair<const KEY, VALUE> value_type;
+
+  class iterator {
+   public:
+    iterator() : _ctrl(nullptr), _slot(nullptr) {}
+    iterator(const int8_t* ctrl, value_type* slot) : _ctrl(ctrl), _slot(slot) {
+      skip_free();
+    }
+    value_type& operator*() const { return *_slot; }
+    value_type* operator->() const { return _slot; }
+    iterator& operator++() {
+      ++_ctrl;
+      ++_slot;
+      skip_free();
+      return *this;
+    }
+    iterator operator++(int) {
+      iterator ret = *this;
+      ++*this;
+      return ret;
+    }
+    friend bool operator==(const iterator& a, const iterator& b) {
+      return a._ctrl == b._ctrl;
+    }
+    friend bool operator!=(const iterator& a, const iterator& b) {
+      return a._ctrl != b._ctrl;
+    }
+
+   private:
+    friend class SwissHashMap;
+    // stops at a full slot or at the sentinel after the last slot
+    void skip_free() {
+      while (*_ctrl < kSentinel) {
+        ++_ctrl;
+        ++_slot;
+      }
+    }
+    const int8_t* _ctrl;
+    value_type* _slot;
+  };
+
+  SwissHashMap() { reset(); }
+  SwissHashMap(const SwissHashMap&) = delete;
+  SwissHashMap& operator=(const SwissHashMap&) = delete;
+  ~SwissHashMap() { clear(); }
+
+  size_t size() const { return _size; }
+  bool empty() const { return _size == 0; }
+  size_t bucket_count() const { return _capacity; }
+  void max_load_factor(float x) { _max_load_factor = x; }
+  float max_load_factor() const { return _max_load_factor; }
+
+  iterator begin() { return {_ctrl, _slots}; }
+  iterator end() { return {_ctrl + _capacity, _slots + _capacity}; }
+
+  iterator find(const KEY& key) { return find_with_hash(key, _hasher(key)); }
+  iterator find_with_hash(const KEY& key, size_t hash) {
+    size_t offset = h1(hash) & _capacity;
+    for (size_t step = kGroupWidth;; offset = (offset + step) & _capacity,
+                step += kGroupWidth) {
+      Group group(_ctrl + offset);
+      for (uint32_t mask = group.match(h2(hash)); mask != 0;
+           mask &= mask - 1) {
+        size_t i = (offset + trailing_zeros(mask)) & _capacity;
+        if (_equal(_slots[i].first, key)) {
+          return {_ctrl + i, _slots + i};
+        }
+      }
+      if (group.match_empty() != 0) {
+        return end();
+      }
+    }
+  }
+
+  std::pair<iterator, bool> insert(const value_type& value) {
+    return insert_with_hash(value, _hasher(value.first));
+  }
+  std::pair<iterator, bool> insert_with_hash(const value_type& value,
+                                             size_t hash) {
+    iterator it = find_with_hash(value.first, hash);
+    if (it != end()) {
+      return {it, false};
+    }
+    size_t i = find_first_free(hash);
+    if (_growth_left == 0 && _ctrl[i] != kDeleted) {
+      rehash_and_grow();
+      i = find_first_free(hash);
+    }
+    if (_ctrl[i] == kEmpty) {
+      --_growth_left;
+    }
+    set_ctrl(i, h2(hash));
+    new (_slots + i) value_type(value);
+    ++_size;
+    return {{_ctrl + i, _slots + i}, true};
+  }
+
+  // the slot is marked deleted, it is reused by inserts and dropped when the
+  // map is rehashed
+  void quick_erase(iterator it) {
+    size_t i = it._ctrl - _ctrl;
+    _slots[i].~value_type();
+    set_ctrl(i, kDeleted);
+    --_size;
+  }
+  iterator erase(iterator it) {
+    quick_erase(it);
+    return ++it;
+  }
+  size_t erase(const KEY& key) {
+    iterator it = find(key);
+    if (it == end()) {
+      return 0;
+    }
+    quick_erase(it);
+    return 1;
+  }
+
+  void clear() {
+    if (_capacity == 0) {
+      return;
+    }
+    for (iterator it = begin(); it != end(); ++it) {
+      it->~value_type();
+    }
+    delete[] _ctrl;
+    ::operator delete(_slots);
+    reset();
+  }
+
+ private:
+  static const size_t kGroupWidth = 16;
+  static const int8_t kEmpty = -128;
+  static const int8_t kDeleted = -2;
+  static const int8_t kSentinel = -1;
+
+  // the control bytes of kGroupWidth slots from ctrl on
+  struct Group {
+    explicit Group(const int8_t* ctrl) : ctrl(ctrl) {}
+#ifdef __SSE2__
+    uint32_t match(int8_t h) const {
+      __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ctrl));
+      return _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_set1_epi8(h), c));
+    }
+    uint32_t match_empty() const { return match(kEmpty); }
+    uint32_t match_free() const {
+      __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ctrl));
+      return _mm_movemask_epi8(_mm_cmpgt_epi8(_mm_set1_epi8(kSentinel), c));
+    }
+#else
+    uint32_t match(int8_t h) const {
+      uint32_t mask = 0;
+      for (size_t i = 0; i < kGroupWidth; ++i) {
+        mask |= static_cast<uint32_t>(ctrl[i] == h) << i;
+      }
+      return mask;
+    }
+    uint32_t match_empty() const { return match(kEmpty); }
+    uint32_t match_free() const {
+      uint32_t mask = 0;
+      for (size_t i = 0; i < kGroupWidth; ++i) {
+        mask |= static_cast<uint32_t>(ctrl[i] < kSentinel) << i;
+      }
+      return mask;
+    }
+#endif
+    const int8_t* ctrl;
+  };
+
+  static size_t h1(size_t hash) { return hash >> 7; }
+  static int8_t h2(size_t hash) { return hash & 0x7F; }
+  static size_t trailing_zeros(uint32_t mask) { return __builtin_ctz(mask); }
+
+  // the control bytes of an empty map, a sentinel and a group of empties
+  static int8_t* empty_group() {
+    alignas(16) static int8_t group[kGroupWidth] = {kSentinel,
+                                                    kEmpty,
+                                                    kEmpty,
+                                                    kEmpty,
+                                                    kEmpty,
+                                                    kEmpty,
+                                                    kEmpty,
+                                                    kEmpty,
+                                                    kEmpty,
+                                                    kEmpty,
+                                                    kEmpty,
+                                                    kEmpty,
+                                                    kEmpty,
+                                                    kEmpty,
+                                                    kEmpty,
+                                                    kEmpty};
+    return group;
+  }
+
+  void reset() {
+    _ctrl = empty_group();
+    _slots = nullptr;
+    _capacity = 0;
+    _size = 0;
+    _growth_left = 0;
+  }
+
+  size_t capacity_to_growth(size_t capacity) const {
+    size_t growth = static_cast<size_t>(capacity * _max_load_factor);
+    return std::max<size_t>(1, std::min(growth, capacity - 1));
+  }
+
+  // there are capacity slots and capacity + 1 is a power of two. The control
+  // bytes of the first kGroupWidth - 1 slots are repeated after the sentinel,
+  // so a group can be loaded from any slot.
+  void set_ctrl(size_t i, int8_t h) {
+    _ctrl[i] = h;
+    _ctrl[((i - (kGroupWidth - 1)) & _capacity) + (kGroupWidth - 1)] = h;
+  }
+
+  size_t find_first_free(size_t hash) const {
+    size_t offset = h1(hash) & _capacity;
+    for (size_t step = kGroupWidth;; offset = (offset + step) & _capacity,
+                step += kGroupWidth) {
+      uint32_t mask = Group(_ctrl + offset).match_free();
+      if (mask != 0) {
+        return (offset + trailing_zeros(mask)) & _capacity;
+      }
+    }
+  }
+
+  // drops the deleted slots, the capacity is doubled unless most of the
+  // slots in use were deleted ones
+  void rehash_and_grow() {
+    if (_capacity == 0) {
+      resize(kGroupWidth - 1);
+    } else if (_size * 2 <= capacity_to_growth(_capacity)) {
+      resize(_capacity);
+    } else {
+      resize(_capacity * 2 + 1);
+    }
+  }
+
+  void resize(size_t capacity) {
+    int8_t* old_ctrl = _ctrl;
+    value_type* old_slots = _slots;
+    size_t old_capacity = _capacity;
+
+    _capacity = capacity;
+    _ctrl = new int8_t[_capacity + kGroupWidth];
+    memset(_ctrl, kEmpty, _capacity + kGroupWidth);
+    _ctrl[_capacity] = kSentinel;
+    _slots = static_cast<value_type*>(
+        ::operator new(sizeof(value_type) * _capacity));
+    _growth_left = capacity_to_growth(_capacity) - _size;
+
+    for (size_t i = 0; i < old_capacity; ++i) {
+      if (old_ctrl[i] >= 0) {
+        size_t hash = _hasher(old_slots[i].first);
+        size_t j = find_first_free(hash);
+        set_ctrl(j, h2(hash));
+        new (_slots + j) value_type(std::move(old_slots[i]));
+        old_slots[i].~value_type();
+      }
+    }
+    if (old_capacity != 0) {
+      delete[] old_ctrl;
+      ::operator delete(old_slots);
+    }
+  }
+
+  int8_t* _ctrl;
+  value_type* _slots;
+  size_t _capacity;
+  size_t _size;
+  size_t _growth_left;
+  float _max_load_factor = 0.875f;
+  HASH _hasher;
+  std::equal_to<KEY> _equal;
+};
+
+}  // namespace distributed
+}  // namespace paddle
@@ -18,6 +18,7 @@
 #include <sstream>
 #include <string>
 
+#include "paddle/fluid/distributed/common/radix_sort.h"
 #include "paddle/fluid/distributed/ps/service/coordinator_client.h"
 #include "paddle/fluid/framework/archive.h"
 #include "paddle/fluid/string/split.h"
@@ -480,6 +481,56 @@ std::future<int32_t> BrpcPsClient::PrintTableStat(uint32_t table_id) {
   }
   return fut;
 }
+
+std::future<int32_t> BrpcPsClient::PrefetchSparse(size_t table_id,
+                                                  const uint64_t *keys,
+                                                  size_t num) {
+  size_t request_call_num = _server_channels.size();
+  const auto &server_param = _config.server_param().downpour_server_param();
+  uint64_t shard_num = FLAGS_pserver_sparse_table_shard_num;
+  for (int i = 0; i < server_param.downpour_table_param_size(); ++i) {
+    const auto &table_param = server_param.downpour_table_param(i);
+    if (table_param.table_id() == table_id) {
+      shard_num = table_param.shard_num();
+      break;
+    }
+  }
+  std::vector<std::vector<uint64_t>> ids(request_call_num);
+  for (size_t i = 0; i < num; ++i) {
+    ids[get_sparse_shard(shard_num, request_call_num, keys[i])].push_back(
+        keys[i]);
+  }
+
+  DownpourBrpcClosure *closure = new DownpourBrpcClosure(
+      request_call_num, [request_call_num](void *done) {
+        int ret = 0;
+        auto *closure = reinterpret_cast<DownpourBrpcClosure *>(done);
+        for (size_t i = 0; i < request_call_num; ++i) {
+          if (closure->check_response(i, PS_PREFETCH_SPARSE_TABLE) != 0) {
+            ret = -1;
+            break;
+          }
+        }
+        closure->set_promise_value(ret);
+      });
+  auto promise = std::make_shared<std::promise<int32_t>>();
+  closure->add_promise(promise);
+  std::future<int> fut = promise->get_future();
+  for (size_t i = 0; i < request_call_num; ++i) {
+    uint32_t kv_size = ids[i].size();
+    auto *request = closure->request(i);
+    request->set_cmd_id(PS_PREFETCH_SPARSE_TABLE);
+    request->set_table_id(table_id);
+    request->set_client_id(_client_id);
+    request->add_params(reinterpret_cast<char *>(&kv_size), sizeof(uint32_t));
+    request->set_data(reinterpret_cast<const char *>(ids[i].data()),
+                      kv_size * sizeof(uint64_t));
+    PsService_Stub rpc_stub(GetSparseChannel(i));
+    rpc_stub.service(
+        closure->cntl(i), closure->request(i), closure->response(i), closure);
+  }
+  return fut;
+}
 std::future<int32_t> BrpcPsClient::SendCmd(
     uint32_t table_id, int cmd_id, const std::vector<std::string> &params) {
   size_t request_call_num = _server_channels.size();
@@ -1035,12 +1086,13 @@ std::future<int32_t> BrpcPsClient::PushSparseRawGradient(
     value_ptrs[pserver_idx].push_back(update_values[i]);
   }
 
+  SparseWireCodec codec = GetSparseWireCodec(table_id, false);
   for (size_t shard_idx = 0; shard_idx < request_call_num; ++shard_idx) {
     auto kvs = ids[shard_idx];
     auto value_ptr = value_ptrs[shard_idx];
 
     size_t kv_size = kvs.size();
-    uint32_t value_size = accessor->GetAccessorInfo().update_size;
+    uint32_t value_size = codec.EncodedSize();
 
     // 发送RPC请求
     auto *push_request = closure->request(shard_idx);
@@ -1048,6 +1100,11 @@ std::future<int32_t> BrpcPsClient::PushSparseRawGradient(
     push_request->set_table_id(table_id);
     push_request->set_client_id(_client_id);
     push_request->add_params((char *)&kv_size, sizeof(uint32_t));  // NOLINT
+    if (!codec.IsExact()) {
+      uint32_t precision = codec.precision();
+      push_request->add_params(reinterpret_cast<char *>(&precision),
+                               sizeof(uint32_t));
+    }
     auto *push_data = push_request->mutable_data();
     push_data->resize(kv_size * (sizeof(uint64_t) + value_size));
     char *push_data_ptr = const_cast<char *>(push_data->data());
@@ -1055,7 +1112,7 @@ std::future<int32_t> BrpcPsClient::PushSparseRawGradient(
     push_data_ptr += kv_size * sizeof(uint64_t);
 
     for (size_t i = 0; i < kv_size; ++i) {
-      memcpy(push_data_ptr, value_ptr[i], value_size);
+      codec.Encode(value_ptr[i], push_data_ptr);
       push_data_ptr += value_size;
     }
     PsService_Stub rpc_stub(GetSparseChannel(shard_idx));
@@ -1132,6 +1189,33 @@ std::future<int32_t> BrpcPsClient::PushGlobalStep(int table_id,
   return fut;
 }
 
+SparseWireCodec BrpcPsClient::GetSparseWireCodec(size_t table_id, bool pull) {
+  const auto &server_param = _config.server_param().downpour_server_param();
+  SparseWirePrecision precision = SPARSE_WIRE_FP32;
+  for (int i = 0; i < server_param.downpour_table_param_size(); ++i) {
+    const auto &table_param = server_param.downpour_table_param(i);
+    if (table_param.table_id() == table_id) {
+      precision = table_param.sparse_wire_precision();
+      break;
+    }
+  }
+  auto *accessor = GetTableAccessor(table_id);
+  auto info = accessor->GetAccessorInfo();
+  return SparseWireCodec(precision,
+                         pull ? info.select_dim : info.update_dim,
+                         accessor->GetEmbedxDim());
+}
+
+// keys of a pull to a server, sorted, without the duplicates
+static size_t DistinctKeyNum(
+    const std::vector<std::pair<uint64_t, float *>> &sorted_kvs) {
+  size_t num = 0;
+  for (size_t i = 0; i < sorted_kvs.size(); ++i) {
+    num += i == 0 || sorted_kvs[i].first != sorted_kvs[i - 1].first;
+  }
+  return num;
+}
+
 std::future<int32_t> BrpcPsClient::PullSparse(float **select_values,
                                               size_t table_id,
                                               const uint64_t *keys,
@@ -1164,9 +1248,10 @@ std::future<int32_t> BrpcPsClient::PullSparse(float **select_values,
   auto *accessor = GetTableAccessor(table_id);
 
   size_t value_size = accessor->GetAccessorInfo().select_size;
+  SparseWireCodec codec = GetSparseWireCodec(table_id, true);
 
   DownpourBrpcClosure *closure = new DownpourBrpcClosure(
-      request_call_num, [shard_sorted_kvs, value_size](void *done) {
+      request_call_num, [shard_sorted_kvs, value_size, codec](void *done) {
         int ret = 0;
         auto *closure = reinterpret_cast<DownpourBrpcClosure *>(done);
         for (size_t i = 0; i < shard_sorted_kvs->size(); ++i) {
@@ -1180,6 +1265,11 @@ std::future<int32_t> BrpcPsClient::PullSparse(float **select_values,
           butil::IOBufBytesIterator io_buffer_itr(res_io_buffer);
           uint64_t last_key = UINT64_MAX;
           float *last_value_data = NULL;
+          // a server without sparse_wire_precision answers in fp32
+          bool decode =
+              !codec.IsExact() &&
+              res_io_buffer.size() != DistinctKeyNum(request_kvs) * value_size;
+          std::vector<char> encoded(codec.EncodedSize());
 
           for (size_t kv_idx = 0; kv_idx < request_kvs.size(); ++kv_idx) {
             auto *kv_pair = &(request_kvs[kv_idx]);
@@ -1190,9 +1280,18 @@ std::future<int32_t> BrpcPsClient::PullSparse(float **select_values,
             } else {
               last_key = kv_pair->first;
               last_value_data = kv_pair->second;
-              if (value_size !=
-                  io_buffer_itr.copy_and_forward(
-                      reinterpret_cast<void *>(last_value_data), value_size)) {
+              if (decode) {
+                if (encoded.size() != io_buffer_itr.copy_and_forward(
+                                          encoded.data(), encoded.size())) {
+                  LOG(WARNING) << "res data is lack or not in format";
+                  ret = -1;
+                  break;
+                }
+                codec.Decode(encoded.data(), last_value_data);
+              } else if (value_size !=
+                         io_buffer_itr.copy_and_forward(
+                             reinterpret_cast<void *>(last_value_data),
+                             value_size)) {
                 LOG(WARNING) << "res data is lack or not in format";
                 ret = -1;
                 break;
@@ -1209,12 +1308,7 @@ std::future<int32_t> BrpcPsClient::PullSparse(float **select_values,
 
   for (size_t i = 0; i < request_call_num; ++i) {
     auto &sorted_kvs = shard_sorted_kvs->at(i);
-    std::sort(sorted_kvs.begin(),
-              sorted_kvs.end(),
-              [](const std::pair<uint64_t, float *> &k1,
-                 const std::pair<uint64_t, float *> &k2) {
-                return k1.first < k2.first;
-              });
+    RadixSortByKey(&sorted_kvs);
 
     uint64_t last_key = UINT64_MAX;
     uint32_t kv_request_count = 0;
@@ -1250,6 +1344,11 @@ std::future<int32_t> BrpcPsClient::PullSparse(float **select_values,
       closure->request(i)->set_client_id(_client_id);
       closure->request(i)->add_params((char *)&kv_request_count,  // NOLINT
                                       sizeof(uint32_t));
+      if (!codec.IsExact()) {
+        uint32_t precision = codec.precision();
+        closure->request(i)->add_params(reinterpret_cast<char *>(&precision),
+                                        sizeof(uint32_t));
+      }
       PsService_Stub rpc_stub(GetCmdChannel(i));
       closure->cntl(i)->set_log_id(butil::gettimeofday_ms());
       rpc_stub.service(
@@ -1325,12 +1424,7 @@ std::future<int32_t> BrpcPsClient::PullSparseParam(float **select_values,
 
   for (size_t i = 0; i < request_call_num; ++i) {
     auto &sorted_kvs = shard_sorted_kvs->at(i);
-    std::sort(sorted_kvs.begin(),
-              sorted_kvs.end(),
-              [](const std::pair<uint64_t, float *> &k1,
-                 const std::pair<uint64_t, float *> &k2) {
-                return k1.first < k2.first;
-              });
+    RadixSortByKey(&sorted_kvs);
 
     uint64_t last_key = UINT64_MAX;
     uint32_t kv_request_count = 0;
@@ -1408,8 +1502,8 @@ std::future<int32_t> BrpcPsClient::PushSparseRawGradientPartial(
     uint32_t num,
     void *done,
     int pserver_idx) {
-  auto *accessor = GetTableAccessor(table_id);
-  size_t value_size = accessor->GetAccessorInfo().update_size;
+  SparseWireCodec codec = GetSparseWireCodec(table_id, false);
+  size_t value_size = codec.EncodedSize();
   DownpourBrpcClosure *closure = reinterpret_cast<DownpourBrpcClosure *>(done);
   auto promise = std::make_shared<std::promise<int32_t>>();
   closure->add_promise(promise);
@@ -1421,13 +1515,18 @@ std::future<int32_t> BrpcPsClient::PushSparseRawGradientPartial(
   push_request->set_table_id(table_id);
   push_request->set_client_id(_client_id);
   push_request->add_params((char *)&num, sizeof(uint32_t));  // NOLINT
+  if (!codec.IsExact()) {
+    uint32_t precision = codec.precision();
+    push_request->add_params(reinterpret_cast<char *>(&precision),
+                             sizeof(uint32_t));
+  }
   auto *push_data = push_request->mutable_data();
   push_data->resize(num * (sizeof(uint64_t) + value_size));
   char *push_data_ptr = const_cast<char *>(push_data->data());
   memcpy(push_data_ptr, keys, num * sizeof(uint64_t));
   push_data_ptr += num * sizeof(uint64_t);
   for (uint32_t i = 0; i < num; ++i) {
-    memcpy(push_data_ptr, update_values[i], value_size);
+    codec.Encode(update_values[i], push_data_ptr);
     push_data_ptr += value_size;
   }
   PsService_Stub rpc_stub(GetSparseChannel(pserver_idx));
@@ -1770,12 +1869,7 @@ int BrpcPsClient::PushSparseAsyncShardMerge(
   }
 
   // 按key排序&去重
-  std::sort(sorted_kv_list.begin(),
-            sorted_kv_list.end(),
-            [](const std::pair<uint64_t, const float *> &k1,
-               const std::pair<uint64_t, const float *> &k2) {
-              return k1.first < k2.first;
-            });
+  RadixSortByKey(&sorted_kv_list);
 
   auto &async_task = task_list[0];
   size_t sorted_kv_size = sorted_kv_list.size();
@@ -1857,8 +1951,14 @@ int BrpcPsClient::PushSparseAsyncShardPush(
   push_request->set_client_id(_client_id);
   push_request->add_params(reinterpret_cast<char *>(&merged_kv_count),
                            sizeof(uint32_t));  // NOLINT
+  SparseWireCodec codec = GetSparseWireCodec(table_id, false);
+  if (!codec.IsExact()) {
+    uint32_t precision = codec.precision();
+    push_request->add_params(reinterpret_cast<char *>(&precision),
+                             sizeof(uint32_t));
+  }
   auto *push_data = push_request->mutable_data();
-  int update_size = accessor->GetAccessorInfo().update_size;
+  int update_size = codec.EncodedSize();
   push_data->resize(merged_kv_count * (sizeof(uint64_t) + update_size));
   char *push_data_ptr = const_cast<char *>(push_data->data());
   memcpy(push_data_ptr,
@@ -1868,9 +1968,8 @@ int BrpcPsClient::PushSparseAsyncShardPush(
   for (size_t i = 0; i < merged_kv_count; ++i) {
     const char *task_data_ptr = merged_value_list[i].data();
 
-    memcpy(push_data_ptr,
-           (float *)(task_data_ptr),  // NOLINT
-           update_size);
+    codec.Encode(reinterpret_cast<const float *>(task_data_ptr),
+                 push_data_ptr);
     push_data_ptr += update_size;
   }
   PsService_Stub rpc_stub(GetSparseChannel(shard_idx));
@@ -26,6 +26,7 @@
 #include "paddle/fluid/distributed/ps/service/brpc_utils.h"
 #include "paddle/fluid/distributed/ps/service/ps_client.h"
 #include "paddle/fluid/distributed/ps/service/sendrecv.pb.h"
+#include "paddle/fluid/distributed/ps/service/sparse_wire_codec.h"
 #include "paddle/fluid/framework/channel.h"
 #include "paddle/fluid/framework/lod_tensor.h"
 #include "paddle/fluid/framework/scope.h"
@@ -269,6 +270,10 @@ class BrpcPsClient : public PSClient {
 
   virtual std::future<int32_t> PrintTableStat(uint32_t table_id);
 
+  std::future<int32_t> PrefetchSparse(size_t table_id,
+                                      const uint64_t *keys,
+                                      size_t num) override;
+
   virtual std::future<int32_t> Barrier(size_t table_id, uint32_t barrier_type);
 
   virtual std::future<int32_t> PullGeoParam(size_t table_id,
@@ -345,6 +350,10 @@ class BrpcPsClient : public PSClient {
                                    int cmd_id,
                                    const std::vector<std::string> &param);
 
+  // codec of the pull (select) or push (update) values of a sparse table, as
+  // its sparse_wire_precision says
+  SparseWireCodec GetSparseWireCodec(size_t table_id, bool pull);
+
   bool _running = false;
   bool _flushing = false;
   std::atomic<uint32_t> _async_call_num;  // 异步请求计数
@@ -18,6 +18,7 @@
 
 #include "butil/object_pool.h"
 #include "paddle/fluid/distributed/common/cost_timer.h"
+#include "paddle/fluid/distributed/ps/service/sparse_wire_codec.h"
 #include "paddle/fluid/distributed/ps/table/depends/sparse_utils.h"
 #include "paddle/fluid/distributed/ps/table/table.h"
 #include "paddle/fluid/framework/archive.h"
@@ -203,6 +204,8 @@ int32_t BrpcPsService::Initialize() {
   _service_handler_map[PS_PUSH_DENSE_PARAM] = &BrpcPsService::PushDenseParam;
   _service_handler_map[PS_PRINT_TABLE_STAT] = &BrpcPsService::PrintTableStat;
   _service_handler_map[PS_PULL_GEO_PARAM] = &BrpcPsService::PullGeoParam;
+  _service_handler_map[PS_PREFETCH_SPARSE_TABLE] =
+      &BrpcPsService::PrefetchSparse;
   _service_handler_map[PS_PUSH_SPARSE_PARAM] = &BrpcPsService::PushSparseParam;
   _service_handler_map[PS_BARRIER] = &BrpcPsService::Barrier;
   _service_handler_map[PS_START_PROFILER] = &BrpcPsService::StartProfiler;
@@ -495,6 +498,18 @@ int32_t BrpcPsService::PullGeoParam(Table *table,
   return 0;
 }
 
+// the sparse_wire_precision a client sends as params(1) of a sparse pull or
+// push, fp32 for the clients that send none
+static SparseWirePrecision RequestWirePrecision(
+    const PsRequestMessage &request) {
+  if (request.params_size() < 2 ||
+      request.params(1).size() != sizeof(uint32_t)) {
+    return SPARSE_WIRE_FP32;
+  }
+  return static_cast<SparseWirePrecision>(
+      *reinterpret_cast<const uint32_t *>(request.params(1).c_str()));
+}
+
 int32_t BrpcPsService::PullSparse(Table *table,
                                   const PsRequestMessage &request,
                                   PsResponseMessage &response,
@@ -543,8 +558,22 @@ int32_t BrpcPsService::PullSparse(Table *table,
   table->Pull(table_context);
   // table->PullSparse(res_data->data(), value);
 
-  cntl->response_attachment().append(reinterpret_cast<char *>(res_data->data()),
-                                     res_data->size() * sizeof(float));
+  auto embedx_dim = table->ValueAccesor()->GetEmbedxDim();
+  SparseWireCodec codec(RequestWirePrecision(request), dim, embedx_dim);
+  if (codec.IsExact()) {
+    cntl->response_attachment().append(
+        reinterpret_cast<char *>(res_data->data()),
+        res_data->size() * sizeof(float));
+  } else {
+    auto encoded = butil::get_object<std::vector<char>>();
+    encoded->resize(num * codec.EncodedSize());
+    for (size_t i = 0; i < num; ++i) {
+      codec.Encode(res_data->data() + i * dim,
+                   encoded->data() + i * codec.EncodedSize());
+    }
+    cntl->response_attachment().append(encoded->data(), encoded->size());
+    butil::return_object(encoded);
+  }
   butil::return_object(res_data);
   return 0;
 }
@@ -576,11 +605,31 @@ int32_t BrpcPsService::PushSparse(Table *table,
   |---keysData---|---valuesData---|
   |---8*{num}B---|----------------|
   */
+  auto *accessor = table->ValueAccesor();
+  size_t update_dim = accessor->GetAccessorInfo().update_dim;
+  SparseWireCodec codec(
+      RequestWirePrecision(request), update_dim, accessor->GetEmbedxDim());
+  if (!codec.IsExact() &&
+      push_data.size() != num * (sizeof(uint64_t) + codec.EncodedSize())) {
+    set_response_code(response, -1, "push sparse data size mismatch");
+    return 0;
+  }
   TableContext table_context;
   table_context.value_type = Sparse;
   table_context.push_context.keys = (const uint64_t *)push_data.data();
   table_context.push_context.values =
       (const float *)(push_data.data() + sizeof(uint64_t) * num);
+  std::vector<float> *decoded = nullptr;
+  if (!codec.IsExact()) {
+    decoded = butil::get_object<std::vector<float>>();
+    decoded->resize(num * update_dim);
+    const char *encoded = push_data.data() + sizeof(uint64_t) * num;
+    for (size_t i = 0; i < num; ++i) {
+      codec.Decode(encoded + i * codec.EncodedSize(),
+                   decoded->data() + i * update_dim);
+    }
+    table_context.push_context.values = decoded->data();
+  }
   table_context.num = num;
   // const uint64_t *keys = (const uint64_t *)push_data.data();
   // const float *values = (const float *)(push_data.data() + sizeof(uint64_t) *
@@ -589,6 +638,36 @@ int32_t BrpcPsService::PushSparse(Table *table,
     // if (table->PushSparse(keys, values, num) != 0) {
     set_response_code(response, -1, "PushSparse error");
   }
+  if (decoded != nullptr) {
+    butil::return_object(decoded);
+  }
+  return 0;
+}
+
+int32_t BrpcPsService::PrefetchSparse(Table *table,
+                                      const PsRequestMessage &request,
+                                      PsResponseMessage &response,
+                                      brpc::Controller *cntl) {
+  CHECK_TABLE_EXIST(table, request, response)
+  if (request.params_size() < 1) {
+    set_response_code(response,
+                      -1,
+                      "PsRequestMessage.params is requeired at "
+                      "least 1 for num of sparse_key");
+    return 0;
+  }
+  const uint32_t num =
+      *(reinterpret_cast<const uint32_t *>(request.params(0).c_str()));
+  const auto &keys_data = request.data();
+  if (keys_data.size() != num * sizeof(uint64_t)) {
+    set_response_code(response, -1, "prefetch sparse data size mismatch");
+    return 0;
+  }
+  // the table copies the keys and loads them in its own tasks
+  if (table->Prefetch(reinterpret_cast<const uint64_t *>(keys_data.data()),
+                      num) != 0) {
+    set_response_code(response, -1, "Prefetch error");
+  }
   return 0;
 }
 
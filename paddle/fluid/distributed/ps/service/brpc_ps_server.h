@@ -113,6 +113,10 @@ class BrpcPsService : public PsBaseService {
                        const PsRequestMessage &request,
                        PsResponseMessage &response,  // NOLINT
                        brpc::Controller *cntl);
+  int32_t PrefetchSparse(Table *table,
+                         const PsRequestMessage &request,
+                         PsResponseMessage &response,  // NOLINT
+                         brpc::Controller *cntl);
   int32_t Barrier(Table *table,
                   const PsRequestMessage &request,
                   PsResponseMessage &response,  // NOLINT
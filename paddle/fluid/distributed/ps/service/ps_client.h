@@ -161,6 +161,28 @@ class PSClient {
 
   virtual std::future<int32_t> PrintTableStat(uint32_t table_id) = 0;
 
+  // asks the servers to move the values of keys to their faster tier ahead
+  // of the pulls, the future is ready once the servers have taken the keys
+  virtual std::future<int32_t> PrefetchSparse(size_t table_id,
+                                              const uint64_t *keys,
+                                              size_t num) {
+    VLOG(0) << "Did not implement";
+    std::promise<int32_t> promise;
+    std::future<int> fut = promise.get_future();
+    promise.set_value(-1);
+    return fut;
+  }
+
+  // tells the servers that the values pulled by PullSparsePtr are no longer
+  // used through their pointers
+  virtual std::future<int32_t> UnpinSparse(size_t table_id) {
+    VLOG(0) << "Did not implement";
+    std::promise<int32_t> promise;
+    std::future<int> fut = promise.get_future();
+    promise.set_value(-1);
+    return fut;
+  }
+
   // 确保所有积攒中的请求都发起发送
   virtual std::future<int32_t> Flush() = 0;
   // server优雅退出
@@ -88,6 +88,16 @@ class PsLocalClient : public PSClient {
 
     return fut;
   }
+  virtual ::std::future<int32_t> PrefetchSparse(size_t table_id,
+                                                const uint64_t* keys,
+                                                size_t num) {
+    GetTable(table_id)->Prefetch(keys, num);
+    return done();
+  }
+  virtual ::std::future<int32_t> UnpinSparse(size_t table_id) {
+    GetTable(table_id)->UnpinValues();
+    return done();
+  }
   virtual ::std::future<int32_t> PushSparse(size_t table_id,
                                             const uint64_t* keys,
                                             const float** update_values,
@@ -0,0 +1,181 @@
+// Copyright (c) 2022 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "paddle/fluid/distributed/ps/service/sparse_wire_codec.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "glog/logging.h"
+
+namespace paddle {
+namespace distributed {
+
+// phi::dtype::float16 and bfloat16 truncate on the CPU, which would bias the
+// gradients of every push toward zero, so the conversions are done here
+
+uint16_t FloatToHalf(float value) {
+  uint32_t bits = 0;
+  memcpy(&bits, &value, sizeof(bits));
+  uint16_t sign = (bits >> 16) & 0x8000;
+  uint32_t abs = bits & 0x7fffffff;
+  if (abs > 0x7f800000) {  // NaN
+    return sign | 0x7e00;
+  }
+  if (abs >= 0x477ff000) {  // rounds to inf or is inf, saturates at 65504
+    return sign | 0x7bff;
+  }
+  if (abs < 0x38800000) {  // subnormal in fp16, 2^-24 per step
+    float sub = 0;
+    memcpy(&sub, &abs, sizeof(sub));
+    return sign | static_cast<uint16_t>(std::nearbyint(sub * 16777216.0f));
+  }
+  // rebias the exponent from 127 to 15 and round the 13 dropped bits
+  abs += 0xc8000fff + ((abs >> 13) & 1);
+  return sign | static_cast<uint16_t>(abs >> 13);
+}
+
+float HalfToFloat(uint16_t value) {
+  uint32_t sign = static_cast<uint32_t>(value & 0x8000) << 16;
+  uint32_t abs = value & 0x7fff;
+  uint32_t bits = 0;
+  if (abs >= 0x7c00) {
+    bits = sign | 0x7f800000 | ((abs & 0x3ff) << 13);
+  } else if (abs >= 0x0400) {
+    bits = sign | ((abs << 13) + 0x38000000);
+  } else {
+    float sub = abs * (1.0f / 16777216.0f);
+    memcpy(&bits, &sub, sizeof(bits));
+    bits |= sign;
+  }
+  float ret = 0;
+  memcpy(&ret, &bits, sizeof(ret));
+  return ret;
+}
+
+uint16_t FloatToBFloat16(float value) {
+  uint32_t bits = 0;
+  memcpy(&bits, &value, sizeof(bits));
+  if ((bits & 0x7fffffff) > 0x7f800000) {
+    return (bits >> 16) | 0x40;
+  }
+  bits += 0x7fff + ((bits >> 16) & 1);
+  return bits >> 16;
+}
+
+float BFloat16ToFloat(uint16_t value) {
+  uint32_t bits = static_cast<uint32_t>(value) << 16;
+  float ret = 0;
+  memcpy(&ret, &bits, sizeof(ret));
+  return ret;
+}
+
+SparseWireCodec::SparseWireCodec(SparseWirePrecision precision,
+                                 size_t dim,
+                                 size_t embedx_dim)
+    : _precision(precision), _embedx_dim(std::min(embedx_dim, dim)) {
+  _exact_dim = dim - _embedx_dim;
+  size_t exact_size = _exact_dim * sizeof(float);
+  switch (_precision) {
+    case SPARSE_WIRE_FP16:
+    case SPARSE_WIRE_BF16:
+      _encoded_size = exact_size + _embedx_dim * sizeof(uint16_t);
+      break;
+    case SPARSE_WIRE_INT8:
+      _encoded_size = exact_size + sizeof(float) + _embedx_dim;
+      break;
+    default:
+      LOG_IF(ERROR, _precision != SPARSE_WIRE_FP32)
+          << "unknown sparse_wire_precision " << _precision
+          << ", use SPARSE_WIRE_FP32";
+      _precision = SPARSE_WIRE_FP32;
+      _encoded_size = dim * sizeof(float);
+      break;
+  }
+}
+
+void SparseWireCodec::Encode(const float* value, char* out) const {
+  memcpy(out, value, _exact_dim * sizeof(float));
+  out += _exact_dim * sizeof(float);
+  const float* embedx = value + _exact_dim;
+  switch (_precision) {
+    case SPARSE_WIRE_FP16:
+      for (size_t i = 0; i < _embedx_dim; ++i) {
+        uint16_t half = FloatToHalf(embedx[i]);
+        memcpy(out + i * sizeof(half), &half, sizeof(half));
+      }
+      break;
+    case SPARSE_WIRE_BF16:
+      for (size_t i = 0; i < _embedx_dim; ++i) {
+        uint16_t half = FloatToBFloat16(embedx[i]);
+        memcpy(out + i * sizeof(half), &half, sizeof(half));
+      }
+      break;
+    case SPARSE_WIRE_INT8: {
+      float max_abs = 0;
+      for (size_t i = 0; i < _embedx_dim; ++i) {
+        max_abs = std::max(max_abs, std::fabs(embedx[i]));
+      }
+      float scale = max_abs / 127;
+      memcpy(out, &scale, sizeof(scale));
+      out += sizeof(scale);
+      float inv_scale = scale > 0 ? 1 / scale : 0;
+      for (size_t i = 0; i < _embedx_dim; ++i) {
+        float q = std::nearbyint(embedx[i] * inv_scale);
+        out[i] = static_cast<int8_t>(std::min(127.0f, std::max(-127.0f, q)));
+      }
+      break;
+    }
+    default:
+      memcpy(out, embedx, _embedx_dim * sizeof(float));
+      break;
+  }
+}
+
+void SparseWireCodec::Decode(const char* in, float* value) const {
+  memcpy(value, in, _exact_dim * sizeof(float));
+  in += _exact_dim * sizeof(float);
+  float* embedx = value + _exact_dim;
+  uint16_t half = 0;
+  switch (_precision) {
+    case SPARSE_WIRE_FP16:
+      for (size_t i = 0; i < _embedx_dim; ++i) {
+        memcpy(&half, in + i * sizeof(half), sizeof(half));
+        embedx[i] = HalfToFloat(half);
+      }
+      break;
+    case SPARSE_WIRE_BF16:
+      for (size_t i = 0; i < _embedx_dim; ++i) {
+        memcpy(&half, in + i * sizeof(half), sizeof(half));
+        embedx[i] = BFloat16ToFloat(half);
+      }
+      break;
+    case SPARSE_WIRE_INT8: {
+      float scale = 0;
+      memcpy(&scale, in, sizeof(scale));
+      in += sizeof(scale);
+      for (size_t i = 0; i < _embedx_dim; ++i) {
+        embedx[i] = static_cast<int8_t>(in[i]) * scale;
+      }
+      break;
+    }
+    default:
+      memcpy(embedx, in, _embedx_dim * sizeof(float));
+      break;
+  }
+}
+
+}  // namespace distributed
+}  // namespace paddle
@@ -0,0 +1,58 @@
+// Copyright (c) 2022 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "paddle/fluid/distributed/the_one_ps.pb.h"
+
+namespace paddle {
+namespace distributed {
+
+// Encodes the pull and push values of a sparse table for the wire with the
+// sparse_wire_precision of the table. A value of dim floats ends with
+// embedx_dim embedx floats, as the values of all the sparse accessors do.
+// The floats before them (show, click, slot, embed) stay exact, the embedx
+// ones go as fp16 or bf16, or as int8 with a float scale per value.
+// Conversions round to nearest even, fp16 saturates at its max finite value.
+class SparseWireCodec {
+ public:
+  SparseWireCodec(SparseWirePrecision precision,
+                  size_t dim,
+                  size_t embedx_dim);
+
+  SparseWirePrecision precision() const { return _precision; }
+  // bytes of an encoded value
+  size_t EncodedSize() const { return _encoded_size; }
+  bool IsExact() const { return _precision == SPARSE_WIRE_FP32; }
+
+  void Encode(const float* value, char* out) const;
+  void Decode(const char* in, float* value) const;
+
+ private:
+  SparseWirePrecision _precision;
+  size_t _exact_dim;
+  size_t _embedx_dim;
+  size_t _encoded_size;
+};
+
+uint16_t FloatToHalf(float value);
+float HalfToFloat(uint16_t value);
+uint16_t FloatToBFloat16(float value);
+float BFloat16ToFloat(uint16_t value);
+
+}  // namespace distributed
+}  // namespace paddle
@@ -90,6 +90,8 @@ class ValueAccessor {
   virtual int Initialize() = 0;
 
   virtual AccessorInfo GetAccessorInfo() { return _accessor_info; }
+  // embedx floats at the end of a pull and a push value of a sparse table
+  virtual size_t GetEmbedxDim() { return _config.embedx_dim(); }
 
   virtual bool NeedExtendMF(float* value) { return false; }
   virtual bool HasMF(size_t size) { return false; }
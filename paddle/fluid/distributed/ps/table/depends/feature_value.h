@@ -15,10 +15,16 @@
 #pragma once
 
 #include <mct/hash-map.hpp>
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <memory>
 #include <vector>
 
 #include "gflags/gflags.h"
+#include "glog/logging.h"
 #include "paddle/fluid/distributed/common/chunk_allocator.h"
+#include "paddle/fluid/distributed/common/swiss_hash_map.h"
 
 namespace paddle {
 namespace distributed {
@@ -27,24 +33,335 @@ static const int CTR_SPARSE_SHARD_BUCKET_NUM_BITS = 6;
 static const size_t CTR_SPARSE_SHARD_BUCKET_NUM =
     static_cast<size_t>(1) << CTR_SPARSE_SHARD_BUCKET_NUM_BITS;
 
+// The hash of the sparse table shards. std::hash of an integer is the integer
+// itself, while the bucket of a key comes from the high bits of its hash and
+// feasigns often keep the slot in their high bits, so the hash is mixed with
+// the finalizer of MurmurHash3 first.
+template <class KEY>
+struct SparseShardHash {
+  size_t operator()(const KEY& key) const {
+    uint64_t h = std::hash<KEY>()(key);
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+  }
+};
+
+// A handle of FeatureValueSlabs has the value class in its high bits and the
+// index of the record in its class in the low bits.
+static const int FEATURE_VALUE_CLASS_BITS = 4;
+static const int FEATURE_VALUE_INDEX_BITS = 32 - FEATURE_VALUE_CLASS_BITS;
+static const uint32_t FEATURE_VALUE_INDEX_MASK =
+    (static_cast<uint32_t>(1) << FEATURE_VALUE_INDEX_BITS) - 1;
+// the last class keeps FixedFeatureValue objects, see FeatureValueSlabs::pin
+static const uint32_t FEATURE_VALUE_HEAP_CLASS =
+    (static_cast<uint32_t>(1) << FEATURE_VALUE_CLASS_BITS) - 1;
+static const uint32_t FEATURE_VALUE_EMPTY_HANDLE = 0xFFFFFFFF;
+static const int FEATURE_VALUE_SLAB_CHUNK_BITS = 12;
+
 class FixedFeatureValue {
  public:
   FixedFeatureValue() {}
   ~FixedFeatureValue() {}
-  float* data() { return _data.data(); }
-  size_t size() { return _data.size(); }
-  void resize(size_t size) { _data.resize(size); }
+  float* data() { return _borrowed != nullptr ? _borrowed : _data.data(); }
+  size_t size() {
+    return _borrowed != nullptr ? _borrowed_size : _data.size();
+  }
+  void resize(size_t size) {
+    if (_borrowed != nullptr) {
+      if (size == _borrowed_size) {
+        return;
+      }
+      _data.assign(_borrowed, _borrowed + std::min(size, _borrowed_size));
+      _borrowed = nullptr;
+    }
+    _data.resize(size);
+  }
   void shrink_to_fit() { _data.shrink_to_fit(); }
+  // The value is the size floats at data, kept by someone else (a record of
+  // FeatureValueSlabs), until a resize to another size copies them.
+  void borrow(float* data, size_t size) {
+    std::vector<float>().swap(_data);
+    _borrowed = data;
+    _borrowed_size = size;
+  }
+  bool borrowed() const { return _borrowed != nullptr; }
 
  private:
   std::vector<float> _data;
+  float* _borrowed = nullptr;
+  size_t _borrowed_size = 0;
+};
+
+// FeatureValueSlabs keeps the float values of a shard in slabs, one slab per
+// value size (e.g. the size of a value without and with mf), each holding
+// records of that many floats back to back in chunks of
+// 1 << FEATURE_VALUE_SLAB_CHUNK_BITS records. A value is addressed by a 32-bit
+// handle, so the map of a shard holds no pointer and no per-value header or
+// heap block.
+// Records move between slabs when they are resized, data() of a handle is
+// only valid until the next resize of it. Values whose pointer is handed out,
+// as to PS-GPU by PullSparsePtr, are pinned as a FixedFeatureValue instead,
+// which borrows the record until it is resized.
+// Not thread safe, as the shard it belongs to.
+class FeatureValueSlabs {
+ public:
+  FeatureValueSlabs() {}
+  FeatureValueSlabs(const FeatureValueSlabs&) = delete;
+  ~FeatureValueSlabs() { clear(); }
+
+  float* data(uint32_t handle) {
+    uint32_t cls = handle >> FEATURE_VALUE_INDEX_BITS;
+    uint32_t index = handle & FEATURE_VALUE_INDEX_MASK;
+    if (cls != FEATURE_VALUE_HEAP_CLASS) {
+      return _slabs[cls].at(index);
+    }
+    return handle == FEATURE_VALUE_EMPTY_HANDLE ? nullptr
+                                                : _heap_values[index]->data();
+  }
+  size_t size(uint32_t handle) {
+    uint32_t cls = handle >> FEATURE_VALUE_INDEX_BITS;
+    if (cls != FEATURE_VALUE_HEAP_CLASS) {
+      return _slabs[cls].stride;
+    }
+    return handle == FEATURE_VALUE_EMPTY_HANDLE
+               ? 0
+               : _heap_values[handle & FEATURE_VALUE_INDEX_MASK]->size();
+  }
+
+  // Adds a slab for values of size floats, if there is none yet. Slabs are
+  // also added on the first resize to a size.
+  void add_class(size_t size) { find_class(size); }
+
+  // Moves the value to the slab of its new size. As with std::vector::resize
+  // the first floats are kept and the new ones are zero.
+  void resize(uint32_t* handle, size_t size) {
+    uint32_t cls = *handle >> FEATURE_VALUE_INDEX_BITS;
+    if (*handle != FEATURE_VALUE_EMPTY_HANDLE &&
+        cls == FEATURE_VALUE_HEAP_CLASS) {
+      uint32_t index = *handle & FEATURE_VALUE_INDEX_MASK;
+      _heap_values[index]->resize(size);
+      release_stale_record(index);
+      return;
+    }
+    size_t old_size = this->size(*handle);
+    if (old_size == size) {
+      return;
+    }
+    uint32_t new_handle = FEATURE_VALUE_EMPTY_HANDLE;
+    float* new_data = nullptr;
+    if (size > 0) {
+      uint32_t new_cls = find_class(size);
+      if (new_cls == FEATURE_VALUE_HEAP_CLASS) {
+        new_handle = acquire_heap_value();
+        _heap_values[new_handle & FEATURE_VALUE_INDEX_MASK]->resize(size);
+      } else {
+        new_handle = (new_cls << FEATURE_VALUE_INDEX_BITS) |
+                     _slabs[new_cls].acquire();
+      }
+      new_data = data(new_handle);
+      size_t keep = std::min(old_size, size);
+      if (keep > 0) {
+        memcpy(new_data, data(*handle), keep * sizeof(float));
+      }
+      memset(new_data + keep, 0, (size - keep) * sizeof(float));
+    }
+    release(*handle);
+    *handle = new_handle;
+  }
+
+  // Gives the value a FixedFeatureValue that stays at its address until the
+  // value is released, resizes included. The FixedFeatureValue borrows the
+  // record of the value, which is kept out of the free records, so a pin
+  // costs the FixedFeatureValue and no copy of the floats until the value
+  // is resized to another size.
+  FixedFeatureValue* pin(uint32_t* handle) {
+    uint32_t cls = *handle >> FEATURE_VALUE_INDEX_BITS;
+    if (*handle == FEATURE_VALUE_EMPTY_HANDLE) {
+      *handle = acquire_heap_value();
+    } else if (cls != FEATURE_VALUE_HEAP_CLASS) {
+      uint32_t new_handle = acquire_heap_value();
+      uint32_t index = new_handle & FEATURE_VALUE_INDEX_MASK;
+      _heap_values[index]->borrow(data(*handle), size(*handle));
+      _heap_records[index] = *handle;
+      *handle = new_handle;
+    }
+    return _heap_values[*handle & FEATURE_VALUE_INDEX_MASK];
+  }
+
+  // Gives a pinned value back to the slab of its size, the pointer pin gave
+  // is invalid after it. A value still on its record gets the record back
+  // without a copy. A value stays in the heap class if all the classes are
+  // taken by other sizes.
+  void unpin(uint32_t* handle) {
+    uint32_t cls = *handle >> FEATURE_VALUE_INDEX_BITS;
+    if (*handle == FEATURE_VALUE_EMPTY_HANDLE ||
+        cls != FEATURE_VALUE_HEAP_CLASS) {
+      return;
+    }
+    uint32_t index = *handle & FEATURE_VALUE_INDEX_MASK;
+    FixedFeatureValue* value = _heap_values[index];
+    if (value->borrowed()) {
+      uint32_t record = _heap_records[index];
+      _heap_records[index] = FEATURE_VALUE_EMPTY_HANDLE;
+      release(*handle);
+      *handle = record;
+      return;
+    }
+    // resized through the pointer of pin
+    release_stale_record(index);
+    uint32_t new_cls = find_class(value->size());
+    if (new_cls == FEATURE_VALUE_HEAP_CLASS) {
+      return;
+    }
+    uint32_t new_handle =
+        (new_cls << FEATURE_VALUE_INDEX_BITS) | _slabs[new_cls].acquire();
+    memcpy(data(new_handle), value->data(), value->size() * sizeof(float));
+    release(*handle);
+    *handle = new_handle;
+  }
+
+  // values in the heap class, pinned or not
+  size_t heap_value_num() {
+    return _heap_values.size() - _free_heap_values.size();
+  }
+
+  void release(uint32_t handle) {
+    if (handle == FEATURE_VALUE_EMPTY_HANDLE) {
+      return;
+    }
+    uint32_t cls = handle >> FEATURE_VALUE_INDEX_BITS;
+    uint32_t index = handle & FEATURE_VALUE_INDEX_MASK;
+    if (cls != FEATURE_VALUE_HEAP_CLASS) {
+      _slabs[cls].free_records.push_back(index);
+      return;
+    }
+    if (_heap_records[index] != FEATURE_VALUE_EMPTY_HANDLE) {
+      release(_heap_records[index]);
+      _heap_records[index] = FEATURE_VALUE_EMPTY_HANDLE;
+    }
+    _heap_alloc.release(_heap_values[index]);
+    _heap_values[index] = nullptr;
+    _free_heap_values.push_back(index);
+  }
+
+  void clear() {
+    for (auto* value : _heap_values) {
+      if (value != nullptr) {
+        _heap_alloc.release(value);
+      }
+    }
+    _heap_values.clear();
+    _heap_records.clear();
+    _free_heap_values.clear();
+    for (auto& slab : _slabs) {
+      slab.chunks.clear();
+      slab.free_records.clear();
+      slab.record_num = 0;
+    }
+  }
+
+ private:
+  struct Slab {
+    size_t stride;
+    std::vector<std::unique_ptr<float[]>> chunks;
+    uint32_t record_num = 0;
+    std::vector<uint32_t> free_records;
+
+    float* at(uint32_t index) {
+      return chunks[index >> FEATURE_VALUE_SLAB_CHUNK_BITS].get() +
+             (index & ((1 << FEATURE_VALUE_SLAB_CHUNK_BITS) - 1)) * stride;
+    }
+    uint32_t acquire() {
+      if (!free_records.empty()) {
+        uint32_t index = free_records.back();
+        free_records.pop_back();
+        return index;
+      }
+      CHECK(record_num < FEATURE_VALUE_INDEX_MASK)
+          << "too many values of size " << stride << " in a shard";
+      if ((record_num & ((1 << FEATURE_VALUE_SLAB_CHUNK_BITS) - 1)) == 0) {
+        chunks.emplace_back(
+            new float[stride << FEATURE_VALUE_SLAB_CHUNK_BITS]);
+      }
+      return record_num++;
+    }
+  };
+
+  // returns FEATURE_VALUE_HEAP_CLASS when all the classes are taken
+  uint32_t find_class(size_t size) {
+    for (size_t i = 0; i < _slabs.size(); ++i) {
+      if (_slabs[i].stride == size) {
+        return i;
+      }
+    }
+    if (_slabs.size() == FEATURE_VALUE_HEAP_CLASS) {
+      return FEATURE_VALUE_HEAP_CLASS;
+    }
+    _slabs.emplace_back();
+    _slabs.back().stride = size;
+    return _slabs.size() - 1;
+  }
+
+  uint32_t acquire_heap_value() {
+    uint32_t index;
+    if (!_free_heap_values.empty()) {
+      index = _free_heap_values.back();
+      _free_heap_values.pop_back();
+    } else {
+      CHECK(_heap_values.size() < FEATURE_VALUE_INDEX_MASK)
+          << "too many pinned values in a shard";
+      index = _heap_values.size();
+      _heap_values.push_back(nullptr);
+      _heap_records.push_back(FEATURE_VALUE_EMPTY_HANDLE);
+    }
+    _heap_values[index] = _heap_alloc.acquire();
+    return (FEATURE_VALUE_HEAP_CLASS << FEATURE_VALUE_INDEX_BITS) | index;
+  }
+
+  // frees the record a heap value borrowed once the value was resized off it
+  void release_stale_record(uint32_t index) {
+    if (_heap_records[index] != FEATURE_VALUE_EMPTY_HANDLE &&
+        !_heap_values[index]->borrowed()) {
+      release(_heap_records[index]);
+      _heap_records[index] = FEATURE_VALUE_EMPTY_HANDLE;
+    }
+  }
+
+  std::vector<Slab> _slabs;
+  std::vector<FixedFeatureValue*> _heap_values;
+  // the record each heap value borrows, see pin
+  std::vector<uint32_t> _heap_records;
+  std::vector<uint32_t> _free_heap_values;
+  ChunkAllocator<FixedFeatureValue> _heap_alloc;
+};
+
+// A value of FeatureValueSlabs with the interface of FixedFeatureValue. It
+// refers to the handle in the map, so it is valid until the next insert into
+// or erase from the shard.
+class FeatureValueRef {
+ public:
+  FeatureValueRef(FeatureValueSlabs* slabs, uint32_t* handle)
+      : _slabs(slabs), _handle(handle) {}
+  float* data() const { return _slabs->data(*_handle); }
+  size_t size() const { return _slabs->size(*_handle); }
+  void resize(size_t size) const { _slabs->resize(_handle, size); }
+  void shrink_to_fit() const {}
+
+ private:
+  FeatureValueSlabs* _slabs;
+  uint32_t* _handle;
 };
 
 template <class KEY, class VALUE>
 struct alignas(64) SparseTableShard {
  public:
-  typedef typename mct::closed_hash_map<KEY, mct::Pointer, std::hash<KEY>>
-      map_type;
+  typedef
+      typename mct::closed_hash_map<KEY, mct::Pointer, SparseShardHash<KEY>>
+          map_type;
   struct iterator {
     typename map_type::iterator it;
     size_t bucket;
@@ -195,7 +512,241 @@ struct alignas(64) SparseTableShard {
  private:
   map_type _buckets[CTR_SPARSE_SHARD_BUCKET_NUM];
   ChunkAllocator<VALUE> _alloc;
-  std::hash<KEY> _hasher;
+  SparseShardHash<KEY> _hasher;
+};
+
+// The map value of SlabSparseTableShard, the handle of the value in
+// FeatureValueSlabs and the epoch the key was last touched in. With 64-bit
+// keys it takes the padding of the map pair.
+struct SlabEntry {
+  uint32_t handle;
+  uint32_t epoch;
+};
+
+// SlabSparseTableShard is a SparseTableShard of float values kept in
+// FeatureValueSlabs, the map holds the 32-bit handle of each value. value()
+// and operator[] return a FeatureValueRef instead of a reference.
+// MAP is mct::closed_hash_map or SwissHashMap, hashing with SparseShardHash.
+// The shard also keeps the keys touched since the last next_epoch, so that
+// a delta save does not scan all of them.
+template <class KEY,
+          class MAP =
+              mct::closed_hash_map<KEY, SlabEntry, SparseShardHash<KEY>>>
+struct alignas(64) SlabSparseTableShard {
+ public:
+  typedef MAP map_type;
+  struct iterator {
+    typename map_type::iterator it;
+    size_t bucket;
+    map_type* buckets;
+    FeatureValueSlabs* values;
+    friend bool operator==(const iterator& a, const iterator& b) {
+      return a.it == b.it;
+    }
+    friend bool operator!=(const iterator& a, const iterator& b) {
+      return a.it != b.it;
+    }
+    const KEY& key() const { return it->first; }
+    FeatureValueRef value() const { return {values, &it->second.handle}; }
+    iterator& operator++() {
+      ++it;
+
+      while (it == buckets[bucket].end() &&
+             bucket + 1 < CTR_SPARSE_SHARD_BUCKET_NUM) {
+        it = buckets[++bucket].begin();
+      }
+
+      return *this;
+    }
+    iterator operator++(int) {
+      iterator ret = *this;
+      ++*this;
+      return ret;
+    }
+  };
+  struct local_iterator {
+    typename map_type::iterator it;
+    FeatureValueSlabs* values;
+    friend bool operator==(const local_iterator& a, const local_iterator& b) {
+      return a.it == b.it;
+    }
+    friend bool operator!=(const local_iterator& a, const local_iterator& b) {
+      return a.it != b.it;
+    }
+    const KEY& key() const { return it->first; }
+    FeatureValueRef value() const { return {values, &it->second.handle}; }
+    local_iterator& operator++() {
+      ++it;
+      return *this;
+    }
+    local_iterator operator++(int) { return {it++, values}; }
+  };
+
+  ~SlabSparseTableShard() { clear(); }
+  bool empty() { return size() == 0; }
+  size_t size() {
+    size_t num = 0;
+    for (size_t bucket = 0; bucket < CTR_SPARSE_SHARD_BUCKET_NUM; bucket++) {
+      num += _buckets[bucket].size();
+    }
+    return num;
+  }
+  void set_max_load_factor(float x) {
+    for (size_t bucket = 0; bucket < CTR_SPARSE_SHARD_BUCKET_NUM; bucket++) {
+      _buckets[bucket].max_load_factor(x);
+    }
+  }
+  // see FeatureValueSlabs::add_class
+  void add_value_class(size_t size) { _values.add_class(size); }
+  size_t bucket_count() { return CTR_SPARSE_SHARD_BUCKET_NUM; }
+  size_t bucket_size(size_t bucket) { return _buckets[bucket].size(); }
+  void clear() {
+    for (size_t bucket = 0; bucket < CTR_SPARSE_SHARD_BUCKET_NUM; bucket++) {
+      _buckets[bucket].clear();
+    }
+    _values.clear();
+    _changed_keys.clear();
+    _pinned_keys.clear();
+  }
+  iterator begin() {
+    auto it = _buckets[0].begin();
+    size_t bucket = 0;
+    while (it == _buckets[bucket].end() &&
+           bucket + 1 < CTR_SPARSE_SHARD_BUCKET_NUM) {
+      it = _buckets[++bucket].begin();
+    }
+    return {it, bucket, _buckets, &_values};
+  }
+  iterator end() {
+    return {_buckets[CTR_SPARSE_SHARD_BUCKET_NUM - 1].end(),
+            CTR_SPARSE_SHARD_BUCKET_NUM - 1,
+            _buckets,
+            &_values};
+  }
+  local_iterator begin(size_t bucket) {
+    return {_buckets[bucket].begin(), &_values};
+  }
+  local_iterator end(size_t bucket) {
+    return {_buckets[bucket].end(), &_values};
+  }
+  iterator find(const KEY& key) {
+    size_t hash = _hasher(key);
+    size_t bucket = compute_bucket(hash);
+    auto it = _buckets[bucket].find_with_hash(key, hash);
+    if (it == _buckets[bucket].end()) {
+      return end();
+    }
+    return {it, bucket, _buckets, &_values};
+  }
+  FeatureValueRef operator[](const KEY& key) {
+    return emplace(key).first.value();
+  }
+  // a new key has an empty value
+  std::pair<iterator, bool> emplace(const KEY& key) {
+    size_t hash = _hasher(key);
+    size_t bucket = compute_bucket(hash);
+    auto res = _buckets[bucket].insert_with_hash(
+        {key, SlabEntry{FEATURE_VALUE_EMPTY_HANDLE, 0}}, hash);
+    return {{res.first, bucket, _buckets, &_values}, res.second};
+  }
+  // see FeatureValueSlabs::pin
+  FixedFeatureValue* pin(iterator it) {
+    uint32_t handle = it.it->second.handle;
+    FixedFeatureValue* value = _values.pin(&it.it->second.handle);
+    if (it.it->second.handle != handle) {
+      _pinned_keys.push_back(it.it->first);
+    }
+    return value;
+  }
+  // moves the values pinned since the last unpin_all back to the slabs, once
+  // the pointers of pin are no longer used. Keys erased since are skipped.
+  void unpin_all() {
+    for (const KEY& key : _pinned_keys) {
+      auto it = find(key);
+      if (it != end()) {
+        _values.unpin(&it.it->second.handle);
+      }
+    }
+    _pinned_keys.clear();
+    _pinned_keys.shrink_to_fit();
+  }
+  // see FeatureValueSlabs::heap_value_num
+  size_t heap_value_num() { return _values.heap_value_num(); }
+  // marks the key of it as changed in the current epoch
+  void touch(iterator it) {
+    if (it.it->second.epoch != _epoch) {
+      it.it->second.epoch = _epoch;
+      _changed_keys.push_back(it.it->first);
+    }
+  }
+  // the keys touched in the current epoch in ascending order, including the
+  // ones erased since. Valid until the next touch.
+  const std::vector<KEY>& changed_keys() {
+    if (_changed_keys_sorted < _changed_keys.size()) {
+      std::sort(_changed_keys.begin(), _changed_keys.end());
+      // a key erased and touched again is in twice
+      _changed_keys.erase(
+          std::unique(_changed_keys.begin(), _changed_keys.end()),
+          _changed_keys.end());
+      _changed_keys_sorted = _changed_keys.size();
+    }
+    return _changed_keys;
+  }
+  // starts a new epoch with no key changed
+  void next_epoch() {
+    _changed_keys.clear();
+    _changed_keys_sorted = 0;
+    // 0 is the epoch of keys never touched
+    if (++_epoch == 0) {
+      _epoch = 1;
+    }
+  }
+  iterator erase(iterator it) {
+    _values.release(it.it->second.handle);
+    size_t bucket = it.bucket;
+    auto it2 = _buckets[bucket].erase(it.it);
+    while (it2 == _buckets[bucket].end() &&
+           bucket + 1 < CTR_SPARSE_SHARD_BUCKET_NUM) {
+      it2 = _buckets[++bucket].begin();
+    }
+    return {it2, bucket, _buckets, &_values};
+  }
+  void quick_erase(iterator it) {
+    _values.release(it.it->second.handle);
+    _buckets[it.bucket].quick_erase(it.it);
+  }
+  local_iterator erase(size_t bucket, local_iterator it) {
+    _values.release(it.it->second.handle);
+    return {_buckets[bucket].erase(it.it), &_values};
+  }
+  void quick_erase(size_t bucket, local_iterator it) {
+    _values.release(it.it->second.handle);
+    _buckets[bucket].quick_erase(it.it);
+  }
+  size_t erase(const KEY& key) {
+    auto it = find(key);
+    if (it == end()) {
+      return 0;
+    }
+    quick_erase(it);
+    return 1;
+  }
+  size_t compute_bucket(size_t hash) {
+    if (CTR_SPARSE_SHARD_BUCKET_NUM == 1) {
+      return 0;
+    } else {
+      return hash >> (sizeof(size_t) * 8 - CTR_SPARSE_SHARD_BUCKET_NUM_BITS);
+    }
+  }
+
+ private:
+  map_type _buckets[CTR_SPARSE_SHARD_BUCKET_NUM];
+  FeatureValueSlabs _values;
+  SparseShardHash<KEY> _hasher;
+  uint32_t _epoch = 1;
+  std::vector<KEY> _changed_keys;
+  size_t _changed_keys_sorted = 0;
+  std::vector<KEY> _pinned_keys;
 };
 
 }  // namespace distributed
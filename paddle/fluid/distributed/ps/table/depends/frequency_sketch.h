@@ -0,0 +1,106 @@
+// Copyright (c) 2022 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace paddle {
+namespace distributed {
+
+// the counters of a FrequencySketch stop at 15
+static const uint32_t kSketchMaxFrequency = 15;
+
+// Access frequency of keys for the TinyLFU cache policy, a count-min sketch
+// of 4 rows of 4 bit counters. After 10 accesses per key of the cache all the
+// counters are halved, so that the frequencies follow the recent accesses.
+// Not thread safe, a sketch belongs to one shard.
+class FrequencySketch {
+ public:
+  explicit FrequencySketch(size_t capacity = 0) { Resize(capacity); }
+
+  // sizes the sketch for a cache of capacity keys, 8 bytes a key, and clears
+  // the counts
+  void Resize(size_t capacity) {
+    size_t width = 64;
+    while (width < 4 * capacity) {
+      width <<= 1;
+    }
+    // 16 counters per word
+    _words.assign(width / 16 * kRows, 0);
+    _row_words = width / 16;
+    _width_mask = width - 1;
+    _additions = 0;
+    _sample_size = std::max<size_t>(10 * capacity, width);
+  }
+
+  void Increment(uint64_t key) {
+    bool added = false;
+    for (size_t row = 0; row < kRows; ++row) {
+      size_t counter = Counter(key, row);
+      uint64_t& word = _words[row * _row_words + counter / 16];
+      int shift = (counter % 16) * 4;
+      if (((word >> shift) & 0xf) < kSketchMaxFrequency) {
+        word += 1ull << shift;
+        added = true;
+      }
+    }
+    if (added && ++_additions >= _sample_size) {
+      Age();
+    }
+  }
+
+  uint32_t Estimate(uint64_t key) const {
+    uint32_t frequency = kSketchMaxFrequency;
+    for (size_t row = 0; row < kRows; ++row) {
+      size_t counter = Counter(key, row);
+      uint64_t word = _words[row * _row_words + counter / 16];
+      frequency = std::min<uint32_t>(frequency,
+                                     (word >> ((counter % 16) * 4)) & 0xf);
+    }
+    return frequency;
+  }
+
+  // halves all the counters
+  void Age() {
+    for (auto& word : _words) {
+      word = (word >> 1) & 0x7777777777777777ull;
+    }
+    _additions /= 2;
+  }
+
+ private:
+  static const size_t kRows = 4;
+
+  size_t Counter(uint64_t key, size_t row) const {
+    // a mix of splitmix64 with a seed per row, feasigns are often sequential
+    uint64_t h = key + 0x9e3779b97f4a7c15ull * (row + 1);
+    h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ull;
+    h = (h ^ (h >> 27)) * 0x94d049bb133111ebull;
+    h ^= h >> 31;
+    return h & _width_mask;
+  }
+
+  std::vector<uint64_t> _words;
+  size_t _row_words;
+  size_t _width_mask;
+  size_t _additions;
+  size_t _sample_size;
+};
+
+}  // namespace distributed
+}  // namespace paddle
@@ -17,12 +17,20 @@
 #include <rocksdb/db.h>
 #include <rocksdb/filter_policy.h>
 #include <rocksdb/options.h>
+#include <rocksdb/rate_limiter.h>
 #include <rocksdb/slice.h>
+#include <rocksdb/sst_file_writer.h>
 #include <rocksdb/table.h>
 #include <rocksdb/write_batch.h>
 
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
 #include <iostream>
 #include <string>
+#include <vector>
+
+#include "paddle/fluid/distributed/the_one_ps.pb.h"
 
 namespace paddle {
 namespace distributed {
@@ -30,63 +38,94 @@ namespace distributed {
 class RocksDBHandler {
  public:
   RocksDBHandler() {}
-  ~RocksDBHandler() {}
+  ~RocksDBHandler() { close(); }
 
   static RocksDBHandler* GetInstance() {
     static RocksDBHandler handler;
     return &handler;
   }
 
-  int initialize(const std::string& db_path, const int colnum) {
-    VLOG(3) << "db path: " << db_path << " colnum: " << colnum;
-    rocksdb::Options options;
-    rocksdb::BlockBasedTableOptions bbto;
-    bbto.block_size = 4 * 1024;
-    bbto.block_cache = rocksdb::NewLRUCache(64 * 1024 * 1024);
-    bbto.block_cache_compressed = rocksdb::NewLRUCache(64 * 1024 * 1024);
-    bbto.cache_index_and_filter_blocks = false;
-    bbto.filter_policy.reset(rocksdb::NewBloomFilterPolicy(20, false));
-    bbto.whole_key_filtering = true;
-    options.table_factory.reset(rocksdb::NewBlockBasedTableFactory(bbto));
+  // layout tells how the keys are spread over the colnum column families, a
+  // db left by the last run is reopened only if it was written with the same
+  // layout, otherwise it is cleared
+  int initialize(const std::string& db_path,
+                 const int colnum,
+                 const RocksDBParameter& param = RocksDBParameter(),
+                 const std::string& layout = "") {
+    VLOG(3) << "db path: " << db_path << " colnum: " << colnum
+            << " layout: " << layout;
+    close();
+    _db_path = db_path;
+    _options = BuildOptions(param);
+    _reopened = false;
 
-    options.keep_log_file_num = 100;
-    options.max_log_file_size = 50 * 1024 * 1024;  // 50MB
-    options.create_if_missing = true;
-    options.use_direct_reads = true;
-    options.max_background_flushes = 5;
-    options.max_background_compactions = 5;
-    options.base_background_compactions = 10;
-    options.write_buffer_size = 256 * 1024 * 1024;  // 256MB
-    options.max_write_buffer_number = 8;
-    options.max_bytes_for_level_base =
-        options.max_write_buffer_number * options.write_buffer_size;
-    options.min_write_buffer_number_to_merge = 1;
-    options.target_file_size_base = 1024 * 1024 * 1024;  // 1024MB
-    options.memtable_prefix_bloom_size_ratio = 0.02;
-    options.num_levels = 4;
-    options.max_open_files = -1;
-
-    options.compression = rocksdb::kNoCompression;
-    options.level0_file_num_compaction_trigger = 8;
-    options.level0_slowdown_writes_trigger =
-        1.8 * options.level0_file_num_compaction_trigger;
-    options.level0_stop_writes_trigger =
-        3.6 * options.level0_file_num_compaction_trigger;
+    // the column families of the last run, if it left a db to reopen
+    std::vector<std::string> families;
+    bool reopen =
+        param.reopen_existing() && !db_path.empty() &&
+        rocksdb::DB::ListColumnFamilies(_options, db_path, &families).ok();
 
-    if (!db_path.empty()) {
-      std::string rm_cmd = "rm -rf " + db_path;
-      system(rm_cmd.c_str());
+    rocksdb::Status s;
+    _handles.assign(colnum, nullptr);
+    if (reopen) {
+      std::vector<rocksdb::ColumnFamilyDescriptor> descriptors;
+      for (auto& name : families) {
+        descriptors.emplace_back(name, _options);
+      }
+      std::vector<rocksdb::ColumnFamilyHandle*> handles;
+      s = rocksdb::DB::Open(_options, db_path, descriptors, &handles, &_db);
+      std::string last_layout;
+      if (s.ok() &&
+          !_db->Get(rocksdb::ReadOptions(), kLayoutKey, &last_layout).ok()) {
+        last_layout.clear();
+      }
+      if (s.ok() && last_layout != layout) {
+        LOG(ERROR) << "DB layout [" << last_layout << "] of path:" << db_path
+                   << " differs from [" << layout
+                   << "], the db is cleared instead of reopened";
+        for (auto* handle : handles) {
+          _db->DestroyColumnFamilyHandle(handle);
+        }
+        delete _db;
+        _db = nullptr;
+        reopen = false;
+      }
+      for (size_t i = 0; reopen && s.ok() && i < handles.size(); ++i) {
+        for (int j = 0; j < colnum; ++j) {
+          if (families[i] == "shard_" + std::to_string(j)) {
+            _handles[j] = handles[i];
+          }
+        }
+      }
     }
-
-    rocksdb::Status s = rocksdb::DB::Open(options, db_path, &_db);
-    assert(s.ok());
-    _handles.resize(colnum);
+    if (!reopen) {
+      if (!db_path.empty()) {
+        std::string rm_cmd = "rm -rf " + db_path;
+        system(rm_cmd.c_str());
+      }
+      s = rocksdb::DB::Open(_options, db_path, &_db);
+    }
+    if (!s.ok()) {
+      LOG(ERROR) << "DB open failed, path:" << db_path
+                 << " status:" << s.ToString();
+      _db = nullptr;
+      return -1;
+    }
+    int reused = 0;
     for (int i = 0; i < colnum; i++) {
+      if (_handles[i] != nullptr) {
+        ++reused;
+        continue;
+      }
       s = _db->CreateColumnFamily(
-          options, "shard_" + std::to_string(i), &_handles[i]);
+          _options, "shard_" + std::to_string(i), &_handles[i]);
       assert(s.ok());
     }
-    LOG(INFO) << "DB initialize success, colnum:" << colnum;
+    s = _db->Put(rocksdb::WriteOptions(), kLayoutKey, layout);
+    assert(s.ok());
+    _reopened = reused > 0;
+    LOG(INFO) << "DB initialize success, colnum:" << colnum
+              << " reopened shards:" << reused;
     return 0;
   }
 
@@ -131,6 +170,87 @@ class RocksDBHandler {
     return 0;
   }
 
+  // values of keys in one batch of reads, found[i] is 0 for the missed keys
+  int multi_get(int id,
+                const std::vector<rocksdb::Slice>& keys,
+                std::vector<std::string>* values,
+                std::vector<int>* found) {
+    std::vector<rocksdb::ColumnFamilyHandle*> handles(keys.size(),
+                                                      _handles[id]);
+    std::vector<rocksdb::Status> status =
+        _db->MultiGet(rocksdb::ReadOptions(), handles, keys, values);
+    found->resize(keys.size());
+    for (size_t i = 0; i < keys.size(); ++i) {
+      (*found)[i] = status[i].ok();
+      assert(status[i].ok() || status[i].IsNotFound());
+    }
+    return 0;
+  }
+
+  // writes the pairs to an sst file and ingests it into the column family of
+  // id, so bulk loads skip the memtables and the compactions of L0. The last
+  // value of a key repeated in the batch wins, as with put_batch.
+  int ingest_batch(int id,
+                   std::vector<std::pair<char*, int>>& ssd_keys,
+                   std::vector<std::pair<char*, int>>& ssd_values,
+                   int n) {
+    if (n == 0) {
+      return 0;
+    }
+    std::vector<int> order(n);
+    for (int i = 0; i < n; ++i) {
+      order[i] = i;
+    }
+    auto key_of = [&ssd_keys](int i) {
+      return rocksdb::Slice(ssd_keys[i].first, ssd_keys[i].second);
+    };
+    std::stable_sort(order.begin(), order.end(), [&key_of](int a, int b) {
+      return key_of(a).compare(key_of(b)) < 0;
+    });
+
+    std::string file = _db_path + "/ingest_" + std::to_string(id) + "_" +
+                       std::to_string(_ingest_seq++) + ".sst";
+    rocksdb::SstFileWriter writer(
+        rocksdb::EnvOptions(), _options, _handles[id]);
+    rocksdb::Status s = writer.Open(file);
+    for (int i = 0; s.ok() && i < n; ++i) {
+      if (i + 1 < n && key_of(order[i]) == key_of(order[i + 1])) {
+        continue;
+      }
+      s = writer.Put(key_of(order[i]),
+                     rocksdb::Slice(ssd_values[order[i]].first,
+                                    ssd_values[order[i]].second));
+    }
+    if (s.ok()) {
+      s = writer.Finish();
+    }
+    if (s.ok()) {
+      rocksdb::IngestExternalFileOptions ingest_options;
+      ingest_options.move_files = true;
+      s = _db->IngestExternalFile(_handles[id], {file}, ingest_options);
+    }
+    if (!s.ok()) {
+      LOG(ERROR) << "DB ingest failed, file:" << file
+                 << " status:" << s.ToString();
+      std::remove(file.c_str());
+      return -1;
+    }
+    return 0;
+  }
+
+  int del_batch(int id, std::vector<std::pair<char*, int>>& ssd_keys, int n) {
+    rocksdb::WriteOptions options;
+    options.disableWAL = true;
+    rocksdb::WriteBatch batch(n * 32);
+    for (int i = 0; i < n; i++) {
+      batch.Delete(_handles[id],
+                   rocksdb::Slice(ssd_keys[i].first, ssd_keys[i].second));
+    }
+    rocksdb::Status s = _db->Write(options, &batch);
+    assert(s.ok());
+    return 0;
+  }
+
   int del_data(int id, const char* key, int key_len) {
     rocksdb::WriteOptions options;
     options.disableWAL = true;
@@ -146,6 +266,36 @@ class RocksDBHandler {
     return 0;
   }
 
+  int compact(int id) {
+    rocksdb::Status s = _db->CompactRange(
+        rocksdb::CompactRangeOptions(), _handles[id], nullptr, nullptr);
+    assert(s.ok());
+    return 0;
+  }
+
+  // drops the values of the column family of id and creates it again empty
+  int clear(int id) {
+    std::string name = "shard_" + std::to_string(id);
+    rocksdb::Status s = _db->DropColumnFamily(_handles[id]);
+    if (s.ok()) {
+      s = _db->DestroyColumnFamilyHandle(_handles[id]);
+      _handles[id] = nullptr;
+    }
+    if (s.ok()) {
+      s = _db->CreateColumnFamily(_options, name, &_handles[id]);
+    }
+    if (!s.ok()) {
+      LOG(ERROR) << "DB clear failed, column family:" << name
+                 << " status:" << s.ToString();
+      return -1;
+    }
+    return 0;
+  }
+
+  // whether the last initialize reopened the column families of a db left by
+  // the last run
+  bool reopened() const { return _reopened; }
+
   rocksdb::Iterator* get_iterator(int id) {
     return _db->NewIterator(rocksdb::ReadOptions(), _handles[id]);
   }
@@ -156,8 +306,96 @@ class RocksDBHandler {
   }
 
  private:
+  static rocksdb::CompressionType ToCompressionType(
+      RocksDBCompression compression) {
+    switch (compression) {
+      case ROCKSDB_SNAPPY:
+        return rocksdb::kSnappyCompression;
+      case ROCKSDB_LZ4:
+        return rocksdb::kLZ4Compression;
+      case ROCKSDB_ZSTD:
+        return rocksdb::kZSTD;
+      default:
+        return rocksdb::kNoCompression;
+    }
+  }
+
+  // closes the db of the last initialize, if any
+  void close() {
+    if (_db == nullptr) {
+      return;
+    }
+    for (auto* handle : _handles) {
+      if (handle != nullptr) {
+        _db->DestroyColumnFamilyHandle(handle);
+      }
+    }
+    _handles.clear();
+    delete _db;
+    _db = nullptr;
+  }
+
+  static rocksdb::Options BuildOptions(const RocksDBParameter& param) {
+    const size_t mb = 1024 * 1024;
+    rocksdb::Options options;
+    rocksdb::BlockBasedTableOptions bbto;
+    bbto.block_size = 4 * 1024;
+    bbto.block_cache = rocksdb::NewLRUCache(param.block_cache_mb() * mb);
+    bbto.block_cache_compressed =
+        rocksdb::NewLRUCache(param.compressed_block_cache_mb() * mb);
+    bbto.cache_index_and_filter_blocks = false;
+    bbto.filter_policy.reset(
+        rocksdb::NewBloomFilterPolicy(param.bloom_bits_per_key(), false));
+    bbto.whole_key_filtering = true;
+    options.table_factory.reset(rocksdb::NewBlockBasedTableFactory(bbto));
+
+    options.keep_log_file_num = 100;
+    options.max_log_file_size = 50 * 1024 * 1024;  // 50MB
+    options.create_if_missing = true;
+    options.use_direct_reads = true;
+    options.max_background_flushes = 5;
+    options.max_background_compactions = 5;
+    options.base_background_compactions = 10;
+    options.write_buffer_size = param.write_buffer_mb() * mb;
+    options.max_write_buffer_number = param.max_write_buffer_number();
+    options.max_bytes_for_level_base =
+        options.max_write_buffer_number * options.write_buffer_size;
+    options.min_write_buffer_number_to_merge = 1;
+    options.target_file_size_base = 1024 * 1024 * 1024;  // 1024MB
+    options.memtable_prefix_bloom_size_ratio = 0.02;
+    options.num_levels = param.num_levels();
+    options.max_open_files = -1;
+
+    options.compression = rocksdb::kNoCompression;
+    if (param.compression_per_level_size() > 0) {
+      options.compression_per_level.resize(options.num_levels);
+      for (int i = 0; i < options.num_levels; ++i) {
+        int level = std::min(i, param.compression_per_level_size() - 1);
+        options.compression_per_level[i] =
+            ToCompressionType(param.compression_per_level(level));
+      }
+    }
+    if (param.rate_limit_mb_per_sec() > 0) {
+      options.rate_limiter.reset(
+          rocksdb::NewGenericRateLimiter(param.rate_limit_mb_per_sec() * mb));
+    }
+    options.level0_file_num_compaction_trigger = 8;
+    options.level0_slowdown_writes_trigger =
+        1.8 * options.level0_file_num_compaction_trigger;
+    options.level0_stop_writes_trigger =
+        3.6 * options.level0_file_num_compaction_trigger;
+    return options;
+  }
+
+  // key in the default column family of the layout the db was written with
+  static constexpr const char* kLayoutKey = "shard_layout";
+
   std::vector<rocksdb::ColumnFamilyHandle*> _handles;
-  rocksdb::DB* _db;
+  rocksdb::DB* _db = nullptr;
+  rocksdb::Options _options;
+  std::string _db_path;
+  std::atomic<uint64_t> _ingest_seq{0};
+  bool _reopened = false;
 };
 }  // namespace distributed
 }  // namespace paddle
@@ -13,6 +13,7 @@
 // limitations under the License.
 
 #include <omp.h>
+#include <chrono>  // NOLINT
 #include <sstream>
 
 #include "glog/logging.h"
@@ -36,10 +37,16 @@ DEFINE_bool(pserver_enable_create_feasign_randomly,
             false,
             "pserver_enable_create_feasign_randomly");
 DEFINE_int32(pserver_table_save_max_retry, 3, "pserver_table_save_max_retry");
+DEFINE_int64(pserver_background_shrink_keys_per_second,
+             0,
+             "keys a background shrink visits per second, 0 for no limit");
 
 namespace paddle {
 namespace distributed {
 
+// values of full size a push task hands to one Update of the accessor
+static const size_t kPushBatch = 64;
+
 int32_t MemorySparseTable::Initialize() {
   auto& profiler = CostProfiler::instance();
   profiler.register_profiler("pserver_sparse_update_all");
@@ -73,7 +80,16 @@ int32_t MemorySparseTable::InitializeValue() {
           << " _real_local_shard_num: " << _real_local_shard_num
           << " _task_pool_size:" << _task_pool_size;
 
+  _track_changed_keys = _config.track_changed_keys();
   _local_shards.reset(new shard_type[_real_local_shard_num]);
+  // slabs for the values without and with mf, others are added when used
+  size_t value_size = _value_accesor->GetAccessorInfo().size / sizeof(float);
+  size_t mf_value_size =
+      _value_accesor->GetAccessorInfo().mf_size / sizeof(float);
+  for (int i = 0; i < _real_local_shard_num; ++i) {
+    _local_shards[i].add_value_class(value_size - mf_value_size);
+    _local_shards[i].add_value_class(value_size);
+  }
 
   if (_config.enable_revert()) {
     // calculate merged shard number based on config param;
@@ -104,6 +120,7 @@ int32_t MemorySparseTable::InitializeValue() {
 
 int32_t MemorySparseTable::Load(const std::string& path,
                                 const std::string& param) {
+  WaitShrinkDone();
   std::string table_path = TableDir(path);
   auto file_list = _afs_client.list(table_path);
 
@@ -124,6 +141,7 @@ int32_t MemorySparseTable::Load(const std::string& path,
     return -1;
   }
 
+  _changed_keys_incomplete = true;
   if (load_param == 5) {
     return LoadPatch(file_list, load_param);
   }
@@ -136,6 +154,8 @@ int32_t MemorySparseTable::Load(const std::string& path,
 
   size_t feature_value_size =
       _value_accesor->GetAccessorInfo().size / sizeof(float);
+  // a snapshot of another accessor or dim is not retried
+  std::atomic<bool> mismatched{false};
 #if defined(PADDLE_WITH_MKLML)
   int thread_num = _real_local_shard_num < 15 ? _real_local_shard_num : 15;
   omp_set_num_threads(thread_num);
@@ -146,9 +166,13 @@ int32_t MemorySparseTable::Load(const std::string& path,
     channel_config.path = file_list[file_start_idx + i];
     VLOG(1) << "MemorySparseTable::load begin load " << channel_config.path
             << " into local shard " << i;
-    channel_config.converter = _value_accesor->Converter(load_param).converter;
-    channel_config.deconverter =
-        _value_accesor->Converter(load_param).deconverter;
+    bool binary = IsSparseSnapshot(channel_config.path);
+    if (!binary) {
+      channel_config.converter =
+          _value_accesor->Converter(load_param).converter;
+      channel_config.deconverter =
+          _value_accesor->Converter(load_param).deconverter;
+    }
 
     bool is_read_failed = false;
     int retry_num = 0;
@@ -160,11 +184,26 @@ int32_t MemorySparseTable::Load(const std::string& path,
       auto read_channel = _afs_client.open_r(channel_config, 0, &err_no);
       char* end = NULL;
       auto& shard = _local_shards[i];
+      int snapshot_ret = 0;
       try {
-        while (read_channel->read_line(line_data) == 0 &&
+        if (binary) {
+          snapshot_ret =
+              LoadSnapshot(read_channel.get(),
+                           channel_config.path,
+                           [&shard](uint64_t) { return &shard; });
+        }
+        if (snapshot_ret == -2) {
+          read_channel->close();
+          mismatched = true;
+          break;
+        }
+        if (snapshot_ret != 0) {
+          err_no = -1;
+        }
+        while (!binary && read_channel->read_line(line_data) == 0 &&
                line_data.size() > 1) {
           uint64_t key = std::strtoul(line_data.data(), &end, 10);
-          auto& value = shard[key];
+          auto value = shard[key];
           value.resize(feature_value_size);
           int parse_size = _value_accesor->ParseFromString(++end, value.data());
           value.resize(parse_size);
@@ -195,6 +234,12 @@ int32_t MemorySparseTable::Load(const std::string& path,
       }
     } while (is_read_failed);
   }
+  if (mismatched) {
+    LOG(ERROR) << "MemorySparseTable load failed, snapshot does not match the "
+                  "table, path:"
+               << path;
+    return -1;
+  }
   LOG(INFO) << "MemorySparseTable load success, path from "
             << file_list[file_start_idx] << " to "
             << file_list[file_start_idx + _real_local_shard_num - 1];
@@ -221,6 +266,8 @@ int32_t MemorySparseTable::LoadPatch(const std::vector<std::string>& file_list,
       _value_accesor->GetAccessorInfo().size / sizeof(float);
   end_idx =
       end_idx < _m_sparse_table_shard_num ? end_idx : _m_sparse_table_shard_num;
+  // a snapshot of another accessor or dim is not retried
+  std::atomic<bool> mismatched{false};
 #if defined(PADDLE_WITH_MKLML)
   int thread_num = (end_idx - start_idx) < 15 ? (end_idx - start_idx) : 15;
   omp_set_num_threads(thread_num);
@@ -229,9 +276,13 @@ int32_t MemorySparseTable::LoadPatch(const std::vector<std::string>& file_list,
   for (size_t i = start_idx; i < end_idx; ++i) {
     FsChannelConfig channel_config;
     channel_config.path = file_list[i];
-    channel_config.converter = _value_accesor->Converter(load_param).converter;
-    channel_config.deconverter =
-        _value_accesor->Converter(load_param).deconverter;
+    bool binary = IsSparseSnapshot(channel_config.path);
+    if (!binary) {
+      channel_config.converter =
+          _value_accesor->Converter(load_param).converter;
+      channel_config.deconverter =
+          _value_accesor->Converter(load_param).deconverter;
+    }
 
     bool is_read_failed = false;
     int retry_num = 0;
@@ -252,26 +303,42 @@ int32_t MemorySparseTable::LoadPatch(const std::vector<std::string>& file_list,
           global_shard_idx_str.append(std::to_string(j)).append(",");
         }
       }
+      auto shard_of = [&](uint64_t key) -> shard_type* {
+        auto index_iter = global_shard_idx.find(key % _sparse_table_shard_num);
+        if (index_iter == global_shard_idx.end()) {
+          LOG(WARNING) << "MemorySparseTable key:" << key << " not match shard,"
+                       << " file_idx:" << i
+                       << " global_shard_idx:" << global_shard_idx_str
+                       << " shard num:" << _sparse_table_shard_num
+                       << " file:" << channel_config.path;
+          return nullptr;
+        }
+        return &_local_shards[*index_iter % _avg_local_shard_num];
+      };
+      int snapshot_ret = 0;
       try {
-        while (read_channel->read_line(line_data) == 0 &&
+        if (binary) {
+          snapshot_ret =
+              LoadSnapshot(read_channel.get(), channel_config.path, shard_of);
+        }
+        if (snapshot_ret == -2) {
+          read_channel->close();
+          mismatched = true;
+          break;
+        }
+        if (snapshot_ret != 0) {
+          err_no = -1;
+        }
+        while (!binary && read_channel->read_line(line_data) == 0 &&
                line_data.size() > 1) {
           uint64_t key = std::strtoul(line_data.data(), &end, 10);
-
-          auto index_iter =
-              global_shard_idx.find(key % _sparse_table_shard_num);
-          if (index_iter == global_shard_idx.end()) {
-            LOG(WARNING) << "MemorySparseTable key:" << key
-                         << " not match shard,"
-                         << " file_idx:" << i
-                         << " global_shard_idx:" << global_shard_idx_str
-                         << " shard num:" << _sparse_table_shard_num
-                         << " file:" << channel_config.path;
+          shard_type* shard_ptr = shard_of(key);
+          if (shard_ptr == nullptr) {
             continue;
           }
-          size_t local_shard_idx = *index_iter % _avg_local_shard_num;
-          auto& shard = _local_shards[local_shard_idx];
+          auto& shard = *shard_ptr;
 
-          auto& value = shard[key];
+          auto value = shard[key];
           value.resize(feature_value_size);
           int parse_size = _value_accesor->ParseFromString(++end, value.data());
           value.resize(parse_size);
@@ -296,11 +363,71 @@ int32_t MemorySparseTable::LoadPatch(const std::vector<std::string>& file_list,
       }
     } while (is_read_failed);
   }
+  if (mismatched) {
+    LOG(ERROR) << "MemorySparseTable load patch failed, snapshot does not "
+                  "match the table, path from "
+               << file_list[start_idx];
+    return -1;
+  }
   LOG(INFO) << "MemorySparseTable load success, path from "
             << file_list[start_idx] << " to " << file_list[end_idx - 1];
   return 0;
 }
 
+SparseSnapshotHeader MemorySparseTable::SnapshotHeader(int save_param,
+                                                      size_t file_idx) {
+  SparseSnapshotHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, SPARSE_SNAPSHOT_MAGIC, sizeof(header.magic));
+  header.version = SPARSE_SNAPSHOT_VERSION;
+  header.compress = _config.compress_in_save() ? 1 : 0;
+  header.value_dim = _value_accesor->GetAccessorInfo().size / sizeof(float);
+  header.mf_dim = _value_accesor->GetAccessorInfo().mf_size / sizeof(float);
+  header.table_id = _config.table_id();
+  header.file_idx = file_idx;
+  header.save_param = save_param;
+  snprintf(header.accessor_class,
+           sizeof(header.accessor_class),
+           "%s",
+           _config.accessor().accessor_class().c_str());
+  return header;
+}
+
+int32_t MemorySparseTable::LoadSnapshot(
+    FsReadChannel* channel,
+    const std::string& path,
+    const std::function<shard_type*(uint64_t)>& shard_of) {
+  SparseSnapshotReader reader(channel);
+  SparseSnapshotHeader header;
+  if (reader.ReadHeader(&header) != 0) {
+    return -1;
+  }
+  SparseSnapshotHeader expect = SnapshotHeader(header.save_param, 0);
+  if (header.value_dim != expect.value_dim || header.mf_dim != expect.mf_dim ||
+      strcmp(header.accessor_class, expect.accessor_class) != 0) {
+    LOG(ERROR) << "MemorySparseTable snapshot " << path << " of "
+               << header.accessor_class << " value_dim:" << header.value_dim
+               << " mf_dim:" << header.mf_dim << " can not be loaded into "
+               << expect.accessor_class << " value_dim:" << expect.value_dim
+               << " mf_dim:" << expect.mf_dim;
+    return -2;
+  }
+  uint64_t key = 0;
+  const float* data = nullptr;
+  uint32_t dim = 0;
+  int ret = 0;
+  while ((ret = reader.Next(&key, &data, &dim)) == 0) {
+    shard_type* shard = shard_of(key);
+    if (shard == nullptr) {
+      continue;
+    }
+    auto value = (*shard)[key];
+    value.resize(dim);
+    memcpy(value.data(), data, dim * sizeof(float));
+  }
+  return ret < 0 ? -1 : 0;
+}
+
 void MemorySparseTable::Revert() {
   for (size_t i = 0; i < _real_local_shard_num; ++i) {
     _local_shards_new[i].clear();
@@ -311,6 +438,28 @@ void MemorySparseTable::CheckSavePrePatchDone() {
   _save_patch_model_thread.join();
 }
 
+// calls fn with the iterators of all the keys of shard, or of the ones in
+// its changed_keys, until fn returns false
+template <class FN>
+static void VisitShard(MemorySparseTable::shard_type* shard,
+                       bool changed_only,
+                       FN fn) {
+  if (!changed_only) {
+    for (auto it = shard->begin(); it != shard->end(); ++it) {
+      if (!fn(it)) {
+        return;
+      }
+    }
+    return;
+  }
+  for (uint64_t key : shard->changed_keys()) {
+    auto it = shard->find(key);
+    if (it != shard->end() && !fn(it)) {
+      return;
+    }
+  }
+}
+
 int32_t MemorySparseTable::Save(const std::string& dirname,
                                 const std::string& param) {
   if (_real_local_shard_num == 0) {
@@ -319,6 +468,7 @@ int32_t MemorySparseTable::Save(const std::string& dirname,
   }
 
   VLOG(0) << "MemorySparseTable::save dirname: " << dirname;
+  WaitShrinkDone();
   int save_param =
       atoi(param.c_str());  // checkpoint:0  xbox delta:1  xbox base:2
 
@@ -341,6 +491,11 @@ int32_t MemorySparseTable::Save(const std::string& dirname,
   std::atomic<uint32_t> feasign_size_all{0};
 
   size_t file_start_idx = _avg_local_shard_num * _shard_idx;
+  // an xbox delta holds the keys whose delta score passed the threshold, and
+  // the delta score of a key only grows when it is pushed, so the keys
+  // changed since the last xbox save are all that can be in it
+  bool changed_only =
+      _track_changed_keys && save_param == 1 && !_changed_keys_incomplete;
 
 #if defined(PADDLE_WITH_MKLML)
 #ifdef PADDLE_WITH_GPU_GRAPH
@@ -353,7 +508,18 @@ int32_t MemorySparseTable::Save(const std::string& dirname,
 #endif
   for (int i = 0; i < _real_local_shard_num; ++i) {
     FsChannelConfig channel_config;
-    if (_config.compress_in_save() && (save_param == 0 || save_param == 3)) {
+    bool binary =
+        _config.binary_in_save() && (save_param == 0 || save_param == 3);
+    if (binary) {
+      // compressed by blocks inside the file
+      channel_config.path =
+          paddle::string::format_string("%s/part-%03d-%05d%s",
+                                        table_path.c_str(),
+                                        _shard_idx,
+                                        file_start_idx + i,
+                                        SPARSE_SNAPSHOT_SUFFIX);
+    } else if (_config.compress_in_save() &&
+               (save_param == 0 || save_param == 3)) {
       channel_config.path =
           paddle::string::format_string("%s/part-%03d-%05d.gz",
                                         table_path.c_str(),
@@ -365,22 +531,44 @@ int32_t MemorySparseTable::Save(const std::string& dirname,
                                                           _shard_idx,
                                                           file_start_idx + i);
     }
-    channel_config.converter = _value_accesor->Converter(save_param).converter;
-    channel_config.deconverter =
-        _value_accesor->Converter(save_param).deconverter;
+    if (!binary) {
+      channel_config.converter =
+          _value_accesor->Converter(save_param).converter;
+      channel_config.deconverter =
+          _value_accesor->Converter(save_param).deconverter;
+    }
     bool is_write_failed = false;
     int feasign_size = 0;
     int retry_num = 0;
     int err_no = 0;
     auto& shard = _local_shards[i];
+    if (changed_only && _config.enable_sparse_table_cache()) {
+      // the cache threshold is over all the keys
+      for (auto it = shard.begin(); it != shard.end(); ++it) {
+        if (_value_accesor->Save(it.value().data(), 4)) {
+          tk.push(i, _value_accesor->GetField(it.value().data(), "show"));
+        }
+      }
+    }
     do {
       err_no = 0;
       feasign_size = 0;
       is_write_failed = false;
       auto write_channel =
           _afs_client.open_w(channel_config, 1024 * 1024 * 40, &err_no);
-      for (auto it = shard.begin(); it != shard.end(); ++it) {
-        if (_config.enable_sparse_table_cache() &&
+      SparseSnapshotWriter snapshot_writer(write_channel.get());
+      if (binary && snapshot_writer.WriteHeader(SnapshotHeader(
+                        save_param, file_start_idx + i)) != 0) {
+        ++retry_num;
+        is_write_failed = true;
+        LOG(ERROR) << "MemorySparseTable save header failed, retry it! path:"
+                   << channel_config.path << " , retry_num=" << retry_num;
+      }
+      VisitShard(&shard, changed_only, [&](shard_type::iterator it) {
+        if (is_write_failed) {
+          return false;
+        }
+        if (!changed_only && _config.enable_sparse_table_cache() &&
             (save_param == 1 || save_param == 2) &&
             _value_accesor->Save(it.value().data(), 4)) {
           CostTimer timer10("sprase table top push");
@@ -388,19 +576,33 @@ int32_t MemorySparseTable::Save(const std::string& dirname,
         }
 
         if (_value_accesor->Save(it.value().data(), save_param)) {
-          std::string format_value = _value_accesor->ParseToString(
-              it.value().data(), it.value().size());
-          if (0 != write_channel->write_line(paddle::string::format_string(
-                       "%lu %s", it.key(), format_value.c_str()))) {
+          int ret = 0;
+          if (binary) {
+            ret = snapshot_writer.Append(
+                it.key(), it.value().data(), it.value().size());
+          } else {
+            std::string format_value = _value_accesor->ParseToString(
+                it.value().data(), it.value().size());
+            ret = write_channel->write_line(paddle::string::format_string(
+                "%lu %s", it.key(), format_value.c_str()));
+          }
+          if (0 != ret) {
             ++retry_num;
             is_write_failed = true;
             LOG(ERROR)
                 << "MemorySparseTable save prefix failed, retry it! path:"
                 << channel_config.path << " , retry_num=" << retry_num;
-            break;
+            return false;
           }
           ++feasign_size;
         }
+        return true;
+      });
+      if (binary && !is_write_failed && snapshot_writer.Finish() != 0) {
+        ++retry_num;
+        is_write_failed = true;
+        LOG(ERROR) << "MemorySparseTable save end failed, retry it! path:"
+                   << channel_config.path << " , retry_num=" << retry_num;
       }
       write_channel->close();
       if (err_no == -1) {
@@ -419,11 +621,19 @@ int32_t MemorySparseTable::Save(const std::string& dirname,
       }
     } while (is_write_failed);
     feasign_size_all += feasign_size;
-    for (auto it = shard.begin(); it != shard.end(); ++it) {
+    VisitShard(&shard, changed_only, [&](shard_type::iterator it) {
       _value_accesor->UpdateStatAfterSave(it.value().data(), save_param);
+      return true;
+    });
+    if (_track_changed_keys && (save_param == 1 || save_param == 2)) {
+      shard.next_epoch();
     }
     LOG(INFO) << "MemorySparseTable save prefix success, path: "
-              << channel_config.path << " feasign_size: " << feasign_size;
+              << channel_config.path << " feasign_size: " << feasign_size
+              << (changed_only ? " (changed keys only)" : "");
+  }
+  if (save_param == 1 || save_param == 2) {
+    _changed_keys_incomplete = false;
   }
   _local_show_threshold = tk.top();
   // int32 may overflow need to change return value
@@ -448,14 +658,20 @@ int32_t MemorySparseTable::SavePatch(const std::string& path, int save_param) {
 #endif
   for (size_t i = 0; i < _m_real_local_shard_num; ++i) {
     FsChannelConfig channel_config;
-    channel_config.path = paddle::string::format_string("%s/part-%03d-%05d",
-                                                        table_path.c_str(),
-                                                        _shard_idx,
-                                                        file_start_idx + i);
-
-    channel_config.converter = _value_accesor->Converter(save_param).converter;
-    channel_config.deconverter =
-        _value_accesor->Converter(save_param).deconverter;
+    bool binary = _config.binary_in_save();
+    channel_config.path =
+        paddle::string::format_string("%s/part-%03d-%05d%s",
+                                      table_path.c_str(),
+                                      _shard_idx,
+                                      file_start_idx + i,
+                                      binary ? SPARSE_SNAPSHOT_SUFFIX : "");
+
+    if (!binary) {
+      channel_config.converter =
+          _value_accesor->Converter(save_param).converter;
+      channel_config.deconverter =
+          _value_accesor->Converter(save_param).deconverter;
+    }
 
     bool is_write_failed = false;
     int feasign_size = 0;
@@ -467,16 +683,31 @@ int32_t MemorySparseTable::SavePatch(const std::string& path, int save_param) {
       is_write_failed = false;
       auto write_channel =
           _afs_client.open_w(channel_config, 1024 * 1024 * 40, &err_no);
+      SparseSnapshotWriter snapshot_writer(write_channel.get());
+      if (binary && snapshot_writer.WriteHeader(SnapshotHeader(
+                        save_param, file_start_idx + i)) != 0) {
+        ++retry_num;
+        is_write_failed = true;
+        LOG(ERROR) << "MemorySparseTable save header failed, retry it! path:"
+                   << channel_config.path << " , retry_num=" << retry_num;
+      }
 
-      for (size_t j = 0; j < _real_local_shard_num; ++j) {
+      for (size_t j = 0; j < _real_local_shard_num && !is_write_failed; ++j) {
         if (j % _m_real_local_shard_num == i) {
           auto& shard = _local_shards_patch_model[j];
           for (auto it = shard.begin(); it != shard.end(); ++it) {
             if (_value_accesor->Save(it.value().data(), save_param)) {
-              std::string format_value = _value_accesor->ParseToString(
-                  it.value().data(), it.value().size());
-              if (0 != write_channel->write_line(paddle::string::format_string(
-                           "%lu %s", it.key(), format_value.c_str()))) {
+              int ret = 0;
+              if (binary) {
+                ret = snapshot_writer.Append(
+                    it.key(), it.value().data(), it.value().size());
+              } else {
+                std::string format_value = _value_accesor->ParseToString(
+                    it.value().data(), it.value().size());
+                ret = write_channel->write_line(paddle::string::format_string(
+                    "%lu %s", it.key(), format_value.c_str()));
+              }
+              if (0 != ret) {
                 ++retry_num;
                 is_write_failed = true;
                 LOG(ERROR) << "MemorySparseTable save failed, retry it! path:"
@@ -490,6 +721,12 @@ int32_t MemorySparseTable::SavePatch(const std::string& path, int save_param) {
         }
         if (is_write_failed) break;
       }
+      if (binary && !is_write_failed && snapshot_writer.Finish() != 0) {
+        ++retry_num;
+        is_write_failed = true;
+        LOG(ERROR) << "MemorySparseTable save end failed, retry it! path:"
+                   << channel_config.path << " , retry_num=" << retry_num;
+      }
       write_channel->close();
       if (err_no == -1) {
         ++retry_num;
@@ -723,6 +960,32 @@ int64_t MemorySparseTable::LocalMFSize() {
 std::pair<int64_t, int64_t> MemorySparseTable::PrintTableStat() {
   int64_t feasign_size = LocalSize();
   int64_t mf_size = LocalMFSize();
+
+  // how evenly the keys spread over the local shards and their buckets, a
+  // max far above the average means a few buckets take most of the keys
+  size_t max_shard_size = 0;
+  size_t max_bucket_size = 0;
+  size_t empty_bucket_num = 0;
+  size_t bucket_num = 0;
+  for (int i = 0; i < _real_local_shard_num; ++i) {
+    auto& shard = _local_shards[i];
+    max_shard_size = std::max(max_shard_size, shard.size());
+    for (size_t bucket = 0; bucket < shard.bucket_count(); ++bucket) {
+      size_t bucket_size = shard.bucket_size(bucket);
+      max_bucket_size = std::max(max_bucket_size, bucket_size);
+      empty_bucket_num += bucket_size == 0;
+      ++bucket_num;
+    }
+  }
+  if (_real_local_shard_num > 0 && bucket_num > 0) {
+    LOG(INFO) << "MemorySparseTable table_id:" << _config.table_id()
+              << " feasign_size:" << feasign_size << " mf_size:" << mf_size
+              << " shard size max/avg:" << max_shard_size << "/"
+              << feasign_size / _real_local_shard_num
+              << " bucket size max/avg:" << max_bucket_size << "/"
+              << feasign_size / bucket_num
+              << " empty buckets:" << empty_bucket_num << "/" << bucket_num;
+  }
   return {feasign_size, mf_size};
 }
 
@@ -796,12 +1059,16 @@ int32_t MemorySparseTable::PullSparse(float* pull_values,
                   if (FLAGS_pserver_create_value_when_push) {
                     memset(data_buffer, 0, sizeof(float) * data_size);
                   } else {
-                    auto& feature_value = local_shard[key];
+                    auto res = local_shard.emplace(key);
+                    auto feature_value = res.first.value();
                     feature_value.resize(data_size);
                     float* data_ptr = feature_value.data();
                     _value_accesor->Create(&data_buffer_ptr, 1);
                     memcpy(
                         data_ptr, data_buffer_ptr, data_size * sizeof(float));
+                    if (_track_changed_keys) {
+                      local_shard.touch(res.first);
+                    }
                   }
                 } else {
                   data_size = itr.value().size();
@@ -861,17 +1128,21 @@ int32_t MemorySparseTable::PullSparsePtr(char** pull_values,
                 uint64_t key = keys[i].first;
                 auto itr = local_shard.find(key);
                 size_t data_size = value_size - mf_value_size;
-                FixedFeatureValue* ret = NULL;
                 if (itr == local_shard.end()) {
                   // ++missed_keys;
-                  auto& feature_value = local_shard[key];
+                  itr = local_shard.emplace(key).first;
+                  auto feature_value = itr.value();
                   feature_value.resize(data_size);
                   float* data_ptr = feature_value.data();
                   _value_accesor->Create(&data_buffer_ptr, 1);
                   memcpy(data_ptr, data_buffer_ptr, data_size * sizeof(float));
-                  ret = &feature_value;
-                } else {
-                  ret = itr.value_ptr();
+                }
+                // the caller keeps the pointer, as PS-GPU does until the
+                // values are dumped back
+                FixedFeatureValue* ret = local_shard.pin(itr);
+                if (_track_changed_keys) {
+                  // updated through the pointer
+                  local_shard.touch(itr);
                 }
                 int pull_data_idx = keys[i].second;
                 pull_values[pull_data_idx] = reinterpret_cast<char*>(ret);
@@ -885,6 +1156,22 @@ int32_t MemorySparseTable::PullSparsePtr(char** pull_values,
   return 0;
 }
 
+int32_t MemorySparseTable::UnpinValues() {
+  std::vector<std::future<int>> tasks(_real_local_shard_num);
+  for (int shard_id = 0; shard_id < _real_local_shard_num; ++shard_id) {
+    tasks[shard_id] =
+        _shards_task_pool[shard_id % _shards_task_pool.size()]->enqueue(
+            [this, shard_id]() -> int {
+              _local_shards[shard_id].unpin_all();
+              return 0;
+            });
+  }
+  for (size_t shard_id = 0; shard_id < tasks.size(); ++shard_id) {
+    tasks[shard_id].wait();
+  }
+  return 0;
+}
+
 int32_t MemorySparseTable::PushSparse(const uint64_t* keys,
                                       const float* values,
                                       size_t num) {
@@ -918,6 +1205,25 @@ int32_t MemorySparseTable::PushSparse(const uint64_t* keys,
           auto& local_shard_new = _local_shards_new[shard_id];
           float data_buffer[value_col];  // NOLINT
           float* data_buffer_ptr = data_buffer;
+          // the values of full size are updated in place in batches, their
+          // records stay put until resized
+          uint64_t batch_keys[kPushBatch];
+          float* batch_values[kPushBatch];
+          const float* batch_updates[kPushBatch];
+          size_t batch_num = 0;
+          auto flush_batch = [&]() {
+            _value_accesor->Update(batch_values, batch_updates, batch_num);
+            if (_config.enable_revert()) {
+              for (size_t j = 0; j < batch_num; ++j) {
+                auto feature_value_new = local_shard_new[batch_keys[j]];
+                feature_value_new.resize(value_col);
+                memcpy(feature_value_new.data(),
+                       batch_values[j],
+                       value_col * sizeof(float));
+              }
+            }
+            batch_num = 0;
+          };
           for (size_t i = 0; i < keys.size(); ++i) {
             uint64_t key = keys[i].first;
             uint64_t push_data_idx = keys[i].second;
@@ -930,7 +1236,7 @@ int32_t MemorySparseTable::PushSparse(const uint64_t* keys,
                 continue;
               }
               auto value_size = value_col - mf_value_col;
-              auto& feature_value = local_shard[key];
+              auto feature_value = local_shard[key];
               feature_value.resize(value_size);
               _value_accesor->Create(&data_buffer_ptr, 1);
               memcpy(feature_value.data(),
@@ -939,33 +1245,42 @@ int32_t MemorySparseTable::PushSparse(const uint64_t* keys,
               itr = local_shard.find(key);
             }
 
-            auto& feature_value = itr.value();
+            if (_track_changed_keys) {
+              local_shard.touch(itr);
+            }
+            auto feature_value = itr.value();
             float* value_data = feature_value.data();
             size_t value_size = feature_value.size();
 
             if (value_size == value_col) {  // 已拓展到最大size, 则就地update
-              _value_accesor->Update(&value_data, &update_data, 1);
-            } else {
-              // 拷入buffer区进行update，然后再回填，不需要的mf则回填时抛弃了
-              memcpy(data_buffer_ptr, value_data, value_size * sizeof(float));
-              _value_accesor->Update(&data_buffer_ptr, &update_data, 1);
-
-              if (_value_accesor->NeedExtendMF(data_buffer)) {
-                feature_value.resize(value_col);
-                value_data = feature_value.data();
-                _value_accesor->Create(&value_data, 1);
+              batch_keys[batch_num] = key;
+              batch_values[batch_num] = value_data;
+              batch_updates[batch_num] = update_data;
+              if (++batch_num == kPushBatch) {
+                flush_batch();
               }
-              memcpy(value_data, data_buffer_ptr, value_size * sizeof(float));
+              continue;
             }
+            // 拷入buffer区进行update，然后再回填，不需要的mf则回填时抛弃了
+            memcpy(data_buffer_ptr, value_data, value_size * sizeof(float));
+            _value_accesor->Update(&data_buffer_ptr, &update_data, 1);
+
+            if (_value_accesor->NeedExtendMF(data_buffer)) {
+              feature_value.resize(value_col);
+              value_data = feature_value.data();
+              _value_accesor->Create(&value_data, 1);
+            }
+            memcpy(value_data, data_buffer_ptr, value_size * sizeof(float));
             if (_config.enable_revert()) {
-              FixedFeatureValue* feature_value_new = &(local_shard_new[key]);
+              auto feature_value_new = local_shard_new[key];
               auto new_size = feature_value.size();
-              feature_value_new->resize(new_size);
-              memcpy(feature_value_new->data(),
+              feature_value_new.resize(new_size);
+              memcpy(feature_value_new.data(),
                      value_data,
                      new_size * sizeof(float));
             }
           }
+          flush_batch();
           return 0;
         });
   }
@@ -1006,6 +1321,9 @@ int32_t MemorySparseTable::PushSparse(const uint64_t* keys,
           auto& local_shard = _local_shards[shard_id];
           float data_buffer[value_col];  // NOLINT
           float* data_buffer_ptr = data_buffer;
+          float* batch_values[kPushBatch];
+          const float* batch_updates[kPushBatch];
+          size_t batch_num = 0;
           for (size_t i = 0; i < keys.size(); ++i) {
             uint64_t key = keys[i].first;
             uint64_t push_data_idx = keys[i].second;
@@ -1017,7 +1335,7 @@ int32_t MemorySparseTable::PushSparse(const uint64_t* keys,
                 continue;
               }
               auto value_size = value_col - mf_value_col;
-              auto& feature_value = local_shard[key];
+              auto feature_value = local_shard[key];
               feature_value.resize(value_size);
               _value_accesor->Create(&data_buffer_ptr, 1);
               memcpy(feature_value.data(),
@@ -1025,23 +1343,32 @@ int32_t MemorySparseTable::PushSparse(const uint64_t* keys,
                      value_size * sizeof(float));
               itr = local_shard.find(key);
             }
-            auto& feature_value = itr.value();
+            if (_track_changed_keys) {
+              local_shard.touch(itr);
+            }
+            auto feature_value = itr.value();
             float* value_data = feature_value.data();
             size_t value_size = feature_value.size();
             if (value_size == value_col) {  // 已拓展到最大size, 则就地update
-              _value_accesor->Update(&value_data, &update_data, 1);
-            } else {
-              // 拷入buffer区进行update，然后再回填，不需要的mf则回填时抛弃了
-              memcpy(data_buffer_ptr, value_data, value_size * sizeof(float));
-              _value_accesor->Update(&data_buffer_ptr, &update_data, 1);
-              if (_value_accesor->NeedExtendMF(data_buffer)) {
-                feature_value.resize(value_col);
-                value_data = feature_value.data();
-                _value_accesor->Create(&value_data, 1);
+              batch_values[batch_num] = value_data;
+              batch_updates[batch_num] = update_data;
+              if (++batch_num == kPushBatch) {
+                _value_accesor->Update(batch_values, batch_updates, batch_num);
+                batch_num = 0;
               }
-              memcpy(value_data, data_buffer_ptr, value_size * sizeof(float));
+              continue;
+            }
+            // 拷入buffer区进行update，然后再回填，不需要的mf则回填时抛弃了
+            memcpy(data_buffer_ptr, value_data, value_size * sizeof(float));
+            _value_accesor->Update(&data_buffer_ptr, &update_data, 1);
+            if (_value_accesor->NeedExtendMF(data_buffer)) {
+              feature_value.resize(value_col);
+              value_data = feature_value.data();
+              _value_accesor->Create(&value_data, 1);
             }
+            memcpy(value_data, data_buffer_ptr, value_size * sizeof(float));
           }
+          _value_accesor->Update(batch_values, batch_updates, batch_num);
           return 0;
         });
   }
@@ -1052,26 +1379,144 @@ int32_t MemorySparseTable::PushSparse(const uint64_t* keys,
   return 0;
 }
 
+int32_t MemorySparseTable::ExportChangedKeys(std::vector<uint64_t>* keys) {
+  if (!_track_changed_keys) {
+    LOG(WARNING) << "MemorySparseTable track_changed_keys is not enabled, "
+                 << "table_id:" << _config.table_id();
+    return -1;
+  }
+  std::vector<std::vector<uint64_t>> shard_keys(_real_local_shard_num);
+  std::vector<std::future<int>> tasks(_real_local_shard_num);
+  // in the task queues of the shards, so that pushes do not run meanwhile
+  for (int shard_id = 0; shard_id < _real_local_shard_num; ++shard_id) {
+    tasks[shard_id] = _shards_task_pool[shard_id % _task_pool_size]->enqueue(
+        [this, shard_id, &shard_keys]() -> int {
+          shard_keys[shard_id] = _local_shards[shard_id].changed_keys();
+          return 0;
+        });
+  }
+  size_t key_num = 0;
+  for (int shard_id = 0; shard_id < _real_local_shard_num; ++shard_id) {
+    tasks[shard_id].wait();
+    key_num += shard_keys[shard_id].size();
+  }
+  keys->reserve(keys->size() + key_num);
+  for (auto& shard_key : shard_keys) {
+    keys->insert(keys->end(), shard_key.begin(), shard_key.end());
+  }
+  return 0;
+}
+
 int32_t MemorySparseTable::Flush() { return 0; }
 
 int32_t MemorySparseTable::Shrink(const std::string& param) {
+  // a shrink decays the values, so there is one at a time
+  WaitShrinkDone();
+  if (_config.background_shrink()) {
+    VLOG(0) << "MemorySparseTable::Shrink in background";
+    _shrink_thread = std::thread(&MemorySparseTable::BackgroundShrink, this);
+    return 0;
+  }
   VLOG(0) << "MemorySparseTable::Shrink";
-  // TODO(zhaocaibei123): implement with multi-thread
+  std::vector<size_t> erased(_real_local_shard_num, 0);
+  std::vector<std::future<int>> tasks(_real_local_shard_num);
   for (int shard_id = 0; shard_id < _real_local_shard_num; ++shard_id) {
-    // Shrink
-    auto& shard = _local_shards[shard_id];
-    for (auto it = shard.begin(); it != shard.end();) {
-      if (_value_accesor->Shrink(it.value().data())) {
-        it = shard.erase(it);
-      } else {
-        ++it;
-      }
-    }
+    tasks[shard_id] = _shards_task_pool[shard_id % _task_pool_size]->enqueue(
+        [this, shard_id, &erased]() -> int {
+          for (size_t bucket = 0; bucket < CTR_SPARSE_SHARD_BUCKET_NUM;
+               ++bucket) {
+            ShrinkBucket(shard_id, bucket, &erased[shard_id]);
+          }
+          return 0;
+        });
   }
+  size_t erased_num = 0;
+  for (int shard_id = 0; shard_id < _real_local_shard_num; ++shard_id) {
+    tasks[shard_id].wait();
+    erased_num += erased[shard_id];
+  }
+  LOG(INFO) << "MemorySparseTable shrink success, table_id:"
+            << _config.table_id() << " erased:" << erased_num;
   return 0;
 }
 
-void MemorySparseTable::Clear() { VLOG(0) << "clear coming soon"; }
+size_t MemorySparseTable::ShrinkBucket(int shard_id,
+                                       size_t bucket,
+                                       size_t* erased) {
+  auto& shard = _local_shards[shard_id];
+  size_t visited = 0;
+  for (auto it = shard.begin(bucket); it != shard.end(bucket); ++visited) {
+    if (_value_accesor->Shrink(it.value().data())) {
+      it = shard.erase(bucket, it);
+      ++*erased;
+    } else {
+      ++it;
+    }
+  }
+  return visited;
+}
+
+// The same bucket of every local shard is shrunk at a time, each in the task
+// queue of its shard, so pushes to a shard wait for one bucket at most.
+void MemorySparseTable::BackgroundShrink() {
+  auto begin = std::chrono::steady_clock::now();
+  size_t visited_num = 0;
+  size_t erased_num = 0;
+  for (size_t bucket = 0; bucket < CTR_SPARSE_SHARD_BUCKET_NUM; ++bucket) {
+    std::vector<size_t> erased(_real_local_shard_num, 0);
+    std::vector<std::future<size_t>> tasks(_real_local_shard_num);
+    for (int shard_id = 0; shard_id < _real_local_shard_num; ++shard_id) {
+      tasks[shard_id] = _shards_task_pool[shard_id % _task_pool_size]->enqueue(
+          [this, shard_id, bucket, &erased]() -> size_t {
+            return ShrinkBucket(shard_id, bucket, &erased[shard_id]);
+          });
+    }
+    for (int shard_id = 0; shard_id < _real_local_shard_num; ++shard_id) {
+      visited_num += tasks[shard_id].get();
+      erased_num += erased[shard_id];
+    }
+    int64_t limit = FLAGS_pserver_background_shrink_keys_per_second;
+    if (limit > 0) {
+      std::this_thread::sleep_until(
+          begin + std::chrono::microseconds(
+                      static_cast<int64_t>(visited_num * 1e6 / limit)));
+    }
+  }
+  LOG(INFO) << "MemorySparseTable background shrink success, table_id:"
+            << _config.table_id() << " visited:" << visited_num
+            << " erased:" << erased_num << " seconds:"
+            << std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                             begin)
+                   .count();
+}
+
+void MemorySparseTable::WaitShrinkDone() {
+  if (_shrink_thread.joinable()) {
+    _shrink_thread.join();
+  }
+}
+
+// frees the values of all the keys, the slabs included
+void MemorySparseTable::Clear() {
+  WaitShrinkDone();
+  std::vector<std::future<int>> tasks(_real_local_shard_num);
+  for (int shard_id = 0; shard_id < _real_local_shard_num; ++shard_id) {
+    tasks[shard_id] = _shards_task_pool[shard_id % _task_pool_size]->enqueue(
+        [this, shard_id]() -> int {
+          _local_shards[shard_id].clear();
+          if (_local_shards_new) {
+            _local_shards_new[shard_id].clear();
+          }
+          return 0;
+        });
+  }
+  for (int shard_id = 0; shard_id < _real_local_shard_num; ++shard_id) {
+    tasks[shard_id].wait();
+  }
+  _changed_keys_incomplete = false;
+  LOG(INFO) << "MemorySparseTable clear success, table_id:"
+            << _config.table_id();
+}
 
 }  // namespace distributed
 }  // namespace paddle
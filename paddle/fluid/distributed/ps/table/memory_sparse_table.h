@@ -18,6 +18,7 @@
 #include <assert.h>
 #include <pthread.h>
 
+#include <functional>
 #include <memory>
 #include <mutex>  // NOLINT
 #include <string>
@@ -29,6 +30,7 @@
 #include "paddle/fluid/distributed/ps/table/accessor.h"
 #include "paddle/fluid/distributed/ps/table/common_table.h"
 #include "paddle/fluid/distributed/ps/table/depends/feature_value.h"
+#include "paddle/fluid/distributed/ps/table/sparse_snapshot.h"
 #include "paddle/fluid/string/string_helper.h"
 
 #define PSERVER_SAVE_SUFFIX ".shard"
@@ -38,9 +40,16 @@ namespace distributed {
 
 class MemorySparseTable : public Table {
  public:
-  typedef SparseTableShard<uint64_t, FixedFeatureValue> shard_type;
+#ifdef PADDLE_WITH_PSCORE_SWISS_MAP
+  typedef SlabSparseTableShard<
+      uint64_t,
+      SwissHashMap<uint64_t, SlabEntry, SparseShardHash<uint64_t>>>
+      shard_type;
+#else
+  typedef SlabSparseTableShard<uint64_t> shard_type;
+#endif
   MemorySparseTable() {}
-  virtual ~MemorySparseTable() {}
+  virtual ~MemorySparseTable() { WaitShrinkDone(); }
 
   // unused method end
   static int32_t sparse_local_shard_num(uint32_t shard_num,
@@ -91,11 +100,19 @@ class MemorySparseTable : public Table {
   int32_t PullSparse(float* values, const PullSparseValue& pull_value);
 
   int32_t PullSparsePtr(char** pull_values, const uint64_t* keys, size_t num);
+  // moves the values pinned by PullSparsePtr back to the slabs, the pointers
+  // it gave are invalid after it
+  int32_t UnpinValues() override;
 
   int32_t PushSparse(const uint64_t* keys, const float* values, size_t num);
 
   int32_t PushSparse(const uint64_t* keys, const float** values, size_t num);
 
+  // keys changed since the last xbox save (save_param 1 or 2) on this
+  // server, including erased ones, for online serving to update. Needs
+  // track_changed_keys.
+  int32_t ExportChangedKeys(std::vector<uint64_t>* keys) override;
+
   int32_t Flush() override;
   int32_t Shrink(const std::string& param) override;
   void Clear() override;
@@ -111,6 +128,20 @@ class MemorySparseTable : public Table {
   virtual int32_t SavePatch(const std::string& path, int save_param);
   virtual int32_t LoadPatch(const std::vector<std::string>& file_list,
                             int save_param);
+  // shrinks the keys in a bucket of a local shard, adds the erased ones to
+  // erased and returns the visited ones. Runs in the task queue of the shard.
+  size_t ShrinkBucket(int shard_id, size_t bucket, size_t* erased);
+  void BackgroundShrink();
+  // joins the background shrink, if there is one
+  void WaitShrinkDone();
+  // header of a binary snapshot of this table, see sparse_snapshot.h
+  SparseSnapshotHeader SnapshotHeader(int save_param, size_t file_idx);
+  // loads a binary snapshot, shard_of gives the local shard of a key or
+  // nullptr to skip it. Returns -1 if the file is cut or broken, -2 if it
+  // was saved with another accessor class, value_dim or mf_dim.
+  int32_t LoadSnapshot(FsReadChannel* channel,
+                       const std::string& path,
+                       const std::function<shard_type*(uint64_t)>& shard_of);
 
   int _task_pool_size = 24;
   int _avg_local_shard_num;
@@ -126,9 +157,15 @@ class MemorySparseTable : public Table {
   float _shard_merge_rate{1.0f};
   double _local_show_threshold{0.0};
 
+  bool _track_changed_keys{false};
+  // the changed keys miss the values loaded since the last xbox save, so the
+  // next xbox delta save scans all the keys
+  bool _changed_keys_incomplete{false};
+
   std::unique_ptr<shard_type[]> _local_shards_new;
   std::unique_ptr<shard_type[]> _local_shards_patch_model;
   std::thread _save_patch_model_thread;
+  std::thread _shrink_thread;
 };
 
 }  // namespace distributed
@@ -16,13 +16,236 @@
 
 #include <gflags/gflags.h>
 
+#include <cmath>
+
 #include "glog/logging.h"
+#include "paddle/fluid/platform/cpu_info.h"
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#define SPARSE_SGD_RULE_SIMD
+#endif
 
 DEFINE_bool(enable_show_scale_gradient, true, "enable show scale gradient");
 
 namespace paddle {
 namespace distributed {
 
+// Batch kernels of the rules. The loops of a kernel run to the dim as a
+// constant, and the kernel is inlined into a function built for AVX2 or
+// AVX-512, so that the compiler vectorizes them. The weights, the sgd state
+// and the gradient of a value never overlap, hence __restrict__. This file is
+// built with -fno-math-errno, or the loops calling sqrt would stay scalar.
+#define SPARSE_SGD_KERNEL inline __attribute__((always_inline))
+
+// as SparseValueSGDRule::BoundValue, NaN goes to the min bound
+static SPARSE_SGD_KERNEL float BoundKernelValue(float w,
+                                                float min_bound,
+                                                float max_bound) {
+  w = w >= min_bound ? w : min_bound;
+  return w <= max_bound ? w : max_bound;
+}
+
+template <int DIM>
+struct NaiveKernel {
+  static SPARSE_SGD_KERNEL void Run(const SparseSGDKernelParam& p,
+                                    float* __restrict__ w,
+                                    float* __restrict__ sgd,
+                                    const float* __restrict__ g,
+                                    float scale) {
+    for (int i = 0; i < DIM; ++i) {
+      w[i] = BoundKernelValue(
+          w[i] - p.learning_rate * g[i], p.min_bound, p.max_bound);
+    }
+  }
+};
+
+template <int DIM>
+struct AdaGradKernel {
+  static SPARSE_SGD_KERNEL void Run(const SparseSGDKernelParam& p,
+                                    float* __restrict__ w,
+                                    float* __restrict__ sgd,
+                                    const float* __restrict__ g,
+                                    float scale) {
+    // in double as SparseAdaGradSGDRule::UpdateValueWork, so the batches and
+    // the single updates of SSDSparseTable apply the same arithmetic
+    float ratio = std::sqrt(p.initial_g2sum / (p.initial_g2sum + sgd[0]));
+    double g2[DIM];
+    for (int i = 0; i < DIM; ++i) {
+      double scaled_grad = g[i] / scale;
+      w[i] = BoundKernelValue(w[i] - p.learning_rate * scaled_grad * ratio,
+                              p.min_bound,
+                              p.max_bound);
+      g2[i] = scaled_grad * scaled_grad;
+    }
+    double add_g2sum = 0;
+    for (int i = 0; i < DIM; ++i) {
+      add_g2sum += g2[i];
+    }
+    sgd[0] += add_g2sum / DIM;
+  }
+};
+
+template <int DIM>
+struct StdAdaGradKernel {
+  static SPARSE_SGD_KERNEL void Run(const SparseSGDKernelParam& p,
+                                    float* __restrict__ w,
+                                    float* __restrict__ sgd,
+                                    const float* __restrict__ g,
+                                    float scale) {
+    for (int i = 0; i < DIM; ++i) {
+      double scaled_grad = g[i] / scale;
+      w[i] = BoundKernelValue(
+          w[i] - p.learning_rate * scaled_grad *
+                     std::sqrt(p.initial_g2sum / (p.initial_g2sum + sgd[i])),
+          p.min_bound,
+          p.max_bound);
+      sgd[i] += scaled_grad * scaled_grad;
+    }
+  }
+};
+
+// sgd is gsum[DIM], g2sum[DIM], beta1_pow, beta2_pow
+template <int DIM>
+struct AdamKernel {
+  static SPARSE_SGD_KERNEL void Run(const SparseSGDKernelParam& p,
+                                    float* __restrict__ w,
+                                    float* __restrict__ sgd,
+                                    const float* __restrict__ g,
+                                    float scale) {
+    float* gsum = sgd;
+    float* g2sum = sgd + DIM;
+    float& beta1_pow = sgd[2 * DIM];
+    float& beta2_pow = sgd[2 * DIM + 1];
+    float lr = p.learning_rate * std::sqrt(1 - beta2_pow) / (1 - beta1_pow);
+    for (int i = 0; i < DIM; ++i) {
+      gsum[i] = p.beta1_decay_rate * gsum[i] + (1 - p.beta1_decay_rate) * g[i];
+      g2sum[i] = p.beta2_decay_rate * g2sum[i] +
+                 (1 - p.beta2_decay_rate) * g[i] * g[i];
+      w[i] = BoundKernelValue(
+          w[i] - lr * (gsum[i] / (std::sqrt(g2sum[i]) + p.ada_epsilon)),
+          p.min_bound,
+          p.max_bound);
+    }
+    beta1_pow *= p.beta1_decay_rate;
+    beta2_pow *= p.beta2_decay_rate;
+  }
+};
+
+// sgd is gsum, g2sum, beta1_pow, beta2_pow
+template <int DIM>
+struct SharedAdamKernel {
+  static SPARSE_SGD_KERNEL void Run(const SparseSGDKernelParam& p,
+                                    float* __restrict__ w,
+                                    float* __restrict__ sgd,
+                                    const float* __restrict__ g,
+                                    float scale) {
+    float lr = p.learning_rate * std::sqrt(1 - sgd[3]) / (1 - sgd[2]);
+    float gsum = sgd[0];
+    float g2sum = sgd[1];
+    float new_gsum[DIM];
+    float new_g2sum[DIM];
+    for (int i = 0; i < DIM; ++i) {
+      new_gsum[i] = p.beta1_decay_rate * gsum + (1 - p.beta1_decay_rate) * g[i];
+      new_g2sum[i] = p.beta2_decay_rate * g2sum +
+                     (1 - p.beta2_decay_rate) * g[i] * g[i];
+      w[i] = BoundKernelValue(
+          w[i] - lr * (new_gsum[i] / (std::sqrt(new_g2sum[i]) + p.ada_epsilon)),
+          p.min_bound,
+          p.max_bound);
+    }
+    double sum_gsum = 0.0;
+    double sum_g2sum = 0.0;
+    for (int i = 0; i < DIM; ++i) {
+      sum_gsum += new_gsum[i];
+      sum_g2sum += new_g2sum[i];
+    }
+    sgd[0] = sum_gsum / DIM;
+    sgd[1] = sum_g2sum / DIM;
+    sgd[2] *= p.beta1_decay_rate;
+    sgd[3] *= p.beta2_decay_rate;
+  }
+};
+
+template <class KERNEL>
+static SPARSE_SGD_KERNEL void RunBatch(const SparseSGDKernelParam& param,
+                                       float** w,
+                                       float** sgd,
+                                       const float** push_value,
+                                       const float* scale,
+                                       size_t num) {
+  // a copy the stores to the values do not alias
+  const SparseSGDKernelParam p = param;
+  for (size_t i = 0; i < num; ++i) {
+    KERNEL::Run(p, w[i], sgd[i], push_value[i], scale[i]);
+  }
+}
+
+template <class KERNEL>
+static void RunBatchDefault(const SparseSGDKernelParam& param,
+                            float** w,
+                            float** sgd,
+                            const float** push_value,
+                            const float* scale,
+                            size_t num) {
+  RunBatch<KERNEL>(param, w, sgd, push_value, scale, num);
+}
+
+#ifdef SPARSE_SGD_RULE_SIMD
+template <class KERNEL>
+__attribute__((target("avx2,fma"))) static void RunBatchAvx2(
+    const SparseSGDKernelParam& param,
+    float** w,
+    float** sgd,
+    const float** push_value,
+    const float* scale,
+    size_t num) {
+  RunBatch<KERNEL>(param, w, sgd, push_value, scale, num);
+}
+
+template <class KERNEL>
+__attribute__((target("avx512f"))) static void RunBatchAvx512(
+    const SparseSGDKernelParam& param,
+    float** w,
+    float** sgd,
+    const float** push_value,
+    const float* scale,
+    size_t num) {
+  RunBatch<KERNEL>(param, w, sgd, push_value, scale, num);
+}
+#endif
+
+template <class KERNEL>
+static SparseSGDBatchKernel SelectIsa() {
+#ifdef SPARSE_SGD_RULE_SIMD
+  if (platform::MayIUse(platform::avx512f)) {
+    return RunBatchAvx512<KERNEL>;
+  }
+  if (platform::MayIUse(platform::avx2)) {
+    return RunBatchAvx2<KERNEL>;
+  }
+#endif
+  return RunBatchDefault<KERNEL>;
+}
+
+// the kernel of a rule for the common embedding dims, nullptr for the others
+template <template <int> class KERNEL>
+static SparseSGDBatchKernel SelectBatchKernel(size_t dim) {
+  switch (dim) {
+    case 1:
+      return SelectIsa<KERNEL<1>>();
+    case 8:
+      return SelectIsa<KERNEL<8>>();
+    case 16:
+      return SelectIsa<KERNEL<16>>();
+    case 32:
+      return SelectIsa<KERNEL<32>>();
+    case 64:
+      return SelectIsa<KERNEL<64>>();
+    default:
+      return nullptr;
+  }
+}
+
 void SparseNaiveSGDRule::LoadConfig(const SparseCommonSGDRuleParameter& param,
                                     size_t emb_dim) {
   _embedding_dim = emb_dim;
@@ -39,6 +262,7 @@ void SparseNaiveSGDRule::LoadConfig(const SparseCommonSGDRuleParameter& param,
     _min_bound = naive_param.weight_bounds(0);
     _max_bound = naive_param.weight_bounds(1);
   }
+  _batch_kernel = SelectBatchKernel<NaiveKernel>(_embedding_dim);
 }
 
 void SparseNaiveSGDRule::UpdateValueWork(float* w,
@@ -86,6 +310,7 @@ void SparseAdaGradSGDRule::LoadConfig(const SparseCommonSGDRuleParameter& param,
     _min_bound = adagrad_param.weight_bounds(0);
     _max_bound = adagrad_param.weight_bounds(1);
   }
+  _batch_kernel = SelectBatchKernel<AdaGradKernel>(_embedding_dim);
 }
 
 void SparseAdaGradSGDRule::UpdateValueWork(float* w,
@@ -143,6 +368,7 @@ void StdAdaGradSGDRule::LoadConfig(const SparseCommonSGDRuleParameter& param,
     _min_bound = adagrad_param.weight_bounds(0);
     _max_bound = adagrad_param.weight_bounds(1);
   }
+  _batch_kernel = SelectBatchKernel<StdAdaGradKernel>(_embedding_dim);
 }
 
 void StdAdaGradSGDRule::UpdateValueWork(float* w,
@@ -197,6 +423,7 @@ void SparseAdamSGDRule::LoadConfig(const SparseCommonSGDRuleParameter& param,
     _min_bound = adam_param.weight_bounds(0);
     _max_bound = adam_param.weight_bounds(1);
   }
+  _batch_kernel = SelectBatchKernel<AdamKernel>(_embedding_dim);
 }
 
 void SparseAdamSGDRule::UpdateValueWork(float* w,
@@ -271,6 +498,7 @@ void SparseSharedAdamSGDRule::LoadConfig(
     _min_bound = adam_param.weight_bounds(0);
     _max_bound = adam_param.weight_bounds(1);
   }
+  _batch_kernel = SelectBatchKernel<SharedAdamKernel>(_embedding_dim);
 }
 
 void SparseSharedAdamSGDRule::UpdateValueWork(float* w,
@@ -26,6 +26,24 @@
 namespace paddle {
 namespace distributed {
 
+// the config of a rule a batch kernel needs, see UpdateValueBatch
+struct SparseSGDKernelParam {
+  float learning_rate;
+  float initial_g2sum;
+  float beta1_decay_rate;
+  float beta2_decay_rate;
+  float ada_epsilon;
+  float min_bound;
+  float max_bound;
+};
+
+typedef void (*SparseSGDBatchKernel)(const SparseSGDKernelParam& param,
+                                     float** w,
+                                     float** sgd,
+                                     const float** push_value,
+                                     const float* scale,
+                                     size_t num);
+
 class SparseValueSGDRule {
  public:
   SparseValueSGDRule() {}
@@ -51,6 +69,21 @@ class SparseValueSGDRule {
                    float scale = 1) {
     UpdateValueWork(w, sgd, push_value, scale);
   }
+  // updates num values as UpdateValue(w[i], sgd[i], push_value[i], scale[i])
+  // does, with a kernel for the dim of the rule when it has one
+  void UpdateValueBatch(float** w,
+                        float** sgd,
+                        const float** push_value,
+                        const float* scale,
+                        size_t num) {
+    if (_batch_kernel != nullptr) {
+      _batch_kernel(KernelParam(), w, sgd, push_value, scale, num);
+      return;
+    }
+    for (size_t i = 0; i < num; ++i) {
+      UpdateValueWork(w[i], sgd[i], push_value[i], scale[i]);
+    }
+  }
   template <class T>
   void BoundValue(T& w) {  // NOLINT
     if (!(w >= _min_bound)) {
@@ -63,10 +96,16 @@ class SparseValueSGDRule {
   float& MaxBound() { return _max_bound; }
 
  protected:
+  virtual SparseSGDKernelParam KernelParam() {
+    return {0, 0, 0, 0, 0, _min_bound, _max_bound};
+  }
+
   float _min_bound;
   float _max_bound;
   float _initial_range;
   size_t _embedding_dim;
+  // set by LoadConfig for the dims with a kernel
+  SparseSGDBatchKernel _batch_kernel = nullptr;
 
  private:
   std::string _name;
@@ -85,6 +124,11 @@ class SparseNaiveSGDRule : public SparseValueSGDRule {
   virtual void InitValueWork(float* value, float* sgd, bool zero_init);
   virtual size_t Dim() { return 0; }
 
+ protected:
+  SparseSGDKernelParam KernelParam() override {
+    return {learning_rate_, 0, 0, 0, 0, _min_bound, _max_bound};
+  }
+
  private:
   float learning_rate_;
 };
@@ -101,6 +145,11 @@ class SparseAdaGradSGDRule : public SparseValueSGDRule {
   virtual size_t Dim() { return 1; }
   size_t G2SumIndex() { return 0; }
 
+ protected:
+  SparseSGDKernelParam KernelParam() override {
+    return {learning_rate_, _initial_g2sum, 0, 0, 0, _min_bound, _max_bound};
+  }
+
  private:
   float learning_rate_;
   float _initial_g2sum;
@@ -118,6 +167,11 @@ class StdAdaGradSGDRule : public SparseValueSGDRule {
   virtual size_t Dim() { return _embedding_dim; }
   size_t G2SumIndex() { return 0; }
 
+ protected:
+  SparseSGDKernelParam KernelParam() override {
+    return {learning_rate_, _initial_g2sum, 0, 0, 0, _min_bound, _max_bound};
+  }
+
  private:
   float learning_rate_;
   float _initial_g2sum;
@@ -139,6 +193,16 @@ class SparseAdamSGDRule : public SparseValueSGDRule {
   size_t Beta2PowIndex() { return Beta1PowIndex() + 1; }
 
  protected:
+  SparseSGDKernelParam KernelParam() override {
+    return {learning_rate_,
+            0,
+            _beta1_decay_rate,
+            _beta2_decay_rate,
+            _ada_epsilon,
+            _min_bound,
+            _max_bound};
+  }
+
   float learning_rate_;
   float _beta1_decay_rate;
   float _beta2_decay_rate;
@@ -161,6 +225,16 @@ class SparseSharedAdamSGDRule : public SparseValueSGDRule {
   size_t Beta2PowIndex() { return Beta1PowIndex() + 1; }
 
  protected:
+  SparseSGDKernelParam KernelParam() override {
+    return {learning_rate_,
+            0,
+            _beta1_decay_rate,
+            _beta2_decay_rate,
+            _ada_epsilon,
+            _min_bound,
+            _max_bound};
+  }
+
   float learning_rate_;
   float _beta1_decay_rate;
   float _beta2_decay_rate;
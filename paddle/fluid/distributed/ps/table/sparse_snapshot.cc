@@ -0,0 +1,208 @@
+// Copyright (c) 2022 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "paddle/fluid/distributed/ps/table/sparse_snapshot.h"
+
+#include <zlib.h>
+
+#include <cstring>
+
+#include "glog/logging.h"
+
+namespace paddle {
+namespace distributed {
+
+bool IsSparseSnapshot(const std::string& path) {
+  size_t len = strlen(SPARSE_SNAPSHOT_SUFFIX);
+  return path.size() >= len &&
+         path.compare(path.size() - len, len, SPARSE_SNAPSHOT_SUFFIX) == 0;
+}
+
+int SparseSnapshotWriter::WriteHeader(const SparseSnapshotHeader& header) {
+  _compress = header.compress != 0;
+  _block.reserve(_block_size + 4096);
+  return _channel->write(reinterpret_cast<const char*>(&header),
+                         sizeof(header));
+}
+
+int SparseSnapshotWriter::Append(uint64_t key,
+                                 const float* value,
+                                 uint32_t dim) {
+  _block.append(reinterpret_cast<const char*>(&key), sizeof(key));
+  _block.append(reinterpret_cast<const char*>(&dim), sizeof(dim));
+  _block.append(reinterpret_cast<const char*>(value), dim * sizeof(float));
+  ++_block_record_num;
+  ++_record_num;
+  if (_block.size() >= _block_size) {
+    return FlushBlock();
+  }
+  return 0;
+}
+
+int SparseSnapshotWriter::FlushBlock() {
+  if (_block_record_num == 0) {
+    return 0;
+  }
+  SparseSnapshotBlockHeader block_header;
+  block_header.record_num = _block_record_num;
+  block_header.raw_size = _block.size();
+  block_header.crc =
+      crc32(0L, reinterpret_cast<const Bytef*>(_block.data()), _block.size());
+  const std::string* stored = &_block;
+  if (_compress) {
+    uLongf size = compressBound(_block.size());
+    _compressed.resize(size);
+    if (compress2(reinterpret_cast<Bytef*>(&_compressed[0]),
+                  &size,
+                  reinterpret_cast<const Bytef*>(_block.data()),
+                  _block.size(),
+                  Z_BEST_SPEED) != Z_OK) {
+      LOG(ERROR) << "SparseSnapshotWriter compress failed";
+      return -1;
+    }
+    _compressed.resize(size);
+    stored = &_compressed;
+  }
+  block_header.stored_size = stored->size();
+  if (_channel->write(reinterpret_cast<const char*>(&block_header),
+                      sizeof(block_header)) != 0 ||
+      _channel->write(stored->data(), stored->size()) != 0) {
+    return -1;
+  }
+  _block_record_num = 0;
+  _block.clear();
+  return 0;
+}
+
+int SparseSnapshotWriter::Finish() {
+  if (FlushBlock() != 0) {
+    return -1;
+  }
+  SparseSnapshotBlockHeader end_header;
+  memset(&end_header, 0, sizeof(end_header));
+  if (_channel->write(reinterpret_cast<const char*>(&end_header),
+                      sizeof(end_header)) != 0) {
+    return -1;
+  }
+  return _channel->write(reinterpret_cast<const char*>(&_record_num),
+                         sizeof(_record_num));
+}
+
+int SparseSnapshotReader::ReadHeader(SparseSnapshotHeader* header) {
+  if (_channel->read(reinterpret_cast<char*>(header), sizeof(*header)) != 0 ||
+      memcmp(header->magic, SPARSE_SNAPSHOT_MAGIC, sizeof(header->magic)) !=
+          0) {
+    LOG(ERROR) << "not a sparse table snapshot";
+    return -1;
+  }
+  if (header->version != SPARSE_SNAPSHOT_VERSION) {
+    LOG(ERROR) << "sparse table snapshot version " << header->version
+               << " is not supported";
+    return -1;
+  }
+  header->accessor_class[sizeof(header->accessor_class) - 1] = '\0';
+  _compress = header->compress != 0;
+  return 0;
+}
+
+int SparseSnapshotReader::ReadBlock() {
+  SparseSnapshotBlockHeader block_header;
+  if (_channel->read(reinterpret_cast<char*>(&block_header),
+                     sizeof(block_header)) != 0) {
+    LOG(ERROR) << "sparse table snapshot is cut after " << _record_num
+               << " records";
+    return -1;
+  }
+  if (block_header.record_num == 0) {
+    uint64_t record_num = 0;
+    if (_channel->read(reinterpret_cast<char*>(&record_num),
+                       sizeof(record_num)) != 0) {
+      LOG(ERROR) << "sparse table snapshot is cut at its end";
+      return -1;
+    }
+    if (record_num != _record_num) {
+      LOG(ERROR) << "sparse table snapshot has " << _record_num
+                 << " records, expect " << record_num;
+      return -1;
+    }
+    _end = true;
+    return 1;
+  }
+  std::string* target = _compress ? &_stored : &_block;
+  target->resize(block_header.stored_size);
+  if (_channel->read(&(*target)[0], block_header.stored_size) != 0) {
+    LOG(ERROR) << "sparse table snapshot is cut after " << _record_num
+               << " records";
+    return -1;
+  }
+  if (_compress) {
+    uLongf size = block_header.raw_size;
+    _block.resize(size);
+    if (uncompress(reinterpret_cast<Bytef*>(&_block[0]),
+                   &size,
+                   reinterpret_cast<const Bytef*>(_stored.data()),
+                   _stored.size()) != Z_OK ||
+        size != block_header.raw_size) {
+      LOG(ERROR) << "sparse table snapshot block can not be uncompressed";
+      return -1;
+    }
+  } else if (block_header.raw_size != block_header.stored_size) {
+    LOG(ERROR) << "sparse table snapshot block size mismatch";
+    return -1;
+  }
+  if (crc32(0L, reinterpret_cast<const Bytef*>(_block.data()), _block.size()) !=
+      block_header.crc) {
+    LOG(ERROR) << "sparse table snapshot block checksum mismatch";
+    return -1;
+  }
+  _offset = 0;
+  _block_record_num = block_header.record_num;
+  _block_record_idx = 0;
+  return 0;
+}
+
+int SparseSnapshotReader::Next(uint64_t* key,
+                               const float** value,
+                               uint32_t* dim) {
+  if (_end) {
+    return 1;
+  }
+  if (_block_record_idx == _block_record_num) {
+    int ret = ReadBlock();
+    if (ret != 0) {
+      return ret;
+    }
+  }
+  const size_t head_size = sizeof(uint64_t) + sizeof(uint32_t);
+  if (_offset + head_size > _block.size()) {
+    LOG(ERROR) << "sparse table snapshot block is broken";
+    return -1;
+  }
+  memcpy(key, _block.data() + _offset, sizeof(uint64_t));
+  memcpy(dim, _block.data() + _offset + sizeof(uint64_t), sizeof(uint32_t));
+  _offset += head_size;
+  if (_offset + *dim * sizeof(float) > _block.size()) {
+    LOG(ERROR) << "sparse table snapshot block is broken";
+    return -1;
+  }
+  // records are 4-byte aligned in the block
+  *value = reinterpret_cast<const float*>(_block.data() + _offset);
+  _offset += *dim * sizeof(float);
+  ++_block_record_idx;
+  ++_record_num;
+  return 0;
+}
+
+}  // namespace distributed
+}  // namespace paddle
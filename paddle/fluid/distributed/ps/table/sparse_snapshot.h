@@ -0,0 +1,114 @@
+// Copyright (c) 2022 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include "paddle/fluid/distributed/common/afs_warpper.h"
+
+namespace paddle {
+namespace distributed {
+
+// A binary snapshot is the file of a sparse table shard saved with
+// binary_in_save, the floats of the values as they are in memory:
+//   SparseSnapshotHeader
+//   blocks of records, each a SparseSnapshotBlockHeader and its data,
+//     zlib compressed when the header says so. The records of a block are
+//     uint64 key, uint32 dim, dim floats.
+//   a block header of 0 records, then the uint64 number of records
+// Each block has the crc32 of its uncompressed data, and the number of
+// records at the end tells a complete file from a cut one.
+
+static const char SPARSE_SNAPSHOT_MAGIC[8] = {
+    'P', 'S', 'S', 'N', 'A', 'P', '\0', '\0'};
+static const uint32_t SPARSE_SNAPSHOT_VERSION = 1;
+static const char SPARSE_SNAPSHOT_SUFFIX[] = ".bin";
+
+struct SparseSnapshotHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t compress;   // 1 for zlib blocks
+  uint32_t value_dim;  // AccessorInfo.size / sizeof(float)
+  uint32_t mf_dim;     // AccessorInfo.mf_size / sizeof(float)
+  uint64_t table_id;
+  uint32_t file_idx;
+  int32_t save_param;
+  char accessor_class[64];
+};
+
+struct SparseSnapshotBlockHeader {
+  uint32_t record_num;
+  uint32_t raw_size;
+  uint32_t stored_size;
+  uint32_t crc;
+};
+
+// true if path is a binary snapshot by its name
+bool IsSparseSnapshot(const std::string& path);
+
+class SparseSnapshotWriter {
+ public:
+  // block_size is the uncompressed size a block is written at
+  explicit SparseSnapshotWriter(FsWriteChannel* channel,
+                                size_t block_size = 4 << 20)
+      : _channel(channel), _block_size(block_size) {}
+
+  // all the methods return 0, or -1 when the channel fails
+  int WriteHeader(const SparseSnapshotHeader& header);
+  int Append(uint64_t key, const float* value, uint32_t dim);
+  // writes the last block and the end of the file
+  int Finish();
+
+  uint64_t record_num() const { return _record_num; }
+
+ private:
+  int FlushBlock();
+
+  FsWriteChannel* _channel;
+  size_t _block_size;
+  bool _compress = false;
+  std::string _block;
+  std::string _compressed;
+  uint32_t _block_record_num = 0;
+  uint64_t _record_num = 0;
+};
+
+class SparseSnapshotReader {
+ public:
+  explicit SparseSnapshotReader(FsReadChannel* channel) : _channel(channel) {}
+
+  // -1 if the file is not a binary snapshot of this version
+  int ReadHeader(SparseSnapshotHeader* header);
+  // 0 with the next record, whose value is valid until the next call, 1 at
+  // the end of the file, -1 when the file is cut or a checksum is wrong
+  int Next(uint64_t* key, const float** value, uint32_t* dim);
+
+ private:
+  int ReadBlock();
+
+  FsReadChannel* _channel;
+  bool _compress = false;
+  std::string _block;
+  std::string _stored;
+  size_t _offset = 0;
+  uint32_t _block_record_num = 0;
+  uint32_t _block_record_idx = 0;
+  uint64_t _record_num = 0;
+  bool _end = false;
+};
+
+}  // namespace distributed
+}  // namespace paddle
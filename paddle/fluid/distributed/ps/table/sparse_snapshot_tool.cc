@@ -0,0 +1,166 @@
+// Copyright (c) 2022 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Converts a part file of a sparse table between the text format and the
+// binary snapshot of binary_in_save, e.g. to read a binary checkpoint or to
+// load a text one faster. --table_conf is the TableParameter of the table in
+// text format, its accessor parses and prints the values.
+//   ./sparse_snapshot_tool --mode=to_text --table_conf=table.prototxt \
+//       --input=part-000-00000.bin --output=part-000-00000.gz
+
+#include <google/protobuf/text_format.h>
+
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "gflags/gflags.h"
+#include "glog/logging.h"
+#include "paddle/fluid/distributed/ps/table/accessor.h"
+#include "paddle/fluid/distributed/ps/table/sparse_snapshot.h"
+#include "paddle/fluid/distributed/the_one_ps.pb.h"
+#include "paddle/fluid/framework/io/fs.h"
+#include "paddle/fluid/string/string_helper.h"
+
+DEFINE_string(mode, "to_text", "to_text or to_binary");
+DEFINE_string(input, "", "File to convert.");
+DEFINE_string(output, "", "Converted file, .gz for compressed text.");
+DEFINE_string(table_conf, "", "TableParameter of the table, in text format.");
+DEFINE_int32(save_param, 0, "save_param recorded in a binary snapshot.");
+DEFINE_bool(compress, true, "Compress the blocks of a binary snapshot.");
+
+namespace paddle {
+namespace distributed {
+
+static ValueAccessor* CreateAccessor(const TableParameter& table) {
+  auto* accessor =
+      CREATE_PSCORE_CLASS(ValueAccessor, table.accessor().accessor_class());
+  CHECK(accessor != nullptr)
+      << "unknown accessor " << table.accessor().accessor_class();
+  CHECK(accessor->Configure(table.accessor()) == 0 &&
+        accessor->Initialize() == 0)
+      << "accessor " << table.accessor().accessor_class()
+      << " initialize failed";
+  return accessor;
+}
+
+static int ToText(ValueAccessor* accessor) {
+  int err_no = 0;
+  FsReadChannel reader_channel;
+  FsWriteChannel writer_channel;
+  FsChannelConfig config;
+  reader_channel.open(framework::fs_open_read(FLAGS_input, &err_no, ""),
+                      config);
+  writer_channel.open(framework::fs_open_write(FLAGS_output, &err_no, ""),
+                      config);
+  SparseSnapshotReader reader(&reader_channel);
+  SparseSnapshotHeader header;
+  if (reader.ReadHeader(&header) != 0) {
+    return -1;
+  }
+  LOG(INFO) << FLAGS_input << ": table " << header.table_id << ", "
+            << header.accessor_class << " value_dim " << header.value_dim
+            << " mf_dim " << header.mf_dim << ", save_param "
+            << header.save_param;
+  uint64_t key = 0;
+  const float* value = nullptr;
+  uint32_t dim = 0;
+  int ret = 0;
+  while ((ret = reader.Next(&key, &value, &dim)) == 0) {
+    std::string format_value = accessor->ParseToString(value, dim);
+    if (writer_channel.write_line(paddle::string::format_string(
+            "%lu %s", key, format_value.c_str())) != 0) {
+      LOG(ERROR) << "write " << FLAGS_output << " failed";
+      return -1;
+    }
+  }
+  writer_channel.close();
+  return ret < 0 || err_no != 0 ? -1 : 0;
+}
+
+static int ToBinary(const TableParameter& table, ValueAccessor* accessor) {
+  int err_no = 0;
+  FsReadChannel reader_channel;
+  FsWriteChannel writer_channel;
+  FsChannelConfig config;
+  reader_channel.open(framework::fs_open_read(FLAGS_input, &err_no, ""),
+                      config);
+  writer_channel.open(framework::fs_open_write(FLAGS_output, &err_no, ""),
+                      config);
+  SparseSnapshotHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, SPARSE_SNAPSHOT_MAGIC, sizeof(header.magic));
+  header.version = SPARSE_SNAPSHOT_VERSION;
+  header.compress = FLAGS_compress ? 1 : 0;
+  header.value_dim = accessor->GetAccessorInfo().size / sizeof(float);
+  header.mf_dim = accessor->GetAccessorInfo().mf_size / sizeof(float);
+  header.table_id = table.table_id();
+  header.save_param = FLAGS_save_param;
+  snprintf(header.accessor_class,
+           sizeof(header.accessor_class),
+           "%s",
+           table.accessor().accessor_class().c_str());
+
+  SparseSnapshotWriter writer(&writer_channel);
+  if (writer.WriteHeader(header) != 0) {
+    return -1;
+  }
+  std::vector<float> value(header.value_dim);
+  std::string line;
+  char* end = nullptr;
+  while (reader_channel.read_line(line) == 0 && line.size() > 1) {
+    uint64_t key = std::strtoul(line.data(), &end, 10);
+    int dim = accessor->ParseFromString(++end, value.data());
+    if (writer.Append(key, value.data(), dim) != 0) {
+      LOG(ERROR) << "write " << FLAGS_output << " failed";
+      return -1;
+    }
+  }
+  if (writer.Finish() != 0) {
+    return -1;
+  }
+  writer_channel.close();
+  LOG(INFO) << FLAGS_output << ": " << writer.record_num() << " records";
+  return err_no != 0 ? -1 : 0;
+}
+
+static int Run() {
+  std::ifstream conf(FLAGS_table_conf);
+  CHECK(conf.good()) << "can not open " << FLAGS_table_conf;
+  std::stringstream conf_text;
+  conf_text << conf.rdbuf();
+  TableParameter table;
+  CHECK(google::protobuf::TextFormat::ParseFromString(conf_text.str(), &table))
+      << "can not parse " << FLAGS_table_conf;
+  std::unique_ptr<ValueAccessor> accessor(CreateAccessor(table));
+  if (FLAGS_mode == "to_text") {
+    return ToText(accessor.get());
+  } else if (FLAGS_mode == "to_binary") {
+    return ToBinary(table, accessor.get());
+  }
+  LOG(ERROR) << "unknown mode " << FLAGS_mode;
+  return -1;
+}
+
+}  // namespace distributed
+}  // namespace paddle
+
+int main(int argc, char* argv[]) {
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  google::InitGoogleLogging(argv[0]);
+  return paddle::distributed::Run() == 0 ? 0 : -1;
+}
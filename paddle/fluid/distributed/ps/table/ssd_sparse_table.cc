@@ -14,6 +14,9 @@
 
 #include "paddle/fluid/distributed/ps/table/ssd_sparse_table.h"
 
+#include <algorithm>
+#include <chrono>  // NOLINT
+
 #include "paddle/fluid/distributed/common/cost_timer.h"
 #include "paddle/fluid/distributed/common/local_random.h"
 #include "paddle/fluid/distributed/common/topk_calculator.h"
@@ -30,10 +33,59 @@ DEFINE_int32(pserver_load_batch_size, 5000, "load batch size for ssd");
 namespace paddle {
 namespace distributed {
 
+// keys of a Prefetch a task of a shard loads, so that pulls wait for a
+// part of the keys at most
+static const size_t kPrefetchBatch = 4096;
+
+static uint64_t MicrosSince(std::chrono::steady_clock::time_point begin) {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+             std::chrono::steady_clock::now() - begin)
+      .count();
+}
+
 int32_t SSDSparseTable::Initialize() {
   MemorySparseTable::Initialize();
+  if (_track_changed_keys) {
+    // the pulls and pushes of the values in rocksdb do not touch the keys,
+    // the xbox delta saves would miss them
+    LOG(WARNING) << "SSDSparseTable does not support track_changed_keys, "
+                 << "it is disabled, table_id:" << _config.table_id();
+    _track_changed_keys = false;
+  }
   _db = paddle::distributed::RocksDBHandler::GetInstance();
-  _db->initialize(FLAGS_rocksdb_path, _real_local_shard_num);
+  // the keys of a column family depend on all of them, a db of another
+  // layout is not reopened
+  std::string layout = paddle::string::format_string(
+      "local_shard_num:%d shard_num:%d server:%lu/%lu",
+      _real_local_shard_num,
+      _sparse_table_shard_num,
+      _shard_idx,
+      _shard_num);
+  if (_db->initialize(FLAGS_rocksdb_path,
+                      _real_local_shard_num,
+                      _config.rocksdb_param(),
+                      layout) != 0) {
+    LOG(ERROR) << "SSDSparseTable rocksdb initialize failed, path:"
+               << FLAGS_rocksdb_path;
+    return -1;
+  }
+
+  _cache_policy = _config.ssd_cache_policy();
+  if (_cache_policy != SSD_CACHE_UNSEEN_DAYS && _real_local_shard_num > 0) {
+    _shard_mem_keys =
+        (_config.ssd_cache_mem_keys() + _real_local_shard_num - 1) /
+        _real_local_shard_num;
+  }
+  _admit_scores.assign(_real_local_shard_num, 0.0f);
+  if (_cache_policy == SSD_CACHE_TINYLFU && _shard_mem_keys > 0) {
+    _sketches.resize(_real_local_shard_num);
+    for (auto& sketch : _sketches) {
+      sketch.Resize(_shard_mem_keys);
+    }
+  }
+  LOG(INFO) << "SSDSparseTable cache policy:"
+            << SSDCachePolicy_Name(_cache_policy)
+            << " shard mem keys:" << _shard_mem_keys;
   return 0;
 }
 
@@ -102,22 +154,30 @@ int32_t SSDSparseTable::PullSparse(float* pull_values,
                 auto& local_shard = _local_shards[shard_id];
                 float data_buffer[value_size];  // NOLINT
                 float* data_buffer_ptr = data_buffer;
+                SSDCacheStat stat;
                 for (size_t i = 0; i < keys.size(); ++i) {
                   uint64_t key = keys[i].first;
+                  if (!_sketches.empty()) {
+                    _sketches[shard_id].Increment(key);
+                  }
                   auto itr = local_shard.find(key);
                   size_t data_size = value_size - mf_value_size;
                   if (itr == local_shard.end()) {
                     // pull rocksdb
                     std::string tmp_string("");
-                    if (_db->get(shard_id,
-                                 reinterpret_cast<char*>(&key),
-                                 sizeof(uint64_t),
-                                 tmp_string) > 0) {
+                    auto read_begin = std::chrono::steady_clock::now();
+                    int not_found = _db->get(shard_id,
+                                             reinterpret_cast<char*>(&key),
+                                             sizeof(uint64_t),
+                                             tmp_string);
+                    stat.ssd_read_us += MicrosSince(read_begin);
+                    if (not_found > 0) {
                       ++missed_keys;
+                      ++stat.miss;
                       if (FLAGS_pserver_create_value_when_push) {
                         memset(data_buffer, 0, sizeof(float) * data_size);
                       } else {
-                        auto& feature_value = local_shard[key];
+                        auto feature_value = local_shard[key];
                         feature_value.resize(data_size);
                         float* data_ptr =
                             const_cast<float*>(feature_value.data());
@@ -127,12 +187,13 @@ int32_t SSDSparseTable::PullSparse(float* pull_values,
                                data_size * sizeof(float));
                       }
                     } else {
+                      ++stat.ssd_hit;
                       data_size = tmp_string.size() / sizeof(float);
                       memcpy(data_buffer_ptr,
                              paddle::string::str_to_float(tmp_string),
                              data_size * sizeof(float));
                       // from rocksdb to mem
-                      auto& feature_value = local_shard[key];
+                      auto feature_value = local_shard[key];
                       feature_value.resize(data_size);
                       memcpy(const_cast<float*>(feature_value.data()),
                              data_buffer_ptr,
@@ -142,6 +203,7 @@ int32_t SSDSparseTable::PullSparse(float* pull_values,
                                     sizeof(uint64_t));
                     }
                   } else {
+                    ++stat.mem_hit;
                     data_size = itr.value().size();
                     memcpy(data_buffer_ptr,
                            itr.value().data(),
@@ -157,6 +219,7 @@ int32_t SSDSparseTable::PullSparse(float* pull_values,
                   _value_accesor->Select(
                       &select_data, (const float**)&data_buffer_ptr, 1);
                 }
+                AddCacheStat(stat);
                 return 0;
               });
     }
@@ -203,34 +266,43 @@ int32_t SSDSparseTable::PullSparsePtr(char** pull_values,
                 auto& local_shard = _local_shards[shard_id];
                 float data_buffer[value_size];  // NOLINT
                 float* data_buffer_ptr = data_buffer;
+                SSDCacheStat stat;
                 for (size_t i = 0; i < keys.size(); ++i) {
                   uint64_t key = keys[i].first;
+                  if (!_sketches.empty()) {
+                    _sketches[shard_id].Increment(key);
+                  }
                   auto itr = local_shard.find(key);
                   size_t data_size = value_size - mf_value_size;
-                  FixedFeatureValue* ret = NULL;
                   if (itr == local_shard.end()) {
                     // pull rocksdb
                     std::string tmp_string("");
-                    if (_db->get(shard_id,
-                                 reinterpret_cast<char*>(&key),
-                                 sizeof(uint64_t),
-                                 tmp_string) > 0) {
+                    auto read_begin = std::chrono::steady_clock::now();
+                    int not_found = _db->get(shard_id,
+                                             reinterpret_cast<char*>(&key),
+                                             sizeof(uint64_t),
+                                             tmp_string);
+                    stat.ssd_read_us += MicrosSince(read_begin);
+                    if (not_found > 0) {
                       ++missed_keys;
-                      auto& feature_value = local_shard[key];
+                      ++stat.miss;
+                      itr = local_shard.emplace(key).first;
+                      auto feature_value = itr.value();
                       feature_value.resize(data_size);
                       float* data_ptr =
                           const_cast<float*>(feature_value.data());
                       _value_accesor->Create(&data_buffer_ptr, 1);
                       memcpy(
                           data_ptr, data_buffer_ptr, data_size * sizeof(float));
-                      ret = &feature_value;
                     } else {
+                      ++stat.ssd_hit;
                       data_size = tmp_string.size() / sizeof(float);
                       memcpy(data_buffer_ptr,
                              paddle::string::str_to_float(tmp_string),
                              data_size * sizeof(float));
                       // from rocksdb to mem
-                      auto& feature_value = local_shard[key];
+                      itr = local_shard.emplace(key).first;
+                      auto feature_value = itr.value();
                       feature_value.resize(data_size);
                       memcpy(const_cast<float*>(feature_value.data()),
                              data_buffer_ptr,
@@ -238,14 +310,15 @@ int32_t SSDSparseTable::PullSparsePtr(char** pull_values,
                       _db->del_data(shard_id,
                                     reinterpret_cast<char*>(&key),
                                     sizeof(uint64_t));
-                      ret = &feature_value;
                     }
                   } else {
-                    ret = itr.value_ptr();
+                    ++stat.mem_hit;
                   }
+                  FixedFeatureValue* ret = local_shard.pin(itr);
                   int pull_data_idx = keys[i].second;
                   pull_values[pull_data_idx] = reinterpret_cast<char*>(ret);
                 }
+                AddCacheStat(stat);
                 return 0;
               });
     }
@@ -304,7 +377,7 @@ int32_t SSDSparseTable::PushSparse(const uint64_t* keys,
                       continue;
                     }
                     auto value_size = value_col - mf_value_col;
-                    auto& feature_value = local_shard[key];
+                    auto feature_value = local_shard[key];
                     feature_value.resize(value_size);
                     _value_accesor->Create(&data_buffer_ptr, 1);
                     memcpy(const_cast<float*>(feature_value.data()),
@@ -312,7 +385,7 @@ int32_t SSDSparseTable::PushSparse(const uint64_t* keys,
                            value_size * sizeof(float));
                     itr = local_shard.find(key);
                   }
-                  auto& feature_value = itr.value();
+                  auto feature_value = itr.value();
                   float* value_data = const_cast<float*>(feature_value.data());
                   size_t value_size = feature_value.size();
 
@@ -409,7 +482,7 @@ int32_t SSDSparseTable::PushSparse(const uint64_t* keys,
                       continue;
                     }
                     auto value_size = value_col - mf_value_col;
-                    auto& feature_value = local_shard[key];
+                    auto feature_value = local_shard[key];
                     feature_value.resize(value_size);
                     _value_accesor->Create(&data_buffer_ptr, 1);
                     memcpy(const_cast<float*>(feature_value.data()),
@@ -417,7 +490,7 @@ int32_t SSDSparseTable::PushSparse(const uint64_t* keys,
                            value_size * sizeof(float));
                     itr = local_shard.find(key);
                   }
-                  auto& feature_value = itr.value();
+                  auto feature_value = itr.value();
                   float* value_data = const_cast<float*>(feature_value.data());
                   size_t value_size = feature_value.size();
 
@@ -450,7 +523,144 @@ int32_t SSDSparseTable::PushSparse(const uint64_t* keys,
   return 0;
 }
 
+int32_t SSDSparseTable::Prefetch(const uint64_t* keys, size_t num) {
+  std::vector<std::vector<uint64_t>> task_keys(_real_local_shard_num);
+  for (size_t i = 0; i < num; ++i) {
+    int shard_id = (keys[i] % _sparse_table_shard_num) % _avg_local_shard_num;
+    task_keys[shard_id].push_back(keys[i]);
+  }
+  _prefetch_key += num;
+
+  std::lock_guard<std::mutex> lock(_prefetch_mutex);
+  _prefetch_tasks.erase(
+      std::remove_if(_prefetch_tasks.begin(),
+                     _prefetch_tasks.end(),
+                     [](const std::future<int>& task) {
+                       return task.wait_for(std::chrono::seconds(0)) ==
+                              std::future_status::ready;
+                     }),
+      _prefetch_tasks.end());
+  for (int shard_id = 0; shard_id < _real_local_shard_num; ++shard_id) {
+    auto& shard_keys = task_keys[shard_id];
+    for (size_t begin = 0; begin < shard_keys.size(); begin += kPrefetchBatch) {
+      size_t end = std::min(begin + kPrefetchBatch, shard_keys.size());
+      auto batch_keys = std::make_shared<std::vector<uint64_t>>(
+          shard_keys.begin() + begin, shard_keys.begin() + end);
+      _prefetch_tasks.push_back(
+          _shards_task_pool[shard_id % _shards_task_pool.size()]->enqueue(
+              [this, shard_id, batch_keys]() -> int {
+                PrefetchShard(shard_id, *batch_keys);
+                return 0;
+              }));
+    }
+  }
+  return 0;
+}
+
+void SSDSparseTable::PrefetchShard(int shard_id,
+                                   const std::vector<uint64_t>& keys) {
+  auto& local_shard = _local_shards[shard_id];
+  std::vector<uint64_t> cold_keys;
+  for (auto key : keys) {
+    if (local_shard.find(key) == local_shard.end()) {
+      cold_keys.push_back(key);
+    }
+  }
+  std::sort(cold_keys.begin(), cold_keys.end());
+  cold_keys.erase(std::unique(cold_keys.begin(), cold_keys.end()),
+                  cold_keys.end());
+  std::vector<rocksdb::Slice> db_keys;
+  db_keys.reserve(cold_keys.size());
+  for (auto& key : cold_keys) {
+    db_keys.emplace_back(reinterpret_cast<char*>(&key), sizeof(uint64_t));
+  }
+  std::vector<std::string> db_values;
+  std::vector<int> found;
+  _db->multi_get(shard_id, db_keys, &db_values, &found);
+
+  SSDCacheStat stat;
+  for (size_t i = 0; i < cold_keys.size(); ++i) {
+    if (!found[i]) {
+      continue;
+    }
+    uint64_t key = cold_keys[i];
+    float* data = paddle::string::str_to_float(db_values[i]);
+    if (_shard_mem_keys > 0 && local_shard.size() >= _shard_mem_keys &&
+        CacheScore(shard_id, key, data) <= _admit_scores[shard_id]) {
+      ++stat.prefetch_reject;
+      continue;
+    }
+    size_t data_size = db_values[i].size() / sizeof(float);
+    auto feature_value = local_shard.emplace(key).first.value();
+    feature_value.resize(data_size);
+    memcpy(const_cast<float*>(feature_value.data()),
+           data,
+           data_size * sizeof(float));
+    _db->del_data(shard_id, reinterpret_cast<char*>(&key), sizeof(uint64_t));
+    ++stat.prefetch_load;
+  }
+  AddCacheStat(stat);
+}
+
+void SSDSparseTable::WaitPrefetchDone() {
+  std::vector<std::future<int>> tasks;
+  {
+    std::lock_guard<std::mutex> lock(_prefetch_mutex);
+    tasks.swap(_prefetch_tasks);
+  }
+  for (auto& task : tasks) {
+    task.wait();
+  }
+}
+
+float SSDSparseTable::CacheScore(int shard_id, uint64_t key, float* value) {
+  if (_cache_policy == SSD_CACHE_TINYLFU) {
+    return _sketches[shard_id].Estimate(key);
+  }
+  return _value_accesor->GetField(value, "show");
+}
+
+void SSDSparseTable::AddCacheStat(const SSDCacheStat& stat) {
+  _mem_hit += stat.mem_hit;
+  _ssd_hit += stat.ssd_hit;
+  _miss += stat.miss;
+  _ssd_read_us += stat.ssd_read_us;
+  _prefetch_load += stat.prefetch_load;
+  _prefetch_reject += stat.prefetch_reject;
+  _evict += stat.evict;
+}
+
+SSDCacheStat SSDSparseTable::CacheStat() {
+  SSDCacheStat stat;
+  stat.mem_hit = _mem_hit;
+  stat.ssd_hit = _ssd_hit;
+  stat.miss = _miss;
+  stat.ssd_read_us = _ssd_read_us;
+  stat.prefetch_key = _prefetch_key;
+  stat.prefetch_load = _prefetch_load;
+  stat.prefetch_reject = _prefetch_reject;
+  stat.evict = _evict;
+  return stat;
+}
+
+std::pair<int64_t, int64_t> SSDSparseTable::PrintTableStat() {
+  SSDCacheStat stat = CacheStat();
+  uint64_t ssd_reads = stat.ssd_hit + stat.miss;
+  LOG(INFO) << "SSDSparseTable table_id:" << _config.table_id()
+            << " mem_hit:" << stat.mem_hit << " ssd_hit:" << stat.ssd_hit
+            << " miss:" << stat.miss << " ssd_read_avg_us:"
+            << (ssd_reads > 0 ? static_cast<double>(stat.ssd_read_us) /
+                                    ssd_reads
+                              : 0.0)
+            << " prefetch_key:" << stat.prefetch_key
+            << " prefetch_load:" << stat.prefetch_load
+            << " prefetch_reject:" << stat.prefetch_reject
+            << " evict:" << stat.evict;
+  return MemorySparseTable::PrintTableStat();
+}
+
 int32_t SSDSparseTable::Shrink(const std::string& param) {
+  WaitPrefetchDone();
 #if defined(PADDLE_WITH_MKLML)
   int thread_num = _real_local_shard_num < 20 ? _real_local_shard_num : 20;
   omp_set_num_threads(thread_num);
@@ -492,28 +702,77 @@ int32_t SSDSparseTable::Shrink(const std::string& param) {
   return 0;
 }
 
-int32_t SSDSparseTable::UpdateTable() {
-  // TODO implement with multi-thread
-  int count = 0;
+void SSDSparseTable::Clear() {
+  WaitPrefetchDone();
   for (int i = 0; i < _real_local_shard_num; ++i) {
-    auto& shard = _local_shards[i];
-    // from mem to ssd
-    for (auto it = shard.begin(); it != shard.end();) {
-      if (_value_accesor->SaveSSD(it.value().data())) {
-        _db->put(i,
-                 (char*)&it.key(),
-                 sizeof(uint64_t),
-                 (char*)it.value().data(),
-                 it.value().size() * sizeof(float));
-        count++;
-        it = shard.erase(it);
-      } else {
-        ++it;
-      }
-    }
-    _db->flush(i);
+    _local_shards[i].clear();
+    _db->clear(i);
+    _admit_scores[i] = 0.0f;
+  }
+  for (auto& sketch : _sketches) {
+    sketch.Resize(_shard_mem_keys);
+  }
+}
+
+int32_t SSDSparseTable::UpdateTable() {
+  WaitPrefetchDone();
+  std::atomic<int64_t> count{0};
+  std::vector<std::future<int>> tasks(_real_local_shard_num);
+  for (int shard_id = 0; shard_id < _real_local_shard_num; ++shard_id) {
+    tasks[shard_id] =
+        _shards_task_pool[shard_id % _shards_task_pool.size()]->enqueue(
+            [this, shard_id, &count]() -> int {
+              auto& shard = _local_shards[shard_id];
+              int64_t shard_count = 0;
+              // from mem to ssd
+              for (auto it = shard.begin(); it != shard.end();) {
+                if (_value_accesor->SaveSSD(it.value().data())) {
+                  _db->put(shard_id,
+                           (char*)&it.key(),
+                           sizeof(uint64_t),
+                           (char*)it.value().data(),
+                           it.value().size() * sizeof(float));
+                  ++shard_count;
+                  it = shard.erase(it);
+                } else {
+                  ++it;
+                }
+              }
+              // over the memory limit the values of the lowest score too
+              if (_shard_mem_keys > 0 && shard.size() > _shard_mem_keys) {
+                std::vector<std::pair<float, uint64_t>> scores;
+                scores.reserve(shard.size());
+                for (auto it = shard.begin(); it != shard.end(); ++it) {
+                  scores.emplace_back(
+                      CacheScore(shard_id, it.key(), it.value().data()),
+                      it.key());
+                }
+                size_t evict_num = shard.size() - _shard_mem_keys;
+                std::nth_element(scores.begin(),
+                                 scores.begin() + evict_num - 1,
+                                 scores.end());
+                for (size_t i = 0; i < evict_num; ++i) {
+                  auto it = shard.find(scores[i].second);
+                  _db->put(shard_id,
+                           reinterpret_cast<char*>(&scores[i].second),
+                           sizeof(uint64_t),
+                           reinterpret_cast<char*>(it.value().data()),
+                           it.value().size() * sizeof(float));
+                  shard.erase(it);
+                }
+                _admit_scores[shard_id] = scores[evict_num - 1].first;
+                _evict += evict_num;
+                shard_count += evict_num;
+              }
+              _db->flush(shard_id);
+              count += shard_count;
+              return 0;
+            });
+  }
+  for (auto& task : tasks) {
+    task.wait();
   }
-  LOG(INFO) << "Table>> update count: " << count;
+  LOG(INFO) << "Table>> update count: " << count.load();
   return 0;
 }
 
@@ -528,6 +787,7 @@ int64_t SSDSparseTable::LocalSize() {
 
 int32_t SSDSparseTable::Save(const std::string& path,
                              const std::string& param) {
+  WaitPrefetchDone();
   if (_real_local_shard_num == 0) {
     _local_show_threshold = -1;
     return 0;
@@ -702,6 +962,7 @@ int64_t SSDSparseTable::CacheShuffle(
     paddle::framework::Channel<std::pair<uint64_t, std::string>>&
         shuffled_channel,
     const std::vector<Table*>& table_ptrs) {
+  WaitPrefetchDone();
   LOG(INFO) << "cache shuffle with cache threshold: " << cache_threshold
             << " param:" << param;
   int save_param = atoi(param.c_str());  // batch_model:0  xbox:1
@@ -860,7 +1121,41 @@ int32_t SSDSparseTable::SaveCache(
 
 int32_t SSDSparseTable::Load(const std::string& path,
                              const std::string& param) {
-  return MemorySparseTable::Load(path, param);
+  WaitPrefetchDone();
+  int32_t ret = MemorySparseTable::Load(path, param);
+  if (ret != 0 || !_db->reopened()) {
+    return ret;
+  }
+#if defined(PADDLE_WITH_MKLML)
+  int thread_num = _real_local_shard_num < 20 ? _real_local_shard_num : 20;
+  omp_set_num_threads(thread_num);
+#pragma omp parallel for schedule(dynamic)
+#endif
+  for (int i = 0; i < _real_local_shard_num; ++i) {
+    DropMemKeysFromDb(i);
+  }
+  return ret;
+}
+
+void SSDSparseTable::DropMemKeysFromDb(int shard_id) {
+  auto& shard = _local_shards[shard_id];
+  std::vector<uint64_t> tmp_key;
+  std::vector<std::pair<char*, int>> ssd_keys;
+  tmp_key.reserve(FLAGS_pserver_load_batch_size);
+  ssd_keys.reserve(FLAGS_pserver_load_batch_size);
+  for (auto it = shard.begin(); it != shard.end(); ++it) {
+    tmp_key.emplace_back(it.key());
+    ssd_keys.emplace_back(
+        std::make_pair((char*)&tmp_key.back(), sizeof(uint64_t)));
+    if (static_cast<int>(ssd_keys.size()) == FLAGS_pserver_load_batch_size) {
+      _db->del_batch(shard_id, ssd_keys, ssd_keys.size());
+      ssd_keys.clear();
+      tmp_key.clear();
+    }
+  }
+  if (ssd_keys.size() > 0) {
+    _db->del_batch(shard_id, ssd_keys, ssd_keys.size());
+  }
 }
 
 //加载path目录下数据[start_idx, end_idx)
@@ -868,6 +1163,7 @@ int32_t SSDSparseTable::Load(size_t start_idx,
                              size_t end_idx,
                              const std::vector<std::string>& file_list,
                              const std::string& param) {
+  WaitPrefetchDone();
   if (start_idx >= file_list.size()) {
     return 0;
   }
@@ -880,6 +1176,21 @@ int32_t SSDSparseTable::Load(size_t start_idx,
   end_idx = static_cast<int>(end_idx) < _sparse_table_shard_num
                 ? end_idx
                 : _sparse_table_shard_num;
+  // ingested sst files are better few and big, the batch puts small
+  const auto& rocksdb_param = _config.rocksdb_param();
+  bool ingest = rocksdb_param.ingest_on_load();
+  int batch_size = ingest ? rocksdb_param.ingest_batch_keys()
+                          : FLAGS_pserver_load_batch_size;
+  auto write_batch = [this, ingest](
+                         int shard_id,
+                         std::vector<std::pair<char*, int>>& keys,
+                         std::vector<std::pair<char*, int>>& values) {
+    // a batch that fails to ingest is put instead
+    if (!ingest ||
+        _db->ingest_batch(shard_id, keys, values, keys.size()) != 0) {
+      _db->put_batch(shard_id, keys, values, keys.size());
+    }
+  };
 #if defined(PADDLE_WITH_MKLML)
   int thread_num = (end_idx - start_idx) < 20 ? (end_idx - start_idx) : 20;
   omp_set_num_threads(thread_num);
@@ -898,9 +1209,9 @@ int32_t SSDSparseTable::Load(size_t start_idx,
     std::vector<std::pair<char*, int>> ssd_keys;
     std::vector<std::pair<char*, int>> ssd_values;
     std::vector<uint64_t> tmp_key;
-    ssd_keys.reserve(FLAGS_pserver_load_batch_size);
-    ssd_values.reserve(FLAGS_pserver_load_batch_size);
-    tmp_key.reserve(FLAGS_pserver_load_batch_size);
+    ssd_keys.reserve(batch_size);
+    ssd_values.reserve(batch_size);
+    tmp_key.reserve(batch_size);
     do {
       ssd_keys.clear();
       ssd_values.clear();
@@ -912,8 +1223,8 @@ int32_t SSDSparseTable::Load(size_t start_idx,
       char* end = NULL;
       int local_shard_id = i % _avg_local_shard_num;
       auto& shard = _local_shards[local_shard_id];
-      float data_buffer[FLAGS_pserver_load_batch_size * feature_value_size];
-      float* data_buffer_ptr = data_buffer;
+      std::vector<float> data_buffer(batch_size * feature_value_size);
+      float* data_buffer_ptr = data_buffer.data();
       uint64_t mem_count = 0;
       uint64_t ssd_count = 0;
       uint64_t mem_mf_count = 0;
@@ -942,21 +1253,19 @@ int32_t SSDSparseTable::Load(size_t start_idx,
             ssd_values.emplace_back(std::make_pair((char*)data_buffer_ptr,
                                                    value_size * sizeof(float)));
             data_buffer_ptr += feature_value_size;
-            if (static_cast<int>(ssd_keys.size()) ==
-                FLAGS_pserver_load_batch_size) {
-              _db->put_batch(
-                  local_shard_id, ssd_keys, ssd_values, ssd_keys.size());
+            if (static_cast<int>(ssd_keys.size()) == batch_size) {
+              write_batch(local_shard_id, ssd_keys, ssd_values);
               ssd_keys.clear();
               ssd_values.clear();
               tmp_key.clear();
-              data_buffer_ptr = data_buffer;
+              data_buffer_ptr = data_buffer.data();
             }
             ssd_count++;
             if (value_size > feature_value_size - mf_value_size) {
               ssd_mf_count++;
             }
           } else {
-            auto& value = shard[key];
+            auto value = shard[key];
             value.resize(value_size);
             _value_accesor->ParseFromString(end, value.data());
             mem_count++;
@@ -967,7 +1276,7 @@ int32_t SSDSparseTable::Load(size_t start_idx,
         }
         // last batch
         if (ssd_keys.size() > 0) {
-          _db->put_batch(local_shard_id, ssd_keys, ssd_values, ssd_keys.size());
+          write_batch(local_shard_id, ssd_keys, ssd_values);
         }
         read_channel->close();
         if (err_no == -1) {
@@ -978,7 +1287,13 @@ int32_t SSDSparseTable::Load(size_t start_idx,
           continue;
         }
 
+        if (_db->reopened()) {
+          DropMemKeysFromDb(local_shard_id);
+        }
         _db->flush(local_shard_id);
+        if (rocksdb_param.compact_after_load()) {
+          _db->compact(local_shard_id);
+        }
         LOG(INFO) << "Table>> load done. ALL[" << mem_count + ssd_count
                   << "] MEM[" << mem_count << "] MEM_MF[" << mem_mf_count
                   << "] SSD[" << ssd_count << "] SSD_MF[" << ssd_mf_count
@@ -14,18 +14,42 @@
 
 #pragma once
 
+#include <atomic>
+#include <future>
+#include <mutex>  // NOLINT
+#include <vector>
+
 #include "gflags/gflags.h"
+#include "paddle/fluid/distributed/ps/table/depends/frequency_sketch.h"
 #include "paddle/fluid/distributed/ps/table/depends/rocksdb_warpper.h"
 #include "paddle/fluid/distributed/ps/table/memory_sparse_table.h"
 
 namespace paddle {
 namespace distributed {
 
+// where the keys of the pulls of an SSDSparseTable were found, and what the
+// prefetches and the cache policy moved
+struct SSDCacheStat {
+  uint64_t mem_hit = 0;
+  uint64_t ssd_hit = 0;
+  // keys in neither, new to the table
+  uint64_t miss = 0;
+  // time of the rocksdb reads of the pulls
+  uint64_t ssd_read_us = 0;
+  uint64_t prefetch_key = 0;
+  // prefetched keys moved from rocksdb to memory, and the ones the policy
+  // left in rocksdb
+  uint64_t prefetch_load = 0;
+  uint64_t prefetch_reject = 0;
+  // values moved to rocksdb over ssd_cache_mem_keys
+  uint64_t evict = 0;
+};
+
 class SSDSparseTable : public MemorySparseTable {
  public:
-  typedef SparseTableShard<uint64_t, FixedFeatureValue> shard_type;
+  typedef MemorySparseTable::shard_type shard_type;
   SSDSparseTable() {}
-  virtual ~SSDSparseTable() {}
+  virtual ~SSDSparseTable() { WaitPrefetchDone(); }
 
   int32_t Initialize() override;
   int32_t InitializeShard() override;
@@ -42,13 +66,18 @@ class SSDSparseTable : public MemorySparseTable {
   int32_t PushSparse(const uint64_t* keys, const float* values, size_t num);
   int32_t PushSparse(const uint64_t* keys, const float** values, size_t num);
 
+  // moves the values of keys from rocksdb to memory in the task queues of
+  // the shards and returns at once, so that the keys of the next pass are
+  // warm when its pulls come. Over ssd_cache_mem_keys, a value is admitted
+  // only if it scores above the ones the last UpdateTable evicted.
+  int32_t Prefetch(const uint64_t* keys, size_t num) override;
+  SSDCacheStat CacheStat();
+  std::pair<int64_t, int64_t> PrintTableStat() override;
+
   int32_t Flush() override { return 0; }
   virtual int32_t Shrink(const std::string& param) override;
-  virtual void Clear() override {
-    for (int i = 0; i < _real_local_shard_num; ++i) {
-      _local_shards[i].clear();
-    }
-  }
+  // drops the values in memory and in rocksdb
+  virtual void Clear() override;
 
   virtual int32_t Save(const std::string& path,
                        const std::string& param) override;
@@ -78,9 +107,42 @@ class SSDSparseTable : public MemorySparseTable {
   int64_t LocalSize();
 
  private:
+  // loads the values of a part of the keys of a Prefetch, in the task queue
+  // of the shard
+  void PrefetchShard(int shard_id, const std::vector<uint64_t>& keys);
+  void WaitPrefetchDone();
+  // rank of a value in memory for the cache policy, the lowest go to rocksdb
+  // first
+  float CacheScore(int shard_id, uint64_t key, float* value);
+  void AddCacheStat(const SSDCacheStat& stat);
+  // deletes the keys in memory of a local shard from rocksdb. A reopened db
+  // still holds the values of the last run, a Load that puts them in memory
+  // would leave them twice
+  void DropMemKeysFromDb(int shard_id);
+
   RocksDBHandler* _db;
   int64_t _cache_tk_size;
   double _local_show_threshold{0.0};
+
+  SSDCachePolicy _cache_policy{SSD_CACHE_UNSEEN_DAYS};
+  // values a local shard keeps in memory, 0 for no limit
+  size_t _shard_mem_keys{0};
+  // pull frequencies of the keys of each local shard, for SSD_CACHE_TINYLFU
+  std::vector<FrequencySketch> _sketches;
+  // highest score the last UpdateTable evicted from each local shard
+  std::vector<float> _admit_scores;
+
+  std::mutex _prefetch_mutex;
+  std::vector<std::future<int>> _prefetch_tasks;
+
+  std::atomic<uint64_t> _mem_hit{0};
+  std::atomic<uint64_t> _ssd_hit{0};
+  std::atomic<uint64_t> _miss{0};
+  std::atomic<uint64_t> _ssd_read_us{0};
+  std::atomic<uint64_t> _prefetch_key{0};
+  std::atomic<uint64_t> _prefetch_load{0};
+  std::atomic<uint64_t> _prefetch_reject{0};
+  std::atomic<uint64_t> _evict{0};
 };
 
 }  // namespace distributed
@@ -21,6 +21,7 @@
 #include <memory>
 #include <string>
 #include <utility>
+#include <vector>
 
 #include "paddle/fluid/distributed/common/afs_warpper.h"
 #include "paddle/fluid/distributed/ps/table/accessor.h"
@@ -147,6 +148,16 @@ class Table {
 
   virtual void *GetShard(size_t shard_idx) = 0;
   virtual std::pair<int64_t, int64_t> PrintTableStat() { return {0, 0}; }
+  // hint that keys are pulled soon, for the tables with a slower tier
+  virtual int32_t Prefetch(const uint64_t *keys, size_t num) { return 0; }
+  // the values pulled by pointer are no longer used, as after PS-GPU dumped
+  // them back at the end of a pass
+  virtual int32_t UnpinValues() { return 0; }
+  // appends the keys changed since the last xbox save, -1 if the table does
+  // not track them
+  virtual int32_t ExportChangedKeys(std::vector<uint64_t> *keys) {
+    return -1;
+  }
 
   // for patch model
   virtual void Revert() {}
@@ -748,6 +748,16 @@ void FleetWrapper::PrintTableStat(const uint64_t table_id) {
   }
 }
 
+void FleetWrapper::PrefetchSparse(const uint64_t table_id,
+                                  const std::vector<uint64_t>& keys) {
+  auto ret = worker_ptr_->PrefetchSparse(table_id, keys.data(), keys.size());
+  ret.wait();
+  int32_t err_code = ret.get();
+  if (err_code == -1) {
+    LOG(ERROR) << "prefetch sparse table failed";
+  }
+}
+
 void FleetWrapper::ShrinkSparseTable(int table_id, int threshold) {
   auto ret = worker_ptr_->Shrink(table_id, std::to_string(threshold));
   ret.wait();
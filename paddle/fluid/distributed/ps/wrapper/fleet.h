@@ -242,6 +242,10 @@ class FleetWrapper {
   void BarrierWithTable(uint32_t barrier_type);
 
   void PrintTableStat(const uint64_t table_id);
+  // warms the sparse table for the keys of the next pass, the servers load
+  // them in the background
+  void PrefetchSparse(const uint64_t table_id,
+                      const std::vector<uint64_t>& keys);
   // mode = 0, load all feature
   // mode = 1, load delta feature, which means load diff
   void LoadModel(const std::string& path, const int mode);
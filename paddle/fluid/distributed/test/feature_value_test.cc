@@ -14,6 +14,8 @@ limitations under the License. */
 
 #include "paddle/fluid/distributed/ps/table/depends/feature_value.h"
 
+#include <algorithm>
+#include <map>
 #include <vector>
 
 #include "gtest/gtest.h"
@@ -46,5 +48,219 @@ TEST(BENCHMARK, LargeScaleKV) {
   ASSERT_FLOAT_EQ(value_data[3], 0.3);
 }
 
+TEST(SlabSparseTableShard, Resize) {
+  SlabSparseTableShard<uint64_t> shard;
+  shard.add_value_class(4);
+  shard.add_value_class(8);
+  // 10000 values span a few chunks, every third one extended to 8
+  for (uint64_t key = 0; key < 10000; ++key) {
+    auto value = shard[key];
+    ASSERT_EQ(value.size(), 0UL);
+    value.resize(4);
+    for (int i = 0; i < 4; ++i) {
+      value.data()[i] = key + i * 0.25;
+    }
+    if (key % 3 == 0) {
+      value.resize(8);
+      value.data()[7] = key;
+    }
+  }
+  ASSERT_EQ(shard.size(), 10000UL);
+  for (uint64_t key = 0; key < 10000; key += 2) {
+    ASSERT_EQ(shard.erase(key), 1UL);
+  }
+  // freed records are reused by new keys
+  for (uint64_t key = 20000; key < 25000; ++key) {
+    auto value = shard[key];
+    value.resize(4);
+    value.data()[0] = key;
+  }
+  ASSERT_EQ(shard.size(), 10000UL);
+
+  size_t num = 0;
+  for (auto it = shard.begin(); it != shard.end(); ++it, ++num) {
+    uint64_t key = it.key();
+    float* data = it.value().data();
+    if (key >= 20000) {
+      ASSERT_EQ(it.value().size(), 4UL);
+      ASSERT_FLOAT_EQ(data[0], key);
+      continue;
+    }
+    ASSERT_EQ(key % 2, 1UL);
+    ASSERT_EQ(it.value().size(), key % 3 == 0 ? 8UL : 4UL);
+    for (int i = 0; i < 4; ++i) {
+      ASSERT_FLOAT_EQ(data[i], key + i * 0.25);
+    }
+    if (key % 3 == 0) {
+      ASSERT_FLOAT_EQ(data[4], 0.0);
+      ASSERT_FLOAT_EQ(data[7], key);
+    }
+  }
+  ASSERT_EQ(num, 10000UL);
+
+  // shrinking keeps the head of the value
+  auto value = shard.find(9999).value();
+  value.resize(2);
+  ASSERT_FLOAT_EQ(value.data()[1], 9999.25);
+  shard.clear();
+  ASSERT_TRUE(shard.empty());
+}
+
+TEST(SlabSparseTableShard, Pin) {
+  SlabSparseTableShard<uint64_t> shard;
+  // more sizes than value classes, the last ones live in the heap class
+  std::map<uint64_t, FixedFeatureValue*> pinned;
+  for (uint64_t key = 1; key <= 40; ++key) {
+    auto value = shard[key];
+    value.resize(key);
+    value.data()[key - 1] = key;
+    if (key % 4 == 0) {
+      pinned[key] = shard.pin(shard.find(key));
+    }
+  }
+  for (uint64_t key = 41; key <= 100; ++key) {
+    auto value = shard[key];
+    value.resize(key % 7 + 1);
+  }
+  for (auto& p : pinned) {
+    FixedFeatureValue* ptr = p.second;
+    ASSERT_EQ(ptr->size(), p.first);
+    ASSERT_FLOAT_EQ(ptr->data()[p.first - 1], p.first);
+    // a pinned value is resized in place of the pointer, as by PS-GPU
+    ptr->resize(p.first + 1);
+    ptr->data()[p.first] = -1.0;
+    ASSERT_EQ(shard.pin(shard.find(p.first)), ptr);
+    auto value = shard.find(p.first).value();
+    ASSERT_EQ(value.size(), p.first + 1);
+    ASSERT_FLOAT_EQ(value.data()[p.first], -1.0);
+  }
+  for (uint64_t key = 1; key <= 40; ++key) {
+    auto value = shard.find(key).value();
+    ASSERT_FLOAT_EQ(value.data()[key - 1], key);
+  }
+}
+
+TEST(SlabSparseTableShard, PinBorrowsRecord) {
+  SlabSparseTableShard<uint64_t> shard;
+  for (uint64_t key = 0; key < 4; ++key) {
+    auto value = shard[key];
+    value.resize(5);
+    value.data()[4] = key;
+  }
+  float* record = shard.find(1).value().data();
+  FixedFeatureValue* ptr = shard.pin(shard.find(1));
+  // no copy, the pointer writes the record
+  ASSERT_EQ(ptr->data(), record);
+  ASSERT_EQ(ptr->size(), 5UL);
+  ptr->data()[0] = -1.0;
+  shard.unpin_all();
+  ASSERT_EQ(shard.heap_value_num(), 0UL);
+  ASSERT_EQ(shard.find(1).value().data(), record);
+  ASSERT_FLOAT_EQ(shard.find(1).value().data()[0], -1.0);
+
+  // a resize through the pointer copies the value off the record, which is
+  // freed by unpin and reused by the next value of the size
+  ptr = shard.pin(shard.find(1));
+  ptr->resize(7);
+  ASSERT_NE(ptr->data(), record);
+  ASSERT_FLOAT_EQ(ptr->data()[4], 1.0);
+  shard.unpin_all();
+  ASSERT_EQ(shard.find(1).value().size(), 7UL);
+  ASSERT_FLOAT_EQ(shard.find(1).value().data()[0], -1.0);
+  ASSERT_FLOAT_EQ(shard.find(1).value().data()[4], 1.0);
+  auto value = shard[4];
+  value.resize(5);
+  ASSERT_EQ(value.data(), record);
+
+  // erasing a pinned value frees its record too
+  ptr = shard.pin(shard.find(2));
+  record = ptr->data();
+  shard.erase(2);
+  ASSERT_EQ(shard.heap_value_num(), 0UL);
+  value = shard[5];
+  value.resize(5);
+  ASSERT_EQ(value.data(), record);
+}
+
+TEST(SlabSparseTableShard, Unpin) {
+  SlabSparseTableShard<uint64_t> shard;
+  for (uint64_t key = 0; key < 100; ++key) {
+    auto value = shard[key];
+    value.resize(5);
+    value.data()[4] = key;
+  }
+  for (int round = 0; round < 3; ++round) {
+    std::map<uint64_t, FixedFeatureValue*> pinned;
+    for (uint64_t key = 0; key < 100; key += 2) {
+      pinned[key] = shard.pin(shard.find(key));
+    }
+    ASSERT_EQ(shard.heap_value_num(), 50UL);
+    // updated through the pointers, one grows as by a new mf
+    for (auto& p : pinned) {
+      p.second->data()[0] = round;
+    }
+    pinned[10]->resize(7);
+    pinned[10]->data()[6] = -1.0;
+    // an erased key is skipped
+    shard.erase(20);
+    ASSERT_EQ(shard.heap_value_num(), 49UL);
+    shard.unpin_all();
+    // the heap values are given back each pass
+    ASSERT_EQ(shard.heap_value_num(), 0UL);
+    for (uint64_t key = 0; key < 100; ++key) {
+      if (key == 20) {
+        ASSERT_TRUE(shard.find(key) == shard.end());
+        continue;
+      }
+      auto value = shard.find(key).value();
+      ASSERT_EQ(value.size(), key == 10 ? 7UL : 5UL);
+      ASSERT_FLOAT_EQ(value.data()[4], key);
+      if (key % 2 == 0) {
+        ASSERT_FLOAT_EQ(value.data()[0], round);
+      }
+    }
+    ASSERT_FLOAT_EQ(shard.find(10).value().data()[6], -1.0);
+    shard[20].resize(5);
+    shard.find(20).value().data()[4] = 20;
+    shard.find(10).value().resize(5);
+  }
+}
+
+TEST(SlabSparseTableShard, ChangedKeys) {
+  SlabSparseTableShard<uint64_t> shard;
+  for (uint64_t key = 0; key < 1000; ++key) {
+    shard[key].resize(3);
+  }
+  // only touched keys are changed, once each however often they are touched
+  ASSERT_TRUE(shard.changed_keys().empty());
+  for (int round = 0; round < 3; ++round) {
+    for (int key = 990; key >= 10; key -= 20) {
+      shard.touch(shard.find(key));
+    }
+  }
+  ASSERT_EQ(shard.changed_keys().size(), 50UL);
+  ASSERT_EQ(shard.changed_keys().front(), 10UL);
+  ASSERT_EQ(shard.changed_keys().back(), 990UL);
+
+  // an erased key stays, and is not doubled when it is touched again
+  shard.erase(10);
+  shard.touch(shard.find(30));
+  shard.touch(shard.emplace(10).first);
+  ASSERT_EQ(shard.changed_keys().size(), 50UL);
+  ASSERT_TRUE(std::is_sorted(shard.changed_keys().begin(),
+                             shard.changed_keys().end()));
+  shard.erase(50);
+  ASSERT_EQ(shard.changed_keys().size(), 50UL);
+
+  shard.next_epoch();
+  ASSERT_TRUE(shard.changed_keys().empty());
+  shard.touch(shard.find(30));
+  shard.touch(shard.find(31));
+  shard.touch(shard.find(30));
+  ASSERT_EQ(shard.changed_keys(), std::vector<uint64_t>({30, 31}));
+  shard.clear();
+  ASSERT_TRUE(shard.changed_keys().empty());
+}
+
 }  // namespace distributed
 }  // namespace paddle
@@ -0,0 +1,76 @@
+/* Copyright (c) 2022 PaddlePaddle Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License. */
+
+#include "paddle/fluid/distributed/ps/table/depends/frequency_sketch.h"
+
+#include <random>
+
+#include "gtest/gtest.h"
+
+namespace paddle {
+namespace distributed {
+
+TEST(FrequencySketch, Estimate) {
+  FrequencySketch sketch(1024);
+  EXPECT_EQ(sketch.Estimate(1), 0u);
+  for (int i = 0; i < 5; ++i) {
+    sketch.Increment(1);
+  }
+  EXPECT_EQ(sketch.Estimate(1), 5u);
+  for (int i = 0; i < 100; ++i) {
+    sketch.Increment(2);
+  }
+  EXPECT_EQ(sketch.Estimate(2), kSketchMaxFrequency);
+  sketch.Age();
+  EXPECT_EQ(sketch.Estimate(1), 2u);
+  EXPECT_EQ(sketch.Estimate(2), kSketchMaxFrequency / 2);
+}
+
+// hot keys stand out of a stream of cold ones, and the keys that stop coming
+// fall behind the ones hot now
+TEST(FrequencySketch, HotKeys) {
+  const size_t capacity = 4096;
+  FrequencySketch sketch(capacity);
+  std::mt19937_64 engine(0);
+  auto run = [&](uint64_t hot_begin) {
+    for (int round = 0; round < 20; ++round) {
+      for (uint64_t key = hot_begin; key < hot_begin + 64; ++key) {
+        sketch.Increment(key);
+      }
+      for (size_t i = 0; i < capacity; ++i) {
+        sketch.Increment(engine() | (1ull << 63));
+      }
+    }
+  };
+  auto sum = [&](uint64_t hot_begin) {
+    uint32_t total = 0;
+    for (uint64_t key = hot_begin; key < hot_begin + 64; ++key) {
+      total += sketch.Estimate(key);
+    }
+    return total;
+  };
+
+  run(0);
+  uint32_t cold = 0;
+  for (int i = 0; i < 64; ++i) {
+    cold += sketch.Estimate(engine() | (1ull << 63));
+  }
+  EXPECT_GT(sum(0), 2 * cold);
+
+  run(64);
+  EXPECT_GT(sum(64), 2 * sum(0));
+}
+
+}  // namespace distributed
+}  // namespace paddle
@@ -0,0 +1,162 @@
+/* Copyright (c) 2022 PaddlePaddle Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License. */
+
+// Key grouping speed of a sparse pull of BrpcPsClient, which splits the keys
+// of a batch by server and sorts the keys of each server with the pointers of
+// their values, by std::sort as the client did and by RadixSortByKey. The
+// keys are slot prefixed feasigns with a zipf distribution, so that a batch
+// has duplicates as the batches of a trainer do.
+//   ./key_sort_benchmark --batch_keys=1000000 --server_num=10
+
+#include <algorithm>
+#include <chrono>  // NOLINT
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <utility>
+#include <vector>
+
+#include "gflags/gflags.h"
+#include "glog/logging.h"
+#include "paddle/fluid/distributed/common/radix_sort.h"
+
+DEFINE_int64(batch_keys, 1000000, "Keys of a pull.");
+DEFINE_int64(distinct_keys, 10000000, "Keys the pulls draw from.");
+DEFINE_int32(slot_num, 300, "Slots of the keys.");
+DEFINE_double(zipf, 1.1, "Zipf exponent of the keys, 0 for uniform.");
+DEFINE_int32(server_num, 10, "Servers a pull is split to.");
+DEFINE_int32(batch_num, 10, "Pulls to time.");
+DEFINE_int32(repeat, 3, "Timed runs, the best is reported.");
+
+namespace paddle {
+namespace distributed {
+
+typedef std::vector<std::vector<std::pair<uint64_t, float*>>> ShardKvs;
+
+static std::vector<std::vector<uint64_t>> MakeBatches() {
+  std::mt19937_64 engine(0);
+  std::vector<uint64_t> keys(FLAGS_distinct_keys);
+  for (auto& key : keys) {
+    key = ((engine() % FLAGS_slot_num) << 48) | (engine() >> 16);
+  }
+  std::vector<double> cdf(keys.size());
+  double sum = 0;
+  for (size_t i = 0; i < keys.size(); ++i) {
+    sum += FLAGS_zipf > 0 ? 1.0 / std::pow(i + 1, FLAGS_zipf) : 1.0;
+    cdf[i] = sum;
+  }
+  std::uniform_real_distribution<double> uniform(0.0, 1.0);
+  std::vector<std::vector<uint64_t>> batches(FLAGS_batch_num);
+  for (auto& batch : batches) {
+    batch.resize(FLAGS_batch_keys);
+    for (auto& key : batch) {
+      double target = uniform(engine) * sum;
+      size_t i =
+          std::lower_bound(cdf.begin(), cdf.end(), target) - cdf.begin();
+      key = keys[std::min(i, keys.size() - 1)];
+    }
+  }
+  return batches;
+}
+
+static double Seconds(std::chrono::steady_clock::time_point begin) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                       begin)
+      .count();
+}
+
+// splits a batch by server as PullSparse does, the sort is timed alone
+template <class SORT>
+static double RunSort(const std::vector<std::vector<uint64_t>>& batches,
+                      float* values,
+                      SORT sort,
+                      size_t* distinct) {
+  double seconds = 0;
+  *distinct = 0;
+  ShardKvs shard_kvs(FLAGS_server_num);
+  for (auto& batch : batches) {
+    for (auto& kvs : shard_kvs) {
+      kvs.clear();
+    }
+    for (size_t i = 0; i < batch.size(); ++i) {
+      shard_kvs[batch[i] % FLAGS_server_num].push_back({batch[i], values + i});
+    }
+    auto begin = std::chrono::steady_clock::now();
+    for (auto& kvs : shard_kvs) {
+      sort(&kvs);
+    }
+    seconds += Seconds(begin);
+    for (auto& kvs : shard_kvs) {
+      for (size_t i = 0; i < kvs.size(); ++i) {
+        *distinct += i == 0 || kvs[i].first != kvs[i - 1].first;
+      }
+    }
+  }
+  return seconds;
+}
+
+static void Run() {
+  auto batches = MakeBatches();
+  std::vector<float> values(FLAGS_batch_keys);
+  size_t key_num = FLAGS_batch_keys * FLAGS_batch_num;
+  printf("%-16s %12s %12s\n", "sort", "M keys/s", "distinct");
+  double std_best = 1e30;
+  double radix_best = 1e30;
+  size_t std_distinct = 0;
+  size_t radix_distinct = 0;
+  for (int r = 0; r < FLAGS_repeat; ++r) {
+    std_best = std::min(
+        std_best,
+        RunSort(
+            batches,
+            values.data(),
+            [](std::vector<std::pair<uint64_t, float*>>* kvs) {
+              std::sort(kvs->begin(),
+                        kvs->end(),
+                        [](const std::pair<uint64_t, float*>& k1,
+                           const std::pair<uint64_t, float*>& k2) {
+                          return k1.first < k2.first;
+                        });
+            },
+            &std_distinct));
+    radix_best = std::min(
+        radix_best,
+        RunSort(
+            batches,
+            values.data(),
+            [](std::vector<std::pair<uint64_t, float*>>* kvs) {
+              RadixSortByKey(kvs);
+            },
+            &radix_distinct));
+  }
+  CHECK_EQ(std_distinct, radix_distinct);
+  printf("%-16s %12.1f %12zu\n",
+         "std::sort",
+         key_num / std_best / 1e6,
+         std_distinct);
+  printf("%-16s %12.1f %12zu\n",
+         "RadixSortByKey",
+         key_num / radix_best / 1e6,
+         radix_distinct);
+}
+
+}  // namespace distributed
+}  // namespace paddle
+
+int main(int argc, char* argv[]) {
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  google::InitGoogleLogging(argv[0]);
+  paddle::distributed::Run();
+  return 0;
+}
@@ -17,12 +17,18 @@ limitations under the License. */
 #include <ThreadPool.h>
 #include <unistd.h>
 
+#include <fstream>
+#include <memory>
+#include <set>
+#include <sstream>
 #include <string>
 #include <thread>  // NOLINT
+#include <vector>
 
 #include "google/protobuf/text_format.h"
 #include "gtest/gtest.h"
 #include "paddle/fluid/distributed/ps/table/table.h"
+#include "paddle/fluid/framework/io/fs.h"
 #include "paddle/fluid/distributed/the_one_ps.pb.h"
 
 namespace paddle {
@@ -152,5 +158,272 @@ TEST(MemorySparseTable, SGD) {
   }
 }
 
+TEST(MemorySparseTable, Shrink) {
+  int emb_dim = 8;
+  for (bool background : {false, true}) {
+    TableParameter table_config;
+    table_config.set_table_class("MemorySparseTable");
+    table_config.set_shard_num(10);
+    table_config.set_background_shrink(background);
+    FsClientParameter fs_config;
+    std::unique_ptr<MemorySparseTable> table(new MemorySparseTable());
+    table->SetShard(0, 1);
+
+    TableAccessorParameter *accessor_config = table_config.mutable_accessor();
+    accessor_config->set_accessor_class("CtrCommonAccessor");
+    accessor_config->set_fea_dim(11);
+    accessor_config->set_embedx_dim(emb_dim);
+    accessor_config->set_embedx_threshold(5);
+    auto *ctr_param = accessor_config->mutable_ctr_accessor_param();
+    ctr_param->set_nonclk_coeff(0.2);
+    ctr_param->set_click_coeff(1);
+    ctr_param->set_show_click_decay_rate(0.99);
+    ctr_param->set_delete_threshold(1.0);
+    accessor_config->mutable_embed_sgd_param()->set_name("SparseNaiveSGDRule");
+    accessor_config->mutable_embedx_sgd_param()->set_name(
+        "SparseNaiveSGDRule");
+    Table *base = table.get();
+    ASSERT_EQ(base->Initialize(table_config, fs_config), 0);
+
+    // the keys of odd shows score 2 and stay, the others score 0
+    std::vector<uint64_t> keys;
+    std::vector<float> grads;
+    for (uint64_t key = 0; key < 1000; ++key) {
+      keys.push_back(key);
+      grads.push_back(0);                  // slot
+      grads.push_back(key % 2 ? 10 : 0);  // show
+      for (int k = 0; k < emb_dim + 2; ++k) {
+        grads.push_back(0);
+      }
+    }
+    TableContext table_context;
+    table_context.value_type = Sparse;
+    table_context.push_context.keys = keys.data();
+    table_context.push_context.values = grads.data();
+    table_context.num = keys.size();
+    table->Push(table_context);
+    ASSERT_EQ(table->LocalSize(), 1000);
+
+    ASSERT_EQ(table->Shrink(""), 0);
+    // a shrink waits for the one in background, the second one only decays
+    ASSERT_EQ(table->Shrink(""), 0);
+    ASSERT_EQ(table->LocalSize(), 500);
+    table->Clear();
+    ASSERT_EQ(table->LocalSize(), 0);
+  }
+}
+
+TEST(MemorySparseTable, UnpinValues) {
+  int emb_dim = 8;
+  TableParameter table_config;
+  table_config.set_table_class("MemorySparseTable");
+  table_config.set_shard_num(10);
+  FsClientParameter fs_config;
+  std::unique_ptr<MemorySparseTable> table(new MemorySparseTable());
+  table->SetShard(0, 1);
+
+  TableAccessorParameter *accessor_config = table_config.mutable_accessor();
+  accessor_config->set_accessor_class("CtrCommonAccessor");
+  accessor_config->set_fea_dim(11);
+  accessor_config->set_embedx_dim(emb_dim);
+  accessor_config->set_embedx_threshold(5);
+  auto *ctr_param = accessor_config->mutable_ctr_accessor_param();
+  ctr_param->set_nonclk_coeff(0.2);
+  ctr_param->set_click_coeff(1);
+  ctr_param->set_show_click_decay_rate(0.99);
+  ctr_param->set_delete_threshold(0);
+  accessor_config->mutable_embed_sgd_param()->set_name("SparseNaiveSGDRule");
+  accessor_config->mutable_embedx_sgd_param()->set_name("SparseNaiveSGDRule");
+  Table *base = table.get();
+  ASSERT_EQ(base->Initialize(table_config, fs_config), 0);
+
+  auto heap_value_num = [&table]() {
+    size_t num = 0;
+    for (int i = 0; i < 10; ++i) {
+      num += reinterpret_cast<MemorySparseTable::shard_type *>(
+                 table->GetShard(i))
+                 ->heap_value_num();
+    }
+    return num;
+  };
+  std::vector<uint64_t> keys;
+  std::vector<float> grads;
+  for (uint64_t key = 0; key < 1000; ++key) {
+    keys.push_back(key);
+    grads.push_back(0);  // slot
+    grads.push_back(1);  // show
+    for (int k = 0; k < emb_dim + 2; ++k) {
+      grads.push_back(0);
+    }
+  }
+  std::vector<char *> pull_values(keys.size());
+  // pull, push and end pass, as PS-GPU does for each pass
+  for (int pass = 0; pass < 3; ++pass) {
+    ASSERT_EQ(
+        table->PullSparsePtr(pull_values.data(), keys.data(), keys.size()), 0);
+    ASSERT_EQ(heap_value_num(), keys.size());
+    ASSERT_EQ(table->PushSparse(keys.data(), grads.data(), keys.size()), 0);
+    for (size_t i = 0; i < keys.size(); ++i) {
+      auto *value = reinterpret_cast<FixedFeatureValue *>(pull_values[i]);
+      // the unseen days, as the dump back of PS-GPU writes the values
+      value->data()[1] = pass;
+    }
+    ASSERT_EQ(table->UnpinValues(), 0);
+    ASSERT_EQ(heap_value_num(), 0UL);
+    ASSERT_EQ(table->LocalSize(), 1000);
+  }
+  ASSERT_EQ(table->PullSparsePtr(pull_values.data(), keys.data(), keys.size()),
+            0);
+  for (size_t i = 0; i < keys.size(); ++i) {
+    auto *value = reinterpret_cast<FixedFeatureValue *>(pull_values[i]);
+    ASSERT_FLOAT_EQ(value->data()[1], 2);
+  }
+}
+
+// a table of 4 shards whose xbox delta saves hold the keys with a delta score
+// of 0.5, 5 shows without click
+static std::unique_ptr<MemorySparseTable> MakeDeltaTable(bool track,
+                                                         bool binary = false,
+                                                         int embedx_dim = 8) {
+  TableParameter table_config;
+  table_config.set_table_class("MemorySparseTable");
+  table_config.set_shard_num(4);
+  table_config.set_compress_in_save(false);
+  table_config.set_enable_sparse_table_cache(false);
+  table_config.set_track_changed_keys(track);
+  table_config.set_binary_in_save(binary);
+  FsClientParameter fs_config;
+  std::unique_ptr<MemorySparseTable> table(new MemorySparseTable());
+  table->SetShard(0, 1);
+
+  TableAccessorParameter *accessor_config = table_config.mutable_accessor();
+  accessor_config->set_accessor_class("CtrCommonAccessor");
+  accessor_config->set_fea_dim(3 + embedx_dim);
+  accessor_config->set_embedx_dim(embedx_dim);
+  accessor_config->set_embedx_threshold(5);
+  auto *ctr_param = accessor_config->mutable_ctr_accessor_param();
+  ctr_param->set_nonclk_coeff(0.1);
+  ctr_param->set_click_coeff(1);
+  ctr_param->set_base_threshold(0);
+  ctr_param->set_delta_threshold(0.5);
+  ctr_param->set_delta_keep_days(16);
+  ctr_param->set_show_click_decay_rate(0.99);
+  ctr_param->set_delete_threshold(0);
+  accessor_config->mutable_embed_sgd_param()->set_name("SparseNaiveSGDRule");
+  accessor_config->mutable_embedx_sgd_param()->set_name("SparseNaiveSGDRule");
+  Table *base = table.get();
+  EXPECT_EQ(base->Initialize(table_config, fs_config), 0);
+  return table;
+}
+
+// pushes show shows of each key in [begin, end)
+static void PushShows(MemorySparseTable *table,
+                      uint64_t begin,
+                      uint64_t end,
+                      float show) {
+  std::vector<uint64_t> keys;
+  std::vector<float> grads;
+  for (uint64_t key = begin; key < end; ++key) {
+    keys.push_back(key);
+    grads.push_back(0);     // slot
+    grads.push_back(show);  // show
+    for (int k = 0; k < 8 + 2; ++k) {
+      grads.push_back(0);
+    }
+  }
+  ASSERT_EQ(table->PushSparse(keys.data(), grads.data(), keys.size()), 0);
+}
+
+// the keys of the text files a table of 4 shards saved under dirname
+static std::set<uint64_t> SavedKeys(const std::string &dirname) {
+  std::set<uint64_t> keys;
+  for (int i = 0; i < 4; ++i) {
+    std::ifstream file(dirname + "/000/part-000-0000" + std::to_string(i));
+    EXPECT_TRUE(file.good());
+    std::string line;
+    while (std::getline(file, line)) {
+      uint64_t key = 0;
+      std::istringstream(line) >> key;
+      EXPECT_TRUE(keys.insert(key).second);
+    }
+  }
+  return keys;
+}
+
+// an xbox delta save that visits the changed keys only writes the keys of a
+// full scan, also after a load, whose keys it does not know
+TEST(MemorySparseTable, ChangedKeysSave) {
+  auto tracked = MakeDeltaTable(true);
+  auto scanned = MakeDeltaTable(false);
+  auto save_delta = [&tracked, &scanned]() {
+    EXPECT_EQ(tracked->Save("changed_keys_tracked", "1"), 0);
+    EXPECT_EQ(scanned->Save("changed_keys_scanned", "1"), 0);
+    auto keys = SavedKeys("changed_keys_tracked");
+    EXPECT_EQ(keys, SavedKeys("changed_keys_scanned"));
+    return keys;
+  };
+  // 5 shows or more are saved, the others wait for more
+  for (auto *table : {tracked.get(), scanned.get()}) {
+    PushShows(table, 0, 1000, 3);
+    PushShows(table, 0, 500, 2);
+  }
+  ASSERT_EQ(save_delta().size(), 500UL);
+  for (auto *table : {tracked.get(), scanned.get()}) {
+    PushShows(table, 400, 600, 2);
+    PushShows(table, 700, 800, 2);
+  }
+  std::vector<uint64_t> changed;
+  Table *base = tracked.get();
+  ASSERT_EQ(base->ExportChangedKeys(&changed), 0);
+  ASSERT_EQ(changed.size(), 300UL);
+  ASSERT_EQ(static_cast<Table *>(scanned.get())->ExportChangedKeys(&changed),
+            -1);
+  // the saved keys of the last delta wait for 5 more shows
+  auto keys = save_delta();
+  ASSERT_EQ(keys.size(), 200UL);
+  ASSERT_EQ(*keys.begin(), 500UL);
+  ASSERT_EQ(*keys.rbegin(), 799UL);
+  ASSERT_TRUE(save_delta().empty());
+
+  // the loaded values that passed the threshold are in the next delta
+  for (auto *table : {tracked.get(), scanned.get()}) {
+    PushShows(table, 0, 100, 5);
+  }
+  ASSERT_EQ(tracked->Save("changed_keys_checkpoint", "0"), 0);
+  tracked = MakeDeltaTable(true);
+  scanned = MakeDeltaTable(false);
+  ASSERT_EQ(tracked->Load("changed_keys_checkpoint", "0"), 0);
+  ASSERT_EQ(scanned->Load("changed_keys_checkpoint", "0"), 0);
+  ASSERT_EQ(save_delta().size(), 100UL);
+  for (auto *table : {tracked.get(), scanned.get()}) {
+    PushShows(table, 100, 150, 5);
+  }
+  ASSERT_EQ(save_delta().size(), 50UL);
+
+  for (auto &dirname : {"changed_keys_tracked",
+                        "changed_keys_scanned",
+                        "changed_keys_checkpoint"}) {
+    paddle::framework::fs_remove(dirname);
+  }
+}
+
+// a binary snapshot saved with another embedx_dim fails the load, without
+// retrying or ending the process
+TEST(MemorySparseTable, SnapshotMismatch) {
+  auto saved = MakeDeltaTable(false, true);
+  PushShows(saved.get(), 0, 100, 5);
+  ASSERT_EQ(saved->Save("snapshot_mismatch", "0"), 0);
+
+  auto same = MakeDeltaTable(false, true);
+  EXPECT_EQ(same->Load("snapshot_mismatch", "0"), 0);
+  EXPECT_GT(same->LocalSize(), 0);
+  EXPECT_EQ(same->LocalSize(), saved->LocalSize());
+  auto other = MakeDeltaTable(false, true, 4);
+  EXPECT_EQ(other->Load("snapshot_mismatch", "0"), -1);
+  EXPECT_EQ(other->LocalSize(), 0);
+
+  paddle::framework::fs_remove("snapshot_mismatch");
+}
+
 }  // namespace distributed
 }  // namespace paddle
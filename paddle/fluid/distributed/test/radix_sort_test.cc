@@ -0,0 +1,89 @@
+/* Copyright (c) 2022 PaddlePaddle Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License. */
+
+#include "paddle/fluid/distributed/common/radix_sort.h"
+
+#include <algorithm>
+#include <random>
+#include <utility>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace paddle {
+namespace distributed {
+
+// RadixSortByKey against std::stable_sort, the values are the original
+// positions so that the order of equal keys is checked too
+static void CheckSort(const std::vector<uint64_t>& keys) {
+  std::vector<std::pair<uint64_t, size_t>> kvs;
+  for (size_t i = 0; i < keys.size(); ++i) {
+    kvs.push_back({keys[i], i});
+  }
+  auto expect = kvs;
+  std::stable_sort(expect.begin(),
+                   expect.end(),
+                   [](const std::pair<uint64_t, size_t>& k1,
+                      const std::pair<uint64_t, size_t>& k2) {
+                     return k1.first < k2.first;
+                   });
+  RadixSortByKey(&kvs);
+  ASSERT_EQ(kvs, expect);
+}
+
+TEST(RadixSortByKey, Sort) {
+  std::mt19937_64 engine(0);
+  for (size_t num : {0, 1, 2, 511, 512, 513, 5000, 100000}) {
+    std::vector<uint64_t> keys(num);
+    // random keys
+    for (auto& key : keys) {
+      key = engine();
+    }
+    CheckSort(keys);
+    // slot prefixed feasigns with many duplicates
+    for (auto& key : keys) {
+      key = ((engine() % 300) << 48) | (engine() % 1000);
+    }
+    CheckSort(keys);
+    // one key
+    std::fill(keys.begin(), keys.end(), 12345);
+    CheckSort(keys);
+    // the extremes
+    for (size_t i = 0; i < num; ++i) {
+      keys[i] = i % 3 == 0 ? 0 : (i % 3 == 1 ? UINT64_MAX : UINT64_MAX / 2);
+    }
+    CheckSort(keys);
+  }
+}
+
+TEST(RadixSortByKey, Pointers) {
+  // as the client sorts the keys of a pull with the pointers of their values
+  std::vector<float> values(1000);
+  std::vector<std::pair<uint64_t, float*>> kvs;
+  for (size_t i = 0; i < values.size(); ++i) {
+    values[i] = i % 100;
+    kvs.push_back({static_cast<uint64_t>(values[i]), &values[i]});
+  }
+  RadixSortByKey(&kvs);
+  for (size_t i = 0; i < kvs.size(); ++i) {
+    ASSERT_EQ(kvs[i].first, i / 10);
+    ASSERT_EQ(*kvs[i].second, static_cast<float>(kvs[i].first));
+    if (i % 10 > 0) {
+      ASSERT_LT(kvs[i - 1].second, kvs[i].second);
+    }
+  }
+}
+
+}  // namespace distributed
+}  // namespace paddle
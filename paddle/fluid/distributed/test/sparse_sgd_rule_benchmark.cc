@@ -0,0 +1,163 @@
+/* Copyright (c) 2022 PaddlePaddle Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License. */
+
+// Update speed of the sparse SGD rules, one value at a time by UpdateValue
+// and in batches by UpdateValueBatch, for the embedding dims of --dims. The
+// values are updated in a shuffled order, as a push finds them in a shard.
+//   ./sparse_sgd_rule_benchmark --dims=8,64 --value_num=1000000
+
+#include <algorithm>
+#include <chrono>  // NOLINT
+#include <cstdio>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "gflags/gflags.h"
+#include "glog/logging.h"
+#include "paddle/fluid/distributed/ps/table/sparse_sgd_rule.h"
+#include "paddle/fluid/distributed/the_one_ps.pb.h"
+#include "paddle/fluid/string/string_helper.h"
+
+DEFINE_string(rules,
+              "SparseNaiveSGDRule,SparseAdaGradSGDRule,StdAdaGradSGDRule,"
+              "SparseAdamSGDRule,SparseSharedAdamSGDRule",
+              "Rules to time.");
+DEFINE_string(dims, "8,16,32,64", "Embedding dims to time.");
+DEFINE_int64(value_num, 1000000, "Values updated by a run.");
+DEFINE_int32(batch_size, 64, "Values of an UpdateValueBatch.");
+DEFINE_int32(repeat, 3, "Timed runs, the best is reported.");
+
+namespace paddle {
+namespace distributed {
+
+static SparseCommonSGDRuleParameter RuleParameter(const std::string& name) {
+  SparseCommonSGDRuleParameter param;
+  param.set_name(name);
+  param.mutable_naive()->set_learning_rate(0.05);
+  param.mutable_naive()->set_initial_range(1e-4);
+  param.mutable_naive()->add_weight_bounds(-10.0);
+  param.mutable_naive()->add_weight_bounds(10.0);
+  param.mutable_adagrad()->set_learning_rate(0.05);
+  param.mutable_adagrad()->set_initial_g2sum(3.0);
+  param.mutable_adagrad()->set_initial_range(1e-4);
+  param.mutable_adagrad()->add_weight_bounds(-10.0);
+  param.mutable_adagrad()->add_weight_bounds(10.0);
+  param.mutable_adam()->set_learning_rate(0.001);
+  param.mutable_adam()->set_initial_range(1e-4);
+  param.mutable_adam()->set_beta1_decay_rate(0.9);
+  param.mutable_adam()->set_beta2_decay_rate(0.999);
+  param.mutable_adam()->set_ada_epsilon(1e-08);
+  param.mutable_adam()->add_weight_bounds(-10.0);
+  param.mutable_adam()->add_weight_bounds(10.0);
+  return param;
+}
+
+static double Seconds(std::chrono::steady_clock::time_point begin) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                       begin)
+      .count();
+}
+
+static void RunRule(const std::string& name, size_t dim) {
+  auto* rule_ptr = CREATE_PSCORE_CLASS(SparseValueSGDRule, name);
+  std::unique_ptr<SparseValueSGDRule> rule(rule_ptr);
+  CHECK(rule != nullptr) << "unknown rule " << name;
+  rule->LoadConfig(RuleParameter(name), dim);
+
+  size_t value_dim = dim + rule->Dim();
+  size_t value_num = FLAGS_value_num;
+  std::vector<float> values(value_num * value_dim);
+  std::vector<float> grads(value_num * dim);
+  std::vector<float> scales(value_num);
+  std::mt19937 engine(0);
+  std::uniform_real_distribution<float> uniform(-1, 1);
+  for (size_t i = 0; i < value_num; ++i) {
+    rule->InitValue(
+        &values[i * value_dim], &values[i * value_dim + dim], false);
+    scales[i] = 1 + i % 4;
+  }
+  for (auto& grad : grads) {
+    grad = uniform(engine) * 0.01f;
+  }
+  std::vector<size_t> order(value_num);
+  for (size_t i = 0; i < value_num; ++i) {
+    order[i] = i;
+  }
+  std::shuffle(order.begin(), order.end(), engine);
+  std::vector<float*> w(value_num);
+  std::vector<float*> sgd(value_num);
+  std::vector<const float*> grad(value_num);
+  std::vector<float> scale(value_num);
+  for (size_t i = 0; i < value_num; ++i) {
+    w[i] = &values[order[i] * value_dim];
+    sgd[i] = &values[order[i] * value_dim + dim];
+    grad[i] = &grads[i * dim];
+    scale[i] = scales[order[i]];
+  }
+
+  double scalar_best = 1e30;
+  double batch_best = 1e30;
+  for (int r = 0; r < FLAGS_repeat; ++r) {
+    auto begin = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < value_num; ++i) {
+      rule->UpdateValue(w[i], sgd[i], grad[i], scale[i]);
+    }
+    scalar_best = std::min(scalar_best, Seconds(begin));
+
+    begin = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < value_num; i += FLAGS_batch_size) {
+      rule->UpdateValueBatch(
+          &w[i],
+          &sgd[i],
+          &grad[i],
+          &scale[i],
+          std::min<size_t>(FLAGS_batch_size, value_num - i));
+    }
+    batch_best = std::min(batch_best, Seconds(begin));
+  }
+  printf("%-26s %6zu %14.1f %14.1f %8.2f\n",
+         name.c_str(),
+         dim,
+         value_num / scalar_best / 1e6,
+         value_num / batch_best / 1e6,
+         scalar_best / batch_best);
+}
+
+static void Run() {
+  printf("%-26s %6s %14s %14s %8s\n",
+         "rule",
+         "dim",
+         "M scalar/s",
+         "M batch/s",
+         "speedup");
+  auto names = paddle::string::split_string<std::string>(FLAGS_rules, ",");
+  auto dims = paddle::string::split_string<std::string>(FLAGS_dims, ",");
+  for (auto& name : names) {
+    for (auto& dim : dims) {
+      RunRule(name, std::stoul(dim));
+    }
+  }
+}
+
+}  // namespace distributed
+}  // namespace paddle
+
+int main(int argc, char* argv[]) {
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  google::InitGoogleLogging(argv[0]);
+  paddle::distributed::Run();
+  return 0;
+}
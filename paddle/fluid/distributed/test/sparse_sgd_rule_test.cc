@@ -16,6 +16,10 @@ limitations under the License. */
 
 #include <cmath>
 #include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
 
 #include "gtest/gtest.h"
 #include "paddle/fluid/distributed/the_one_ps.pb.h"
@@ -205,5 +209,77 @@ TEST(downpour_sparse_adam_test, test_init_and_update) {
     ASSERT_FLOAT_EQ(value[i], label[i]) << "i is " << i;
   }
 }
+
+// UpdateValueBatch of each rule against UpdateValue, for the dims with a
+// batch kernel and one without
+TEST(SparseValueSGDRule, UpdateValueBatch) {
+  std::vector<std::string> names = {"SparseNaiveSGDRule",
+                                    "SparseAdaGradSGDRule",
+                                    "StdAdaGradSGDRule",
+                                    "SparseAdamSGDRule",
+                                    "SparseSharedAdamSGDRule"};
+  std::mt19937 engine(0);
+  std::uniform_real_distribution<float> uniform(-1, 1);
+  const size_t num = 37;
+  for (auto& name : names) {
+    for (size_t dim : {1, 8, 10, 16, 32, 64}) {
+      SparseCommonSGDRuleParameter param;
+      param.set_name(name);
+      param.mutable_naive()->set_learning_rate(0.1);
+      param.mutable_naive()->add_weight_bounds(-0.5);
+      param.mutable_naive()->add_weight_bounds(0.5);
+      param.mutable_adagrad()->set_learning_rate(0.1);
+      param.mutable_adagrad()->set_initial_g2sum(3);
+      param.mutable_adagrad()->add_weight_bounds(-0.5);
+      param.mutable_adagrad()->add_weight_bounds(0.5);
+      param.mutable_adam()->set_learning_rate(0.1);
+      param.mutable_adam()->set_beta1_decay_rate(0.9);
+      param.mutable_adam()->set_beta2_decay_rate(0.999);
+      param.mutable_adam()->set_ada_epsilon(1e-08);
+      param.mutable_adam()->add_weight_bounds(-0.5);
+      param.mutable_adam()->add_weight_bounds(0.5);
+      auto* rule_ptr = CREATE_PSCORE_CLASS(SparseValueSGDRule, name);
+      std::unique_ptr<SparseValueSGDRule> rule(rule_ptr);
+      ASSERT_TRUE(rule != nullptr);
+      rule->LoadConfig(param, dim);
+
+      size_t value_dim = dim + rule->Dim();
+      std::vector<float> values(num * value_dim);
+      std::vector<float> grads(num * dim);
+      std::vector<float> scales(num);
+      for (size_t i = 0; i < num; ++i) {
+        rule->InitValue(&values[i * value_dim], &values[i * value_dim + dim],
+                        false);
+        for (size_t j = 0; j < dim; ++j) {
+          grads[i * dim + j] = uniform(engine);
+        }
+        scales[i] = 1 + i % 3;
+      }
+      // the second update also has history in sgd
+      std::vector<float> expect = values;
+      for (int round = 0; round < 2; ++round) {
+        std::vector<float*> w(num);
+        std::vector<float*> sgd(num);
+        std::vector<const float*> grad(num);
+        for (size_t i = 0; i < num; ++i) {
+          rule->UpdateValue(&expect[i * value_dim],
+                            &expect[i * value_dim + dim],
+                            &grads[i * dim],
+                            scales[i]);
+          w[i] = &values[i * value_dim];
+          sgd[i] = &values[i * value_dim + dim];
+          grad[i] = &grads[i * dim];
+        }
+        rule->UpdateValueBatch(
+            w.data(), sgd.data(), grad.data(), scales.data(), num);
+      }
+      for (size_t i = 0; i < values.size(); ++i) {
+        ASSERT_NEAR(values[i], expect[i], 1e-5 * (1 + std::fabs(expect[i])))
+            << name << " dim " << dim << " i " << i;
+      }
+    }
+  }
+}
+
 }  // namespace distributed
 }  // namespace paddle
@@ -0,0 +1,222 @@
+/* Copyright (c) 2022 PaddlePaddle Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License. */
+
+// Bucket balance and lookup speed of a sparse table shard, for the bucket
+// hash the shards used to have (std::hash, the identity) and SparseShardHash,
+// with mct::closed_hash_map and with SwissHashMap as the bucket map.
+// The keys are read from --key_file, whose lines start with a feasign as the
+// part files of a saved sparse table do, or else made up as slot prefixed
+// feasigns with a zipf distribution.
+//   ./sparse_shard_benchmark --key_file=table/part-000-00000 --lookup_num=1e7
+
+#include <algorithm>
+#include <chrono>  // NOLINT
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "gflags/gflags.h"
+#include "glog/logging.h"
+#include "paddle/fluid/distributed/ps/table/depends/feature_value.h"
+
+DEFINE_string(key_file, "", "File of keys, the first column of each line.");
+DEFINE_int64(key_num, 5000000, "Made up keys when there is no key_file.");
+DEFINE_int32(slot_num, 300, "Slots of the made up keys.");
+DEFINE_int32(slot_bits,
+             16,
+             "High bits of a made up key holding its slot, 0 to hash them.");
+DEFINE_double(zipf, 1.1, "Zipf exponent of the lookups, 0 for uniform.");
+DEFINE_int64(lookup_num, 10000000, "Lookups to time.");
+DEFINE_double(miss_ratio, 0.1, "Ratio of lookups of absent keys.");
+DEFINE_int32(shard_num, 1000, "Shards of the table, for the shard balance.");
+DEFINE_int32(server_num, 10, "Servers of the table, for the shard balance.");
+DEFINE_int32(repeat, 3, "Timed runs, the best is reported.");
+
+namespace paddle {
+namespace distributed {
+
+struct IdentityHash {
+  size_t operator()(uint64_t key) const { return key; }
+};
+
+static std::vector<uint64_t> ReadKeys() {
+  std::vector<uint64_t> keys;
+  if (!FLAGS_key_file.empty()) {
+    std::ifstream in(FLAGS_key_file);
+    CHECK(in.good()) << "can not open " << FLAGS_key_file;
+    std::string line;
+    while (std::getline(in, line)) {
+      keys.push_back(std::strtoull(line.c_str(), nullptr, 10));
+    }
+  } else {
+    std::mt19937_64 engine(0);
+    keys.reserve(FLAGS_key_num);
+    for (int64_t i = 0; i < FLAGS_key_num; ++i) {
+      uint64_t slot = engine() % FLAGS_slot_num;
+      uint64_t sign = engine();
+      keys.push_back(FLAGS_slot_bits == 0
+                         ? sign
+                         : (slot << (64 - FLAGS_slot_bits)) |
+                               (sign >> FLAGS_slot_bits));
+    }
+  }
+  std::sort(keys.begin(), keys.end());
+  keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+  return keys;
+}
+
+// lookups of the keys by rank with a zipf distribution, the ranks are
+// shuffled so that the hot keys are not the small ones
+static std::vector<uint64_t> MakeLookups(const std::vector<uint64_t>& keys) {
+  std::mt19937_64 engine(1);
+  std::vector<size_t> rank(keys.size());
+  for (size_t i = 0; i < rank.size(); ++i) {
+    rank[i] = i;
+  }
+  std::shuffle(rank.begin(), rank.end(), engine);
+  std::vector<double> cdf(keys.size());
+  double sum = 0;
+  for (size_t i = 0; i < keys.size(); ++i) {
+    sum += FLAGS_zipf > 0 ? 1.0 / std::pow(i + 1, FLAGS_zipf) : 1.0;
+    cdf[i] = sum;
+  }
+  std::uniform_real_distribution<double> uniform(0.0, 1.0);
+  std::vector<uint64_t> lookups(FLAGS_lookup_num);
+  for (auto& key : lookups) {
+    if (uniform(engine) < FLAGS_miss_ratio) {
+      key = engine();
+      continue;
+    }
+    size_t i = std::lower_bound(cdf.begin(), cdf.end(), uniform(engine) * sum) -
+               cdf.begin();
+    key = keys[rank[std::min(i, keys.size() - 1)]];
+  }
+  return lookups;
+}
+
+// the buckets of a shard, routed by the high bits of HASH as in
+// SlabSparseTableShard::compute_bucket
+template <class MAP, class HASH>
+struct Buckets {
+  MAP maps[CTR_SPARSE_SHARD_BUCKET_NUM];
+  HASH hasher;
+
+  size_t bucket(size_t hash) const {
+    return hash >> (sizeof(size_t) * 8 - CTR_SPARSE_SHARD_BUCKET_NUM_BITS);
+  }
+  void insert(uint64_t key, uint32_t value) {
+    size_t hash = hasher(key);
+    maps[bucket(hash)].insert_with_hash({key, value}, hash);
+  }
+  bool find(uint64_t key) {
+    size_t hash = hasher(key);
+    auto& map = maps[bucket(hash)];
+    return map.find_with_hash(key, hash) != map.end();
+  }
+};
+
+static double Seconds(std::chrono::steady_clock::time_point begin) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                       begin)
+      .count();
+}
+
+template <class MAP, class HASH>
+static void RunLookup(const char* name,
+                      const std::vector<uint64_t>& keys,
+                      const std::vector<uint64_t>& lookups) {
+  std::unique_ptr<Buckets<MAP, HASH>> buckets(new Buckets<MAP, HASH>());
+  auto begin = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < keys.size(); ++i) {
+    buckets->insert(keys[i], i);
+  }
+  double insert_seconds = Seconds(begin);
+
+  size_t max_bucket_size = 0;
+  size_t empty_bucket_num = 0;
+  for (auto& map : buckets->maps) {
+    max_bucket_size = std::max<size_t>(max_bucket_size, map.size());
+    empty_bucket_num += map.size() == 0;
+  }
+
+  double best = 1e30;
+  size_t hit = 0;
+  for (int r = 0; r < FLAGS_repeat; ++r) {
+    hit = 0;
+    begin = std::chrono::steady_clock::now();
+    for (uint64_t key : lookups) {
+      hit += buckets->find(key);
+    }
+    best = std::min(best, Seconds(begin));
+  }
+  printf("%-28s %10.1f %14.1f %10.3f %10zu %8zu\n",
+         name,
+         keys.size() / insert_seconds / 1e6,
+         lookups.size() / best / 1e6,
+         max_bucket_size * 1.0 * CTR_SPARSE_SHARD_BUCKET_NUM / keys.size(),
+         empty_bucket_num,
+         hit);
+}
+
+static void PrintShardBalance(const std::vector<uint64_t>& keys) {
+  // the routing of MemorySparseTable, a key goes to shard key % shard_num
+  // and a server owns avg_local_shard_num consecutive shards
+  int avg_local_shard_num =
+      (FLAGS_shard_num + FLAGS_server_num - 1) / FLAGS_server_num;
+  std::vector<size_t> sizes(FLAGS_shard_num, 0);
+  for (uint64_t key : keys) {
+    ++sizes[key % FLAGS_shard_num];
+  }
+  size_t max_size = *std::max_element(sizes.begin(), sizes.end());
+  printf("keys %zu, shard size max/avg %.3f (shard_num %d, %d per server)\n\n",
+         keys.size(),
+         max_size * 1.0 * FLAGS_shard_num / keys.size(),
+         FLAGS_shard_num,
+         avg_local_shard_num);
+}
+
+static void Run() {
+  auto keys = ReadKeys();
+  CHECK(!keys.empty());
+  auto lookups = MakeLookups(keys);
+  PrintShardBalance(keys);
+  printf("%-28s %10s %14s %10s %10s %8s\n",
+         "bucket map",
+         "M insert/s",
+         "M lookup/s",
+         "max/avg",
+         "empty",
+         "hits");
+  RunLookup<mct::closed_hash_map<uint64_t, uint32_t, IdentityHash>,
+            IdentityHash>("mct, std::hash", keys, lookups);
+  RunLookup<mct::closed_hash_map<uint64_t, uint32_t, SparseShardHash<uint64_t>>,
+            SparseShardHash<uint64_t>>("mct, SparseShardHash", keys, lookups);
+  RunLookup<SwissHashMap<uint64_t, uint32_t, SparseShardHash<uint64_t>>,
+            SparseShardHash<uint64_t>>(
+      "SwissHashMap, SparseShardHash", keys, lookups);
+}
+
+}  // namespace distributed
+}  // namespace paddle
+
+int main(int argc, char* argv[]) {
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  google::InitGoogleLogging(argv[0]);
+  paddle::distributed::Run();
+  return 0;
+}
@@ -0,0 +1,157 @@
+/* Copyright (c) 2022 PaddlePaddle Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License. */
+
+#include "paddle/fluid/distributed/ps/table/sparse_snapshot.h"
+
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace paddle {
+namespace distributed {
+
+static std::shared_ptr<FILE> OpenFile(const std::string& path,
+                                      const char* mode) {
+  return std::shared_ptr<FILE>(fopen(path.c_str(), mode), fclose);
+}
+
+static SparseSnapshotHeader MakeHeader(bool compress) {
+  SparseSnapshotHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, SPARSE_SNAPSHOT_MAGIC, sizeof(header.magic));
+  header.version = SPARSE_SNAPSHOT_VERSION;
+  header.compress = compress;
+  header.value_dim = 17;
+  header.mf_dim = 9;
+  header.table_id = 3;
+  header.file_idx = 5;
+  snprintf(header.accessor_class,
+           sizeof(header.accessor_class),
+           "%s",
+           "CtrCommonAccessor");
+  return header;
+}
+
+// values of 8 or 17 floats, as with and without embedx
+static void WriteSnapshot(const std::string& path,
+                          bool compress,
+                          size_t record_num) {
+  FsChannelConfig config;
+  FsWriteChannel channel;
+  channel.open(OpenFile(path, "wb"), config);
+  // small blocks, so that a file has many of them
+  SparseSnapshotWriter writer(&channel, 1024);
+  ASSERT_EQ(writer.WriteHeader(MakeHeader(compress)), 0);
+  std::vector<float> value(17);
+  for (size_t i = 0; i < record_num; ++i) {
+    for (size_t j = 0; j < value.size(); ++j) {
+      value[j] = i * 0.5f + j;
+    }
+    ASSERT_EQ(writer.Append(i * 7919, value.data(), i % 3 == 0 ? 17 : 8), 0);
+  }
+  ASSERT_EQ(writer.Finish(), 0);
+  ASSERT_EQ(writer.record_num(), record_num);
+  channel.close();
+}
+
+// the return of Next after the records read, and their number
+static int ReadSnapshot(const std::string& path, size_t* record_num) {
+  FsChannelConfig config;
+  FsReadChannel channel;
+  channel.open(OpenFile(path, "rb"), config);
+  SparseSnapshotReader reader(&channel);
+  SparseSnapshotHeader header;
+  EXPECT_EQ(reader.ReadHeader(&header), 0);
+  EXPECT_EQ(header.value_dim, 17U);
+  EXPECT_EQ(header.mf_dim, 9U);
+  EXPECT_STREQ(header.accessor_class, "CtrCommonAccessor");
+  uint64_t key = 0;
+  const float* value = nullptr;
+  uint32_t dim = 0;
+  int ret = 0;
+  *record_num = 0;
+  while ((ret = reader.Next(&key, &value, &dim)) == 0) {
+    size_t i = *record_num;
+    EXPECT_EQ(key, i * 7919);
+    EXPECT_EQ(dim, i % 3 == 0 ? 17U : 8U);
+    for (size_t j = 0; j < dim; ++j) {
+      EXPECT_FLOAT_EQ(value[j], i * 0.5f + j);
+    }
+    ++*record_num;
+  }
+  return ret;
+}
+
+TEST(SparseSnapshot, RoundTrip) {
+  for (bool compress : {false, true}) {
+    std::string path = "sparse_snapshot_test.bin";
+    WriteSnapshot(path, compress, 10000);
+    size_t record_num = 0;
+    ASSERT_EQ(ReadSnapshot(path, &record_num), 1);
+    ASSERT_EQ(record_num, 10000UL);
+
+    WriteSnapshot(path, compress, 0);
+    ASSERT_EQ(ReadSnapshot(path, &record_num), 1);
+    ASSERT_EQ(record_num, 0UL);
+    unlink(path.c_str());
+  }
+  ASSERT_TRUE(IsSparseSnapshot("table/part-000-00001.bin"));
+  ASSERT_FALSE(IsSparseSnapshot("table/part-000-00001.gz"));
+}
+
+TEST(SparseSnapshot, BrokenFile) {
+  for (bool compress : {false, true}) {
+    std::string path = "sparse_snapshot_test.bin";
+    WriteSnapshot(path, compress, 2000);
+    FILE* file = fopen(path.c_str(), "rb");
+    std::string data;
+    char buffer[4096];
+    size_t size = 0;
+    while ((size = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+      data.append(buffer, size);
+    }
+    fclose(file);
+
+    // cut in the middle of a block and in the record number at the end
+    for (size_t cut : {data.size() / 2, data.size() - 4}) {
+      file = fopen(path.c_str(), "wb");
+      fwrite(data.data(), 1, cut, file);
+      fclose(file);
+      size_t record_num = 0;
+      ASSERT_EQ(ReadSnapshot(path, &record_num), -1);
+      ASSERT_LE(record_num, 2000UL);
+    }
+
+    // a flipped byte in the data of the first block
+    std::string flipped = data;
+    flipped[sizeof(SparseSnapshotHeader) + sizeof(SparseSnapshotBlockHeader) +
+            20] ^= 0x10;
+    file = fopen(path.c_str(), "wb");
+    fwrite(flipped.data(), 1, flipped.size(), file);
+    fclose(file);
+    size_t record_num = 0;
+    ASSERT_EQ(ReadSnapshot(path, &record_num), -1);
+    ASSERT_EQ(record_num, 0UL);
+    unlink(path.c_str());
+  }
+}
+
+}  // namespace distributed
+}  // namespace paddle
@@ -0,0 +1,244 @@
+/* Copyright (c) 2022 PaddlePaddle Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License. */
+
+#include "paddle/fluid/distributed/ps/service/sparse_wire_codec.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <random>
+#include <utility>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace paddle {
+namespace distributed {
+
+TEST(SparseWireCodec, Half) {
+  EXPECT_EQ(FloatToHalf(1.0f), 0x3c00);
+  EXPECT_EQ(FloatToHalf(-2.0f), 0xc000);
+  EXPECT_EQ(FloatToHalf(65504.0f), 0x7bff);
+  EXPECT_EQ(FloatToHalf(1e10f), 0x7bff);
+  EXPECT_EQ(FloatToHalf(-std::numeric_limits<float>::infinity()), 0xfbff);
+  EXPECT_EQ(FloatToHalf(std::pow(2.0f, -24.0f)), 0x0001);
+  EXPECT_EQ(FloatToHalf(0.0f), 0x0000);
+  // halfway between 1 and the next half rounds to even, above it rounds up
+  EXPECT_EQ(FloatToHalf(1.0f + std::pow(2.0f, -11.0f)), 0x3c00);
+  EXPECT_EQ(FloatToHalf(1.0f + 3 * std::pow(2.0f, -11.0f)), 0x3c02);
+  EXPECT_EQ(FloatToHalf(1.0f + 1.5f * std::pow(2.0f, -11.0f)), 0x3c01);
+  EXPECT_TRUE(std::isnan(HalfToFloat(
+      FloatToHalf(std::numeric_limits<float>::quiet_NaN()))));
+  for (uint32_t h = 0; h < 0x7c00; ++h) {
+    uint16_t half = h;
+    ASSERT_EQ(FloatToHalf(HalfToFloat(half)), half);
+    uint16_t neg = h | 0x8000;
+    ASSERT_EQ(FloatToHalf(HalfToFloat(neg)), neg);
+  }
+}
+
+TEST(SparseWireCodec, BFloat16) {
+  EXPECT_EQ(FloatToBFloat16(1.0f), 0x3f80);
+  EXPECT_EQ(BFloat16ToFloat(0x3f80), 1.0f);
+  EXPECT_EQ(FloatToBFloat16(1.0f + std::pow(2.0f, -8.0f)), 0x3f80);
+  EXPECT_EQ(FloatToBFloat16(1.0f + 3 * std::pow(2.0f, -8.0f)), 0x3f82);
+  EXPECT_TRUE(std::isnan(BFloat16ToFloat(
+      FloatToBFloat16(std::numeric_limits<float>::quiet_NaN()))));
+  std::mt19937 engine(0);
+  std::uniform_real_distribution<float> uniform(-100, 100);
+  for (int i = 0; i < 10000; ++i) {
+    float value = uniform(engine);
+    ASSERT_NEAR(BFloat16ToFloat(FloatToBFloat16(value)),
+                value,
+                std::fabs(value) / 256);
+  }
+}
+
+// the floats before embedx go exact, embedx within the error of the precision
+TEST(SparseWireCodec, Codec) {
+  const size_t dim = 3 + 64;
+  const size_t embedx_dim = 64;
+  std::mt19937 engine(0);
+  std::uniform_real_distribution<float> uniform(-1, 1);
+  std::vector<float> value(dim);
+  for (auto& v : value) {
+    v = uniform(engine);
+  }
+  value[0] = 123456.789f;
+  float max_abs = 0;
+  for (size_t i = dim - embedx_dim; i < dim; ++i) {
+    max_abs = std::max(max_abs, std::fabs(value[i]));
+  }
+
+  std::vector<std::pair<SparseWirePrecision, float>> cases = {
+      {SPARSE_WIRE_FP32, 0.0f},
+      {SPARSE_WIRE_FP16, 1.0f / 2048},
+      {SPARSE_WIRE_BF16, 1.0f / 256},
+      {SPARSE_WIRE_INT8, max_abs / 254 * 1.0001f}};
+  for (auto& c : cases) {
+    SparseWireCodec codec(c.first, dim, embedx_dim);
+    EXPECT_EQ(codec.IsExact(), c.first == SPARSE_WIRE_FP32);
+    std::vector<char> encoded(codec.EncodedSize());
+    std::vector<float> decoded(dim);
+    codec.Encode(value.data(), encoded.data());
+    codec.Decode(encoded.data(), decoded.data());
+    for (size_t i = 0; i < dim - embedx_dim; ++i) {
+      ASSERT_EQ(decoded[i], value[i]);
+    }
+    for (size_t i = dim - embedx_dim; i < dim; ++i) {
+      ASSERT_NEAR(decoded[i], value[i], c.second) << c.first;
+    }
+  }
+
+  EXPECT_EQ(SparseWireCodec(SPARSE_WIRE_FP32, dim, embedx_dim).EncodedSize(),
+            dim * sizeof(float));
+  EXPECT_EQ(SparseWireCodec(SPARSE_WIRE_FP16, dim, embedx_dim).EncodedSize(),
+            3 * sizeof(float) + embedx_dim * 2);
+  EXPECT_EQ(SparseWireCodec(SPARSE_WIRE_INT8, dim, embedx_dim).EncodedSize(),
+            4 * sizeof(float) + embedx_dim);
+
+  // a value of zeros has a scale of zero
+  std::vector<float> zeros(dim, 0.0f);
+  SparseWireCodec int8(SPARSE_WIRE_INT8, dim, embedx_dim);
+  std::vector<char> encoded(int8.EncodedSize());
+  std::vector<float> decoded(dim, 1.0f);
+  int8.Encode(zeros.data(), encoded.data());
+  int8.Decode(encoded.data(), decoded.data());
+  EXPECT_EQ(decoded, zeros);
+}
+
+// Toy CTR model with the pulls and pushes of embedx through the codec: a
+// slot embedding sum into a sigmoid, trained by sgd on clicks drawn from a
+// hidden model. Logloss and AUC on held out samples have to stay close to the
+// ones of fp32.
+struct CtrResult {
+  double logloss;
+  double auc;
+};
+
+static double Auc(std::vector<std::pair<float, int>> preds) {
+  std::sort(preds.begin(), preds.end());
+  double pos = 0;
+  double neg = 0;
+  double area = 0;
+  for (auto& p : preds) {
+    if (p.second) {
+      pos += 1;
+    } else {
+      area += pos;
+      neg += 1;
+    }
+  }
+  return 1 - area / (pos * neg);
+}
+
+static CtrResult TrainCtr(SparseWirePrecision precision) {
+  const size_t slot_num = 8;
+  const size_t feasign_num = 200;
+  const size_t embedx_dim = 64;
+  // show, click and the embedx weights, as a pull value of CtrCommonAccessor
+  const size_t dim = 2 + embedx_dim;
+  SparseWireCodec pull_codec(precision, dim, embedx_dim);
+  SparseWireCodec push_codec(precision, dim, embedx_dim);
+
+  std::mt19937 engine(0);
+  std::normal_distribution<float> normal(0, 1);
+  std::uniform_int_distribution<size_t> feasign(0, feasign_num - 1);
+  std::uniform_real_distribution<float> uniform(0, 1);
+  std::vector<float> hidden(slot_num * feasign_num);
+  for (auto& h : hidden) {
+    h = normal(engine) * 0.5f;
+  }
+  std::vector<float> table(slot_num * feasign_num * dim);
+  for (size_t i = 0; i < slot_num * feasign_num; ++i) {
+    for (size_t j = 2; j < dim; ++j) {
+      table[i * dim + j] = normal(engine) * 0.01f;
+    }
+  }
+  std::vector<float> user(embedx_dim, 1.0f / embedx_dim);
+
+  auto sample = [&](std::vector<size_t>* ids) {
+    float logit = 0;
+    for (size_t s = 0; s < slot_num; ++s) {
+      (*ids)[s] = s * feasign_num + feasign(engine);
+      logit += hidden[(*ids)[s]];
+    }
+    return uniform(engine) < 1 / (1 + std::exp(-logit)) ? 1 : 0;
+  };
+
+  std::vector<char> encoded(std::max(pull_codec.EncodedSize(),
+                                     push_codec.EncodedSize()));
+  std::vector<std::vector<float>> pulled(slot_num, std::vector<float>(dim));
+  auto predict = [&](const std::vector<size_t>& ids) {
+    float logit = 0;
+    for (size_t s = 0; s < slot_num; ++s) {
+      pull_codec.Encode(&table[ids[s] * dim], encoded.data());
+      pull_codec.Decode(encoded.data(), pulled[s].data());
+      for (size_t j = 2; j < dim; ++j) {
+        logit += pulled[s][j] * user[j - 2];
+      }
+    }
+    return 1 / (1 + std::exp(-logit));
+  };
+
+  const float learning_rate = 0.5f;
+  std::vector<size_t> ids(slot_num);
+  std::vector<float> grad(dim);
+  std::vector<float> pushed(dim);
+  for (int step = 0; step < 100000; ++step) {
+    int click = sample(&ids);
+    float diff = predict(ids) - click;
+    for (size_t s = 0; s < slot_num; ++s) {
+      grad[0] = 1;
+      grad[1] = click;
+      for (size_t j = 2; j < dim; ++j) {
+        grad[j] = diff * user[j - 2];
+      }
+      push_codec.Encode(grad.data(), encoded.data());
+      push_codec.Decode(encoded.data(), pushed.data());
+      float* value = &table[ids[s] * dim];
+      value[0] += pushed[0];
+      value[1] += pushed[1];
+      for (size_t j = 2; j < dim; ++j) {
+        value[j] -= learning_rate * pushed[j];
+      }
+    }
+  }
+
+  CtrResult result = {0, 0};
+  std::vector<std::pair<float, int>> preds;
+  for (int i = 0; i < 20000; ++i) {
+    int click = sample(&ids);
+    float pred = std::min(std::max(predict(ids), 1e-7f), 1 - 1e-7f);
+    result.logloss -= click ? std::log(pred) : std::log(1 - pred);
+    preds.push_back({pred, click});
+  }
+  result.logloss /= preds.size();
+  result.auc = Auc(preds);
+  return result;
+}
+
+TEST(SparseWireCodec, CtrAccuracyDrift) {
+  CtrResult fp32 = TrainCtr(SPARSE_WIRE_FP32);
+  // the model has to learn something for the drift to mean anything
+  EXPECT_GT(fp32.auc, 0.7);
+  for (auto precision : {SPARSE_WIRE_FP16, SPARSE_WIRE_BF16, SPARSE_WIRE_INT8}) {
+    CtrResult result = TrainCtr(precision);
+    EXPECT_NEAR(result.logloss, fp32.logloss, 0.005) << precision;
+    EXPECT_NEAR(result.auc, fp32.auc, 0.005) << precision;
+  }
+}
+
+}  // namespace distributed
+}  // namespace paddle
@@ -0,0 +1,330 @@
+/* Copyright (c) 2022 PaddlePaddle Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License. */
+
+#include "paddle/fluid/distributed/ps/table/ssd_sparse_table.h"
+
+#include <chrono>  // NOLINT
+#include <fstream>
+#include <memory>
+#include <set>
+#include <sstream>
+#include <string>
+#include <thread>  // NOLINT
+#include <vector>
+
+#include "gflags/gflags.h"
+#include "gtest/gtest.h"
+#include "paddle/fluid/distributed/ps/table/depends/rocksdb_warpper.h"
+#include "paddle/fluid/distributed/ps/table/table.h"
+#include "paddle/fluid/distributed/the_one_ps.pb.h"
+#include "paddle/fluid/framework/io/fs.h"
+
+DECLARE_string(rocksdb_path);
+
+namespace paddle {
+namespace distributed {
+
+static const int kEmbDim = 8;
+
+class TestSSDSparseTable : public SSDSparseTable {
+ public:
+  // keeps the task queues of the shards busy for ms, the tasks queued after
+  // run late
+  void BlockShards(int ms) {
+    for (auto &pool : _shards_task_pool) {
+      pool->enqueue([ms]() {
+        std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+      });
+    }
+  }
+};
+
+// a table of 4 shards over a rocksdb of its own at path, the 4 shards keep
+// mem_keys values in memory and UpdateTable moves the values unseen for more
+// than unseen_days to rocksdb. With reopen the db of the last table at path
+// is reopened
+static std::unique_ptr<TestSSDSparseTable> MakeSSDTable(
+    const std::string &path,
+    SSDCachePolicy policy,
+    int mem_keys,
+    int unseen_days = 1,
+    bool reopen = false) {
+  TableParameter table_config;
+  table_config.set_table_class("SSDSparseTable");
+  table_config.set_shard_num(4);
+  table_config.set_ssd_cache_policy(policy);
+  table_config.set_ssd_cache_mem_keys(mem_keys);
+  table_config.set_compress_in_save(false);
+  table_config.mutable_rocksdb_param()->set_reopen_existing(reopen);
+  TableAccessorParameter *accessor_config = table_config.mutable_accessor();
+  accessor_config->set_accessor_class("CtrCommonAccessor");
+  accessor_config->set_fea_dim(11);
+  accessor_config->set_embedx_dim(kEmbDim);
+  accessor_config->set_embedx_threshold(0);
+  auto *ctr_param = accessor_config->mutable_ctr_accessor_param();
+  ctr_param->set_nonclk_coeff(0.1);
+  ctr_param->set_click_coeff(1);
+  ctr_param->set_show_click_decay_rate(0.99);
+  ctr_param->set_ssd_unseenday_threshold(unseen_days);
+  accessor_config->mutable_embed_sgd_param()->set_name("SparseNaiveSGDRule");
+  accessor_config->mutable_embedx_sgd_param()->set_name("SparseNaiveSGDRule");
+
+  FLAGS_rocksdb_path = path;
+  FsClientParameter fs_config;
+  std::unique_ptr<TestSSDSparseTable> table(new TestSSDSparseTable());
+  table->SetShard(0, 1);
+  Table *base = table.get();
+  EXPECT_EQ(base->Initialize(table_config, fs_config), 0);
+  return table;
+}
+
+static std::vector<uint64_t> KeyRange(uint64_t begin, uint64_t end) {
+  std::vector<uint64_t> keys;
+  for (uint64_t key = begin; key < end; ++key) {
+    keys.push_back(key);
+  }
+  return keys;
+}
+
+// pushes the show of each key in keys[i], shows[i]
+static void PushShows(SSDSparseTable *table,
+                      const std::vector<uint64_t> &keys,
+                      const std::vector<float> &shows) {
+  std::vector<float> grads;
+  for (size_t i = 0; i < keys.size(); ++i) {
+    grads.push_back(0);         // slot
+    grads.push_back(shows[i]);  // show
+    for (int k = 0; k < kEmbDim + 2; ++k) {
+      grads.push_back(0);
+    }
+  }
+  ASSERT_EQ(table->PushSparse(keys.data(), grads.data(), keys.size()), 0);
+}
+
+// pulls the keys [begin, end) and returns their shows
+static std::vector<float> PullShows(SSDSparseTable *table,
+                                    uint64_t begin,
+                                    uint64_t end) {
+  auto keys = KeyRange(begin, end);
+  size_t select_dim = kEmbDim + 3;
+  std::vector<float> values(keys.size() * select_dim);
+  EXPECT_EQ(table->PullSparse(values.data(), keys.data(), keys.size()), 0);
+  std::vector<float> shows;
+  for (size_t i = 0; i < keys.size(); ++i) {
+    shows.push_back(values[i * select_dim]);
+  }
+  return shows;
+}
+
+static std::set<uint64_t> SavedKeys(const std::string &dirname) {
+  std::set<uint64_t> keys;
+  for (int i = 0; i < 4; ++i) {
+    std::ifstream file(dirname + "/000/part-000-0000" + std::to_string(i));
+    EXPECT_TRUE(file.good());
+    std::string line;
+    while (std::getline(file, line)) {
+      uint64_t key = 0;
+      std::istringstream(line) >> key;
+      EXPECT_TRUE(keys.insert(key).second);
+    }
+  }
+  return keys;
+}
+
+// UpdateTable moves the values of the lowest shows of each shard to rocksdb,
+// the pulls find them there and the others in memory
+TEST(SSDSparseTable, EvictShow) {
+  auto table = MakeSSDTable("ssd_sparse_table_test_evict", SSD_CACHE_SHOW, 40);
+  auto keys = KeyRange(0, 200);
+  PushShows(table.get(), keys, std::vector<float>(keys.begin(), keys.end()));
+  ASSERT_EQ(table->UpdateTable(), 0);
+  ASSERT_EQ(table->LocalSize(), 40);
+  ASSERT_EQ(table->CacheStat().evict, 160UL);
+
+  auto shows = PullShows(table.get(), 160, 200);
+  auto stat = table->CacheStat();
+  EXPECT_EQ(stat.mem_hit, 40UL);
+  EXPECT_EQ(stat.ssd_hit, 0UL);
+  shows = PullShows(table.get(), 0, 200);
+  for (uint64_t key = 0; key < 200; ++key) {
+    ASSERT_EQ(shows[key], key);
+  }
+  stat = table->CacheStat();
+  EXPECT_EQ(stat.mem_hit, 80UL);
+  EXPECT_EQ(stat.ssd_hit, 160UL);
+  EXPECT_EQ(stat.miss, 0UL);
+  PullShows(table.get(), 1000, 1010);
+  EXPECT_EQ(table->CacheStat().miss, 10UL);
+}
+
+// with SSD_CACHE_TINYLFU the keys pulled most stay in memory
+TEST(SSDSparseTable, EvictTinyLFU) {
+  auto table =
+      MakeSSDTable("ssd_sparse_table_test_tinylfu", SSD_CACHE_TINYLFU, 40);
+  auto keys = KeyRange(0, 200);
+  PushShows(table.get(), keys, std::vector<float>(keys.size(), 1));
+  PullShows(table.get(), 0, 200);
+  for (int i = 0; i < 5; ++i) {
+    PullShows(table.get(), 0, 40);
+  }
+  ASSERT_EQ(table->UpdateTable(), 0);
+  ASSERT_EQ(table->LocalSize(), 40);
+  auto before = table->CacheStat();
+  PullShows(table.get(), 0, 40);
+  auto after = table->CacheStat();
+  EXPECT_EQ(after.mem_hit - before.mem_hit, 40UL);
+  EXPECT_EQ(after.ssd_hit - before.ssd_hit, 0UL);
+}
+
+// over ssd_cache_mem_keys a prefetch loads only the values that score above
+// the ones the last UpdateTable evicted
+TEST(SSDSparseTable, PrefetchAdmit) {
+  auto table = MakeSSDTable("ssd_sparse_table_test_admit", SSD_CACHE_SHOW, 40);
+  // 1000..1039 go to rocksdb against 0..39, then 40..199 against both
+  auto hot_keys = KeyRange(0, 40);
+  auto warm_keys = KeyRange(1000, 1040);
+  auto cold_keys = KeyRange(40, 200);
+  PushShows(table.get(), hot_keys, std::vector<float>(hot_keys.size(), 20));
+  PushShows(table.get(), warm_keys, std::vector<float>(warm_keys.size(), 10));
+  ASSERT_EQ(table->UpdateTable(), 0);
+  PushShows(table.get(), cold_keys, std::vector<float>(cold_keys.size(), 1));
+  ASSERT_EQ(table->UpdateTable(), 0);
+  ASSERT_EQ(table->CacheStat().evict, 200UL);
+
+  table->Prefetch(warm_keys.data(), warm_keys.size());
+  table->Prefetch(cold_keys.data(), cold_keys.size());
+  // the pulls run after the prefetches in the task queues of the shards
+  PullShows(table.get(), 1000, 1040);
+  PullShows(table.get(), 40, 200);
+  auto stat = table->CacheStat();
+  EXPECT_EQ(stat.prefetch_key, 200UL);
+  EXPECT_EQ(stat.prefetch_load, 40UL);
+  EXPECT_EQ(stat.prefetch_reject, 160UL);
+  EXPECT_EQ(stat.mem_hit, 40UL);
+  EXPECT_EQ(stat.ssd_hit, 160UL);
+}
+
+// Save and Load wait for the prefetches queued before them, a save does not
+// miss the values moving from rocksdb to memory
+TEST(SSDSparseTable, SaveLoadWaitPrefetch) {
+  auto table = MakeSSDTable(
+      "ssd_sparse_table_test_save", SSD_CACHE_UNSEEN_DAYS, 0, -1);
+  auto keys = KeyRange(0, 200);
+  PushShows(table.get(), keys, std::vector<float>(keys.size(), 1));
+  ASSERT_EQ(table->UpdateTable(), 0);
+  ASSERT_EQ(table->LocalSize(), 0);
+
+  table->BlockShards(200);
+  table->Prefetch(keys.data(), keys.size());
+  ASSERT_EQ(table->Save("ssd_sparse_table_test_model", "0"), 0);
+  EXPECT_EQ(table->CacheStat().prefetch_load, 200UL);
+  EXPECT_EQ(table->LocalSize(), 200);
+  EXPECT_EQ(SavedKeys("ssd_sparse_table_test_model").size(), 200UL);
+
+  ASSERT_EQ(table->UpdateTable(), 0);
+  ASSERT_EQ(table->LocalSize(), 0);
+  table->BlockShards(200);
+  table->Prefetch(keys.data(), keys.size());
+  ASSERT_EQ(table->Load("ssd_sparse_table_test_model", "0"), 0);
+  EXPECT_EQ(table->CacheStat().prefetch_load, 400UL);
+}
+
+// a cleared table drops the values UpdateTable moved to rocksdb too, they
+// are pulled again as new keys
+TEST(SSDSparseTable, Clear) {
+  auto table = MakeSSDTable("ssd_sparse_table_test_clear", SSD_CACHE_SHOW, 40);
+  auto keys = KeyRange(0, 200);
+  PushShows(table.get(), keys, std::vector<float>(keys.size(), 1));
+  ASSERT_EQ(table->UpdateTable(), 0);
+  ASSERT_EQ(table->LocalSize(), 40);
+  ASSERT_EQ(table->CacheStat().evict, 160UL);
+
+  table->Clear();
+  ASSERT_EQ(table->LocalSize(), 0);
+  auto before = table->CacheStat();
+  for (float show : PullShows(table.get(), 0, 200)) {
+    ASSERT_EQ(show, 0);
+  }
+  auto after = table->CacheStat();
+  EXPECT_EQ(after.ssd_hit - before.ssd_hit, 0UL);
+  EXPECT_EQ(after.miss - before.miss, 200UL);
+}
+
+// a model loaded over a reopened db is saved with each key once, the keys
+// Load put in memory are no longer in rocksdb
+TEST(SSDSparseTable, SaveAfterReopenLoad) {
+  const std::string path = "ssd_sparse_table_test_reopen_load";
+  paddle::framework::fs_remove(path);
+  {
+    auto table = MakeSSDTable(path, SSD_CACHE_SHOW, 40, 1, true);
+    auto keys = KeyRange(0, 200);
+    PushShows(table.get(), keys, std::vector<float>(keys.begin(), keys.end()));
+    ASSERT_EQ(table->UpdateTable(), 0);
+    ASSERT_EQ(table->LocalSize(), 40);
+    ASSERT_EQ(table->Save("ssd_sparse_table_test_reopen_model", "0"), 0);
+    EXPECT_EQ(SavedKeys("ssd_sparse_table_test_reopen_model").size(), 200UL);
+  }
+
+  auto table = MakeSSDTable(path, SSD_CACHE_SHOW, 40, 1, true);
+  ASSERT_EQ(table->Load("ssd_sparse_table_test_reopen_model", "0"), 0);
+  ASSERT_EQ(table->LocalSize(), 200);
+  ASSERT_EQ(table->Save("ssd_sparse_table_test_reopen_save", "0"), 0);
+  EXPECT_EQ(SavedKeys("ssd_sparse_table_test_reopen_save").size(), 200UL);
+  auto shows = PullShows(table.get(), 0, 200);
+  for (uint64_t key = 0; key < 200; ++key) {
+    ASSERT_EQ(shows[key], key);
+  }
+  EXPECT_EQ(table->CacheStat().ssd_hit, 0UL);
+
+  table.reset();
+  // later runs must not reopen the db
+  paddle::framework::fs_remove(path);
+  paddle::framework::fs_remove("ssd_sparse_table_test_reopen_model");
+  paddle::framework::fs_remove("ssd_sparse_table_test_reopen_save");
+}
+
+// a db is reopened with its values only by the layout it was written with
+TEST(RocksDBHandler, ReopenLayout) {
+  const std::string path = "ssd_sparse_table_test_reopen";
+  paddle::framework::fs_remove(path);
+  RocksDBParameter param;
+  param.set_reopen_existing(true);
+  {
+    RocksDBHandler handler;
+    ASSERT_EQ(handler.initialize(path, 2, param, "layout_a"), 0);
+    uint64_t key = 1;
+    float value = 2;
+    handler.put(1,
+                reinterpret_cast<char *>(&key),
+                sizeof(key),
+                reinterpret_cast<char *>(&value),
+                sizeof(value));
+    handler.flush(1);
+
+    std::string found;
+    ASSERT_EQ(handler.initialize(path, 2, param, "layout_a"), 0);
+    ASSERT_EQ(
+        handler.get(1, reinterpret_cast<char *>(&key), sizeof(key), found), 0);
+    EXPECT_EQ(*reinterpret_cast<const float *>(found.data()), value);
+
+    ASSERT_EQ(handler.initialize(path, 4, param, "layout_b"), 0);
+    EXPECT_EQ(
+        handler.get(1, reinterpret_cast<char *>(&key), sizeof(key), found), 1);
+  }
+  // the handler closed the db, later runs must not reopen it
+  paddle::framework::fs_remove(path);
+}
+
+}  // namespace distributed
+}  // namespace paddle
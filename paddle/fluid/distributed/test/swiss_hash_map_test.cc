@@ -0,0 +1,127 @@
+/* Copyright (c) 2022 PaddlePaddle Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License. */
+
+#include "paddle/fluid/distributed/common/swiss_hash_map.h"
+
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "paddle/fluid/distributed/ps/table/depends/feature_value.h"
+
+namespace paddle {
+namespace distributed {
+
+TEST(SwissHashMap, RandomOps) {
+  typedef SwissHashMap<uint64_t, int, SparseShardHash<uint64_t>> map_type;
+  map_type map;
+  std::unordered_map<uint64_t, int> expect;
+  std::mt19937_64 engine(0);
+  for (int i = 0; i < 200000; ++i) {
+    // few keys, so that inserts and erases hit the same slots
+    uint64_t key = engine() % 20000;
+    switch (engine() % 4) {
+      case 0:
+      case 1: {
+        auto res = map.insert({key, i});
+        auto it = expect.find(key);
+        ASSERT_EQ(res.second, it == expect.end());
+        if (res.second) {
+          expect[key] = i;
+        }
+        ASSERT_EQ(res.first->second, expect[key]);
+        break;
+      }
+      case 2:
+        ASSERT_EQ(map.erase(key), expect.erase(key));
+        break;
+      default: {
+        auto it = map.find(key);
+        auto expect_it = expect.find(key);
+        ASSERT_EQ(it == map.end(), expect_it == expect.end());
+        if (it != map.end()) {
+          ASSERT_EQ(it->second, expect_it->second);
+        }
+      }
+    }
+    ASSERT_EQ(map.size(), expect.size());
+  }
+
+  size_t num = 0;
+  for (auto it = map.begin(); it != map.end(); ++it, ++num) {
+    ASSERT_EQ(expect.at(it->first), it->second);
+  }
+  ASSERT_EQ(num, expect.size());
+
+  // erase while iterating, as Shrink does
+  for (auto it = map.begin(); it != map.end();) {
+    if (it->first % 2 == 0) {
+      expect.erase(it->first);
+      it = map.erase(it);
+    } else {
+      ++it;
+    }
+  }
+  ASSERT_EQ(map.size(), expect.size());
+  for (auto& p : expect) {
+    ASSERT_EQ(p.first % 2, 1UL);
+    ASSERT_TRUE(map.find(p.first) != map.end());
+  }
+  map.clear();
+  ASSERT_TRUE(map.empty());
+  ASSERT_TRUE(map.begin() == map.end());
+  ASSERT_TRUE(map.find(1) == map.end());
+}
+
+TEST(SwissHashMap, StringKey) {
+  SwissHashMap<std::string, std::vector<int>> map;
+  for (int i = 0; i < 1000; ++i) {
+    map.insert({std::to_string(i), std::vector<int>(i % 5, i)});
+  }
+  ASSERT_EQ(map.size(), 1000UL);
+  for (int i = 0; i < 1000; ++i) {
+    auto it = map.find(std::to_string(i));
+    ASSERT_TRUE(it != map.end());
+    ASSERT_EQ(it->second.size(), static_cast<size_t>(i % 5));
+  }
+}
+
+TEST(SwissHashMap, SlabShard) {
+  typedef SwissHashMap<uint64_t, SlabEntry, SparseShardHash<uint64_t>>
+      map_type;
+  SlabSparseTableShard<uint64_t, map_type> shard;
+  // slot prefixed feasigns only differ in their low bits
+  for (uint64_t i = 0; i < 50000; ++i) {
+    uint64_t key = (7ULL << 48) | i;
+    auto value = shard[key];
+    value.resize(3);
+    value.data()[2] = i;
+  }
+  ASSERT_EQ(shard.size(), 50000UL);
+  size_t max_bucket_size = 0;
+  for (size_t bucket = 0; bucket < shard.bucket_count(); ++bucket) {
+    max_bucket_size = std::max(max_bucket_size, shard.bucket_size(bucket));
+  }
+  ASSERT_LT(max_bucket_size, 50000UL / shard.bucket_count() * 2);
+  for (uint64_t i = 0; i < 50000; i += 7) {
+    auto it = shard.find((7ULL << 48) | i);
+    ASSERT_TRUE(it != shard.end());
+    ASSERT_FLOAT_EQ(it.value().data()[2], i);
+  }
+}
+
+}  // namespace distributed
+}  // namespace paddle
@@ -22,11 +22,13 @@
 #include <glog/logging.h>
 
 #include <algorithm>
+#include <atomic>
 #include <condition_variable>  // NOLINT
 #include <deque>
 #include <limits>
 #include <memory>
-#include <mutex>  // NOLINT
+#include <mutex>   // NOLINT
+#include <thread>  // NOLINT
 #include <utility>
 #include <vector>
 
@@ -35,6 +37,152 @@
 namespace paddle {
 namespace framework {
 
+// Storage used by a ChannelObject.
+//   kDeque: std::deque guarded by one mutex, capacity may be unbounded.
+//   kLockFreeRing: bounded MPMC ring, readers and writers only meet on a
+//                  CAS of their own cursor; the mutex is touched only to
+//                  park a thread that found the ring empty or full.
+enum class ChannelBackend { kDeque = 0, kLockFreeRing = 1 };
+
+// Bounded multi-producer/multi-consumer queue (Dmitry Vyukov's algorithm).
+// Every cell carries a sequence number telling whether it is ready to be
+// written or read in the current lap, so no lock is needed.
+template <class T>
+class MpmcRingBuffer {
+ public:
+  explicit MpmcRingBuffer(size_t capacity) {
+    size_t size = 2;
+    while (size < capacity) {
+      size <<= 1;
+    }
+    mask_ = size - 1;
+    cells_.reset(new Cell[size]);
+    for (size_t i = 0; i < size; ++i) {
+      cells_[i].seq.store(i, std::memory_order_relaxed);
+    }
+    enqueue_pos_.store(0, std::memory_order_relaxed);
+    dequeue_pos_.store(0, std::memory_order_relaxed);
+  }
+
+  MpmcRingBuffer(const MpmcRingBuffer&) = delete;
+  MpmcRingBuffer& operator=(const MpmcRingBuffer&) = delete;
+
+  size_t Capacity() const { return mask_ + 1; }
+
+  // approximate when called concurrently with push/pop
+  size_t Size() const {
+    size_t tail = enqueue_pos_.load(std::memory_order_acquire);
+    size_t head = dequeue_pos_.load(std::memory_order_acquire);
+    return tail > head ? tail - head : 0;
+  }
+
+  bool Empty() const { return Size() == 0; }
+
+  bool Full() const { return Size() >= Capacity(); }
+
+  // returns false if the ring is full, val is moved only on success
+  template <class U>
+  bool TryPush(U&& val) {
+    size_t pos = 0;
+    if (Claim(&enqueue_pos_, 0, 1, &pos) == 0) {
+      return false;
+    }
+    Cell& cell = cells_[pos & mask_];
+    cell.data = std::forward<U>(val);
+    cell.seq.store(pos + 1, std::memory_order_release);
+    return true;
+  }
+
+  // returns false if the ring is empty
+  bool TryPop(T* val) { return TryPopBatch(val, 1) != 0; }
+
+  // pushes up to n values with a single CAS on the enqueue cursor and
+  // returns how many were pushed, values are moved out of p if move is true
+  template <class P>
+  size_t TryPushBatch(P* p, size_t n, bool move) {
+    size_t pos = 0;
+    size_t m = Claim(&enqueue_pos_, 0, n, &pos);
+    for (size_t i = 0; i < m; ++i) {
+      Cell& cell = cells_[(pos + i) & mask_];
+      if (move) {
+        cell.data = std::move(p[i]);
+      } else {
+        cell.data = p[i];
+      }
+      cell.seq.store(pos + i + 1, std::memory_order_release);
+    }
+    return m;
+  }
+
+  // pops up to n values with a single CAS on the dequeue cursor
+  size_t TryPopBatch(T* p, size_t n) {
+    size_t pos = 0;
+    size_t m = Claim(&dequeue_pos_, 1, n, &pos);
+    for (size_t i = 0; i < m; ++i) {
+      Cell& cell = cells_[(pos + i) & mask_];
+      p[i] = std::move(cell.data);
+      cell.seq.store(pos + i + mask_ + 1, std::memory_order_release);
+    }
+    return m;
+  }
+
+ private:
+  static constexpr size_t kCacheLineSize = 64;
+
+  struct Cell {
+    std::atomic<size_t> seq;
+    T data;
+  };
+
+  // Claims up to n consecutive cells whose sequence equals pos + i + lag
+  // (lag is 0 for writers and 1 for readers) by moving the cursor forward
+  // once. A cell seen ready stays ready until its claimer releases it, so
+  // checking all cells before the CAS is safe.
+  size_t Claim(std::atomic<size_t>* cursor,
+               size_t lag,
+               size_t n,
+               size_t* claimed_pos) {
+    size_t pos = cursor->load(std::memory_order_relaxed);
+    for (;;) {
+      size_t m = 0;
+      bool moved = false;
+      while (m < n && m <= mask_) {
+        size_t seq =
+            cells_[(pos + m) & mask_].seq.load(std::memory_order_acquire);
+        intptr_t diff =
+            static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + m + lag);
+        if (diff != 0) {
+          // the cursor has moved on if diff > 0 on the first cell
+          moved = (m == 0 && diff > 0);
+          break;
+        }
+        ++m;
+      }
+      if (m == 0 && !moved) {
+        return 0;
+      }
+      if (m == 0) {
+        pos = cursor->load(std::memory_order_relaxed);
+        continue;
+      }
+      if (cursor->compare_exchange_weak(
+              pos, pos + m, std::memory_order_relaxed)) {
+        *claimed_pos = pos;
+        return m;
+      }
+    }
+  }
+
+  std::unique_ptr<Cell[]> cells_;
+  size_t mask_ = 0;
+  // keep both cursors on their own cache line
+  char pad0_[kCacheLineSize];
+  std::atomic<size_t> enqueue_pos_;
+  char pad1_[kCacheLineSize - sizeof(std::atomic<size_t>)];
+  std::atomic<size_t> dequeue_pos_;
+  char pad2_[kCacheLineSize - sizeof(std::atomic<size_t>)];
+};
+
 template <class T>
 class ChannelObject {
  public:
@@ -45,8 +193,32 @@ class ChannelObject {
     capacity_ = (std::min)(MaxCapacity(), capacity);
   }
 
-  const std::deque<T>& GetData() const { return data_; }
+  // kLockFreeRing needs a bounded capacity, it is rounded up to a power of 2
+  ChannelObject(size_t capacity, ChannelBackend backend) : backend_(backend) {
+    capacity_ = (std::min)(MaxCapacity(), capacity);
+    if (backend_ == ChannelBackend::kLockFreeRing) {
+      CHECK(capacity_ < MaxCapacity())
+          << "lock-free ring channel must have a bounded capacity";
+      ring_.reset(new MpmcRingBuffer<T>(capacity_));
+      capacity_ = ring_->Capacity();
+    }
+  }
+
+  ChannelBackend Backend() const { return backend_; }
+
+  const std::deque<T>& GetData() const {
+    CHECK(backend_ == ChannelBackend::kDeque)
+        << "GetData is only supported by deque channel";
+    return data_;
+  }
   void Clear() {
+    if (ring_ != nullptr) {
+      T val;
+      while (ring_->TryPop(&val)) {
+      }
+      NotifyRing();
+      return;
+    }
     std::unique_lock<std::mutex> lock(mutex_);
     data_.clear();
     data_.shrink_to_fit();
@@ -57,6 +229,7 @@ class ChannelObject {
   }
 
   void SetCapacity(size_t x) {  // capacity can be zero
+    CHECK(ring_ == nullptr) << "can not resize lock-free ring channel";
     std::lock_guard<std::mutex> lock(mutex_);
     capacity_ = std::min(MaxCapacity(), x);
     Notify();
@@ -75,7 +248,9 @@ class ChannelObject {
   template <class U>
   void InheritFrom(const std::shared_ptr<ChannelObject<U>>& other) {
     std::lock_guard<std::mutex> lock(mutex_);
-    capacity_ = other->Capacity();
+    if (ring_ == nullptr) {
+      capacity_ = other->Capacity();
+    }
     block_size_ = other->BlockSize();
   }
 
@@ -98,11 +273,17 @@ class ChannelObject {
   }
 
   size_t Size() {
+    if (ring_ != nullptr) {
+      return ring_->Size();
+    }
     std::lock_guard<std::mutex> lock(mutex_);
     return data_.size();
   }
 
   bool Empty() {
+    if (ring_ != nullptr) {
+      return ring_->Empty();
+    }
     std::lock_guard<std::mutex> lock(mutex_);
     return EmptyUnlocked();
   }
@@ -116,6 +297,9 @@ class ChannelObject {
     if (n == 0) {
       return 0;
     }
+    if (ring_ != nullptr) {
+      return RingRead(n, p, false);
+    }
 
     std::unique_lock<std::mutex> lock(mutex_);
     size_t finished = Read(n, p, lock);
@@ -135,6 +319,9 @@ class ChannelObject {
     if (n == 0) {
       return 0;
     }
+    if (ring_ != nullptr) {
+      return RingWrite(n, p);
+    }
     std::unique_lock<std::mutex> lock(mutex_);
     size_t finished = Write(n, p, lock);
     Notify();
@@ -146,6 +333,9 @@ class ChannelObject {
     if (n == 0) {
       return 0;
     }
+    if (ring_ != nullptr) {
+      return RingWrite(n, p, true);
+    }
     std::unique_lock<std::mutex> lock(mutex_);
     size_t finished = WriteMove(n, p, lock);
     Notify();
@@ -164,6 +354,12 @@ class ChannelObject {
     if (size == 0) {
       return 0;
     }
+    if (ring_ != nullptr) {
+      p.resize(size);
+      size_t finished = RingRead(size, &p[0], true);
+      p.resize(finished);
+      return finished;
+    }
     std::unique_lock<std::mutex> lock(mutex_);
     p.resize(size);
     size_t finished = Read(size, &p[0], lock, true);
@@ -196,21 +392,33 @@ class ChannelObject {
  private:
   size_t capacity_ = MaxCapacity();
   size_t block_size_ = 1024;
-  bool closed_ = false;
+  std::atomic<bool> closed_{false};
   std::mutex mutex_;
+  ChannelBackend backend_ = ChannelBackend::kDeque;
   // use deque to store data
   std::deque<T> data_;
+  // or a lock-free ring when backend_ is kLockFreeRing
+  std::unique_ptr<MpmcRingBuffer<T>> ring_;
   size_t reading_count_ = 0;
-  int empty_waiters_ = 0;
-  int full_waiters_ = 0;
+  // only changed with mutex_ held, read without lock by ring writers/readers
+  std::atomic<int> empty_waiters_{0};
+  std::atomic<int> full_waiters_{0};
   std::condition_variable empty_cond_;
   std::condition_variable full_cond_;
 
+  // ring waiters spin before they park on the condition variables
+  static constexpr int kRingSpinCount = 64;
+
   static constexpr size_t MaxCapacity() {
     return (std::numeric_limits<size_t>::max)() / 2;
   }
 
   void Notify() {
+    if (ring_ != nullptr) {
+      empty_cond_.notify_all();
+      full_cond_.notify_all();
+      return;
+    }
     if (empty_waiters_ != 0 && (!EmptyUnlocked() || closed_)) {
       empty_cond_.notify_one();
     }
@@ -255,6 +463,90 @@ class ChannelObject {
     return !closed_;
   }
 
+  // Wake up ring waiters parked on the condition variables, if any. The
+  // fence pairs with the one in RingWait: either this thread sees the
+  // waiter registered, or the waiter sees the ring change before it parks.
+  // Notifying under mutex_ then can not fall between the waiter's last
+  // check and its wait.
+  void NotifyRing() {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (empty_waiters_.load(std::memory_order_relaxed) != 0 ||
+        full_waiters_.load(std::memory_order_relaxed) != 0) {
+      std::lock_guard<std::mutex> lock(mutex_);
+      empty_cond_.notify_all();
+      full_cond_.notify_all();
+    }
+  }
+
+  template <class Ready>
+  void RingWait(std::atomic<int>* waiters,
+                std::condition_variable* cond,
+                Ready ready) {
+    for (int i = 0; i < kRingSpinCount; ++i) {
+      if (ready()) {
+        return;
+      }
+      std::this_thread::yield();
+    }
+    std::unique_lock<std::mutex> lock(mutex_);
+    waiters->fetch_add(1);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    while (!ready()) {
+      cond->wait(lock);
+    }
+    waiters->fetch_sub(1);
+  }
+
+  size_t RingRead(size_t n, T* p, bool once) {
+    size_t finished = 0;
+    while (finished < n) {
+      size_t m = ring_->TryPopBatch(p + finished, n - finished);
+      if (m > 0) {
+        finished += m;
+        continue;
+      }
+      if (once && finished > 0) {
+        break;
+      }
+      // a writer may have pushed between TryPop and the closed check
+      if (closed_ && ring_->Empty()) {
+        break;
+      }
+      if (finished > 0) {
+        NotifyRing();
+      }
+      RingWait(&empty_waiters_, &empty_cond_, [this] {
+        return !ring_->Empty() || closed_;
+      });
+    }
+    if (finished > 0) {
+      NotifyRing();
+    }
+    return finished;
+  }
+
+  template <class P>
+  size_t RingWrite(size_t n, P* p, bool move = false) {
+    size_t finished = 0;
+    while (finished < n && !closed_) {
+      size_t m = ring_->TryPushBatch(p + finished, n - finished, move);
+      if (m > 0) {
+        finished += m;
+        continue;
+      }
+      if (finished > 0) {
+        NotifyRing();
+      }
+      RingWait(&full_waiters_, &full_cond_, [this] {
+        return !ring_->Full() || closed_;
+      });
+    }
+    if (finished > 0) {
+      NotifyRing();
+    }
+    return finished;
+  }
+
   size_t Read(size_t n,
               T* p,
               std::unique_lock<std::mutex>& lock,  // NOLINT
@@ -314,10 +606,19 @@ Channel<T> MakeChannel(size_t capacity = (std::numeric_limits<size_t>::max)()) {
   return std::make_shared<ChannelObject<T>>(capacity);
 }
 
+template <class T>
+Channel<T> MakeChannel(size_t capacity, ChannelBackend backend) {
+  return std::make_shared<ChannelObject<T>>(capacity, backend);
+}
+
 template <class T, class U>
 Channel<T> MakeChannel(const Channel<U>& other) {
   CHECK(other != nullptr) << "channel can not be NULL";
-  Channel<T> chan = std::make_shared<ChannelObject<T>>();
+  Channel<T> chan =
+      other->Backend() == ChannelBackend::kLockFreeRing
+          ? std::make_shared<ChannelObject<T>>(other->Capacity(),
+                                               other->Backend())
+          : std::make_shared<ChannelObject<T>>();
   chan->InheritFrom(other);
   return chan;
 }
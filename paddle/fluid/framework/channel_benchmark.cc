@@ -0,0 +1,109 @@
+// Copyright (c) 2022 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Compares the deque and lock-free ring backends of ChannelObject.
+// Every producer writes blocks of uint64 through Write(std::vector&&) and
+// every consumer drains with Read(std::vector&), as the data feed does.
+//   ./channel_benchmark --threads=1,2,4,8,16,32,64 --items=4000000
+
+#include <chrono>  // NOLINT
+#include <cstdio>
+#include <sstream>
+#include <string>
+#include <thread>  // NOLINT
+#include <vector>
+
+#include "gflags/gflags.h"
+#include "glog/logging.h"
+#include "paddle/fluid/framework/channel.h"
+
+DEFINE_string(threads,
+              "1,2,4,8,16,32,64",
+              "Comma separated producer(=consumer) thread counts.");
+DEFINE_int64(items, 4000000, "Total items passed through the channel.");
+DEFINE_int32(block_size, 1024, "Channel block size.");
+DEFINE_int64(capacity, 65536, "Channel capacity.");
+
+namespace paddle {
+namespace framework {
+
+static double RunOnce(ChannelBackend backend, int threads) {
+  auto chan = MakeChannel<uint64_t>(FLAGS_capacity, backend);
+  chan->SetBlockSize(FLAGS_block_size);
+  int64_t per_thread = FLAGS_items / threads;
+
+  auto start = std::chrono::steady_clock::now();
+  std::vector<std::thread> producers;
+  std::vector<std::thread> consumers;
+  for (int t = 0; t < threads; ++t) {
+    producers.emplace_back([chan, per_thread] {
+      std::vector<uint64_t> block;
+      block.reserve(FLAGS_block_size);
+      for (int64_t i = 0; i < per_thread; ++i) {
+        block.push_back(i);
+        if (block.size() == static_cast<size_t>(FLAGS_block_size)) {
+          chan->Write(std::move(block));
+          block.clear();
+        }
+      }
+      chan->Write(std::move(block));
+    });
+    consumers.emplace_back([chan] {
+      std::vector<uint64_t> block;
+      uint64_t sum = 0;
+      while (chan->Read(block) > 0) {
+        for (auto v : block) {
+          sum += v;
+        }
+      }
+      VLOG(3) << "consumer sum " << sum;
+    });
+  }
+  for (auto& th : producers) {
+    th.join();
+  }
+  chan->Close();
+  for (auto& th : consumers) {
+    th.join();
+  }
+  std::chrono::duration<double> cost = std::chrono::steady_clock::now() - start;
+  return per_thread * threads / cost.count();
+}
+
+static void RunAll() {
+  std::vector<int> thread_nums;
+  std::stringstream ss(FLAGS_threads);
+  std::string item;
+  while (std::getline(ss, item, ',')) {
+    thread_nums.push_back(std::stoi(item));
+  }
+  printf("%8s %18s %18s %8s\n", "threads", "deque(items/s)", "ring(items/s)",
+         "speedup");
+  for (int n : thread_nums) {
+    double deque_rate = RunOnce(ChannelBackend::kDeque, n);
+    double ring_rate = RunOnce(ChannelBackend::kLockFreeRing, n);
+    printf("%8d %18.0f %18.0f %8.2f\n", n, deque_rate, ring_rate,
+           ring_rate / deque_rate);
+  }
+}
+
+}  // namespace framework
+}  // namespace paddle
+
+int main(int argc, char* argv[]) {
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  google::InitGoogleLogging(argv[0]);
+  paddle::framework::RunAll();
+  return 0;
+}
@@ -0,0 +1,163 @@
+// Copyright (c) 2022 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "paddle/fluid/framework/channel.h"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <string>
+#include <thread>  // NOLINT
+
+namespace paddle {
+namespace framework {
+
+static Channel<int> MakeTestChannel(ChannelBackend backend, size_t capacity) {
+  if (backend == ChannelBackend::kDeque) {
+    return MakeChannel<int>(capacity);
+  }
+  return MakeChannel<int>(capacity, backend);
+}
+
+class ChannelBackendTest : public ::testing::TestWithParam<ChannelBackend> {};
+
+TEST_P(ChannelBackendTest, ReadWriteInOrder) {
+  auto chan = MakeTestChannel(GetParam(), 64);
+  std::vector<int> in = {1, 2, 3, 4, 5};
+  EXPECT_EQ(chan->Write(in), in.size());
+  EXPECT_EQ(chan->Size(), in.size());
+  chan->Close();
+
+  std::vector<int> out;
+  EXPECT_EQ(chan->ReadAll(out), in.size());
+  EXPECT_EQ(out, in);
+  EXPECT_TRUE(chan->Empty());
+}
+
+TEST_P(ChannelBackendTest, ReadOnceReturnsAvailable) {
+  auto chan = MakeTestChannel(GetParam(), 64);
+  std::vector<int> in = {7, 8, 9};
+  chan->Write(in);
+
+  std::vector<int> out;
+  EXPECT_EQ(chan->ReadOnce(out, 10), 3UL);
+  EXPECT_EQ(out, in);
+}
+
+TEST_P(ChannelBackendTest, CloseWakesReaderAndStopsWriter) {
+  auto chan = MakeTestChannel(GetParam(), 4);
+  std::thread reader([chan] {
+    int val = 0;
+    EXPECT_FALSE(chan->Get(val));
+  });
+  chan->Close();
+  reader.join();
+
+  EXPECT_FALSE(chan->Put(1));
+}
+
+TEST_P(ChannelBackendTest, MultiProducerMultiConsumer) {
+  const int kThreads = 4;
+  const int kPerThread = 20000;
+  auto chan = MakeTestChannel(GetParam(), 128);
+  chan->SetBlockSize(16);
+
+  std::vector<std::thread> producers;
+  for (int t = 0; t < kThreads; ++t) {
+    producers.emplace_back([chan, t] {
+      std::vector<int> block;
+      for (int i = 0; i < kPerThread; ++i) {
+        block.push_back(t * kPerThread + i);
+        if (block.size() == 16) {
+          chan->Write(std::move(block));
+          block.clear();
+        }
+      }
+      chan->Write(std::move(block));
+    });
+  }
+
+  std::atomic<int64_t> sum(0);
+  std::atomic<int64_t> count(0);
+  std::vector<std::thread> consumers;
+  for (int t = 0; t < kThreads; ++t) {
+    consumers.emplace_back([chan, &sum, &count] {
+      std::vector<int> block;
+      while (chan->Read(block) > 0) {
+        for (int v : block) {
+          sum += v;
+        }
+        count += block.size();
+      }
+    });
+  }
+
+  for (auto& th : producers) {
+    th.join();
+  }
+  chan->Close();
+  for (auto& th : consumers) {
+    th.join();
+  }
+
+  int64_t n = kThreads * kPerThread;
+  EXPECT_EQ(count.load(), n);
+  EXPECT_EQ(sum.load(), n * (n - 1) / 2);
+}
+
+TEST_P(ChannelBackendTest, PingPongParksAndWakes) {
+  // every Get parks on an empty channel, so a lost wakeup hangs the test
+  const int kRounds = 20000;
+  auto ping = MakeTestChannel(GetParam(), 1);
+  auto pong = MakeTestChannel(GetParam(), 1);
+  std::thread peer([ping, pong] {
+    int val = 0;
+    while (ping->Get(val)) {
+      pong->Put(val + 1);
+    }
+    pong->Close();
+  });
+
+  int val = 0;
+  for (int i = 0; i < kRounds; ++i) {
+    EXPECT_TRUE(ping->Put(val));
+    EXPECT_TRUE(pong->Get(val));
+  }
+  ping->Close();
+  peer.join();
+  EXPECT_EQ(val, kRounds);
+}
+
+INSTANTIATE_TEST_CASE_P(Channel,
+                         ChannelBackendTest,
+                         ::testing::Values(ChannelBackend::kDeque,
+                                           ChannelBackend::kLockFreeRing));
+
+TEST(MpmcRingBuffer, RoundsCapacityAndReportsFull) {
+  MpmcRingBuffer<std::string> ring(5);
+  EXPECT_EQ(ring.Capacity(), 8UL);
+  for (int i = 0; i < 8; ++i) {
+    EXPECT_TRUE(ring.TryPush(std::to_string(i)));
+  }
+  EXPECT_TRUE(ring.Full());
+  EXPECT_FALSE(ring.TryPush(std::string("x")));
+
+  std::string val;
+  EXPECT_TRUE(ring.TryPop(&val));
+  EXPECT_EQ(val, "0");
+  EXPECT_TRUE(ring.TryPush(std::string("8")));
+}
+
+}  // namespace framework
+}  // namespace paddle
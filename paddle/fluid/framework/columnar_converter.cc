@@ -0,0 +1,108 @@
+// Copyright (c) 2022 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Converts text files of SlotRecordInMemoryDataFeed to the columnar format.
+//   columnar_converter --data_feed_desc=desc.prototxt --input=part-00000
+//       --output=part-00000.col [--parse_ins_id] [--parse_logkey]
+// Set input_format: "columnar" in the data feed desc to read the output.
+
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "gflags/gflags.h"
+#include "glog/logging.h"
+#include "google/protobuf/text_format.h"
+#include "paddle/fluid/framework/columnar_format.h"
+#include "paddle/fluid/framework/data_feed.pb.h"
+
+DEFINE_string(data_feed_desc, "", "DataFeedDesc prototxt of the dataset");
+DEFINE_string(input, "-", "text file to convert, - for stdin");
+DEFINE_string(output, "", "columnar file to write");
+DEFINE_bool(parse_ins_id, false, "lines start with an ins_id");
+DEFINE_bool(parse_logkey, false, "lines start with a logkey");
+DEFINE_int32(block_ins_num, 4096, "instances per columnar block");
+
+int main(int argc, char* argv[]) {
+  ::GFLAGS_NAMESPACE::ParseCommandLineFlags(&argc, &argv, true);
+  google::InitGoogleLogging(argv[0]);
+  CHECK(!FLAGS_data_feed_desc.empty()) << "--data_feed_desc is required";
+  CHECK(!FLAGS_output.empty()) << "--output is required";
+  CHECK(FLAGS_block_ins_num > 0) << "--block_ins_num must be > 0";
+
+  std::ifstream desc_file(FLAGS_data_feed_desc);
+  CHECK(desc_file.good()) << "can not open " << FLAGS_data_feed_desc;
+  std::string desc_str((std::istreambuf_iterator<char>(desc_file)),
+                       std::istreambuf_iterator<char>());
+  paddle::framework::DataFeedDesc desc;
+  CHECK(google::protobuf::TextFormat::ParseFromString(desc_str, &desc))
+      << "can not parse " << FLAGS_data_feed_desc;
+
+  std::vector<char> slot_types;
+  std::vector<bool> slot_dense;
+  for (const auto& slot : desc.multi_slot_desc().slots()) {
+    slot_types.push_back(slot.type()[0]);
+    slot_dense.push_back(slot.is_dense());
+  }
+  uint16_t flags = 0;
+  if (FLAGS_parse_ins_id) {
+    flags |= paddle::framework::kColumnarHasInsId;
+  }
+  if (FLAGS_parse_logkey) {
+    flags |= paddle::framework::kColumnarHasLogKey;
+  }
+
+  std::ifstream input_file;
+  std::istream* input = &std::cin;
+  if (FLAGS_input != "-") {
+    input_file.open(FLAGS_input);
+    CHECK(input_file.good()) << "can not open " << FLAGS_input;
+    input = &input_file;
+  }
+  FILE* output = fopen(FLAGS_output.c_str(), "wb");
+  CHECK(output != nullptr) << "can not open " << FLAGS_output;
+
+  paddle::framework::ColumnarBlockWriter writer(slot_types, flags);
+  paddle::framework::ColumnarInstance ins;
+  std::string line;
+  size_t lines = 0;
+  size_t bad_lines = 0;
+  size_t text_bytes = 0;
+  size_t columnar_bytes = 0;
+  while (std::getline(*input, line)) {
+    ++lines;
+    text_bytes += line.size() + 1;
+    if (!paddle::framework::ParseColumnarTextInstance(
+            line, slot_types, slot_dense, flags, &ins)) {
+      ++bad_lines;
+      LOG(WARNING) << "skip bad line " << lines << ": " << line;
+      continue;
+    }
+    writer.Add(ins);
+    if (writer.ins_num() >= static_cast<size_t>(FLAGS_block_ins_num)) {
+      columnar_bytes += writer.Flush(output);
+    }
+  }
+  columnar_bytes += writer.Flush(output);
+  CHECK(fclose(output) == 0) << "can not write " << FLAGS_output;
+
+  LOG(INFO) << "converted " << (lines - bad_lines) << " lines, " << bad_lines
+            << " bad lines, text " << text_bytes << " bytes, columnar "
+            << columnar_bytes << " bytes, ratio "
+            << (columnar_bytes > 0
+                    ? static_cast<double>(text_bytes) / columnar_bytes
+                    : 0.0);
+  return bad_lines == 0 ? 0 : 1;
+}
@@ -0,0 +1,442 @@
+// Copyright (c) 2022 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "paddle/fluid/framework/columnar_format.h"
+
+#include <glog/logging.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+namespace paddle {
+namespace framework {
+
+static inline void PutVarint(uint64_t v, std::string* out) {
+  while (v >= 0x80) {
+    out->push_back(static_cast<char>(v | 0x80));
+    v >>= 7;
+  }
+  out->push_back(static_cast<char>(v));
+}
+
+static inline size_t VarintSize(uint64_t v) {
+  size_t n = 1;
+  while (v >= 0x80) {
+    v >>= 7;
+    ++n;
+  }
+  return n;
+}
+
+static inline uint64_t GetVarint(const char** p, const char* end) {
+  const uint8_t* s = reinterpret_cast<const uint8_t*>(*p);
+  uint64_t v = 0;
+  int shift = 0;
+  while (true) {
+    CHECK(reinterpret_cast<const char*>(s) < end) << "varint out of column";
+    uint8_t b = *s++;
+    v |= static_cast<uint64_t>(b & 0x7f) << shift;
+    if (b < 0x80) {
+      break;
+    }
+    shift += 7;
+  }
+  *p = reinterpret_cast<const char*>(s);
+  return v;
+}
+
+static inline uint64_t ZigZag(uint64_t delta) {
+  return (delta << 1) ^
+         static_cast<uint64_t>(static_cast<int64_t>(delta) >> 63);
+}
+
+static inline uint64_t UnZigZag(uint64_t v) {
+  return (v >> 1) ^ (~(v & 1) + 1);
+}
+
+static inline uint64_t LowBits(uint64_t v, int n) {
+  return n >= 64 ? v : (v & ((1ULL << n) - 1));
+}
+
+void ParseLogKey(const std::string& log_key,
+                 uint64_t* search_id,
+                 uint32_t* cmatch,
+                 uint32_t* rank) {
+  std::string searchid_str = log_key.substr(16, 16);
+  *search_id = static_cast<uint64_t>(strtoull(searchid_str.c_str(), NULL, 16));
+  std::string cmatch_str = log_key.substr(11, 3);
+  *cmatch = static_cast<uint32_t>(strtoul(cmatch_str.c_str(), NULL, 16));
+  std::string rank_str = log_key.substr(14, 2);
+  *rank = static_cast<uint32_t>(strtoul(rank_str.c_str(), NULL, 16));
+}
+
+// reads "1 <token> " at str[*pos]
+static bool ParseTextToken(const char* str, size_t* pos, std::string* token) {
+  char* endptr = nullptr;
+  long num = strtol(str + *pos, &endptr, 10);  // NOLINT
+  if (num != 1 || *endptr != ' ') {
+    return false;
+  }
+  const char* begin = endptr + 1;
+  const char* end = begin;
+  while (*end != ' ' && *end != '\0') {
+    ++end;
+  }
+  token->assign(begin, end - begin);
+  *pos = end - str;
+  return !token->empty();
+}
+
+bool ParseColumnarTextInstance(const std::string& line,
+                               const std::vector<char>& slot_types,
+                               const std::vector<bool>& slot_dense,
+                               uint16_t flags,
+                               ColumnarInstance* ins) {
+  const char* str = line.c_str();
+  size_t pos = 0;
+  if (flags & kColumnarHasInsId) {
+    if (!ParseTextToken(str, &pos, &ins->ins_id)) {
+      return false;
+    }
+  }
+  if (flags & kColumnarHasLogKey) {
+    if (!ParseTextToken(str, &pos, &ins->ins_id) ||
+        ins->ins_id.size() < 32) {
+      return false;
+    }
+    ParseLogKey(ins->ins_id, &ins->search_id, &ins->cmatch, &ins->rank);
+  }
+  size_t slot_num = slot_types.size();
+  ins->uint64_values.resize(slot_num);
+  ins->float_values.resize(slot_num);
+  char* endptr = const_cast<char*>(str + pos);
+  for (size_t i = 0; i < slot_num; ++i) {
+    ins->uint64_values[i].clear();
+    ins->float_values[i].clear();
+    const char* begin = endptr;
+    long num = strtol(begin, &endptr, 10);  // NOLINT
+    // a slot has at least one value, padded by the data generator
+    if (endptr == begin || num <= 0) {
+      return false;
+    }
+    for (long j = 0; j < num; ++j) {  // NOLINT
+      begin = endptr;
+      if (slot_types[i] == 'f') {
+        float v = strtof(begin, &endptr);
+        if (endptr == begin) {
+          return false;
+        }
+        if (fabs(v) < 1e-6 && !slot_dense[i]) {
+          continue;
+        }
+        ins->float_values[i].push_back(v);
+      } else {
+        uint64_t v = static_cast<uint64_t>(strtoull(begin, &endptr, 10));
+        if (endptr == begin) {
+          return false;
+        }
+        ins->uint64_values[i].push_back(v);
+      }
+    }
+  }
+  return true;
+}
+
+ColumnarBlockWriter::ColumnarBlockWriter(const std::vector<char>& slot_types,
+                                         uint16_t flags)
+    : slot_types_(slot_types), flags_(flags) {
+  for (char type : slot_types_) {
+    CHECK(type == 'u' || type == 'f') << "unknown slot type: " << type;
+  }
+  lens_.resize(slot_types_.size());
+  uint64_values_.resize(slot_types_.size());
+  float_values_.resize(slot_types_.size());
+}
+
+void ColumnarBlockWriter::Add(const ColumnarInstance& ins) {
+  if (flags_ & (kColumnarHasInsId | kColumnarHasLogKey)) {
+    PutVarint(ins.ins_id.size(), &meta_);
+    meta_.append(ins.ins_id);
+  }
+  if (flags_ & kColumnarHasLogKey) {
+    PutVarint(ins.search_id, &meta_);
+    PutVarint(ins.cmatch, &meta_);
+    PutVarint(ins.rank, &meta_);
+  }
+  for (size_t i = 0; i < slot_types_.size(); ++i) {
+    if (slot_types_[i] == 'f') {
+      auto& vals = ins.float_values[i];
+      lens_[i].push_back(static_cast<uint32_t>(vals.size()));
+      float_values_[i].insert(float_values_[i].end(), vals.begin(), vals.end());
+    } else {
+      auto& vals = ins.uint64_values[i];
+      lens_[i].push_back(static_cast<uint32_t>(vals.size()));
+      uint64_values_[i].insert(
+          uint64_values_[i].end(), vals.begin(), vals.end());
+    }
+  }
+  ++ins_num_;
+}
+
+void ColumnarBlockWriter::EncodeUint64Column(size_t slot,
+                                             std::string* out,
+                                             ColumnarSlotIndex* idx) {
+  const auto& lens = lens_[slot];
+  const auto& vals = uint64_values_[slot];
+  // feasigns of a slot are often close within an instance, while hashed
+  // ones only share their high bits across the block
+  size_t varint_bytes = 0;
+  size_t k = 0;
+  for (uint32_t len : lens) {
+    uint64_t prev = 0;
+    for (uint32_t j = 0; j < len; ++j, ++k) {
+      varint_bytes += VarintSize(ZigZag(vals[k] - prev));
+      prev = vals[k];
+    }
+  }
+  uint64_t min_val = 0;
+  int width = 0;
+  if (!vals.empty()) {
+    auto range = std::minmax_element(vals.begin(), vals.end());
+    min_val = *range.first;
+    uint64_t span = *range.second - min_val;
+    width = span == 0 ? 0 : 64 - __builtin_clzll(span);
+  }
+  size_t packed_bytes = (vals.size() * width + 7) / 8;
+
+  size_t begin = out->size();
+  if (varint_bytes < packed_bytes) {
+    idx->encoding = kColumnarVarintDelta;
+    k = 0;
+    for (uint32_t len : lens) {
+      uint64_t prev = 0;
+      for (uint32_t j = 0; j < len; ++j, ++k) {
+        PutVarint(ZigZag(vals[k] - prev), out);
+        prev = vals[k];
+      }
+    }
+  } else {
+    idx->encoding = kColumnarBitPacked;
+    idx->bit_width = static_cast<uint8_t>(width);
+    idx->base = min_val;
+    uint64_t acc = 0;
+    int nbits = 0;
+    for (uint64_t v : vals) {
+      uint64_t x = v - min_val;
+      int w = width;
+      while (w > 0) {
+        int take = std::min(w, 64 - nbits);
+        acc |= LowBits(x, take) << nbits;
+        x = take >= 64 ? 0 : (x >> take);
+        nbits += take;
+        w -= take;
+        if (nbits == 64) {
+          out->append(reinterpret_cast<const char*>(&acc), sizeof(acc));
+          acc = 0;
+          nbits = 0;
+        }
+      }
+    }
+    if (nbits > 0) {
+      out->append(reinterpret_cast<const char*>(&acc), (nbits + 7) / 8);
+    }
+  }
+  idx->value_bytes = static_cast<uint32_t>(out->size() - begin);
+}
+
+size_t ColumnarBlockWriter::Flush(FILE* fp) {
+  if (ins_num_ == 0) {
+    return 0;
+  }
+  size_t slot_num = slot_types_.size();
+  std::vector<ColumnarSlotIndex> index(slot_num);
+  std::string body;
+  body.append(meta_);
+  for (size_t i = 0; i < slot_num; ++i) {
+    ColumnarSlotIndex& idx = index[i];
+    memset(&idx, 0, sizeof(idx));
+    idx.type = static_cast<uint8_t>(slot_types_[i]);
+    idx.offset = body.size();
+    for (uint32_t len : lens_[i]) {
+      PutVarint(len, &body);
+    }
+    idx.len_bytes = static_cast<uint32_t>(body.size() - idx.offset);
+    if (slot_types_[i] == 'f') {
+      auto& vals = float_values_[i];
+      idx.encoding = kColumnarRawFloat;
+      idx.value_num = static_cast<uint32_t>(vals.size());
+      body.append(reinterpret_cast<const char*>(vals.data()),
+                  vals.size() * sizeof(float));
+      idx.value_bytes = static_cast<uint32_t>(vals.size() * sizeof(float));
+    } else {
+      idx.value_num = static_cast<uint32_t>(uint64_values_[i].size());
+      EncodeUint64Column(i, &body, &idx);
+    }
+    lens_[i].clear();
+    uint64_values_[i].clear();
+    float_values_[i].clear();
+  }
+
+  ColumnarBlockHeader header;
+  memset(&header, 0, sizeof(header));
+  header.magic = kColumnarMagic;
+  header.version = kColumnarVersion;
+  header.flags = flags_;
+  header.ins_num = static_cast<uint32_t>(ins_num_);
+  header.slot_num = static_cast<uint32_t>(slot_num);
+  header.meta_bytes = static_cast<uint32_t>(meta_.size());
+  header.body_bytes = body.size();
+  CHECK(fwrite(&header, sizeof(header), 1, fp) == 1);
+  CHECK(fwrite(index.data(), sizeof(ColumnarSlotIndex), slot_num, fp) ==
+        slot_num);
+  CHECK(fwrite(body.data(), 1, body.size(), fp) == body.size());
+
+  ins_num_ = 0;
+  meta_.clear();
+  return sizeof(header) + sizeof(ColumnarSlotIndex) * slot_num + body.size();
+}
+
+bool ColumnarBlockReader::Read(FILE* fp) {
+  size_t n = fread(&header_, 1, sizeof(header_), fp);
+  if (n == 0) {
+    return false;
+  }
+  CHECK(n == sizeof(header_)) << "truncated columnar block header";
+  CHECK(header_.magic == kColumnarMagic) << "not a columnar block";
+  CHECK(header_.version == kColumnarVersion)
+      << "unsupported columnar version " << header_.version;
+  index_.resize(header_.slot_num);
+  CHECK(fread(index_.data(), sizeof(ColumnarSlotIndex), header_.slot_num, fp) ==
+        header_.slot_num)
+      << "truncated columnar block index";
+  body_.resize(header_.body_bytes);
+  CHECK(fread(body_.data(), 1, body_.size(), fp) == body_.size())
+      << "truncated columnar block body";
+  for (auto& idx : index_) {
+    CHECK(idx.offset + idx.len_bytes + idx.value_bytes <= body_.size())
+        << "columnar slot out of block";
+  }
+  meta_pos_ = 0;
+  return true;
+}
+
+void ColumnarBlockReader::NextMeta(std::string* ins_id,
+                                   uint64_t* search_id,
+                                   uint32_t* cmatch,
+                                   uint32_t* rank) {
+  const char* p = body_.data() + meta_pos_;
+  const char* end = body_.data() + header_.meta_bytes;
+  if (header_.flags & (kColumnarHasInsId | kColumnarHasLogKey)) {
+    size_t len = GetVarint(&p, end);
+    CHECK(p + len <= end) << "columnar ins_id out of meta";
+    ins_id->assign(p, len);
+    p += len;
+  }
+  if (header_.flags & kColumnarHasLogKey) {
+    *search_id = GetVarint(&p, end);
+    *cmatch = static_cast<uint32_t>(GetVarint(&p, end));
+    *rank = static_cast<uint32_t>(GetVarint(&p, end));
+  }
+  meta_pos_ = p - body_.data();
+}
+
+void ColumnarBlockReader::DecodeLengths(size_t slot, uint32_t* lens) const {
+  const ColumnarSlotIndex& idx = index_[slot];
+  const char* p = body_.data() + idx.offset;
+  const char* end = p + idx.len_bytes;
+  for (uint32_t i = 0; i < header_.ins_num; ++i) {
+    lens[i] = static_cast<uint32_t>(GetVarint(&p, end));
+  }
+}
+
+void ColumnarBlockReader::DecodeUint64(size_t slot,
+                                       const uint32_t* lens,
+                                       uint64_t* const* dst) const {
+  const ColumnarSlotIndex& idx = index_[slot];
+  CHECK(idx.type == 'u') << "slot " << slot << " is not uint64";
+  const char* p = body_.data() + idx.offset + idx.len_bytes;
+  const char* end = p + idx.value_bytes;
+  uint32_t ins_num = header_.ins_num;
+  if (idx.encoding == kColumnarVarintDelta) {
+    for (uint32_t i = 0; i < ins_num; ++i) {
+      uint64_t prev = 0;
+      uint64_t* out = dst[i];
+      for (uint32_t j = 0; j < lens[i]; ++j) {
+        prev += UnZigZag(GetVarint(&p, end));
+        if (out != nullptr) {
+          out[j] = prev;
+        }
+      }
+    }
+    return;
+  }
+  CHECK(idx.encoding == kColumnarBitPacked)
+      << "unknown uint64 encoding " << static_cast<int>(idx.encoding);
+  CHECK(static_cast<uint64_t>(idx.value_num) * idx.bit_width <=
+        static_cast<uint64_t>(idx.value_bytes) * 8)
+      << "columnar bit-packed slot out of column";
+  const int width = idx.bit_width;
+  uint64_t acc = 0;
+  int avail = 0;
+  for (uint32_t i = 0; i < ins_num; ++i) {
+    uint64_t* out = dst[i];
+    for (uint32_t j = 0; j < lens[i]; ++j) {
+      uint64_t x = 0;
+      int shift = 0;
+      int w = width;
+      while (w > 0) {
+        if (avail == 0) {
+          size_t bytes = std::min<size_t>(sizeof(acc), end - p);
+          CHECK(bytes > 0) << "columnar bit-packed slot out of column";
+          acc = 0;
+          memcpy(&acc, p, bytes);
+          p += bytes;
+          avail = static_cast<int>(bytes * 8);
+        }
+        int take = std::min(w, avail);
+        x |= LowBits(acc, take) << shift;
+        acc = take >= 64 ? 0 : (acc >> take);
+        avail -= take;
+        shift += take;
+        w -= take;
+      }
+      if (out != nullptr) {
+        out[j] = idx.base + x;
+      }
+    }
+  }
+}
+
+void ColumnarBlockReader::DecodeFloat(size_t slot,
+                                      const uint32_t* lens,
+                                      float* const* dst) const {
+  const ColumnarSlotIndex& idx = index_[slot];
+  CHECK(idx.type == 'f' && idx.encoding == kColumnarRawFloat)
+      << "slot " << slot << " is not a raw float column";
+  const char* p = body_.data() + idx.offset + idx.len_bytes;
+  const char* end = p + idx.value_bytes;
+  for (uint32_t i = 0; i < header_.ins_num; ++i) {
+    size_t bytes = lens[i] * sizeof(float);
+    CHECK(p + bytes <= end) << "columnar float slot out of column";
+    if (dst[i] != nullptr && bytes > 0) {
+      memcpy(dst[i], p, bytes);
+    }
+    p += bytes;
+  }
+}
+
+}  // namespace framework
+}  // namespace paddle
@@ -0,0 +1,164 @@
+// Copyright (c) 2022 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+namespace paddle {
+namespace framework {
+
+// Columnar input format of SlotRecord datasets.
+//
+// A file is a sequence of blocks, each block holds up to a few thousand
+// instances stored column by column:
+//   ColumnarBlockHeader
+//   ColumnarSlotIndex x slot_num    one entry per slot of the data feed desc
+//   body:
+//     meta column                   ins_id / logkey of every instance
+//     slot columns                  at ColumnarSlotIndex::offset
+// A slot column is the feasign count of every instance (varint), followed
+// by the values of all instances:
+//   - uint64 slots: zigzag varint of the delta to the previous value of the
+//     same instance, or bit-packed offsets from the column minimum, the
+//     writer keeps the smaller one;
+//   - float slots: raw floats.
+// A reader only decodes the slots it uses, the others are skipped through
+// the index. Integers are stored in host (little endian) order, like
+// BinaryArchive.
+
+const uint32_t kColumnarMagic = 0x4c4f4350;  // "PCOL"
+const uint16_t kColumnarVersion = 1;
+
+enum ColumnarFlag : uint16_t {
+  kColumnarHasInsId = 1,
+  kColumnarHasLogKey = 2,
+};
+
+enum ColumnarEncoding : uint8_t {
+  kColumnarVarintDelta = 0,
+  kColumnarBitPacked = 1,
+  kColumnarRawFloat = 2,
+};
+
+struct ColumnarBlockHeader {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t flags;
+  uint32_t ins_num;
+  uint32_t slot_num;
+  uint32_t meta_bytes;
+  uint32_t reserved;
+  uint64_t body_bytes;
+};
+
+struct ColumnarSlotIndex {
+  uint8_t type;  // 'u' or 'f', as in the data feed desc
+  uint8_t encoding;
+  uint8_t bit_width;  // kColumnarBitPacked only
+  uint8_t reserved;
+  uint32_t value_num;
+  uint64_t base;    // kColumnarBitPacked only, minimum of the column
+  uint64_t offset;  // column offset in the block body
+  uint32_t len_bytes;
+  uint32_t value_bytes;
+};
+
+static_assert(sizeof(ColumnarBlockHeader) == 32, "columnar header layout");
+static_assert(sizeof(ColumnarSlotIndex) == 32, "columnar index layout");
+
+// one parsed instance, values are indexed by the slot order of the desc
+struct ColumnarInstance {
+  std::string ins_id;
+  uint64_t search_id = 0;
+  uint32_t cmatch = 0;
+  uint32_t rank = 0;
+  std::vector<std::vector<uint64_t>> uint64_values;
+  std::vector<std::vector<float>> float_values;
+};
+
+// Splits a logkey into search_id, cmatch and rank, used by the text parsers
+// of data_feed.cc too. The logkey must have at least 32 characters.
+void ParseLogKey(const std::string& log_key,
+                 uint64_t* search_id,
+                 uint32_t* cmatch,
+                 uint32_t* rank);
+
+// Parses one line of the text format read by SlotRecordInMemoryDataFeed,
+// zero values of sparse float slots are dropped as the text reader does.
+bool ParseColumnarTextInstance(const std::string& line,
+                               const std::vector<char>& slot_types,
+                               const std::vector<bool>& slot_dense,
+                               uint16_t flags,
+                               ColumnarInstance* ins);
+
+class ColumnarBlockWriter {
+ public:
+  ColumnarBlockWriter(const std::vector<char>& slot_types, uint16_t flags);
+
+  void Add(const ColumnarInstance& ins);
+  size_t ins_num() const { return ins_num_; }
+  // writes the block to fp and starts a new one, returns the bytes written
+  size_t Flush(FILE* fp);
+
+ private:
+  void EncodeUint64Column(size_t slot,
+                          std::string* out,
+                          ColumnarSlotIndex* idx);
+
+  std::vector<char> slot_types_;
+  uint16_t flags_;
+  size_t ins_num_ = 0;
+  std::string meta_;
+  std::vector<std::vector<uint32_t>> lens_;
+  std::vector<std::vector<uint64_t>> uint64_values_;
+  std::vector<std::vector<float>> float_values_;
+};
+
+class ColumnarBlockReader {
+ public:
+  // reads the next block, returns false at the end of fp
+  bool Read(FILE* fp);
+
+  uint32_t ins_num() const { return header_.ins_num; }
+  uint32_t slot_num() const { return header_.slot_num; }
+  uint16_t flags() const { return header_.flags; }
+  const ColumnarSlotIndex& slot(size_t i) const { return index_[i]; }
+
+  // next meta of the block, call ins_num() times in order
+  void NextMeta(std::string* ins_id,
+                uint64_t* search_id,
+                uint32_t* cmatch,
+                uint32_t* rank);
+  // feasign count of every instance of a slot
+  void DecodeLengths(size_t slot, uint32_t* lens) const;
+  // values of instance i go to dst[i], or are skipped if it is nullptr,
+  // lens come from DecodeLengths
+  void DecodeUint64(size_t slot,
+                    const uint32_t* lens,
+                    uint64_t* const* dst) const;
+  void DecodeFloat(size_t slot, const uint32_t* lens, float* const* dst) const;
+
+ private:
+  ColumnarBlockHeader header_;
+  std::vector<ColumnarSlotIndex> index_;
+  std::vector<char> body_;
+  size_t meta_pos_ = 0;
+};
+
+}  // namespace framework
+}  // namespace paddle
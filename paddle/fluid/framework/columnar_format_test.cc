@@ -0,0 +1,137 @@
+// Copyright (c) 2022 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "paddle/fluid/framework/columnar_format.h"
+
+#include <random>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace paddle {
+namespace framework {
+
+TEST(ColumnarFormat, ParseText) {
+  std::vector<char> types = {'u', 'f', 'u'};
+  std::vector<bool> dense = {false, false, false};
+  ColumnarInstance ins;
+  ASSERT_TRUE(ParseColumnarTextInstance(
+      "1 ins_0 2 11 12 3 0.5 0 1.5 1 18446744073709551615",
+      types,
+      dense,
+      kColumnarHasInsId,
+      &ins));
+  EXPECT_EQ(ins.ins_id, "ins_0");
+  EXPECT_EQ(ins.uint64_values[0], (std::vector<uint64_t>{11, 12}));
+  // zero values of sparse float slots are dropped as in the text reader
+  EXPECT_EQ(ins.float_values[1], (std::vector<float>{0.5f, 1.5f}));
+  EXPECT_EQ(ins.uint64_values[2],
+            (std::vector<uint64_t>{18446744073709551615ULL}));
+
+  EXPECT_FALSE(ParseColumnarTextInstance(
+      "1 ins_0 0 3 0.5 0 1.5 1 7", types, dense, kColumnarHasInsId, &ins));
+  EXPECT_FALSE(
+      ParseColumnarTextInstance("2 11 12", types, dense, 0, &ins));
+}
+
+TEST(ColumnarFormat, WriteAndRead) {
+  // slot 0: feasigns close within an instance, slot 1: small ids, slot 2:
+  // floats, slot 3: constant values
+  std::vector<char> types = {'u', 'u', 'f', 'u'};
+  const int ins_num = 1000;
+  std::mt19937_64 rng(0);
+  std::vector<ColumnarInstance> data(ins_num);
+  for (int i = 0; i < ins_num; ++i) {
+    auto& ins = data[i];
+    ins.ins_id = "ins_" + std::to_string(i);
+    ins.search_id = rng();
+    ins.cmatch = i % 7;
+    ins.rank = i % 3;
+    ins.uint64_values.resize(types.size());
+    ins.float_values.resize(types.size());
+    uint64_t base = rng();
+    for (int j = 0; j < i % 5; ++j) {
+      ins.uint64_values[0].push_back(base + j * 3);
+      ins.uint64_values[1].push_back(rng() % 1000);
+      ins.float_values[2].push_back(static_cast<float>(j) * 0.25f);
+    }
+    ins.uint64_values[3].push_back(42);
+  }
+
+  FILE* fp = tmpfile();
+  ASSERT_TRUE(fp != nullptr);
+  ColumnarBlockWriter writer(types, kColumnarHasInsId | kColumnarHasLogKey);
+  for (int i = 0; i < ins_num; ++i) {
+    writer.Add(data[i]);
+    if (writer.ins_num() == 300) {
+      EXPECT_GT(writer.Flush(fp), 0u);
+    }
+  }
+  writer.Flush(fp);
+  rewind(fp);
+
+  ColumnarBlockReader reader;
+  int base = 0;
+  while (reader.Read(fp)) {
+    uint32_t n = reader.ins_num();
+    ASSERT_EQ(reader.slot_num(), types.size());
+    EXPECT_EQ(reader.slot(0).encoding, kColumnarVarintDelta);
+    EXPECT_EQ(reader.slot(1).encoding, kColumnarBitPacked);
+    EXPECT_EQ(reader.slot(3).bit_width, 0);
+    for (uint32_t i = 0; i < n; ++i) {
+      std::string ins_id;
+      uint64_t search_id = 0;
+      uint32_t cmatch = 0;
+      uint32_t rank = 0;
+      reader.NextMeta(&ins_id, &search_id, &cmatch, &rank);
+      EXPECT_EQ(ins_id, data[base + i].ins_id);
+      EXPECT_EQ(search_id, data[base + i].search_id);
+      EXPECT_EQ(cmatch, data[base + i].cmatch);
+      EXPECT_EQ(rank, data[base + i].rank);
+    }
+    std::vector<uint32_t> lens(n);
+    for (size_t s = 0; s < types.size(); ++s) {
+      reader.DecodeLengths(s, lens.data());
+      std::vector<std::vector<uint64_t>> u(n);
+      std::vector<std::vector<float>> f(n);
+      std::vector<uint64_t*> udst(n);
+      std::vector<float*> fdst(n);
+      for (uint32_t i = 0; i < n; ++i) {
+        u[i].resize(lens[i]);
+        f[i].resize(lens[i]);
+        udst[i] = u[i].data();
+        fdst[i] = f[i].data();
+      }
+      if (types[s] == 'f') {
+        reader.DecodeFloat(s, lens.data(), fdst.data());
+      } else {
+        reader.DecodeUint64(s, lens.data(), udst.data());
+      }
+      for (uint32_t i = 0; i < n; ++i) {
+        if (types[s] == 'f') {
+          EXPECT_EQ(f[i], data[base + i].float_values[s]);
+        } else {
+          EXPECT_EQ(u[i], data[base + i].uint64_values[s]);
+        }
+      }
+    }
+    base += n;
+  }
+  EXPECT_EQ(base, ins_num);
+  fclose(fp);
+}
+
+}  // namespace framework
+}  // namespace paddle
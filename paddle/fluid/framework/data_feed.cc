@@ -26,6 +26,7 @@ limitations under the License. */
 #include <sys/stat.h>
 #endif
 #include "io/fs.h"
+#include "paddle/fluid/framework/columnar_format.h"
 #include "paddle/fluid/platform/monitor.h"
 #include "paddle/fluid/platform/timer.h"
 #include "paddle/fluid/framework/fleet/box_wrapper.h"
@@ -54,40 +55,90 @@ DLManager& global_dlmanager_pool() {
 class BufferedLineFileReader {
   typedef std::function<bool()> SampleFunc;
   static const int MAX_FILE_BUFF_SIZE = 4 * 1024 * 1024;
+  // a file whose reads keep failing is opened this many times more, then
+  // the rest of it is skipped
+  static const int MAX_READ_RETRY = 3;
   class FILEReader {
    public:
     explicit FILEReader(FILE* fp) : fp_(fp) {}
-    int read(char* buf, int len) { return fread(buf, sizeof(char), len, fp_); }
+    // a FILE whose reads fail, as one over a cut .gz inflated in process,
+    // throws instead of looking like the end of the file
+    int read(char* buf, int len) {
+      int ret = fread(buf, sizeof(char), len, fp_);
+      if (ret < len && ferror(fp_)) {
+        PADDLE_THROW(platform::errors::Unavailable("Failed to read file."));
+      }
+      return ret;
+    }
 
    private:
     FILE* fp_;
   };
+  // the chunks of a reader that reads into a buffer, read into buff_
+  template <typename T>
+  class BufferChunkReader {
+   public:
+    BufferChunkReader(T* reader, char* buff) : reader_(reader), buff_(buff) {}
+    bool next(const char** data, size_t* len) {
+      int ret = reader_->read(buff_, MAX_FILE_BUFF_SIZE);
+      *data = buff_;
+      *len = ret > 0 ? ret : 0;
+      return ret > 0;
+    }
+
+   private:
+    T* reader_;
+    char* buff_;
+  };
 
  public:
   typedef std::function<bool(const std::string&)> LineFunc;
+  // a line [str, str + len) inside the read buffer, str[len] is '\n' or
+  // '\0', so it can be parsed in place without a copy
+  typedef std::function<bool(const char*, size_t)> LineViewFunc;
 
  private:
+  // a reader that throws, as GzipChunkReader does on a cut file, fails the
+  // read instead of the thread
   template <typename T>
-  int read_lines(T* reader, LineFunc func, int skip_lines) {
+  bool next_chunk(T* reader, const char** data, size_t* len) {
+    try {
+      return reader->next(data, len);
+    } catch (const std::exception& e) {
+      LOG(WARNING) << "read chunk failed: " << e.what();
+      read_error_ = true;
+      return false;
+    }
+  }
+  // T gives the chunks of the file with next, as ChunkReader does
+  template <typename T>
+  int read_lines(T* reader, LineViewFunc func, int skip_lines) {
     int lines = 0;
     size_t ret = 0;
-    char* ptr = NULL;
-    char* eol = NULL;
+    const char* ptr = NULL;
+    const char* eol = NULL;
     total_len_ = 0;
     error_line_ = 0;
+    read_error_ = false;
 
     SampleFunc spfunc = get_sample_func();
+    // only lines across two reads are copied
     std::string x;
-    while (!is_error() && (ret = reader->read(buff_, MAX_FILE_BUFF_SIZE)) > 0) {
+    while (!is_error() && next_chunk(reader, &ptr, &ret)) {
       total_len_ += ret;
-      ptr = buff_;
-      eol = reinterpret_cast<char*>(memchr(ptr, '\n', ret));
+      eol = reinterpret_cast<const char*>(memchr(ptr, '\n', ret));
       while (eol != NULL) {
         int size = static_cast<int>((eol - ptr) + 1);
-        x.append(ptr, size - 1);
         ++lines;
         if (lines > skip_lines && spfunc()) {
-          if (!func(x)) {
+          bool ok = false;
+          if (x.empty()) {
+            ok = func(ptr, size - 1);
+          } else {
+            x.append(ptr, size - 1);
+            ok = func(x.c_str(), x.size());
+          }
+          if (!ok) {
             ++error_line_;
           }
         }
@@ -95,7 +146,7 @@ class BufferedLineFileReader {
         x.clear();
         ptr += size;
         ret -= size;
-        eol = reinterpret_cast<char*>(memchr(ptr, '\n', ret));
+        eol = reinterpret_cast<const char*>(memchr(ptr, '\n', ret));
       }
       if (ret > 0) {
         x.append(ptr, ret);
@@ -104,13 +155,24 @@ class BufferedLineFileReader {
     if (!is_error() && !x.empty()) {
       ++lines;
       if (lines > skip_lines && spfunc()) {
-        if (!func(x)) {
+        if (!func(x.c_str(), x.size())) {
           ++error_line_;
         }
       }
     }
     return lines;
   }
+  template <typename T>
+  int read_lines(T* reader, LineFunc func, int skip_lines) {
+    std::string line;
+    return read_lines<T>(
+        reader,
+        [&func, &line](const char* str, size_t len) {
+          line.assign(str, len);
+          return func(line);
+        },
+        skip_lines);
+  }
 
  public:
   BufferedLineFileReader()
@@ -125,17 +187,46 @@ class BufferedLineFileReader {
 
 #ifdef PADDLE_WITH_BOX_PS
   int read_api(boxps::PaddleDataReader* reader, LineFunc func, int skip_lines) {
-    return read_lines<boxps::PaddleDataReader>(reader, func, skip_lines);
+    BufferChunkReader<boxps::PaddleDataReader> chunks(reader, buff_);
+    return read_lines(&chunks, func, skip_lines);
   }
 #endif
   int read_file(FILE* fp, LineFunc func, int skip_lines) {
     FILEReader reader(fp);
-    return read_lines<FILEReader>(&reader, func, skip_lines);
+    BufferChunkReader<FILEReader> chunks(&reader, buff_);
+    return read_lines(&chunks, func, skip_lines);
+  }
+  int read_file(FILE* fp, LineViewFunc func, int skip_lines) {
+    FILEReader reader(fp);
+    BufferChunkReader<FILEReader> chunks(&reader, buff_);
+    return read_lines(&chunks, func, skip_lines);
+  }
+  // the lines are parsed in the chunks of reader, without a copy
+  int read_chunks(ChunkReader* reader, LineFunc func, int skip_lines) {
+    return read_lines(reader, func, skip_lines);
+  }
+  int read_chunks(ChunkReader* reader, LineViewFunc func, int skip_lines) {
+    return read_lines(reader, func, skip_lines);
   }
   uint64_t file_size(void) { return total_len_; }
   void set_sample_rate(float r) { sample_rate_ = r; }
   size_t get_sample_line() { return sample_line_; }
-  bool is_error(void) { return (error_line_ > 10); }
+  bool is_error(void) { return read_error_ || (error_line_ > 10); }
+  // whether to read the file again after is_error, counting the failed
+  // reads in read_retry. The lines read are skipped on the next read.
+  bool need_retry(const std::string& filename, int* read_retry) {
+    if (!read_error_) {
+      return is_error();
+    }
+    if (++(*read_retry) <= MAX_READ_RETRY) {
+      LOG(WARNING) << "read file:[" << filename << "] failed, retry "
+                   << *read_retry;
+      return true;
+    }
+    LOG(ERROR) << "read file:[" << filename << "] failed " << *read_retry
+               << " times, the rest of it is skipped";
+    return false;
+  }
 
  private:
   SampleFunc get_sample_func() {
@@ -156,6 +247,7 @@ class BufferedLineFileReader {
   float sample_rate_ = 1.0f;
   size_t sample_line_ = 0;
   size_t error_line_ = 0;
+  bool read_error_ = false;
 };
 void RecordCandidateList::ReSize(size_t length) {
   mutex_.lock();
@@ -387,7 +479,8 @@ bool InMemoryDataFeed<T>::Start() {
 #ifdef _LINUX
   VLOG(4) << "entering InMemoryDataFeed<T>::Start()";
   this->CheckSetFileList();
-  if (output_channel_->Size() == 0 && input_channel_->Size() != 0) {
+  if (!stream_input_ && output_channel_->Size() == 0 &&
+      input_channel_->Size() != 0) {
     std::vector<T> data;
     input_channel_->Read(data);
     output_channel_->Write(std::move(data));
@@ -416,14 +509,29 @@ int InMemoryDataFeed<T>::Next() {
     T instance;
     std::vector<T> ins_vec;
     ins_vec.reserve(this->default_batch_size_);
-    while (index < this->default_batch_size_) {
-      if (output_channel_->Size() == 0) {
-        break;
+    if (stream_input_) {
+      // the dataset refills input_channel_ from its spill file while the
+      // readers consume it, a batch waits for the restore until it is full
+      // or the channel is closed
+      std::vector<T> data;
+      while (index < this->default_batch_size_ &&
+             input_channel_->ReadOnce(
+                 data, this->default_batch_size_ - index) > 0) {
+        for (auto& ins : data) {
+          ins_vec.push_back(std::move(ins));
+        }
+        index = static_cast<int>(ins_vec.size());
+      }
+    } else {
+      while (index < this->default_batch_size_) {
+        if (output_channel_->Size() == 0) {
+          break;
+        }
+        output_channel_->Get(instance);
+        ins_vec.push_back(instance);
+        ++index;
+        consume_channel_->Put(std::move(instance));
       }
-      output_channel_->Get(instance);
-      ins_vec.push_back(instance);
-      ++index;
-      consume_channel_->Put(std::move(instance));
     }
     this->batch_size_ = index;
     VLOG(3) << "batch_size_=" << this->batch_size_
@@ -527,6 +635,11 @@ void InMemoryDataFeed<T>::SetCurrentPhase(int current_phase) {
   current_phase_ = current_phase;
 }
 
+template <typename T>
+void InMemoryDataFeed<T>::SetStreamInput(bool stream_input) {
+  stream_input_ = stream_input;
+}
+
 template <typename T>
 void InMemoryDataFeed<T>::SetParseInsId(bool parse_ins_id) {
   parse_ins_id_ = parse_ins_id;
@@ -1142,6 +1255,17 @@ int MultiSlotInMemoryDataFeed::ParseInstanceFromSo(
   return parser->ParseInstance(len, str, instances);
 }
 
+// ok is whether a token of the MultiSlot text line str parsed
+static void CheckSlotToken(bool ok, const char* str) {
+  PADDLE_ENFORCE_EQ(
+      ok,
+      true,
+      platform::errors::InvalidArgument(
+          "The line has fewer or other tokens than the slots of the "
+          "data feed desc.\nplease check this error line: %s",
+          str));
+}
+
 bool MultiSlotInMemoryDataFeed::ParseOneInstanceFromPipe(Record* instance) {
 #ifdef _LINUX
   thread_local string::LineFileReader reader;
@@ -1149,45 +1273,32 @@ bool MultiSlotInMemoryDataFeed::ParseOneInstanceFromPipe(Record* instance) {
   if (!reader.getline(&*(fp_.get()))) {
     return false;
   } else {
+    // parse the line in place, see slot_text_parser.h
     const char* str = reader.get();
-    std::string line = std::string(str);
-    // VLOG(3) << line;
-    char* endptr = const_cast<char*>(str);
-    int pos = 0;
+    const char* end = str + reader.length();
+    const char* pos = str;
+    // the next token, which is a single string behind a count of 1
+    auto next_string = [&pos, end, str]() {
+      uint64_t num = 0;
+      CHECK(ParseUint64(&pos, end, &num) && num == 1);  // NOLINT
+      pos = SkipSpaces(pos, end);
+      const char* token_end = SkipTokens(pos, end, 1);
+      CheckSlotToken(token_end != nullptr, str);
+      std::string token(pos, token_end - pos);
+      pos = token_end;
+      return token;
+    };
     if (parse_ins_id_) {
-      int num = strtol(&str[pos], &endptr, 10);
-      CHECK(num == 1);  // NOLINT
-      pos = endptr - str + 1;
-      size_t len = 0;
-      while (str[pos + len] != ' ') {
-        ++len;
-      }
-      instance->ins_id_ = std::string(str + pos, len);
-      pos += len + 1;
+      instance->ins_id_ = next_string();
       VLOG(3) << "ins_id " << instance->ins_id_;
     }
     if (parse_content_) {
-      int num = strtol(&str[pos], &endptr, 10);
-      CHECK(num == 1);  // NOLINT
-      pos = endptr - str + 1;
-      size_t len = 0;
-      while (str[pos + len] != ' ') {
-        ++len;
-      }
-      instance->content_ = std::string(str + pos, len);
-      pos += len + 1;
+      instance->content_ = next_string();
       VLOG(3) << "content " << instance->content_;
     }
     if (parse_logkey_) {
-      int num = strtol(&str[pos], &endptr, 10);
-      CHECK(num == 1);  // NOLINT
-      pos = endptr - str + 1;
-      size_t len = 0;
-      while (str[pos + len] != ' ') {
-        ++len;
-      }
       // parse_logkey
-      std::string log_key = std::string(str + pos, len);
+      std::string log_key = next_string();
       uint64_t search_id;
       uint32_t cmatch;
       uint32_t rank;
@@ -1197,14 +1308,14 @@ bool MultiSlotInMemoryDataFeed::ParseOneInstanceFromPipe(Record* instance) {
       instance->search_id = search_id;
       instance->cmatch = cmatch;
       instance->rank = rank;
-      pos += len + 1;
     }
     for (size_t i = 0; i < use_slots_index_.size(); ++i) {
       int idx = use_slots_index_[i];
-      int num = strtol(&str[pos], &endptr, 10);
+      uint64_t num = 0;
+      CheckSlotToken(ParseUint64(&pos, end, &num), str);
       PADDLE_ENFORCE_NE(
           num,
-          0,
+          0UL,
           platform::errors::InvalidArgument(
               "The number of ids can not be zero, you need padding "
               "it in data generator; or if there is something wrong with "
@@ -1226,15 +1337,17 @@ bool MultiSlotInMemoryDataFeed::ParseOneInstanceFromPipe(Record* instance) {
                            "please check this error line: %s",
                            str));
 
-        char* uidptr = endptr;
-        uint64_t feasign = (uint64_t)strtoull(uidptr, &uidptr, 10);
+        const char* uidptr = pos;
+        uint64_t feasign = 0;
+        CheckSlotToken(ParseUint64(&uidptr, end, &feasign), str);
         instance->uid_ = feasign;
       }
 #endif
       if (idx != -1) {
         if (all_slots_type_[i][0] == 'f') {  // float
-          for (int j = 0; j < num; ++j) {
-            float feasign = strtof(endptr, &endptr);
+          for (uint64_t j = 0; j < num; ++j) {
+            float feasign = 0;
+            CheckSlotToken(ParseFloat(&pos, end, &feasign), str);
             // if float feasign is equal to zero, ignore it
             // except when slot is dense
             if (fabs(feasign) < 1e-6 && !use_slots_is_dense_[i]) {
@@ -1245,8 +1358,9 @@ bool MultiSlotInMemoryDataFeed::ParseOneInstanceFromPipe(Record* instance) {
             instance->float_feasigns_.push_back(FeatureItem(f, idx));
           }
         } else if (all_slots_type_[i][0] == 'u') {  // uint64
-          for (int j = 0; j < num; ++j) {
-            uint64_t feasign = (uint64_t)strtoull(endptr, &endptr, 10);
+          for (uint64_t j = 0; j < num; ++j) {
+            uint64_t feasign = 0;
+            CheckSlotToken(ParseUint64(&pos, end, &feasign), str);
             // if uint64 feasign is equal to zero, ignore it
             // except when slot is dense
             if (feasign == 0 && !use_slots_is_dense_[i]) {
@@ -1257,14 +1371,9 @@ bool MultiSlotInMemoryDataFeed::ParseOneInstanceFromPipe(Record* instance) {
             instance->uint64_feasigns_.push_back(FeatureItem(f, idx));
           }
         }
-        pos = endptr - str;
       } else {
-        for (int j = 0; j <= num; ++j) {
-          // pos = line.find_first_of(' ', pos + 1);
-          while (line[pos + 1] != ' ') {
-            pos++;
-          }
-        }
+        pos = SkipTokens(SkipSpaces(pos, end), end, num);
+        CheckSlotToken(pos != nullptr, str);
       }
     }
     instance->float_feasigns_.shrink_to_fit();
@@ -1282,16 +1391,17 @@ bool MultiSlotInMemoryDataFeed::ParseOneInstance(Record* instance) {
   std::string line;
   if (getline(file_, line)) {
     VLOG(3) << line;
-    // parse line
+    // parse the line in place, see slot_text_parser.h
     const char* str = line.c_str();
-    char* endptr = const_cast<char*>(str);
-    int pos = 0;
+    const char* end = str + line.size();
+    const char* pos = str;
     for (size_t i = 0; i < use_slots_index_.size(); ++i) {
       int idx = use_slots_index_[i];
-      int num = strtol(&str[pos], &endptr, 10);
+      uint64_t num = 0;
+      CheckSlotToken(ParseUint64(&pos, end, &num), str);
       PADDLE_ENFORCE_NE(
           num,
-          0,
+          0UL,
           platform::errors::InvalidArgument(
               "The number of ids can not be zero, you need padding "
               "it in data generator; or if there is something wrong with "
@@ -1308,8 +1418,9 @@ bool MultiSlotInMemoryDataFeed::ParseOneInstance(Record* instance) {
 
       if (idx != -1) {
         if (all_slots_type_[i][0] == 'f') {  // float
-          for (int j = 0; j < num; ++j) {
-            float feasign = strtof(endptr, &endptr);
+          for (uint64_t j = 0; j < num; ++j) {
+            float feasign = 0;
+            CheckSlotToken(ParseFloat(&pos, end, &feasign), str);
             if (fabs(feasign) < 1e-6) {
               continue;
             }
@@ -1318,8 +1429,9 @@ bool MultiSlotInMemoryDataFeed::ParseOneInstance(Record* instance) {
             instance->float_feasigns_.push_back(FeatureItem(f, idx));
           }
         } else if (all_slots_type_[i][0] == 'u') {  // uint64
-          for (int j = 0; j < num; ++j) {
-            uint64_t feasign = (uint64_t)strtoull(endptr, &endptr, 10);
+          for (uint64_t j = 0; j < num; ++j) {
+            uint64_t feasign = 0;
+            CheckSlotToken(ParseUint64(&pos, end, &feasign), str);
             if (feasign == 0) {
               continue;
             }
@@ -1328,11 +1440,9 @@ bool MultiSlotInMemoryDataFeed::ParseOneInstance(Record* instance) {
             instance->uint64_feasigns_.push_back(FeatureItem(f, idx));
           }
         }
-        pos = endptr - str;
       } else {
-        for (int j = 0; j <= num; ++j) {
-          pos = line.find_first_of(' ', pos + 1);
-        }
+        pos = SkipTokens(SkipSpaces(pos, end), end, num);
+        CheckSlotToken(pos != nullptr, str);
       }
     }
     instance->float_feasigns_.shrink_to_fit();
@@ -2095,6 +2205,17 @@ void SlotRecordInMemoryDataFeed::Init(const DataFeedDesc& data_feed_desc) {
   }
   used_slots_info_.resize(use_slot_size_);
 
+  slot_text_info_.resize(all_slot_num);
+  for (size_t i = 0; i < all_slot_num; ++i) {
+    const AllSlotInfo& all_slot = all_slots_info_[i];
+    SlotTextInfo& text_info = slot_text_info_[i];
+    text_info.type = all_slot.type[0];
+    text_info.used = (all_slot.used_idx != -1);
+    text_info.dense =
+        text_info.used && used_slots_info_[all_slot.used_idx].dense;
+    text_info.slot_value_idx = all_slot.slot_value_idx;
+  }
+
   feed_vec_.resize(used_slots_info_.size());
   const int kEstimatedFeasignNumPerSlot = 5;  // Magic Number
   for (size_t i = 0; i < all_slot_num; i++) {
@@ -2112,6 +2233,7 @@ void SlotRecordInMemoryDataFeed::Init(const DataFeedDesc& data_feed_desc) {
   pipe_command_ = data_feed_desc.pipe_command();
   finish_init_ = true;
   input_type_ = data_feed_desc.input_type();
+  columnar_input_ = (data_feed_desc.input_format() == "columnar");
   size_t pos = pipe_command_.find(".so");
   if (pos != std::string::npos) {
     pos = pipe_command_.rfind('|');
@@ -2126,6 +2248,16 @@ void SlotRecordInMemoryDataFeed::Init(const DataFeedDesc& data_feed_desc) {
   } else {
     so_parser_name_.clear();
   }
+  if (columnar_input_) {
+    std::string command = paddle::string::erase_spaces(pipe_command_);
+    PADDLE_ENFORCE_EQ(
+        so_parser_name_.empty() && (command.empty() || command == "cat"),
+        true,
+        platform::errors::InvalidArgument(
+            "Columnar input files are read as binary blocks, pipe_command "
+            "must be empty or cat, but got [%s].",
+            data_feed_desc.pipe_command()));
+  }
 #if defined(PADDLE_WITH_GPU_GRAPH) && defined(PADDLE_WITH_HETERPS)
   gpu_graph_data_generator_.SetConfig(data_feed_desc);
 #endif
@@ -2133,7 +2265,9 @@ void SlotRecordInMemoryDataFeed::Init(const DataFeedDesc& data_feed_desc) {
 
 void SlotRecordInMemoryDataFeed::LoadIntoMemory() {
   VLOG(3) << "SlotRecord LoadIntoMemory() begin, thread_id=" << thread_id_;
-  if (!so_parser_name_.empty()) {
+  if (columnar_input_) {
+    LoadIntoMemoryByColumnar();
+  } else if (!so_parser_name_.empty()) {
     LoadIntoMemoryByLib();
   } else {
     LoadIntoMemoryByCommand();
@@ -2176,6 +2310,7 @@ void SlotRecordInMemoryDataFeed::LoadIntoMemoryByFile(void) {
   };
 
   std::string filename;
+  SlotRecordArenaScope arena_scope(slot_arena_);
   while (this->PickOneFile(&filename)) {
     VLOG(3) << "PickOneFile, filename=" << filename
             << ", thread_id=" << thread_id_;
@@ -2267,6 +2402,7 @@ void SlotRecordInMemoryDataFeed::LoadIntoMemoryByLine(void) {
                  &record_func,
                  &old_offset](const std::string& line) {
       old_offset = offset;
+      SlotRecordArenaScope arena_scope(slot_arena_);
       if (!parser->ParseOneInstance(line, record_func)) {
         offset = old_offset;
         LOG(WARNING) << "read file:[" << filename << "] item error, line:["
@@ -2283,14 +2419,15 @@ void SlotRecordInMemoryDataFeed::LoadIntoMemoryByLine(void) {
     };
 
     int lines = 0;
+    int read_retry = 0;
 
     do {
       int err_no = 0;
-      this->fp_ = fs_open_read(filename, &err_no, this->pipe_command_, true);
-      CHECK(this->fp_ != nullptr);
-      __fsetlocking(&*(this->fp_), FSETLOCKING_BYCALLER);
-      lines = line_reader.read_file(this->fp_.get(), line_func, lines);
-    } while (line_reader.is_error());
+      auto chunks =
+          fs_open_read_chunks(filename, &err_no, this->pipe_command_, true);
+      CHECK(chunks != nullptr);
+      lines = line_reader.read_chunks(chunks.get(), line_func, lines);
+    } while (line_reader.need_retry(filename, &read_retry));
 
     if (offset > 0) {
       input_channel_->WriteMove(offset, &record_vec[0]);
@@ -2332,21 +2469,24 @@ void SlotRecordInMemoryDataFeed::LoadIntoMemoryByCommand(void) {
     timeline.Start();
     SlotRecordPool().get(&record_vec, OBJPOOL_BLOCK_SIZE);
     int offset = 0;
+    int read_retry = 0;
 
     do {
       int err_no = 0;
-      this->fp_ = fs_open_read(filename, &err_no, this->pipe_command_, true);
-      CHECK(this->fp_ != nullptr);
-      __fsetlocking(&*(this->fp_), FSETLOCKING_BYCALLER);
-
-      lines = line_reader.read_file(
-          this->fp_.get(),
-          [this, &record_vec, &offset, &filename](const std::string& line) {
-            if (ParseOneInstance(line, &record_vec[offset])) {
+      auto chunks =
+          fs_open_read_chunks(filename, &err_no, this->pipe_command_, true);
+      CHECK(chunks != nullptr);
+
+      lines = line_reader.read_chunks(
+          chunks.get(),
+          [this, &record_vec, &offset, &filename](const char* str,
+                                                  size_t len) {
+            if (ParseOneInstance(str, len, &record_vec[offset])) {
               ++offset;
             } else {
               LOG(WARNING) << "read file:[" << filename
-                           << "] item error, line:[" << line << "]";
+                           << "] item error, line:[" << std::string(str, len)
+                           << "]";
               return false;
             }
             if (offset >= OBJPOOL_BLOCK_SIZE) {
@@ -2358,7 +2498,7 @@ void SlotRecordInMemoryDataFeed::LoadIntoMemoryByCommand(void) {
             return true;
           },
           lines);
-    } while (line_reader.is_error());
+    } while (line_reader.need_retry(filename, &read_retry));
     if (offset > 0) {
       input_channel_->WriteMove(offset, &record_vec[0]);
       if (offset < OBJPOOL_BLOCK_SIZE) {
@@ -2382,114 +2522,233 @@ void SlotRecordInMemoryDataFeed::LoadIntoMemoryByCommand(void) {
 #endif
 }
 
-static void parser_log_key(const std::string& log_key,
-                           uint64_t* search_id,
-                           uint32_t* cmatch,
-                           uint32_t* rank) {
-  std::string searchid_str = log_key.substr(16, 16);
-  *search_id = static_cast<uint64_t>(strtoull(searchid_str.c_str(), NULL, 16));
-  std::string cmatch_str = log_key.substr(11, 3);
-  *cmatch = static_cast<uint32_t>(strtoul(cmatch_str.c_str(), NULL, 16));
-  std::string rank_str = log_key.substr(14, 2);
-  *rank = static_cast<uint32_t>(strtoul(rank_str.c_str(), NULL, 16));
+void SlotRecordInMemoryDataFeed::LoadIntoMemoryByColumnar(void) {
+#ifdef _LINUX
+  std::string filename;
+  ColumnarBlockReader reader;
+  std::default_random_engine random_engine;
+  std::uniform_real_distribution<float> uniform_distribution;
+  const bool sample = std::abs(sample_rate_ - 1.0f) >= 1e-5f;
+  // feasign counts of the used slots, unused columns are never decoded
+  std::vector<std::vector<uint32_t>> slot_lens(use_slot_size_);
+  std::vector<uint32_t> uint64_num;
+  std::vector<uint32_t> float_num;
+  std::vector<SlotRecord> ins_recs;
+  std::vector<uint64_t*> uint64_dst;
+  std::vector<float*> float_dst;
+  std::vector<SlotRecord> record_vec;
+  std::string ins_id;
+  uint64_t search_id = 0;
+  uint32_t cmatch = 0;
+  uint32_t rank = 0;
+  SlotRecordArenaScope arena_scope(slot_arena_);
+
+  while (this->PickOneFile(&filename)) {
+    VLOG(3) << "PickOneFile, filename=" << filename
+            << ", thread_id=" << thread_id_;
+    platform::Timer timeline;
+    timeline.Start();
+    int err_no = 0;
+    // binary blocks, pipe_command_ is checked to be a plain read in Init
+    this->fp_ = fs_open_read(filename, &err_no, "", true);
+    CHECK(this->fp_ != nullptr);
+    __fsetlocking(&*(this->fp_), FSETLOCKING_BYCALLER);
+
+    size_t total_num = 0;
+    size_t load_num = 0;
+    while (reader.Read(this->fp_.get())) {
+      CHECK(reader.slot_num() == all_slots_info_.size())
+          << "columnar file " << filename << " has " << reader.slot_num()
+          << " slots, but data feed desc has " << all_slots_info_.size();
+      if (parse_logkey_) {
+        CHECK(reader.flags() & kColumnarHasLogKey)
+            << "columnar file " << filename << " has no logkey";
+      } else if (parse_ins_id_) {
+        CHECK(reader.flags() & (kColumnarHasInsId | kColumnarHasLogKey))
+            << "columnar file " << filename << " has no ins_id";
+      }
+      const uint32_t n = reader.ins_num();
+      total_num += n;
+      uint64_num.assign(n, 0);
+      float_num.assign(n, 0);
+      for (int j = 0; j < use_slot_size_; ++j) {
+        const UsedSlotInfo& info = used_slots_info_[j];
+        CHECK(reader.slot(info.idx).type == info.type[0])
+            << "columnar slot " << info.slot << " type mismatch";
+        slot_lens[j].resize(n);
+        reader.DecodeLengths(info.idx, slot_lens[j].data());
+        auto& num = (info.type[0] == 'u') ? uint64_num : float_num;
+        for (uint32_t i = 0; i < n; ++i) {
+          num[i] += slot_lens[j][i];
+        }
+      }
+      // same filters as the text path: no uint64 feasign, or sampled out
+      size_t keep_num = 0;
+      for (uint32_t i = 0; i < n; ++i) {
+        if (uint64_num[i] == 0 ||
+            (sample && uniform_distribution(random_engine) >= sample_rate_)) {
+          uint64_num[i] = 0;
+        } else {
+          ++keep_num;
+        }
+      }
+      if (keep_num == 0) {
+        continue;
+      }
+      SlotRecordPool().get(&record_vec, keep_num);
+      ins_recs.assign(n, nullptr);
+      for (uint32_t i = 0, k = 0; i < n; ++i) {
+        if (uint64_num[i] == 0) {
+          continue;
+        }
+        SlotRecord rec = record_vec[k++];
+        rec->slot_uint64_feasigns_.slot_values.resize(uint64_num[i]);
+        rec->slot_uint64_feasigns_.slot_offsets.resize(uint64_use_slot_size_ +
+                                                       1);
+        rec->slot_float_feasigns_.slot_values.resize(float_num[i]);
+        rec->slot_float_feasigns_.slot_offsets.resize(float_use_slot_size_ +
+                                                      1);
+        ins_recs[i] = rec;
+      }
+      if (parse_ins_id_ || parse_logkey_) {
+        for (uint32_t i = 0; i < n; ++i) {
+          reader.NextMeta(&ins_id, &search_id, &cmatch, &rank);
+          SlotRecord rec = ins_recs[i];
+          if (rec == nullptr) {
+            continue;
+          }
+          rec->ins_id_ = ins_id;
+          if (parse_logkey_) {
+            rec->search_id = search_id;
+            rec->cmatch = cmatch;
+            rec->rank = rank;
+          }
+        }
+      }
+      // decode every used column straight into the record values, slots
+      // are laid out in slot_value_idx order as add_slot_feasigns does
+      uint64_num.assign(n, 0);
+      float_num.assign(n, 0);
+      uint64_dst.resize(n);
+      float_dst.resize(n);
+      for (int j = 0; j < use_slot_size_; ++j) {
+        const UsedSlotInfo& info = used_slots_info_[j];
+        const bool is_uint64 = (info.type[0] == 'u');
+        for (uint32_t i = 0; i < n; ++i) {
+          SlotRecord rec = ins_recs[i];
+          if (rec == nullptr) {
+            uint64_dst[i] = nullptr;
+            float_dst[i] = nullptr;
+            continue;
+          }
+          if (is_uint64) {
+            auto& values = rec->slot_uint64_feasigns_;
+            values.slot_offsets[info.slot_value_idx] = uint64_num[i];
+            uint64_dst[i] = values.slot_values.data() + uint64_num[i];
+            uint64_num[i] += slot_lens[j][i];
+          } else {
+            auto& values = rec->slot_float_feasigns_;
+            values.slot_offsets[info.slot_value_idx] = float_num[i];
+            float_dst[i] = values.slot_values.data() + float_num[i];
+            float_num[i] += slot_lens[j][i];
+          }
+        }
+        if (is_uint64) {
+          reader.DecodeUint64(info.idx, slot_lens[j].data(), uint64_dst.data());
+        } else {
+          reader.DecodeFloat(info.idx, slot_lens[j].data(), float_dst.data());
+        }
+      }
+      for (uint32_t i = 0; i < n; ++i) {
+        SlotRecord rec = ins_recs[i];
+        if (rec != nullptr) {
+          rec->slot_uint64_feasigns_.slot_offsets[uint64_use_slot_size_] =
+              uint64_num[i];
+          rec->slot_float_feasigns_.slot_offsets[float_use_slot_size_] =
+              float_num[i];
+        }
+      }
+      load_num += keep_num;
+      input_channel_->Write(std::move(record_vec));
+      record_vec.clear();
+    }
+    timeline.Pause();
+    VLOG(3) << "LoadIntoMemoryByColumnar() read all blocks, file=" << filename
+            << ", ins=" << total_num << ", load ins=" << load_num
+            << ", cost time=" << timeline.ElapsedSec()
+            << " seconds, thread_id=" << thread_id_;
+  }
+#endif
 }
 
 bool SlotRecordInMemoryDataFeed::ParseOneInstance(const std::string& line,
                                                   SlotRecord* ins) {
-  SlotRecord& rec = (*ins);
-  // parse line
-  const char* str = line.c_str();
-  char* endptr = const_cast<char*>(str);
-  int pos = 0;
+  return ParseOneInstance(line.c_str(), line.size(), ins);
+}
 
-  thread_local std::vector<std::vector<float>> slot_float_feasigns;
-  thread_local std::vector<std::vector<uint64_t>> slot_uint64_feasigns;
-  slot_float_feasigns.resize(float_use_slot_size_);
-  slot_uint64_feasigns.resize(uint64_use_slot_size_);
+bool SlotRecordInMemoryDataFeed::ParseOneInstance(const char* str,
+                                                  size_t len,
+                                                  SlotRecord* ins) {
+  SlotRecordArenaScope arena_scope(slot_arena_);
+  SlotRecord& rec = (*ins);
+  const char* pos = str;
+  const char* end = str + len;
 
   if (parse_ins_id_) {
-    int num = strtol(&str[pos], &endptr, 10);
-    CHECK(num == 1);  // NOLINT
-    pos = endptr - str + 1;
-    size_t len = 0;
-    while (str[pos + len] != ' ') {
-      ++len;
+    uint64_t num = 0;
+    CHECK(ParseUint64(&pos, end, &num) && num == 1);  // NOLINT
+    pos = SkipSpaces(pos, end);
+    const char* id_end = SkipTokens(pos, end, 1);
+    if (id_end == nullptr) {
+      return false;
     }
-    rec->ins_id_ = std::string(str + pos, len);
-    pos += len + 1;
+    rec->ins_id_.assign(pos, id_end - pos);
+    pos = id_end;
   }
   if (parse_logkey_) {
-    int num = strtol(&str[pos], &endptr, 10);
-    CHECK(num == 1);  // NOLINT
-    pos = endptr - str + 1;
-    size_t len = 0;
-    while (str[pos + len] != ' ') {
-      ++len;
+    uint64_t num = 0;
+    CHECK(ParseUint64(&pos, end, &num) && num == 1);  // NOLINT
+    pos = SkipSpaces(pos, end);
+    const char* key_end = SkipTokens(pos, end, 1);
+    if (key_end == nullptr) {
+      return false;
     }
     // parse_logkey
-    std::string log_key = std::string(str + pos, len);
+    std::string log_key(pos, key_end - pos);
     uint64_t search_id;
     uint32_t cmatch;
     uint32_t rank;
-    parser_log_key(log_key, &search_id, &cmatch, &rank);
+    ParseLogKey(log_key, &search_id, &cmatch, &rank);
 
     rec->ins_id_ = log_key;
     rec->search_id = search_id;
     rec->cmatch = cmatch;
     rec->rank = rank;
-    pos += len + 1;
-  }
-
-  int float_total_slot_num = 0;
-  int uint64_total_slot_num = 0;
-
-  for (size_t i = 0; i < all_slots_info_.size(); ++i) {
-    auto& info = all_slots_info_[i];
-    int num = strtol(&str[pos], &endptr, 10);
-    PADDLE_ENFORCE(num,
-                   "The number of ids can not be zero, you need padding "
-                   "it in data generator; or if there is something wrong with "
-                   "the data, please check if the data contains unresolvable "
-                   "characters.\nplease check this error line: %s",
-                   str);
-    if (info.used_idx != -1) {
-      if (info.type[0] == 'f') {  // float
-        auto& slot_fea = slot_float_feasigns[info.slot_value_idx];
-        slot_fea.clear();
-        for (int j = 0; j < num; ++j) {
-          float feasign = strtof(endptr, &endptr);
-          if (fabs(feasign) < 1e-6 && !used_slots_info_[info.used_idx].dense) {
-            continue;
-          }
-          slot_fea.push_back(feasign);
-          ++float_total_slot_num;
-        }
-      } else if (info.type[0] == 'u') {  // uint64
-        auto& slot_fea = slot_uint64_feasigns[info.slot_value_idx];
-        slot_fea.clear();
-        for (int j = 0; j < num; ++j) {
-          uint64_t feasign =
-              static_cast<uint64_t>(strtoull(endptr, &endptr, 10));
-          slot_fea.push_back(feasign);
-          ++uint64_total_slot_num;
-        }
-      }
-      pos = endptr - str;
-    } else {
-      for (int j = 0; j <= num; ++j) {
-        // pos = line.find_first_of(' ', pos + 1);
-        while (line[pos + 1] != ' ') {
-          pos++;
-        }
-      }
-    }
+    pos = key_end;
+  }
+
+  // values go straight into the record, slots are laid out as
+  // add_slot_feasigns does
+  size_t bad_slot = 0;
+  SlotTextStatus status = ParseSlotText(pos,
+                                        end,
+                                        slot_text_info_,
+                                        uint64_use_slot_size_,
+                                        float_use_slot_size_,
+                                        &rec->slot_uint64_feasigns_,
+                                        &rec->slot_float_feasigns_,
+                                        &slot_text_buffer_,
+                                        &bad_slot);
+  PADDLE_ENFORCE(status != kSlotTextEmptySlot,
+                 "The number of ids can not be zero, you need padding "
+                 "it in data generator; or if there is something wrong with "
+                 "the data, please check if the data contains unresolvable "
+                 "characters.\nplease check this error line: %s",
+                 std::string(str, len));
+  if (status != kSlotTextOk) {
+    return false;
   }
-  rec->slot_float_feasigns_.add_slot_feasigns(slot_float_feasigns,
-                                              float_total_slot_num);
-  rec->slot_uint64_feasigns_.add_slot_feasigns(slot_uint64_feasigns,
-                                               uint64_total_slot_num);
-
-  return (uint64_total_slot_num > 0);
+  return (rec->slot_uint64_feasigns_.slot_offsets[uint64_use_slot_size_] > 0);
 }
 
 void SlotRecordInMemoryDataFeed::AssignFeedVar(const Scope& scope) {
@@ -2599,8 +2858,8 @@ void SlotRecordInMemoryDataFeed::ExpandSlotRecord(SlotRecord* rec) {
   int float_slot_num =
       static_cast<int>(float_total_dims_without_inductives_.size());
   CHECK(float_slot_num == float_use_slot_size_);
-  std::vector<float> old_values;
-  std::vector<uint32_t> old_offsets;
+  SlotVector<float> old_values;
+  SlotVector<uint32_t> old_offsets;
   old_values.swap(ins->slot_float_feasigns_.slot_values);
   old_offsets.swap(ins->slot_float_feasigns_.slot_offsets);
 
@@ -3243,8 +3502,8 @@ void SlotPaddleBoxDataFeed::ExpandSlotRecord(SlotRecord* rec) {
   int float_slot_num =
       static_cast<int>(float_total_dims_without_inductives_.size());
   CHECK(float_slot_num == float_use_slot_size_);
-  std::vector<float> old_values;
-  std::vector<uint32_t> old_offsets;
+  SlotVector<float> old_values;
+  SlotVector<uint32_t> old_offsets;
   old_values.swap(ins->slot_float_feasigns_.slot_values);
   old_offsets.swap(ins->slot_float_feasigns_.slot_offsets);
 
@@ -3699,6 +3958,7 @@ void SlotPaddleBoxDataFeed::LoadIntoMemoryByLine(void) {
     line_func = [this, &parser, &record_vec, &offset, &filename, &record_func,
                  &old_offset](const std::string& line) {
       old_offset = offset;
+      SlotRecordArenaScope arena_scope(slot_arena_);
       if (!parser->ParseOneInstance(line, record_func)) {
         offset = old_offset;
         LOG(WARNING) << "read file:[" << filename << "] item error, line:["
@@ -3715,6 +3975,7 @@ void SlotPaddleBoxDataFeed::LoadIntoMemoryByLine(void) {
     };
 
     int lines = 0;
+    int read_retry = 0;
 
     do {
       if (BoxWrapper::GetInstance()->UseAfsApi() && pipe_command_.empty()) {
@@ -3735,7 +3996,7 @@ void SlotPaddleBoxDataFeed::LoadIntoMemoryByLine(void) {
         __fsetlocking(&*(this->fp_), FSETLOCKING_BYCALLER);
         lines = line_reader.read_file(this->fp_.get(), line_func, lines);
       }
-    } while (line_reader.is_error());
+    } while (line_reader.need_retry(filename, &read_retry));
 
     if (offset > 0) {
       input_channel_->WriteMove(offset, &record_vec[0]);
@@ -3939,6 +4200,7 @@ void SlotPaddleBoxDataFeed::LoadIntoMemoryByCommand(void) {
     timeline.Start();
     slot_pool_->get(&record_vec, OBJPOOL_BLOCK_SIZE);
     int offset = 0;
+    int read_retry = 0;
 
     do {
       if (BoxWrapper::GetInstance()->UseAfsApi()) {
@@ -3970,7 +4232,7 @@ void SlotPaddleBoxDataFeed::LoadIntoMemoryByCommand(void) {
             return true;
           },
           lines);
-    } while (line_reader.is_error());
+    } while (line_reader.need_retry(filename, &read_retry));
     if (offset > 0) {
       input_channel_->WriteMove(offset, &record_vec[0]);
       if (offset < OBJPOOL_BLOCK_SIZE) {
@@ -4042,7 +4304,7 @@ bool SlotPaddleBoxDataFeed::ParseOneInstance(const std::string& line,
     uint64_t search_id;
     uint32_t cmatch;
     uint32_t rank;
-    parser_log_key(log_key, &search_id, &cmatch, &rank);
+    ParseLogKey(log_key, &search_id, &cmatch, &rank);
 
     rec->ins_id_ = log_key;
     rec->search_id = search_id;
@@ -4194,6 +4456,7 @@ void SlotPaddleBoxDataFeedWithGpuReplicaCache::LoadIntoMemoryByLib(void) {
       return true;
     };
     int lines = 0;
+    int read_retry = 0;
     do {
       if (BoxWrapper::GetInstance()->UseAfsApi() && pipe_command_.empty()) {
         while (reader->open(filename) < 0) {
@@ -4214,7 +4477,7 @@ void SlotPaddleBoxDataFeedWithGpuReplicaCache::LoadIntoMemoryByLib(void) {
         __fsetlocking(&*(this->fp_), FSETLOCKING_BYCALLER);
         lines = line_reader.read_file(this->fp_.get(), func, lines);
       }
-    } while (line_reader.is_error());
+    } while (line_reader.need_retry(filename, &read_retry));
     if (offset > 0) {
       input_channel_->WriteMove(offset, &record_vec[0]);
       if (offset < max_fetch_num) {
@@ -4255,6 +4518,7 @@ void SlotPaddleBoxDataFeedWithGpuReplicaCache::LoadIntoMemoryByCommand(void) {
     int gpu_cache_offset;
     int max_fetch_num = OBJPOOL_BLOCK_SIZE;
     slot_pool_->get(&record_vec, max_fetch_num);
+    int read_retry = 0;
     do {
       if (box_ptr->UseAfsApi()) {
         this->fp_ = box_ptr->OpenReadFile(filename, this->pipe_command_);
@@ -4295,7 +4559,7 @@ void SlotPaddleBoxDataFeedWithGpuReplicaCache::LoadIntoMemoryByCommand(void) {
             return true;
           },
           lines);
-    } while (line_reader.is_error());
+    } while (line_reader.need_retry(filename, &read_retry));
     if (offset > 0) {
       input_channel_->WriteMove(offset, &record_vec[0]);
       if (offset < max_fetch_num) {
@@ -4353,7 +4617,7 @@ bool SlotPaddleBoxDataFeedWithGpuReplicaCache::ParseOneInstance(
     uint64_t search_id;
     uint32_t cmatch;
     uint32_t rank;
-    parser_log_key(log_key, &search_id, &cmatch, &rank);
+    ParseLogKey(log_key, &search_id, &cmatch, &rank);
 
     rec->ins_id_ = log_key;
     rec->search_id = search_id;
@@ -4496,6 +4760,7 @@ void InputTableDataFeed::LoadIntoMemoryByLib() {
       return true;
     };
     int lines = 0;
+    int read_retry = 0;
     do {
       if (BoxWrapper::GetInstance()->UseAfsApi() && pipe_command_.empty()) {
         while (reader->open(filename) < 0) {
@@ -4515,7 +4780,7 @@ void InputTableDataFeed::LoadIntoMemoryByLib() {
         __fsetlocking(&*(this->fp_), FSETLOCKING_BYCALLER);
         lines = line_reader.read_file(this->fp_.get(), func, lines);
       }
-    } while (line_reader.is_error());
+    } while (line_reader.need_retry(filename, &read_retry));
     if (offset > 0) {
       input_channel_->WriteMove(offset, &record_vec[0]);
       if (offset < max_fetch_num) {
@@ -4578,6 +4843,7 @@ void InputIndexDataFeed::LoadIntoMemory() {
     };
 
     int lines = 0;
+    int read_retry = 0;
     do {
       if (BoxWrapper::GetInstance()->UseAfsApi() && pipe_command_.empty()) {
         while (reader->open(filename) < 0) {
@@ -4597,7 +4863,7 @@ void InputIndexDataFeed::LoadIntoMemory() {
         __fsetlocking(&*(this->fp_), FSETLOCKING_BYCALLER);
         lines = line_reader.read_file(this->fp_.get(), func, lines);
       }
-    } while (line_reader.is_error());
+    } while (line_reader.need_retry(filename, &read_retry));
     VLOG(3) << "read file:[" << filename << "], lines:[" << lines << "]";
   }
 
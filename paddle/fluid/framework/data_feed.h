@@ -19,6 +19,9 @@ limitations under the License. */
 #define _LINUX
 #endif
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>  // NOLINT
 #include <fstream>
 #include <future>  // NOLINT
 #include <memory>
@@ -39,6 +42,7 @@ limitations under the License. */
 #include "paddle/fluid/framework/fleet/fleet_wrapper.h"
 #include "paddle/fluid/framework/lod_tensor.h"
 #include "paddle/fluid/framework/reader.h"
+#include "paddle/fluid/framework/slot_text_parser.h"
 #include "paddle/fluid/framework/variable.h"
 #include "paddle/fluid/platform/timer.h"
 #include "paddle/fluid/string/string_helper.h"
@@ -53,6 +57,7 @@ DECLARE_int32(record_pool_max_size);
 DECLARE_int32(slotpool_thread_num);
 DECLARE_int32(padbox_record_pool_max_size);
 DECLARE_int32(padbox_slotpool_thread_num);
+DECLARE_int32(padbox_slotpool_thread_cache_size);
 DECLARE_int32(padbox_slotrecord_extend_dim);
 DECLARE_bool(padbox_auc_runner_mode);
 DECLARE_bool(enable_slotpool_wait_release);
@@ -93,10 +98,157 @@ namespace framework {
 //      // trainer do something
 //   }
 
+// SlotRecordArena is a pass scoped bump allocator for the feasign buffers of
+// SlotRecords. Loader threads carve buffers out of large chunks, a buffer is
+// never freed alone, all chunks are released by Reset() when the pass is
+// released. This saves the malloc header and fragmentation of millions of
+// small vectors and makes the release of a pass a few munmap calls.
+class SlotRecordArena {
+ public:
+  static const size_t kChunkSize = 64UL << 20;
+
+  SlotRecordArena() : id_(next_id()) {}
+  ~SlotRecordArena() { Reset(); }
+
+  // thread safe, every thread bumps its own chunk
+  void* Allocate(size_t bytes) {
+    bytes = (bytes + kAlign - 1) & ~(kAlign - 1);
+    ThreadCursor& cur = thread_cursor();
+    if (cur.arena_id != id_ || cur.ptr + bytes > cur.end) {
+      size_t chunk_size = (std::max)(static_cast<size_t>(kChunkSize), bytes);
+      char* chunk = reinterpret_cast<char*>(malloc(chunk_size));
+      CHECK(chunk != nullptr) << "slot record arena alloc failed, size="
+                              << chunk_size;
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        chunks_.push_back(chunk);
+        reserved_bytes_ += chunk_size;
+      }
+      cur.arena_id = id_;
+      cur.ptr = chunk;
+      cur.end = chunk + chunk_size;
+    }
+    void* p = cur.ptr;
+    cur.ptr += bytes;
+    return p;
+  }
+  // all buffers allocated from the arena must be released before
+  void Reset() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto chunk : chunks_) {
+      free(chunk);
+    }
+    chunks_.clear();
+    reserved_bytes_ = 0;
+    // cursors of other threads still point into the freed chunks
+    id_ = next_id();
+  }
+  size_t reserved_bytes() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return reserved_bytes_;
+  }
+
+  // the arena used by SlotValues buffers allocated in the calling thread,
+  // nullptr means buffers come from the heap
+  static SlotRecordArena*& thread_arena() {
+    thread_local SlotRecordArena* arena = nullptr;
+    return arena;
+  }
+
+ private:
+  static const size_t kAlign = 8;
+  struct ThreadCursor {
+    uint64_t arena_id = 0;
+    char* ptr = nullptr;
+    char* end = nullptr;
+  };
+  static ThreadCursor& thread_cursor() {
+    thread_local ThreadCursor cursor;
+    return cursor;
+  }
+  static uint64_t next_id() {
+    static std::atomic<uint64_t> id{1};
+    return id.fetch_add(1);
+  }
+
+  std::atomic<uint64_t> id_;
+  std::mutex mutex_;
+  std::vector<char*> chunks_;
+  size_t reserved_bytes_ = 0;
+};
+
+// make SlotValues buffers of the current thread come from arena in a scope
+class SlotRecordArenaScope {
+ public:
+  explicit SlotRecordArenaScope(SlotRecordArena* arena)
+      : prev_(SlotRecordArena::thread_arena()) {
+    SlotRecordArena::thread_arena() = arena;
+  }
+  ~SlotRecordArenaScope() { SlotRecordArena::thread_arena() = prev_; }
+
+ private:
+  SlotRecordArena* prev_;
+};
+
+// Allocator of SlotValues vectors. Memory comes from the thread's
+// SlotRecordArena if there is one, otherwise from malloc. A tag word in front
+// of the buffer tells which, so vectors filled in an arena scope can still be
+// destroyed or resized anywhere; deallocate is a no-op for arena memory.
+template <typename T>
+struct SlotArenaAllocator {
+  typedef T value_type;
+
+  SlotArenaAllocator() = default;
+  template <typename U>
+  SlotArenaAllocator(const SlotArenaAllocator<U>&) {}  // NOLINT
+
+  T* allocate(size_t n) {
+    size_t bytes = n * sizeof(T) + kHeaderSize;
+    SlotRecordArena* arena = SlotRecordArena::thread_arena();
+    uint64_t* header = nullptr;
+    if (arena != nullptr) {
+      header = reinterpret_cast<uint64_t*>(arena->Allocate(bytes));
+      *header = kArenaTag;
+    } else {
+      header = reinterpret_cast<uint64_t*>(malloc(bytes));
+      if (header == nullptr) {
+        throw std::bad_alloc();
+      }
+      *header = kHeapTag;
+    }
+    return reinterpret_cast<T*>(header + 1);
+  }
+  void deallocate(T* p, size_t) {
+    uint64_t* header = reinterpret_cast<uint64_t*>(p) - 1;
+    if (*header == kHeapTag) {
+      free(header);
+    }
+  }
+  static bool from_arena(const T* p) {
+    return p != nullptr && *(reinterpret_cast<const uint64_t*>(p) - 1) ==
+                               kArenaTag;
+  }
+
+ private:
+  static const size_t kHeaderSize = sizeof(uint64_t);
+  static const uint64_t kHeapTag = 0;
+  static const uint64_t kArenaTag = 1;
+};
+template <typename T, typename U>
+bool operator==(const SlotArenaAllocator<T>&, const SlotArenaAllocator<U>&) {
+  return true;
+}
+template <typename T, typename U>
+bool operator!=(const SlotArenaAllocator<T>&, const SlotArenaAllocator<U>&) {
+  return false;
+}
+template <typename T>
+using SlotVector = std::vector<T, SlotArenaAllocator<T>>;
+
 template <typename T>
 struct SlotValues {
-  std::vector<T> slot_values;
-  std::vector<uint32_t> slot_offsets;
+  SlotVector<T> slot_values;
+  SlotVector<uint32_t> slot_offsets;
 
   void add_values(const T* values, uint32_t num) {
     if (slot_offsets.empty()) {
@@ -127,12 +279,17 @@ struct SlotValues {
     }
     slot_offsets[slot_num] = slot_values.size();
   }
+  // arena buffers are always dropped, the arena may be reset while the
+  // record waits in the object pool
   void clear(bool shrink) {
     slot_offsets.clear();
     slot_values.clear();
-    if (shrink) {
-      slot_values.shrink_to_fit();
-      slot_offsets.shrink_to_fit();
+    if (shrink || SlotArenaAllocator<T>::from_arena(slot_values.data())) {
+      SlotVector<T>().swap(slot_values);
+    }
+    if (shrink ||
+        SlotArenaAllocator<uint32_t>::from_arena(slot_offsets.data())) {
+      SlotVector<uint32_t>().swap(slot_offsets);
     }
   }
 };
@@ -238,76 +395,39 @@ inline void free_slotrecord(SlotRecordObject* p) {
   p->~SlotRecordObject();
   free(p);
 }
-template <class T>
-class SlotObjAllocator {
- public:
-  explicit SlotObjAllocator(std::function<void(T*)> deleter)
-      : free_nodes_(NULL), capacity_(0), deleter_(deleter) {}
-  ~SlotObjAllocator() { clear(); }
-
-  void clear() {
-    T* tmp = NULL;
-    while (free_nodes_ != NULL) {
-      tmp = reinterpret_cast<T*>(free_nodes_);
-      free_nodes_ = free_nodes_->next;
-      deleter_(tmp);
-      --capacity_;
-    }
-    CHECK_EQ(capacity_, static_cast<size_t>(0));
-  }
-  T* acquire(void) {
-    T* x = NULL;
-    x = reinterpret_cast<T*>(free_nodes_);
-    free_nodes_ = free_nodes_->next;
-    --capacity_;
-    return x;
-  }
-  void release(T* x) {
-    Node* node = reinterpret_cast<Node*>(x);
-    node->next = free_nodes_;
-    free_nodes_ = node;
-    ++capacity_;
-  }
-  size_t capacity(void) { return capacity_; }
-  // get more
-  size_t get(size_t n, T** data) {
-    size_t i = 0;
-    while (capacity_ > 0 && i < n) {
-      data[i] = reinterpret_cast<T*>(free_nodes_);
-      free_nodes_ = free_nodes_->next;
-      --capacity_;
-      ++i;
-    }
-    return i;
-  }
-  size_t put(size_t n, T** data) {
-    for (size_t i = 0; i < n; ++i) {
-      Node* node = reinterpret_cast<Node*>(data[i]);
-      node->next = free_nodes_;
-      free_nodes_ = node;
-      ++capacity_;
-    }
-    return capacity_;
-  }
-
- private:
-  struct alignas(T) Node {
-    union {
-      Node* next;
-      char data[sizeof(T)];
-    };
-  };
-  Node* free_nodes_;  // a list
-  size_t capacity_;
-  std::function<void(T*)> deleter_ = nullptr;
-};
 static const int OBJPOOL_BLOCK_SIZE = 10000;
+// thread caches are picked by a per thread index modulo this number
+static const int OBJPOOL_THREAD_CACHE_NUM = 64;
+// the free threads drain the caches idle for this long into the depot
+static const int OBJPOOL_TRIM_INTERVAL_MS = 1000;
+
+struct SlotObjPoolStat {
+  size_t cache_hit = 0;          // objects got from the thread cache
+  size_t depot_hit = 0;          // objects got from the global depot
+  size_t miss = 0;               // objects newly allocated
+  size_t cross_thread_put = 0;   // objects put back by another thread
+  size_t depot_transfer = 0;     // magazines moved between caches and depot
+};
+
+// SlotObjPool keeps free SlotRecords in two levels, like the thread cache and
+// central free list of tcmalloc:
+//   - a cache per thread holding up to FLAGS_padbox_slotpool_thread_cache_size
+//     objects, its mutex is only taken by the owner thread except for
+//     capacity()/clear(), so get/put do not contend with other threads;
+//   - a global depot of magazines (vectors of OBJPOOL_BLOCK_SIZE objects),
+//     caches refill from and spill to it by moving whole magazines.
+// The background threads in run() free objects from the depot when it grows
+// beyond max_capacity_ or when the pool is disabled. Every
+// OBJPOOL_TRIM_INTERVAL_MS they also drain the caches not used since the last
+// round into the depot, and trim()/disable_pool(true) drain all of them, so
+// the objects of threads that stopped loading can be freed too.
 class SlotObjPool {
  public:
   SlotObjPool()
       : inited_(true),
         max_capacity_(FLAGS_padbox_record_pool_max_size),
-        alloc_(free_slotrecord) {
+        cache_size_(FLAGS_padbox_slotpool_thread_cache_size),
+        caches_(OBJPOOL_THREAD_CACHE_NUM) {
     slot_record_byte_size_ = sizeof(SlotRecordObject) +
                              sizeof(float) * FLAGS_padbox_slotrecord_extend_dim;
     for (int i = 0; i < FLAGS_padbox_slotpool_thread_num; ++i) {
@@ -317,31 +437,59 @@ class SlotObjPool {
     count_ = 0;
   }
   ~SlotObjPool() {
-    inited_ = false;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      inited_ = false;
+    }
     cond_.notify_all();
     for (auto& t : threads_) {
       t.join();
     }
+    free_all();
   }
   void set_slotrecord_size(size_t byte_size) {
     slot_record_byte_size_ = byte_size;
   }
-  void disable_pool(bool disable) { disable_pool_ = disable; }
+  void disable_pool(bool disable) {
+    disable_pool_ = disable;
+    if (disable) {
+      drain_caches(true);
+      cond_.notify_all();
+    }
+  }
+  // move the objects of all thread caches to the depot and let the free
+  // threads trim it down to max_capacity_
+  void trim(void) {
+    drain_caches(true);
+    cond_.notify_all();
+  }
   void set_max_capacity(size_t max_capacity) { max_capacity_ = max_capacity; }
   void get(std::vector<SlotRecord>* output, size_t n) {
     output->resize(n);
     return get(&(*output)[0], n);
   }
   void get(SlotRecord* output, size_t n) {
+    ThreadCache& cache = caches_[thread_cache_index()];
     size_t size = 0;
-    mutex_.lock();
-    size = alloc_.get(n, output);
+    size_t from_depot = 0;
+    {
+      std::lock_guard<std::mutex> lock(cache.mutex);
+      size = take_from_cache(&cache, output, n);
+      if (size < n) {
+        from_depot = refill_cache(&cache, n - size);
+        size += take_from_cache(&cache, output + size, n - size);
+      }
+      cache.outstanding += static_cast<int64_t>(n);
+      cache.active = true;
+    }
     count_ += n;
-    mutex_.unlock();
-
+    from_depot = (std::min)(from_depot, size);
+    stat_.cache_hit += size - from_depot;
+    stat_.depot_hit += from_depot;
     if (size == n) {
       return;
     }
+    stat_.miss += n - size;
     for (size_t i = size; i < n; ++i) {
       output[i] = make_slotrecord(slot_record_byte_size_);
     }
@@ -358,66 +506,249 @@ class SlotObjPool {
     for (size_t i = 0; i < num; ++i) {
       input[i]->reset();
     }
-    // pool empty add to pool
-    mutex_.lock();
-    size_t capacity = alloc_.put(num, input);
     count_ -= num;
-    mutex_.unlock();
+    ThreadCache& cache = caches_[thread_cache_index()];
+    std::vector<std::vector<SlotRecord>> spill;
+    {
+      std::lock_guard<std::mutex> lock(cache.mutex);
+      // returns beyond what this thread got were allocated by another thread
+      int64_t before = cache.outstanding;
+      cache.outstanding -= static_cast<int64_t>(num);
+      if (cache.outstanding < 0) {
+        stat_.cross_thread_put += static_cast<size_t>(
+            -cache.outstanding - (std::max)(-before, static_cast<int64_t>(0)));
+      }
+      cache.objs.insert(cache.objs.end(), input, input + num);
+      cache.active = true;
+      // disable pool: hand everything to depot, the free threads release it
+      size_t keep = disable_pool_ ? 0 : cache_size_;
+      while (cache.objs.size() > keep) {
+        size_t n = (std::min)(cache.objs.size() - keep,
+                              static_cast<size_t>(OBJPOOL_BLOCK_SIZE));
+        spill.emplace_back(cache.objs.end() - n, cache.objs.end());
+        cache.objs.resize(cache.objs.size() - n);
+      }
+    }
+    if (spill.empty()) {
+      return;
+    }
+    size_t capacity = 0;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      for (auto& mag : spill) {
+        depot_size_ += mag.size();
+        depot_.push_back(std::move(mag));
+      }
+      capacity = depot_size_;
+    }
+    stat_.depot_transfer += spill.size();
     // disable pool
     if (disable_pool_ || capacity > max_capacity_) {
       cond_.notify_one();
     }
   }
   void run(void) {
-    size_t n = 0;
     size_t max_size = OBJPOOL_BLOCK_SIZE * 50;
-    std::vector<SlotRecord> input;
-    input.resize(max_size);
+    std::vector<std::vector<SlotRecord>> frees;
+    auto drained = std::chrono::steady_clock::now();
     while (inited_) {
-      size_t check_capacity = (disable_pool_) ? 0 : max_capacity_;
+      size_t check_capacity = (disable_pool_) ? 0 : max_capacity_.load();
       {
         std::unique_lock<std::mutex> lock(mutex_);
-        if (alloc_.capacity() <= check_capacity) {
-          cond_.wait(lock);
+        if (depot_size_ <= check_capacity && inited_) {
+          cond_.wait_for(
+              lock, std::chrono::milliseconds(OBJPOOL_TRIM_INTERVAL_MS));
         }
-        n = alloc_.get(max_size, &input[0]);
       }
-      for (size_t i = 0; i < n; ++i) {
-        free_slotrecord(input[i]);
+      // cache mutexes are taken before mutex_
+      auto now = std::chrono::steady_clock::now();
+      if (disable_pool_ ||
+          now - drained >=
+              std::chrono::milliseconds(OBJPOOL_TRIM_INTERVAL_MS)) {
+        drain_caches(disable_pool_);
+        drained = now;
       }
+      check_capacity = (disable_pool_) ? 0 : max_capacity_.load();
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        size_t n = 0;
+        while (!depot_.empty() && n < max_size &&
+               depot_size_ > check_capacity) {
+          n += depot_.back().size();
+          depot_size_ -= depot_.back().size();
+          frees.push_back(std::move(depot_.back()));
+          depot_.pop_back();
+        }
+      }
+      for (auto& mag : frees) {
+        for (auto rec : mag) {
+          free_slotrecord(rec);
+        }
+      }
+      frees.clear();
     }
   }
   void clear(void) {
     platform::Timer timeline;
     timeline.Start();
-    mutex_.lock();
-    size_t total = alloc_.capacity();
-    alloc_.clear();
-    mutex_.unlock();
+    size_t total = free_all();
     timeline.Pause();
     LOG(WARNING) << "clear slot pool data size=" << total
                  << ", span=" << timeline.ElapsedSec();
   }
   size_t capacity(void) {
-    mutex_.lock();
-    size_t total = alloc_.capacity();
-    mutex_.unlock();
-    return total;
+    size_t total = 0;
+    for (auto& cache : caches_) {
+      std::lock_guard<std::mutex> lock(cache.mutex);
+      total += cache.objs.size();
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    return total + depot_size_;
+  }
+  SlotObjPoolStat stat(void) {
+    SlotObjPoolStat ret;
+    ret.cache_hit = stat_.cache_hit;
+    ret.depot_hit = stat_.depot_hit;
+    ret.miss = stat_.miss;
+    ret.cross_thread_put = stat_.cross_thread_put;
+    ret.depot_transfer = stat_.depot_transfer;
+    return ret;
   }
   // print pool info
   void print_info(const char* name = "pool") {
+    SlotObjPoolStat st = stat();
     LOG(INFO) << "[" << name << "]slot alloc object count=" << count_
-              << ", pool size=" << alloc_.capacity();
+              << ", pool size=" << capacity()
+              << ", cache hit=" << st.cache_hit
+              << ", depot hit=" << st.depot_hit << ", miss=" << st.miss
+              << ", cross thread put=" << st.cross_thread_put
+              << ", depot transfer=" << st.depot_transfer;
   }
 
  private:
-  bool inited_;
-  size_t max_capacity_;
+  struct ThreadCache {
+    std::mutex mutex;
+    std::vector<SlotRecord> objs;
+    // objects got minus objects put through this cache
+    int64_t outstanding = 0;
+    // got or put since the last drain_caches
+    bool active = false;
+  };
+  struct AtomicStat {
+    std::atomic<size_t> cache_hit{0};
+    std::atomic<size_t> depot_hit{0};
+    std::atomic<size_t> miss{0};
+    std::atomic<size_t> cross_thread_put{0};
+    std::atomic<size_t> depot_transfer{0};
+  };
+
+  static size_t thread_cache_index(void) {
+    static std::atomic<size_t> next_index{0};
+    thread_local size_t index =
+        next_index.fetch_add(1) % OBJPOOL_THREAD_CACHE_NUM;
+    return index;
+  }
+  // pop up to n objects from the cache tail, cache.mutex must be held
+  static size_t take_from_cache(ThreadCache* cache, SlotRecord* output,
+                                size_t n) {
+    size_t size = (std::min)(n, cache->objs.size());
+    if (size == 0) {
+      return 0;
+    }
+    std::copy(cache->objs.end() - size, cache->objs.end(), output);
+    cache->objs.resize(cache->objs.size() - size);
+    return size;
+  }
+  // move magazines from depot until the cache holds n objects,
+  // cache.mutex must be held, returns the number of objects moved
+  size_t refill_cache(ThreadCache* cache, size_t n) {
+    std::vector<std::vector<SlotRecord>> mags;
+    size_t total = 0;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      while (total < n && !depot_.empty()) {
+        total += depot_.back().size();
+        depot_size_ -= depot_.back().size();
+        mags.push_back(std::move(depot_.back()));
+        depot_.pop_back();
+      }
+    }
+    for (auto& mag : mags) {
+      cache->objs.insert(cache->objs.end(), mag.begin(), mag.end());
+    }
+    stat_.depot_transfer += mags.size();
+    return total;
+  }
+  // move the objects of the caches idle since the last call, or of all
+  // caches, to the depot as magazines, returns the number of objects moved
+  size_t drain_caches(bool all) {
+    std::vector<std::vector<SlotRecord>> mags;
+    size_t total = 0;
+    for (auto& cache : caches_) {
+      std::lock_guard<std::mutex> lock(cache.mutex);
+      bool drain = all || !cache.active;
+      cache.active = false;
+      if (!drain || cache.objs.empty()) {
+        continue;
+      }
+      for (size_t i = 0; i < cache.objs.size(); i += OBJPOOL_BLOCK_SIZE) {
+        size_t end = (std::min)(cache.objs.size(),
+                                i + static_cast<size_t>(OBJPOOL_BLOCK_SIZE));
+        mags.emplace_back(cache.objs.begin() + i, cache.objs.begin() + end);
+      }
+      total += cache.objs.size();
+      cache.objs.clear();
+      cache.objs.shrink_to_fit();
+    }
+    if (mags.empty()) {
+      return 0;
+    }
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      for (auto& mag : mags) {
+        depot_size_ += mag.size();
+        depot_.push_back(std::move(mag));
+      }
+    }
+    stat_.depot_transfer += mags.size();
+    return total;
+  }
+  size_t free_all(void) {
+    size_t total = 0;
+    for (auto& cache : caches_) {
+      std::lock_guard<std::mutex> lock(cache.mutex);
+      for (auto rec : cache.objs) {
+        free_slotrecord(rec);
+      }
+      total += cache.objs.size();
+      cache.objs.clear();
+      cache.objs.shrink_to_fit();
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto& mag : depot_) {
+      for (auto rec : mag) {
+        free_slotrecord(rec);
+      }
+    }
+    total += depot_size_;
+    depot_.clear();
+    depot_size_ = 0;
+    return total;
+  }
+
+ private:
+  std::atomic<bool> inited_;
+  std::atomic<size_t> max_capacity_;
+  size_t cache_size_;
   std::vector<std::thread> threads_;
+  // guards depot_ and depot_size_
   std::mutex mutex_;
-  SlotObjAllocator<SlotRecordObject> alloc_;
-  bool disable_pool_;
-  size_t count_;  // NOLINT
+  std::vector<std::vector<SlotRecord>> depot_;
+  size_t depot_size_ = 0;
+  std::vector<ThreadCache> caches_;
+  AtomicStat stat_;
+  std::atomic<bool> disable_pool_;
+  std::atomic<int64_t> count_;  // NOLINT
   std::condition_variable cond_;
   size_t slot_record_byte_size_ = 0;
 };
@@ -1036,6 +1367,10 @@ class DataFeed {
   virtual void SetParseLogKey(bool parse_logkey) {}
   virtual void SetEnablePvMerge(bool enable_pv_merge) {}
   virtual void SetCurrentPhase(int current_phase) {}
+  // This function will do nothing at default
+  virtual void SetStreamInput(bool stream_input) {}
+  // This function will do nothing at default
+  virtual void SetSlotRecordArena(SlotRecordArena* arena) {}
   virtual void SetDeviceKeys(std::vector<uint64_t>* device_keys, int type) {
 #if defined(PADDLE_WITH_GPU_GRAPH) && defined(PADDLE_WITH_HETERPS)
     gpu_graph_data_generator_.SetDeviceKeys(device_keys, type);
@@ -1210,6 +1545,9 @@ class InMemoryDataFeed : public DataFeed {
   virtual void SetParseLogKey(bool parse_logkey);
   virtual void SetEnablePvMerge(bool enable_pv_merge);
   virtual void SetCurrentPhase(int current_phase);
+  // read input_channel_ a few batches at a time while training and drop the
+  // consumed records, the dataset restores the pass again for every epoch
+  virtual void SetStreamInput(bool stream_input);
   virtual void LoadIntoMemory();
   virtual void LoadIntoMemoryFromSo();
   virtual void SetRecord(T* records) { records_ = records; }
@@ -1245,6 +1583,7 @@ class InMemoryDataFeed : public DataFeed {
   bool parse_content_;
   bool parse_logkey_;
   bool enable_pv_merge_;
+  bool stream_input_ = false;
   int current_phase_{-1};  // only for untest
   std::ifstream file_;
   std::shared_ptr<FILE> fp_;
@@ -1654,10 +1993,16 @@ class SlotRecordInMemoryDataFeed : public InMemoryDataFeed<SlotRecord> {
   virtual void LoadIntoMemoryByLib(void);
   virtual void LoadIntoMemoryByLine(void);
   virtual void LoadIntoMemoryByFile(void);
+  virtual void LoadIntoMemoryByColumnar(void);
   virtual void SetInputChannel(void* channel) {
     input_channel_ = static_cast<ChannelObject<SlotRecord>*>(channel);
   }
+  virtual void SetSlotRecordArena(SlotRecordArena* arena) {
+    slot_arena_ = arena;
+  }
   bool ParseOneInstance(const std::string& line, SlotRecord* rec);
+  // parses the line [str, str + len) in place, str[len] is '\n' or '\0'
+  bool ParseOneInstance(const char* str, size_t len, SlotRecord* rec);
   virtual void PutToFeedVec(const SlotRecord* ins_vec, int num);
   virtual void AssignFeedVar(const Scope& scope);
 #if defined(PADDLE_WITH_CUDA) && defined(PADDLE_WITH_HETERPS)
@@ -1692,6 +2037,13 @@ class SlotRecordInMemoryDataFeed : public InMemoryDataFeed<SlotRecord> {
   std::vector<UsedSlotInfo> used_slots_info_;
   size_t float_total_dims_size_ = 0;
   std::vector<int> float_total_dims_without_inductives_;
+  // feasign buffers of parsed records come from it if not nullptr
+  SlotRecordArena* slot_arena_ = nullptr;
+  // files are columnar blocks (columnar_format.h) instead of text lines
+  bool columnar_input_ = false;
+  // all_slots_info_ for ParseSlotText, and its scratch buffers
+  std::vector<SlotTextInfo> slot_text_info_;
+  SlotTextBuffer slot_text_buffer_;
 
 #if defined(PADDLE_WITH_CUDA) && defined(PADDLE_WITH_HETERPS)
   MiniBatchGpuPack* pack_ = nullptr;
@@ -0,0 +1,185 @@
+/* Copyright (c) 2022 PaddlePaddle Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License. */
+
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <mutex>  // NOLINT
+#include <string>
+#include <vector>
+
+#include "gflags/gflags.h"
+#include "google/protobuf/text_format.h"
+#include "gtest/gtest.h"
+#include "paddle/fluid/framework/data_feed.h"
+#include "paddle/fluid/framework/data_feed_factory.h"
+#include "paddle/fluid/framework/io/fs.h"
+
+DECLARE_bool(enable_fs_native_gzip);
+
+namespace paddle {
+namespace framework {
+
+#ifdef _LINUX
+// lines of key i in [begin, end) in the used slot, padded by an unused
+// slot so that the file spans a few chunks of the reader
+static void WriteSlotFile(const std::string& path, int begin, int end) {
+  int err_no = 0;
+  auto fp = fs_open_write(path, &err_no, "");
+  ASSERT_NE(fp, nullptr);
+  std::string padding = " 100";
+  for (int i = 0; i < 100; ++i) {
+    padding += " 0";
+  }
+  for (int i = begin; i < end; ++i) {
+    std::string line = "1 " + std::to_string(i) + padding + "\n";
+    ASSERT_EQ(fwrite(line.data(), 1, line.size(), fp.get()), line.size());
+  }
+}
+
+// a .gz file cut in the middle fails its reads, the load thread reads it
+// again a few times, keeps the records before the cut once and goes on with
+// the next file
+TEST(SlotRecordInMemoryDataFeed, LoadTruncatedGzip) {
+  FLAGS_enable_fs_native_gzip = true;
+  const int num = 50000;
+  WriteSlotFile("data_feed_load_full.gz", 0, num);
+  WriteSlotFile("data_feed_load_cut.gz", num, 2 * num);
+  {
+    std::ifstream in("data_feed_load_cut.gz", std::ios::binary);
+    std::string content((std::istreambuf_iterator<char>(in)),
+                        std::istreambuf_iterator<char>());
+    in.close();
+    std::ofstream out("data_feed_load_cut.gz",
+                      std::ios::binary | std::ios::trunc);
+    out.write(content.data(), content.size() / 2);
+  }
+
+  DataFeedDesc desc;
+  ASSERT_TRUE(google::protobuf::TextFormat::ParseFromString(
+      "name: \"SlotRecordInMemoryDataFeed\"\n"
+      "batch_size: 32\n"
+      "pipe_command: \"cat\"\n"
+      "multi_slot_desc {\n"
+      "  slots {\n"
+      "    name: \"slot\"\n"
+      "    type: \"uint64\"\n"
+      "    is_dense: false\n"
+      "    is_used: true\n"
+      "  }\n"
+      "  slots {\n"
+      "    name: \"padding\"\n"
+      "    type: \"uint64\"\n"
+      "    is_dense: false\n"
+      "    is_used: false\n"
+      "  }\n"
+      "}\n",
+      &desc));
+  std::mutex mutex;
+  size_t file_idx = 0;
+  auto reader = DataFeedFactory::CreateDataFeed(desc.name());
+  reader->Init(desc);
+  reader->SetThreadId(0);
+  reader->SetThreadNum(1);
+  reader->SetFileListMutex(&mutex);
+  reader->SetFileListIndex(&file_idx);
+  reader->SetFileList({"data_feed_load_cut.gz", "data_feed_load_full.gz"});
+  auto channel = MakeChannel<SlotRecord>();
+  reader->SetInputChannel(channel.get());
+  reader->LoadIntoMemory();
+  channel->Close();
+
+  std::vector<SlotRecord> records;
+  channel->ReadAll(records);
+  std::map<uint64_t, int> counts;
+  for (auto rec : records) {
+    auto& feasigns = rec->slot_uint64_feasigns_;
+    ASSERT_EQ(feasigns.slot_values.size(), 1UL);
+    ++counts[feasigns.slot_values[0]];
+  }
+  SlotRecordPool().put(&records);
+  for (uint64_t key = 0; key < num; ++key) {
+    ASSERT_EQ(counts[key], 1);
+  }
+  size_t cut_records = 0;
+  for (auto& p : counts) {
+    ASSERT_EQ(p.second, 1);
+    if (p.first >= static_cast<uint64_t>(num)) {
+      ASSERT_LT(p.first, 2UL * num);
+      ++cut_records;
+    }
+  }
+  EXPECT_GT(cut_records, 0UL);
+  EXPECT_LT(cut_records, static_cast<size_t>(num));
+
+  std::remove("data_feed_load_full.gz");
+  std::remove("data_feed_load_cut.gz");
+}
+
+// exposes the line parser of MultiSlotInMemoryDataFeed
+class ParseDataFeed : public MultiSlotInMemoryDataFeed {
+ public:
+  void OpenFile(const std::string& path) { file_.open(path); }
+  bool Parse(Record* instance) { return ParseOneInstance(instance); }
+};
+
+// unused slots are skipped wherever they are, the last one included, and
+// zero feasigns are dropped
+TEST(MultiSlotInMemoryDataFeed, ParseOneInstanceSkipsUnusedSlots) {
+  DataFeedDesc desc;
+  desc.set_name("MultiSlotInMemoryDataFeed");
+  desc.set_batch_size(1);
+  const char* types[] = {"uint64", "float", "uint64", "float", "uint64"};
+  const bool used[] = {true, false, false, true, false};
+  for (int i = 0; i < 5; ++i) {
+    auto* slot = desc.mutable_multi_slot_desc()->add_slots();
+    slot->set_name("slot_" + std::to_string(i));
+    slot->set_type(types[i]);
+    slot->set_is_dense(false);
+    slot->set_is_used(used[i]);
+  }
+  {
+    std::ofstream out("data_feed_parse.txt");
+    out << "2 11 0 1 0.5 3 7 8 9 2 0 1.5 2 5 6\n"
+        << "1 12 2 0.25 0.5 1 7 1 2.5 1 5\n";
+  }
+  ParseDataFeed feed;
+  feed.Init(desc);
+  feed.OpenFile("data_feed_parse.txt");
+
+  Record r;
+  ASSERT_TRUE(feed.Parse(&r));
+  ASSERT_EQ(r.uint64_feasigns_.size(), 1UL);
+  EXPECT_EQ(r.uint64_feasigns_[0].sign().uint64_feasign_, 11UL);
+  EXPECT_EQ(r.uint64_feasigns_[0].slot(), 0);
+  ASSERT_EQ(r.float_feasigns_.size(), 1UL);
+  EXPECT_EQ(r.float_feasigns_[0].sign().float_feasign_, 1.5f);
+  EXPECT_EQ(r.float_feasigns_[0].slot(), 1);
+
+  r = Record();
+  ASSERT_TRUE(feed.Parse(&r));
+  ASSERT_EQ(r.uint64_feasigns_.size(), 1UL);
+  EXPECT_EQ(r.uint64_feasigns_[0].sign().uint64_feasign_, 12UL);
+  ASSERT_EQ(r.float_feasigns_.size(), 1UL);
+  EXPECT_EQ(r.float_feasigns_[0].sign().float_feasign_, 2.5f);
+
+  r = Record();
+  EXPECT_FALSE(feed.Parse(&r));
+  std::remove("data_feed_parse.txt");
+}
+#endif
+
+}  // namespace framework
+}  // namespace paddle
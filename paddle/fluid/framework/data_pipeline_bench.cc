@@ -0,0 +1,743 @@
+// Copyright (c) 2022 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Microbenchmarks of the CPU data pipeline of MultiSlotDataset, over a
+// synthetic MultiSlot text file:
+//   parse/*       MultiSlotInMemoryDataFeed::ParseOneInstance, ParseSlotText
+//   archive/*     Record BinaryArchive round trip
+//   shuffle/*     GlobalShuffle message encoding and decoding, every codec
+//   channel/*     ChannelObject<Record> between threads, both backends
+//   slot_pool/*   SlotObjPool get and put of SlotRecords
+//   merge/*       MergeByInsId merge step
+//   feed/*        PutToFeedVec batch packing into LoDTensors
+//   end_to_end    parse -> shuffle codec -> channel -> PutToFeedVec threads
+// Each stage runs alone on prepared input, --benchmark_repetitions times, and
+// the median is reported. The flags and the JSON layout of --benchmark_out
+// follow Google Benchmark, so its tools/compare.py can diff two releases:
+//   ./data_pipeline_bench --lines=200000 --feasign_dist=zipf \
+//       --benchmark_filter='^(parse|shuffle)' --benchmark_out=bench.json
+
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>  // NOLINT
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <random>
+#include <regex>
+#include <sstream>
+#include <string>
+#include <thread>  // NOLINT
+#include <vector>
+
+#include "gflags/gflags.h"
+#include "glog/logging.h"
+#include "paddle/fluid/framework/archive.h"
+#include "paddle/fluid/framework/channel.h"
+#include "paddle/fluid/framework/data_feed.h"
+#include "paddle/fluid/framework/ins_id_merger.h"
+#include "paddle/fluid/framework/lod_tensor.h"
+#include "paddle/fluid/framework/scope.h"
+#include "paddle/fluid/framework/shuffle_codec.h"
+#include "paddle/fluid/framework/slot_text_parser.h"
+
+DEFINE_int64(lines, 100000, "Instances of the synthetic file.");
+DEFINE_int32(uint64_slots, 100, "uint64 slots of an instance.");
+DEFINE_int32(float_slots, 10, "float slots of an instance.");
+DEFINE_double(used_ratio, 0.8, "Ratio of slots the model uses.");
+DEFINE_int32(max_feasigns, 4, "Feasigns per slot, uniform in [1, max].");
+DEFINE_string(feasign_dist,
+              "uniform",
+              "uint64 feasign values: uniform 64 bit or zipf over "
+              "--vocab_size values.");
+DEFINE_int64(vocab_size, 1 << 20, "Distinct feasigns of the zipf values.");
+DEFINE_double(zipf_s, 1.1, "Exponent of the zipf distribution.");
+DEFINE_double(dup_ratio,
+              0.3,
+              "Ratio of instances split into two records for merge/*.");
+DEFINE_int32(batch_size, 512, "Batch size of feed/* and end_to_end.");
+DEFINE_int32(threads, 4, "Threads of the multi-threaded stages.");
+DEFINE_int32(shuffle_block, 1024, "Records per global shuffle message.");
+DEFINE_string(shuffle_codec, "none", "Shuffle codec of end_to_end.");
+DEFINE_string(benchmark_filter, ".", "Regex of the benchmarks to run.");
+DEFINE_int32(benchmark_repetitions, 3, "Timed runs of each benchmark.");
+DEFINE_string(benchmark_out, "", "JSON results are written to this file.");
+
+namespace paddle {
+namespace framework {
+
+// exposes the parser and the batch packing of MultiSlotInMemoryDataFeed
+class BenchDataFeed : public MultiSlotInMemoryDataFeed {
+ public:
+  void OpenFile(const std::string& path) {
+    file_.close();
+    file_.clear();
+    file_.open(path);
+    CHECK(file_.good()) << "can not open " << path;
+  }
+  bool Parse(Record* instance) { return ParseOneInstance(instance); }
+  void Pack(const std::vector<Record>& batch) { PutToFeedVec(batch); }
+};
+
+struct SyntheticData {
+  std::string path;
+  std::string text;
+  DataFeedDesc desc;
+  std::vector<SlotTextInfo> slots;
+  int uint64_slot_num = 0;
+  int float_slot_num = 0;
+  std::vector<std::string> use_slots;
+  std::vector<bool> use_slots_is_dense;
+  // parsed by ParseOneInstance, with an ins_id
+  std::vector<Record> records;
+};
+
+class FeasignGenerator {
+ public:
+  explicit FeasignGenerator(std::default_random_engine* engine)
+      : engine_(engine) {
+    if (FLAGS_feasign_dist == "zipf") {
+      cdf_.resize(FLAGS_vocab_size);
+      double sum = 0;
+      for (int64_t i = 0; i < FLAGS_vocab_size; ++i) {
+        sum += 1.0 / std::pow(i + 1, FLAGS_zipf_s);
+        cdf_[i] = sum;
+      }
+      for (auto& c : cdf_) {
+        c /= sum;
+      }
+    } else {
+      CHECK(FLAGS_feasign_dist == "uniform")
+          << "unknown --feasign_dist " << FLAGS_feasign_dist;
+    }
+  }
+
+  uint64_t Next() {
+    if (cdf_.empty()) {
+      uint64_t v = (static_cast<uint64_t>((*engine_)()) << 32) ^ (*engine_)();
+      return v == 0 ? 1 : v;
+    }
+    double u = uniform_(*engine_);
+    size_t rank = std::lower_bound(cdf_.begin(), cdf_.end(), u) - cdf_.begin();
+    // spread the ranks over the 64 bit space like hashed feature ids
+    return (rank + 1) * 0x9E3779B97F4A7C15ULL;
+  }
+
+ private:
+  std::default_random_engine* engine_;
+  std::uniform_real_distribution<double> uniform_{0.0, 1.0};
+  std::vector<double> cdf_;
+};
+
+static void MakeSyntheticData(SyntheticData* data) {
+  std::default_random_engine engine(0);
+  std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+  FeasignGenerator feasigns(&engine);
+  int slot_num = FLAGS_uint64_slots + FLAGS_float_slots;
+  CHECK(slot_num > 0 && FLAGS_max_feasigns > 0);
+
+  data->desc.set_name("MultiSlotInMemoryDataFeed");
+  data->desc.set_batch_size(FLAGS_batch_size);
+  auto* multi_slot_desc = data->desc.mutable_multi_slot_desc();
+  int uint64_idx = 0;
+  int float_idx = 0;
+  for (int i = 0; i < slot_num; ++i) {
+    SlotTextInfo info;
+    info.type = (i < FLAGS_uint64_slots) ? 'u' : 'f';
+    info.used = uniform(engine) < FLAGS_used_ratio;
+    if (info.used) {
+      info.slot_value_idx = (info.type == 'u') ? uint64_idx++ : float_idx++;
+      data->use_slots.push_back("slot_" + std::to_string(i));
+      data->use_slots_is_dense.push_back(false);
+    }
+    data->slots.push_back(info);
+    auto* slot = multi_slot_desc->add_slots();
+    slot->set_name("slot_" + std::to_string(i));
+    slot->set_type(info.type == 'u' ? "uint64" : "float");
+    slot->set_is_dense(false);
+    slot->set_is_used(info.used);
+  }
+  data->uint64_slot_num = uint64_idx;
+  data->float_slot_num = float_idx;
+
+  std::string& text = data->text;
+  char buf[32];
+  for (int64_t n = 0; n < FLAGS_lines; ++n) {
+    for (int i = 0; i < slot_num; ++i) {
+      int num = 1 + engine() % FLAGS_max_feasigns;
+      text += std::to_string(num);
+      for (int j = 0; j < num; ++j) {
+        text += ' ';
+        if (i < FLAGS_uint64_slots) {
+          text += std::to_string(feasigns.Next());
+        } else {
+          snprintf(buf, sizeof(buf), "%.6f", 0.001f + uniform(engine));
+          text += buf;
+        }
+      }
+      text += (i + 1 < slot_num) ? ' ' : '\n';
+    }
+  }
+  data->path = "./data_pipeline_bench." + std::to_string(getpid()) + ".txt";
+  FILE* fp = fopen(data->path.c_str(), "w");
+  CHECK(fp != nullptr) << "can not open " << data->path;
+  CHECK(fwrite(text.data(), 1, text.size(), fp) == text.size());
+  fclose(fp);
+
+  BenchDataFeed feed;
+  feed.Init(data->desc);
+  feed.OpenFile(data->path);
+  Record r;
+  while (feed.Parse(&r)) {
+    snprintf(buf, sizeof(buf), "ins_%010zu", data->records.size());
+    r.ins_id_ = buf;
+    data->records.push_back(std::move(r));
+    r = Record();
+  }
+  CHECK(static_cast<int64_t>(data->records.size()) == FLAGS_lines);
+}
+
+struct BenchCounters {
+  int64_t items = 0;
+  int64_t bytes = 0;
+};
+
+struct BenchCase {
+  std::string name;
+  // prepares the input of a run, not timed
+  std::function<void()> setup;
+  std::function<void(BenchCounters*)> run;
+};
+
+struct BenchResult {
+  std::string name;
+  double real_ms;
+  double cpu_ms;
+  BenchCounters counters;
+};
+
+static double CpuSeconds() {
+  struct timespec ts;
+  clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static std::vector<std::vector<Record>> SplitBlocks(
+    const std::vector<Record>& records, size_t block) {
+  std::vector<std::vector<Record>> blocks;
+  for (size_t i = 0; i < records.size(); i += block) {
+    blocks.emplace_back(records.begin() + i,
+                        records.begin() + std::min(records.size(), i + block));
+  }
+  return blocks;
+}
+
+static size_t TotalFeasigns(const std::vector<Record>& records) {
+  size_t n = 0;
+  for (auto& r : records) {
+    n += r.uint64_feasigns_.size() + r.float_feasigns_.size();
+  }
+  return n;
+}
+
+static void AddParseBenches(const SyntheticData* data,
+                            std::vector<BenchCase>* cases) {
+  auto feed = std::make_shared<BenchDataFeed>();
+  feed->Init(data->desc);
+  cases->push_back(BenchCase{
+      "parse/one_instance",
+      [feed, data] { feed->OpenFile(data->path); },
+      [feed, data](BenchCounters* c) {
+        Record r;
+        while (feed->Parse(&r)) {
+          r = Record();
+          ++c->items;
+        }
+        c->bytes = data->text.size();
+      }});
+
+  cases->push_back(BenchCase{
+      "parse/slot_text", [] {}, [data](BenchCounters* c) {
+        struct Values {
+          std::vector<uint64_t> slot_values;
+          std::vector<uint32_t> slot_offsets;
+        };
+        struct FloatValues {
+          std::vector<float> slot_values;
+          std::vector<uint32_t> slot_offsets;
+        };
+        Values uint64_values;
+        FloatValues float_values;
+        SlotTextBuffer buffer;
+        const char* p = data->text.data();
+        const char* end = p + data->text.size();
+        while (p < end) {
+          const char* eol =
+              static_cast<const char*>(memchr(p, '\n', end - p));
+          size_t bad_slot = 0;
+          CHECK(ParseSlotText(p,
+                              eol,
+                              data->slots,
+                              data->uint64_slot_num,
+                              data->float_slot_num,
+                              &uint64_values,
+                              &float_values,
+                              &buffer,
+                              &bad_slot) == kSlotTextOk);
+          p = eol + 1;
+          ++c->items;
+        }
+        c->bytes = data->text.size();
+      }});
+}
+
+static void AddArchiveBenches(const SyntheticData* data,
+                              std::vector<BenchCase>* cases) {
+  cases->push_back(BenchCase{
+      "archive/roundtrip", [] {}, [data](BenchCounters* c) {
+        BinaryArchive ar;
+        for (auto& r : data->records) {
+          ar << r;
+        }
+        c->bytes = ar.Length();
+        std::vector<Record> out(data->records.size());
+        for (auto& r : out) {
+          ar >> r;
+        }
+        CHECK(ar.Cursor() == ar.Finish());
+        c->items = out.size();
+      }});
+}
+
+static void AddShuffleBenches(const SyntheticData* data,
+                              std::vector<BenchCase>* cases) {
+  for (auto type :
+       {kShuffleCodecNone, kShuffleCodecZlib, kShuffleCodecFeasign}) {
+    std::string name = ShuffleCodecName(type);
+    cases->push_back(BenchCase{
+        "shuffle/encode_" + name, [] {}, [data, type](BenchCounters* c) {
+          ShuffleRecordEncoder encoder(type);
+          std::string msg;
+          for (size_t i = 0; i < data->records.size(); ++i) {
+            encoder.Add(data->records[i]);
+            if ((i + 1) % FLAGS_shuffle_block == 0 ||
+                i + 1 == data->records.size()) {
+              c->bytes += encoder.Encode(&msg);
+            }
+          }
+          c->items = data->records.size();
+        }});
+
+    auto msgs = std::make_shared<std::vector<std::string>>();
+    cases->push_back(BenchCase{
+        "shuffle/decode_" + name,
+        [data, type, msgs] {
+          if (!msgs->empty()) {
+            return;
+          }
+          ShuffleRecordEncoder encoder(type);
+          for (size_t i = 0; i < data->records.size(); ++i) {
+            encoder.Add(data->records[i]);
+            if ((i + 1) % FLAGS_shuffle_block == 0 ||
+                i + 1 == data->records.size()) {
+              msgs->emplace_back();
+              encoder.Encode(&msgs->back());
+            }
+          }
+        },
+        [msgs](BenchCounters* c) {
+          std::vector<Record> out;
+          for (auto& msg : *msgs) {
+            out.clear();
+            c->bytes += DecodeShuffleRecords(msg.data(), msg.size(), &out);
+            c->items += out.size();
+          }
+        }});
+  }
+}
+
+static void AddChannelBenches(const SyntheticData* data,
+                              std::vector<BenchCase>* cases) {
+  struct Backend {
+    const char* name;
+    ChannelBackend backend;
+  };
+  for (auto backend : {Backend{"deque", ChannelBackend::kDeque},
+                       Backend{"ring", ChannelBackend::kLockFreeRing}}) {
+    // every producer writes its copy of the blocks, the consumers read until
+    // the channel is closed
+    auto blocks =
+        std::make_shared<std::vector<std::vector<std::vector<Record>>>>();
+    cases->push_back(BenchCase{
+        std::string("channel/mpmc_") + backend.name,
+        [data, blocks] {
+          blocks->clear();
+          for (int t = 0; t < FLAGS_threads; ++t) {
+            blocks->push_back(SplitBlocks(data->records, 1024));
+          }
+        },
+        [blocks, backend](BenchCounters* c) {
+          auto chan = MakeChannel<Record>(64 * 1024, backend.backend);
+          chan->SetBlockSize(1024);
+          std::vector<std::thread> producers;
+          std::vector<std::thread> consumers;
+          std::vector<int64_t> read(FLAGS_threads, 0);
+          for (int t = 0; t < FLAGS_threads; ++t) {
+            producers.emplace_back([&, t] {
+              for (auto& block : (*blocks)[t]) {
+                chan->Write(std::move(block));
+              }
+            });
+            consumers.emplace_back([&, t] {
+              std::vector<Record> block;
+              while (chan->Read(block) > 0) {
+                read[t] += block.size();
+              }
+            });
+          }
+          for (auto& t : producers) {
+            t.join();
+          }
+          chan->Close();
+          for (auto& t : consumers) {
+            t.join();
+          }
+          for (auto n : read) {
+            c->items += n;
+          }
+        }});
+  }
+}
+
+static void AddSlotPoolBenches(std::vector<BenchCase>* cases) {
+  cases->push_back(BenchCase{
+      "slot_pool/get_put", [] {}, [](BenchCounters* c) {
+        const int rounds = 200;
+        std::vector<std::thread> threads;
+        for (int t = 0; t < FLAGS_threads; ++t) {
+          threads.emplace_back([] {
+            std::vector<SlotRecord> batch;
+            for (int i = 0; i < rounds; ++i) {
+              SlotRecordPool().get(&batch, FLAGS_batch_size);
+              SlotRecordPool().put(&batch);
+            }
+          });
+        }
+        for (auto& t : threads) {
+          t.join();
+        }
+        c->items = static_cast<int64_t>(rounds) * FLAGS_threads *
+                   FLAGS_batch_size * 2;
+      }});
+}
+
+static void AddMergeBenches(const SyntheticData* data,
+                            std::vector<BenchCase>* cases) {
+  auto inputs = std::make_shared<std::vector<std::vector<Record>>>();
+  cases->push_back(BenchCase{
+      "merge/by_ins_id",
+      [data, inputs] {
+        // a duplicated instance is read as the records of its even and odd
+        // slots, as if from two sources
+        std::default_random_engine engine(1);
+        std::uniform_real_distribution<double> uniform(0.0, 1.0);
+        inputs->assign(FLAGS_threads, std::vector<Record>());
+        size_t n = 0;
+        for (auto& r : data->records) {
+          if (uniform(engine) >= FLAGS_dup_ratio) {
+            (*inputs)[n++ % inputs->size()].push_back(r);
+            continue;
+          }
+          Record parts[2];
+          for (int k = 0; k < 2; ++k) {
+            parts[k].ins_id_ = r.ins_id_;
+          }
+          for (auto& item : r.uint64_feasigns_) {
+            parts[item.slot() % 2].uint64_feasigns_.push_back(item);
+          }
+          for (auto& item : r.float_feasigns_) {
+            parts[item.slot() % 2].float_feasigns_.push_back(item);
+          }
+          for (int k = 0; k < 2; ++k) {
+            (*inputs)[n++ % inputs->size()].push_back(std::move(parts[k]));
+          }
+        }
+      },
+      [data, inputs](BenchCounters* c) {
+        for (auto& input : *inputs) {
+          c->items += input.size();
+        }
+        InsIdMerger merger(data->use_slots, data->use_slots_is_dense, 0);
+        std::atomic<int64_t> merged{0};
+        uint64_t drop = merger.Merge(
+            inputs.get(),
+            4 * FLAGS_threads,
+            FLAGS_threads,
+            [&merged](int partition, std::vector<Record>* recs) {
+              merged += recs->size();
+            });
+        CHECK(drop == 0 && merged == static_cast<int64_t>(
+                                         data->records.size()));
+      }});
+}
+
+// binds the used slots of feed to LoDTensors of scope
+static void AddFeedVars(const SyntheticData& data,
+                        Scope* scope,
+                        BenchDataFeed* feed) {
+  for (auto& name : data.use_slots) {
+    feed->AddFeedVar(scope->Var(name), name);
+  }
+}
+
+static void AddFeedBenches(const SyntheticData* data,
+                           std::vector<BenchCase>* cases) {
+  auto batches = std::make_shared<std::vector<std::vector<Record>>>(
+      SplitBlocks(data->records, FLAGS_batch_size));
+  auto scope = std::make_shared<Scope>();
+  auto feed = std::make_shared<BenchDataFeed>();
+  feed->Init(data->desc);
+  AddFeedVars(*data, scope.get(), feed.get());
+  cases->push_back(BenchCase{
+      "feed/put_to_feed_vec", [] {}, [batches, feed, data](BenchCounters* c) {
+        for (auto& batch : *batches) {
+          feed->Pack(batch);
+          c->items += batch.size();
+        }
+        c->bytes = TotalFeasigns(data->records) * sizeof(uint64_t);
+      }});
+}
+
+static void AddEndToEndBench(const SyntheticData* data,
+                             std::vector<BenchCase>* cases) {
+  ShuffleCodecType codec = kShuffleCodecNone;
+  CHECK(ParseShuffleCodec(FLAGS_shuffle_codec, &codec))
+      << "unknown --shuffle_codec " << FLAGS_shuffle_codec;
+  auto scope = std::make_shared<Scope>();
+  auto feed = std::make_shared<BenchDataFeed>();
+  feed->Init(data->desc);
+  AddFeedVars(*data, scope.get(), feed.get());
+  cases->push_back(BenchCase{
+      "end_to_end",
+      [feed, data] { feed->OpenFile(data->path); },
+      [feed, data, codec](BenchCounters* c) {
+        auto parsed = MakeChannel<Record>(64 * 1024);
+        auto shuffled = MakeChannel<Record>(64 * 1024);
+        parsed->SetBlockSize(FLAGS_shuffle_block);
+        shuffled->SetBlockSize(FLAGS_batch_size);
+        std::thread parser([&] {
+          std::vector<Record> block;
+          Record r;
+          while (feed->Parse(&r)) {
+            block.push_back(std::move(r));
+            r = Record();
+            if (block.size() == static_cast<size_t>(FLAGS_shuffle_block)) {
+              parsed->Write(std::move(block));
+              block.clear();
+            }
+          }
+          if (!block.empty()) {
+            parsed->Write(std::move(block));
+          }
+          parsed->Close();
+        });
+        // one block is one message to a peer and back
+        std::thread shuffler([&] {
+          ShuffleRecordEncoder encoder(codec);
+          std::vector<Record> block;
+          std::vector<Record> received;
+          std::string msg;
+          while (parsed->Read(block) > 0) {
+            for (auto& r : block) {
+              encoder.Add(r);
+            }
+            encoder.Encode(&msg);
+            received.clear();
+            DecodeShuffleRecords(msg.data(), msg.size(), &received);
+            shuffled->Write(std::move(received));
+          }
+          shuffled->Close();
+        });
+        std::vector<Record> batch;
+        while (shuffled->Read(batch) > 0) {
+          feed->Pack(batch);
+          c->items += batch.size();
+        }
+        parser.join();
+        shuffler.join();
+        c->bytes = data->text.size();
+      }});
+}
+
+static std::string JsonEscape(const std::string& s) {
+  std::string out;
+  for (char ch : s) {
+    if (ch == '"' || ch == '\\') {
+      out += '\\';
+      out += ch;
+    } else if (static_cast<unsigned char>(ch) < 0x20) {
+      char buf[8];
+      snprintf(buf, sizeof(buf), "\\u%04x", ch);
+      out += buf;
+    } else {
+      out += ch;
+    }
+  }
+  return out;
+}
+
+static std::string ResultsToJson(const std::vector<BenchResult>& results,
+                                 const SyntheticData& data) {
+  char host[256] = {0};
+  gethostname(host, sizeof(host) - 1);
+  time_t now = time(nullptr);
+  char date[64];
+  strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S%z", localtime(&now));
+  std::ostringstream os;
+  os << "{\n  \"context\": {\n"
+     << "    \"date\": \"" << date << "\",\n"
+     << "    \"host_name\": \"" << JsonEscape(host) << "\",\n"
+     << "    \"executable\": \"data_pipeline_bench\",\n"
+     << "    \"num_cpus\": " << std::thread::hardware_concurrency() << ",\n"
+#ifdef NDEBUG
+     << "    \"library_build_type\": \"release\",\n"
+#else
+     << "    \"library_build_type\": \"debug\",\n"
+#endif
+     << "    \"lines\": " << FLAGS_lines << ",\n"
+     << "    \"bytes\": " << data.text.size() << ",\n"
+     << "    \"uint64_slots\": " << FLAGS_uint64_slots << ",\n"
+     << "    \"float_slots\": " << FLAGS_float_slots << ",\n"
+     << "    \"used_slots\": " << data.use_slots.size() << ",\n"
+     << "    \"max_feasigns\": " << FLAGS_max_feasigns << ",\n"
+     << "    \"feasign_dist\": \"" << JsonEscape(FLAGS_feasign_dist)
+     << "\",\n"
+     << "    \"dup_ratio\": " << FLAGS_dup_ratio << ",\n"
+     << "    \"batch_size\": " << FLAGS_batch_size << ",\n"
+     << "    \"threads\": " << FLAGS_threads << ",\n"
+     << "    \"shuffle_block\": " << FLAGS_shuffle_block << ",\n"
+     << "    \"shuffle_codec\": \"" << JsonEscape(FLAGS_shuffle_codec)
+     << "\"\n  },\n  \"benchmarks\": [";
+  for (size_t i = 0; i < results.size(); ++i) {
+    const auto& r = results[i];
+    double seconds = r.real_ms / 1000;
+    os << (i == 0 ? "\n" : ",\n") << "    {\n"
+       << "      \"name\": \"" << JsonEscape(r.name) << "_median\",\n"
+       << "      \"run_name\": \"" << JsonEscape(r.name) << "\",\n"
+       << "      \"run_type\": \"aggregate\",\n"
+       << "      \"aggregate_name\": \"median\",\n"
+       << "      \"repetitions\": " << FLAGS_benchmark_repetitions << ",\n"
+       << "      \"iterations\": 1,\n"
+       << "      \"real_time\": " << r.real_ms << ",\n"
+       << "      \"cpu_time\": " << r.cpu_ms << ",\n"
+       << "      \"time_unit\": \"ms\",\n"
+       << "      \"items_per_second\": " << r.counters.items / seconds << ",\n"
+       << "      \"bytes_per_second\": " << r.counters.bytes / seconds << "\n"
+       << "    }";
+  }
+  os << "\n  ]\n}\n";
+  return os.str();
+}
+
+static void RunAll() {
+  SyntheticData data;
+  MakeSyntheticData(&data);
+  printf("%lld instances, %.1f MB, %zu slots, %zu used, %zu feasigns\n",
+         static_cast<long long>(FLAGS_lines),  // NOLINT
+         data.text.size() / 1048576.0,
+         data.slots.size(),
+         data.use_slots.size(),
+         TotalFeasigns(data.records));
+
+  std::vector<BenchCase> cases;
+  AddParseBenches(&data, &cases);
+  AddArchiveBenches(&data, &cases);
+  AddShuffleBenches(&data, &cases);
+  AddChannelBenches(&data, &cases);
+  AddSlotPoolBenches(&cases);
+  AddMergeBenches(&data, &cases);
+  AddFeedBenches(&data, &cases);
+  AddEndToEndBench(&data, &cases);
+
+  std::regex filter(FLAGS_benchmark_filter);
+  std::vector<BenchResult> results;
+  printf("%-28s %12s %12s %14s %12s\n",
+         "Benchmark",
+         "Time(ms)",
+         "CPU(ms)",
+         "items/s",
+         "MB/s");
+  for (auto& bench : cases) {
+    if (!std::regex_search(bench.name, filter)) {
+      continue;
+    }
+    std::vector<double> real_ms;
+    std::vector<double> cpu_ms;
+    BenchCounters counters;
+    // the first run warms up caches and pools and is not reported
+    for (int i = 0; i <= FLAGS_benchmark_repetitions; ++i) {
+      bench.setup();
+      counters = BenchCounters();
+      double cpu_begin = CpuSeconds();
+      auto begin = std::chrono::steady_clock::now();
+      bench.run(&counters);
+      std::chrono::duration<double, std::milli> cost =
+          std::chrono::steady_clock::now() - begin;
+      if (i > 0) {
+        real_ms.push_back(cost.count());
+        cpu_ms.push_back((CpuSeconds() - cpu_begin) * 1000);
+      }
+    }
+    std::sort(real_ms.begin(), real_ms.end());
+    std::sort(cpu_ms.begin(), cpu_ms.end());
+    BenchResult result{bench.name,
+                       real_ms[real_ms.size() / 2],
+                       cpu_ms[cpu_ms.size() / 2],
+                       counters};
+    double seconds = result.real_ms / 1000;
+    printf("%-28s %12.2f %12.2f %14.0f %12.1f\n",
+           result.name.c_str(),
+           result.real_ms,
+           result.cpu_ms,
+           counters.items / seconds,
+           counters.bytes / seconds / 1048576.0);
+    results.push_back(result);
+  }
+  unlink(data.path.c_str());
+
+  if (!FLAGS_benchmark_out.empty()) {
+    FILE* fp = fopen(FLAGS_benchmark_out.c_str(), "w");
+    CHECK(fp != nullptr) << "can not open " << FLAGS_benchmark_out;
+    std::string json = ResultsToJson(results, data);
+    CHECK(fwrite(json.data(), 1, json.size(), fp) == json.size());
+    fclose(fp);
+  }
+}
+
+}  // namespace framework
+}  // namespace paddle
+
+int main(int argc, char* argv[]) {
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  google::InitGoogleLogging(argv[0]);
+  CHECK(FLAGS_benchmark_repetitions > 0 && FLAGS_threads > 0 &&
+        FLAGS_batch_size > 0 && FLAGS_shuffle_block > 0);
+  paddle::framework::RunAll();
+  return 0;
+}
@@ -14,6 +14,8 @@
 
 #include "paddle/fluid/framework/data_set.h"
 
+#include <iterator>
+
 #include "gflags/gflags.h"
 #include "google/protobuf/text_format.h"
 #if (defined PADDLE_WITH_DISTRIBUTE) && (defined PADDLE_WITH_PSCORE)
@@ -22,6 +24,7 @@
 #include "paddle/fluid/framework/data_feed_factory.h"
 #include "paddle/fluid/framework/fleet/box_wrapper.h"
 #include "paddle/fluid/framework/fleet/fleet_wrapper.h"
+#include "paddle/fluid/framework/ins_id_merger.h"
 #include "paddle/fluid/framework/io/fs.h"
 #include "paddle/fluid/platform/monitor.h"
 #include "paddle/fluid/platform/timer.h"
@@ -39,6 +42,10 @@
 USE_INT_STAT(STAT_total_feasign_num_in_mem);
 DECLARE_bool(graph_get_neighbor_id);
 DECLARE_bool(padbox_dataset_enable_unrollinstance);
+DECLARE_bool(enable_slotrecord_arena);
+DECLARE_int32(global_shuffle_inflight_mb);
+DECLARE_int32(global_shuffle_recv_thread_num);
+DECLARE_int32(global_shuffle_recv_pending_mb);
 
 namespace paddle {
 namespace framework {
@@ -419,6 +426,9 @@ static int compute_thread_batch_nccl(
 void MultiSlotDataset::PrepareTrain() {
 #ifdef PADDLE_WITH_GLOO
   if (enable_heterps_) {
+    // the readers take their batches from input_records_ by offset, so the
+    // whole pass has to be in memory here
+    RestoreAllSpilled();
     if (input_records_.size() == 0 && input_channel_ != nullptr &&
         input_channel_->Size() != 0) {
       input_channel_->ReadAll(input_records_);
@@ -697,6 +707,7 @@ void MultiSlotDataset::TDMSample(const std::string tree_name,
                                  const uint16_t seed_,
                                  const uint16_t sample_slot) {
 #if (defined PADDLE_WITH_DISTRIBUTE) && (defined PADDLE_WITH_PSCORE)
+  StopStreamSpilled();
   // init tdm tree
   auto wrapper_ptr = paddle::distributed::IndexWrapper::GetInstance();
   wrapper_ptr->insert_tree_index(tree_name, tree_path);
@@ -711,7 +722,20 @@ void MultiSlotDataset::TDMSample(const std::string tree_name,
 
   std::vector<std::vector<Record>> data;
   std::vector<std::vector<Record>> sample_results;
-  if (!input_channel_ || input_channel_->Size() == 0) {
+  auto fleet_ptr = FleetWrapper::GetInstance();
+  if (spiller_ != nullptr && spiller_->PendingRecordNum() > 0) {
+    // spilled records are sampled block by block as they are restored
+    std::vector<Record> block;
+    while (input_channel_->ReadOnce(block, input_channel_->BlockSize()) >
+           0) {
+      std::vector<Record> tmp_results;
+      _layer_wise_sample.sample_from_dataset(
+          sample_slot, &block, &tmp_results);
+      for (auto& rec : tmp_results) {
+        sample_results.emplace_back(1, std::move(rec));
+      }
+    }
+  } else if (!input_channel_ || input_channel_->Size() == 0) {
     for (size_t i = 0; i < multi_output_channel_.size(); ++i) {
       std::vector<Record> tmp_data;
       data.push_back(tmp_data);
@@ -730,7 +754,6 @@ void MultiSlotDataset::TDMSample(const std::string tree_name,
 
   VLOG(1) << "finish read src data, data.size = " << data.size()
           << "; details: ";
-  auto fleet_ptr = FleetWrapper::GetInstance();
   for (unsigned int i = 0; i < data.size(); i++) {
     VLOG(1) << "data[" << i << "]: size = " << data[i].size();
     std::vector<Record> tmp_results;
@@ -776,22 +799,29 @@ void MultiSlotDataset::GlobalShuffle(int thread_num) {
   auto fleet_ptr = framework::FleetWrapper::GetInstance();
 #endif
 
-  if (!input_channel_ || input_channel_->Size() == 0) {
+  if (!input_channel_ || GetMemoryDataSize() == 0) {
     VLOG(3) << "MultiSlotDataset::GlobalShuffle() end, no data to shuffle";
     return;
   }
+  StopStreamSpilled();
 
   // local shuffle
-  input_channel_->Close();
-  std::vector<Record> data;
-  input_channel_->ReadAll(data);
-  std::shuffle(data.begin(), data.end(), fleet_ptr->LocalRandomEngine());
-  input_channel_->Open();
-  input_channel_->Write(std::move(data));
-  data.clear();
-  data.shrink_to_fit();
+  if (spiller_ != nullptr && spiller_->HasSpilled()) {
+    // spilled blocks are shuffled on the fly and sent as they come back,
+    // the restore thread closes input_channel_ after the last one
+    spiller_->Shuffle(input_channel_.get(), &fleet_ptr->LocalRandomEngine());
+  } else {
+    input_channel_->Close();
+    std::vector<Record> data;
+    input_channel_->ReadAll(data);
+    std::shuffle(data.begin(), data.end(), fleet_ptr->LocalRandomEngine());
+    input_channel_->Open();
+    input_channel_->Write(std::move(data));
+    data.clear();
+    data.shrink_to_fit();
 
-  input_channel_->Close();
+    input_channel_->Close();
+  }
   input_channel_->SetBlockSize(fleet_send_batch_size_);
   VLOG(3) << "MultiSlotDataset::GlobalShuffle() input_channel_ size "
           << input_channel_->Size();
@@ -808,22 +838,37 @@ void MultiSlotDataset::GlobalShuffle(int thread_num) {
     }
   };
 
-  auto global_shuffle_func = [this, get_client_id]() {
+  // blocks go out through per-trainer queues, a thread serializes its next
+  // block while the previous ones are still on the wire
+  ShuffleSender sender(
+      trainer_num_,
+      static_cast<int64_t>(FLAGS_global_shuffle_inflight_mb) << 20,
+      [fleet_ptr](int peer, const std::string& msg) {
+        return fleet_ptr->SendClientToClientMsg(0, peer, msg);
+      });
+
+  auto global_shuffle_func = [this, get_client_id, &sender]() {
 #ifdef PADDLE_WITH_PSCORE
     auto fleet_ptr = distributed::FleetWrapper::GetInstance();
 #else
     auto fleet_ptr = framework::FleetWrapper::GetInstance();
 #endif
-    // auto fleet_ptr = framework::FleetWrapper::GetInstance();
     std::vector<Record> data;
+    // reused from block to block, encoders keep their buffers
+    std::vector<std::unique_ptr<ShuffleRecordEncoder>> encoders;
+    for (int i = 0; i < this->trainer_num_; ++i) {
+      encoders.emplace_back(new ShuffleRecordEncoder(shuffle_codec_));
+    }
+    std::vector<int> send_index(this->trainer_num_);
+    std::string msg;
+    platform::Timer encode_timer;
     while (this->input_channel_->Read(data)) {
-      std::vector<paddle::framework::BinaryArchive> ars(this->trainer_num_);
+      encode_timer.Start();
       for (auto& t : data) {
         auto client_id = get_client_id(t);
-        ars[client_id] << t;
+        encoders[client_id]->Add(t);
       }
-      std::vector<std::future<int32_t>> total_status;
-      std::vector<int> send_index(this->trainer_num_);
+      encode_timer.Pause();
       for (int i = 0; i < this->trainer_num_; ++i) {
         send_index[i] = i;
       }
@@ -831,18 +876,18 @@ void MultiSlotDataset::GlobalShuffle(int thread_num) {
           send_index.begin(), send_index.end(), fleet_ptr->LocalRandomEngine());
       for (int index = 0; index < this->trainer_num_; ++index) {
         int i = send_index[index];
-        if (ars[i].Length() == 0) {
+        if (encoders[i]->Empty()) {
           continue;
         }
-        std::string msg(ars[i].Buffer(), ars[i].Length());
-        auto ret = fleet_ptr->SendClientToClientMsg(0, i, msg);
-        total_status.push_back(std::move(ret));
-      }
-      for (auto& t : total_status) {
-        t.wait();
+        encode_timer.Start();
+        size_t raw_bytes = encoders[i]->Encode(&msg);
+        encode_timer.Pause();
+        send_codec_stat_.Add(raw_bytes,
+                             msg.size(),
+                             static_cast<int64_t>(encode_timer.ElapsedUS()));
+        encode_timer.Reset();
+        sender.Send(i, msg);
       }
-      ars.clear();
-      ars.shrink_to_fit();
       data.clear();
       data.shrink_to_fit();
       // currently we find bottleneck is server not able to handle large data
@@ -867,7 +912,20 @@ void MultiSlotDataset::GlobalShuffle(int thread_num) {
   }
   global_shuffle_threads.clear();
   global_shuffle_threads.shrink_to_fit();
+  int64_t failed = sender.Finish();
+  if (failed != 0) {
+    LOG(WARNING) << "MultiSlotDataset::GlobalShuffle() " << failed
+                 << " messages failed to send";
+  }
+  sender.PrintStat("MultiSlotDataset::GlobalShuffle()");
+  send_codec_stat_.Print("MultiSlotDataset::GlobalShuffle()",
+                         ShuffleCodecName(shuffle_codec_));
   input_channel_->Clear();
+  if (spiller_ != nullptr) {
+    // every record is sent, what this worker receives replaces them
+    spiller_->Clear();
+    received_into_spill_ = false;
+  }
   timeline.Pause();
   VLOG(3) << "DatasetImpl<T>::GlobalShuffle() end, cost time="
           << timeline.ElapsedSec() << " seconds";
@@ -1010,6 +1068,23 @@ void DatasetImpl<T>::SetFleetSendSleepSeconds(int seconds) {
   fleet_send_sleep_seconds_ = seconds;
 }
 
+template <typename T>
+void DatasetImpl<T>::SetMemoryBudget(int64_t budget_mb,
+                                     const std::string& spill_dir) {
+  // only the Record channels of MultiSlotDataset can be spilled, the other
+  // datasets keep the whole pass in memory whatever the budget
+  if (budget_mb > 0) {
+    PADDLE_THROW(platform::errors::Unimplemented(
+        "Memory budget is only supported by MultiSlotDataset, this dataset "
+        "keeps the whole pass in memory."));
+  }
+}
+
+template <typename T>
+void DatasetImpl<T>::SetShuffleCodec(const std::string& codec) {
+  LOG(WARNING) << "shuffle codec is not supported by this dataset, ignored";
+}
+
 template <typename T>
 void DatasetImpl<T>::CreateReaders() {
   VLOG(3) << "Calling CreateReaders()";
@@ -1165,16 +1240,54 @@ int MultiSlotDataset::ReceiveFromClient(int msg_type,
   if (msg.length() == 0) {
     return 0;
   }
-  paddle::framework::BinaryArchive ar;
-  ar.SetReadBuffer(const_cast<char*>(msg.c_str()), msg.length(), nullptr);
-  if (ar.Cursor() == ar.Finish()) {
-    return 0;
+  ShuffleReceiver* receiver = nullptr;
+  {
+    std::lock_guard<std::mutex> lock(receiver_mutex_);
+    if (receiver_ == nullptr) {
+      receiver_.reset(new ShuffleReceiver(
+          FLAGS_global_shuffle_recv_thread_num,
+          static_cast<int64_t>(FLAGS_global_shuffle_recv_pending_mb) << 20,
+          [this](int peer, const std::string& msg) {
+            WriteReceivedRecords(msg);
+          }));
+    }
+    receiver = receiver_.get();
   }
+  receiver->Push(client_id, msg);
+#endif
+  return 0;
+}
+
+void MultiSlotDataset::WriteReceivedRecords(const std::string& msg) {
+#ifdef _LINUX
+  platform::Timer timeline;
+  timeline.Start();
   std::vector<Record> data;
-  while (ar.Cursor() < ar.Finish()) {
-    data.push_back(ar.Get<Record>());
+  size_t raw_bytes = DecodeShuffleRecords(msg.data(), msg.size(), &data);
+  timeline.Pause();
+  receive_codec_stat_.Add(
+      raw_bytes, msg.size(), static_cast<int64_t>(timeline.ElapsedUS()));
+  if (data.empty()) {
+    return;
+  }
+
+  Channel<Record> receive_chan;
+  {
+    std::lock_guard<std::mutex> lock(receiver_mutex_);
+    if (memory_budget_mb_ > 0) {
+      if (receive_spiller_ == nullptr) {
+        receive_channel_ = MakeChannel<Record>();
+        receive_spiller_.reset(
+            new RecordSpiller(spill_dir_, memory_budget_mb_ << 20));
+        receive_spiller_->StartSpill(receive_channel_.get());
+      }
+      receive_chan = receive_channel_;
+    }
+  }
+  if (receive_chan != nullptr) {
+    receive_chan->Write(std::move(data));
+    return;
   }
-  CHECK(ar.Cursor() == ar.Finish());
 
   auto fleet_ptr = framework::FleetWrapper::GetInstance();
   // not use random because it doesn't perform well here.
@@ -1193,13 +1306,276 @@ int MultiSlotDataset::ReceiveFromClient(int msg_type,
   data.clear();
   data.shrink_to_fit();
 #endif
-  return 0;
+}
+
+void MultiSlotDataset::WaitShuffleReceived() {
+  ShuffleReceiver* receiver = nullptr;
+  {
+    std::lock_guard<std::mutex> lock(receiver_mutex_);
+    receiver = receiver_.get();
+  }
+  if (receiver != nullptr) {
+    receiver->Wait();
+    receiver->PrintStat("MultiSlotDataset::GlobalShuffle()");
+    receive_codec_stat_.Print("MultiSlotDataset::GlobalShuffle()", "decode");
+  }
+  std::unique_ptr<RecordSpiller> spiller;
+  Channel<Record> chan;
+  {
+    std::lock_guard<std::mutex> lock(receiver_mutex_);
+    spiller.swap(receive_spiller_);
+    chan.swap(receive_channel_);
+  }
+  if (spiller != nullptr) {
+    AdoptReceivedSpill(std::move(spiller), chan);
+  }
+}
+
+void MultiSlotDataset::AdoptReceivedSpill(
+    std::unique_ptr<RecordSpiller> spiller, const Channel<Record>& chan) {
+  spiller->StopSpill();
+  chan->Close();
+  std::vector<Record> data;
+  chan->ReadAll(data);
+  chan->Clear();
+  if (!spiller->HasSpilled()) {
+    WriteToOutputChannels(&data);
+    return;
+  }
+  spiller->PrintStat("MultiSlotDataset::GlobalShuffle()");
+  spiller_ = std::move(spiller);
+  input_channel_->Open();
+  input_channel_->Write(std::move(data));
+  FinishSpill();
+  received_into_spill_ = true;
+}
+
+void MultiSlotDataset::MoveReceivedToOutput() {
+  if (!received_into_spill_) {
+    return;
+  }
+  received_into_spill_ = false;
+  RestoreAllSpilled();
+  std::vector<Record> data;
+  input_channel_->Close();
+  input_channel_->ReadAll(data);
+  input_channel_->Clear();
+  spiller_->Clear();
+  WriteToOutputChannels(&data);
+}
+
+void MultiSlotDataset::WriteToOutputChannels(std::vector<Record>* data) {
+  size_t part = data->size() / channel_num_ + 1;
+  for (int i = 0; i < channel_num_ && !data->empty(); ++i) {
+    size_t begin = data->size() > part ? data->size() - part : 0;
+    std::vector<Record> records(std::make_move_iterator(data->begin() + begin),
+                                std::make_move_iterator(data->end()));
+    data->resize(begin);
+    multi_output_channel_[i]->Write(std::move(records));
+  }
+  std::vector<Record>().swap(*data);
 }
 
 // explicit instantiation
 template class DatasetImpl<Record>;
 
+void MultiSlotDataset::SetMemoryBudget(int64_t budget_mb,
+                                       const std::string& spill_dir) {
+  if (spiller_ != nullptr) {
+    CHECK(!spiller_->HasSpilled())
+        << "release memory before changing the memory budget";
+  }
+  if (budget_mb <= 0) {
+    spiller_ = nullptr;
+    memory_budget_mb_ = 0;
+    VLOG(3) << "MultiSlotDataset memory budget disabled";
+    return;
+  }
+  spiller_.reset(new RecordSpiller(spill_dir, budget_mb << 20));
+  spill_dir_ = spill_dir;
+  memory_budget_mb_ = budget_mb;
+  VLOG(3) << "MultiSlotDataset memory budget=" << budget_mb
+          << "MB, spill dir=" << spill_dir;
+}
+
+void MultiSlotDataset::SetShuffleCodec(const std::string& codec) {
+  PADDLE_ENFORCE_EQ(ParseShuffleCodec(codec, &shuffle_codec_),
+                    true,
+                    platform::errors::InvalidArgument(
+                        "Unknown shuffle codec %s, it should be none, zlib "
+                        "or feasign.",
+                        codec));
+  VLOG(3) << "MultiSlotDataset shuffle codec=" << codec;
+}
+
+void MultiSlotDataset::FinishSpill() {
+  spiller_->StopSpill();
+  if (!spiller_->HasSpilled()) {
+    return;
+  }
+  int64_t total = input_channel_->Size() + spiller_->PendingRecordNum();
+  input_channel_->Open();
+  input_channel_->SetBlockSize(total / thread_num_ + 1);
+  spiller_->StartRestore(input_channel_.get());
+  spiller_->PrintStat("MultiSlotDataset::LoadIntoMemory()");
+}
+
+void MultiSlotDataset::RestoreAllSpilled() {
+  if (spiller_ != nullptr) {
+    StopStreamSpilled();
+    spiller_->RestoreAll();
+  }
+}
+
+void MultiSlotDataset::StreamSpilled() {
+  spiller_->StopRestore();
+  if (spiller_->Replaying()) {
+    // the copies restored after the last epoch
+    input_channel_->Clear();
+  } else {
+    // the records in memory are spilled too, wherever they are
+    std::vector<Record> data;
+    for (auto* channels : {&multi_output_channel_, &multi_consume_channel_}) {
+      for (auto& chan : *channels) {
+        chan->Close();
+        chan->ReadAll(data);
+        chan->Clear();
+        chan->Open();
+        input_channel_->Open();
+        input_channel_->Write(std::move(data));
+      }
+    }
+    spiller_->SpillAll(input_channel_.get());
+  }
+  input_channel_->Open();
+  spiller_->StartRestore(input_channel_.get());
+  SetReadersStreamInput(true);
+}
+
+void MultiSlotDataset::StopStreamSpilled() {
+  if (spiller_ == nullptr || !spiller_->Replaying()) {
+    return;
+  }
+  spiller_->StopRestore();
+  input_channel_->Clear();
+  spiller_->StopReplay();
+  SetReadersStreamInput(false);
+  input_channel_->Open();
+  spiller_->StartRestore(input_channel_.get());
+}
+
+void MultiSlotDataset::SetReadersStreamInput(bool stream_input) {
+  stream_input_ = stream_input;
+  for (auto& reader : readers_) {
+    reader->SetStreamInput(stream_input);
+  }
+}
+
+void MultiSlotDataset::CreateReaders() {
+  DatasetImpl<Record>::CreateReaders();
+  for (auto& reader : readers_) {
+    reader->SetStreamInput(stream_input_);
+  }
+}
+
+void MultiSlotDataset::LoadIntoMemory() {
+  if (spiller_ == nullptr) {
+    DatasetImpl<Record>::LoadIntoMemory();
+    return;
+  }
+  // records not released yet stay in the spill, the new ones go after them
+  StopStreamSpilled();
+  spiller_->StopRestore();
+  spiller_->StartSpill(input_channel_.get());
+  DatasetImpl<Record>::LoadIntoMemory();
+  FinishSpill();
+}
+
+void MultiSlotDataset::PreLoadIntoMemory() {
+  if (spiller_ != nullptr) {
+    StopStreamSpilled();
+    spiller_->StopRestore();
+    spiller_->StartSpill(input_channel_.get());
+  }
+  DatasetImpl<Record>::PreLoadIntoMemory();
+}
+
+void MultiSlotDataset::WaitPreLoadDone() {
+  DatasetImpl<Record>::WaitPreLoadDone();
+  if (spiller_ != nullptr) {
+    FinishSpill();
+  }
+}
+
+void MultiSlotDataset::LocalShuffle() {
+  if (spiller_ == nullptr || !spiller_->HasSpilled()) {
+    DatasetImpl<Record>::LocalShuffle();
+    return;
+  }
+  VLOG(3) << "MultiSlotDataset::LocalShuffle() begin";
+  platform::Timer timeline;
+  timeline.Start();
+  StopStreamSpilled();
+  auto fleet_ptr = framework::FleetWrapper::GetInstance();
+  spiller_->Shuffle(input_channel_.get(), &fleet_ptr->LocalRandomEngine());
+  timeline.Pause();
+  VLOG(3) << "MultiSlotDataset::LocalShuffle() end, cost time="
+          << timeline.ElapsedSec() << " seconds";
+}
+
+void MultiSlotDataset::DynamicAdjustChannelNum(int channel_num,
+                                               bool discard_remaining_ins) {
+  WaitShuffleReceived();
+  if (spiller_ == nullptr || !spiller_->HasSpilled() || enable_pv_merge_ ||
+      enable_heterps_) {
+    // readers take their share of input_channel_ in one read, so training
+    // starts with every record in memory
+    RestoreAllSpilled();
+    DatasetImpl<Record>::DynamicAdjustChannelNum(channel_num,
+                                                 discard_remaining_ins);
+    return;
+  }
+  // the readers stream the pass from input_channel_ while the spiller
+  // restores it, once for every epoch
+  DatasetImpl<Record>::DynamicAdjustChannelNum(channel_num,
+                                               discard_remaining_ins);
+  StreamSpilled();
+}
+
+int64_t MultiSlotDataset::GetMemoryDataSize() {
+  int64_t size = DatasetImpl<Record>::GetMemoryDataSize();
+  if (spiller_ == nullptr) {
+    return size;
+  }
+  if (spiller_->Replaying()) {
+    // input_channel_ holds copies of the spilled records
+    return spiller_->SpilledRecordNum();
+  }
+  return size + spiller_->PendingRecordNum();
+}
+
+int64_t MultiSlotDataset::GetShuffleDataSize() {
+  WaitShuffleReceived();
+  int64_t size = DatasetImpl<Record>::GetShuffleDataSize();
+  if (received_into_spill_) {
+    size += GetMemoryDataSize();
+  }
+  return size;
+}
+
+void MultiSlotDataset::ReleaseMemoryFun() {
+  WaitShuffleReceived();
+  if (spiller_ != nullptr) {
+    spiller_->PrintStat("MultiSlotDataset::ReleaseMemory()");
+    spiller_->Clear();
+    received_into_spill_ = false;
+    SetReadersStreamInput(false);
+  }
+  DatasetImpl<Record>::ReleaseMemoryFun();
+}
+
 void MultiSlotDataset::DynamicAdjustReadersNum(int thread_num) {
+  WaitShuffleReceived();
   if (thread_num_ == thread_num) {
     VLOG(3) << "DatasetImpl<T>::DynamicAdjustReadersNum thread_num_="
             << thread_num_ << ", thread_num_=thread_num, no need to adjust";
@@ -1249,12 +1625,14 @@ void MultiSlotDataset::SetCurrentPhase(int current_phase) {
 }
 
 void MultiSlotDataset::PreprocessInstance() {
-  if (!input_channel_ || input_channel_->Size() == 0) {
+  if (!input_channel_ || GetMemoryDataSize() == 0) {
     return;
   }
   if (!enable_pv_merge_) {  // means to use Record
     this->LocalShuffle();
   } else {  // means to use Pv
+    // pv instances are built from the whole pass sorted by search_id
+    RestoreAllSpilled();
     auto fleet_ptr = framework::FleetWrapper::GetInstance();
     input_channel_->Close();
     std::vector<PvInstance> pv_data;
@@ -1315,6 +1693,8 @@ void MultiSlotDataset::GenerateLocalTablesUnlock(int table_id,
     return;
   }
 
+  WaitShuffleReceived();
+  MoveReceivedToOutput();
   CHECK(multi_output_channel_.size() != 0);  // NOLINT
   auto fleet_ptr_ = framework::FleetWrapper::GetInstance();
   std::vector<std::unordered_map<uint64_t, std::vector<float>>>&
@@ -1388,6 +1768,9 @@ void MultiSlotDataset::MergeByInsId() {
     VLOG(3) << "merge_by_insid=false, will not MergeByInsId";
     return;
   }
+  WaitShuffleReceived();
+  // records of an ins_id are merged together, from anywhere in the pass
+  MoveReceivedToOutput();
   auto multi_slot_desc = data_feed_desc_.multi_slot_desc();
   std::vector<std::string> use_slots;
   std::vector<bool> use_slots_is_dense;
@@ -1399,182 +1782,41 @@ void MultiSlotDataset::MergeByInsId() {
     }
   }
   CHECK(multi_output_channel_.size() != 0);  // NOLINT
-  auto channel_data = paddle::framework::MakeChannel<Record>();
   VLOG(3) << "multi_output_channel_.size() " << multi_output_channel_.size();
+  std::vector<std::vector<Record>> inputs(multi_output_channel_.size());
   for (size_t i = 0; i < multi_output_channel_.size(); ++i) {
-    std::vector<Record> vec_data;
     multi_output_channel_[i]->Close();
-    multi_output_channel_[i]->ReadAll(vec_data);
-    channel_data->Write(std::move(vec_data));
-    vec_data.clear();
-    vec_data.shrink_to_fit();
+    multi_output_channel_[i]->ReadAll(inputs[i]);
     multi_output_channel_[i]->Clear();
+    multi_output_channel_[i]->Open();
   }
-  channel_data->Close();
-  std::vector<Record> recs;
-  recs.reserve(channel_data->Size());
-  channel_data->ReadAll(recs);
-  channel_data->Clear();
-  std::sort(recs.begin(), recs.end(), [](const Record& a, const Record& b) {
-    return a.ins_id_ < b.ins_id_;
-  });
-
-  std::vector<Record> results;
-  uint64_t drop_ins_num = 0;
-  std::unordered_set<uint16_t> all_int64;
-  std::unordered_set<uint16_t> all_float;
-  std::unordered_set<uint16_t> local_uint64;
-  std::unordered_set<uint16_t> local_float;
-  std::unordered_map<uint16_t, std::vector<FeatureItem>> all_dense_uint64;
-  std::unordered_map<uint16_t, std::vector<FeatureItem>> all_dense_float;
-  std::unordered_map<uint16_t, std::vector<FeatureItem>> local_dense_uint64;
-  std::unordered_map<uint16_t, std::vector<FeatureItem>> local_dense_float;
-  std::unordered_map<uint16_t, bool> dense_empty;
-
-  VLOG(3) << "recs.size() " << recs.size();
-  for (size_t i = 0; i < recs.size();) {
-    size_t j = i + 1;
-    while (j < recs.size() && recs[j].ins_id_ == recs[i].ins_id_) {
-      j++;
-    }
-    if (merge_size_ > 0 && j - i != merge_size_) {
-      drop_ins_num += j - i;
-      LOG(WARNING) << "drop ins " << recs[i].ins_id_ << " size=" << j - i
-                   << ", because merge_size=" << merge_size_;
-      i = j;
-      continue;
-    }
-
-    all_int64.clear();
-    all_float.clear();
-    all_dense_uint64.clear();
-    all_dense_float.clear();
-    bool has_conflict_slot = false;
-    uint16_t conflict_slot = 0;
-
-    Record rec;
-    rec.ins_id_ = recs[i].ins_id_;
-    rec.content_ = recs[i].content_;
-
-    for (size_t k = i; k < j; k++) {
-      dense_empty.clear();
-      local_dense_uint64.clear();
-      local_dense_float.clear();
-      for (auto& feature : recs[k].uint64_feasigns_) {
-        uint16_t slot = feature.slot();
-        if (!use_slots_is_dense[slot]) {
-          continue;
-        }
-        local_dense_uint64[slot].push_back(feature);
-        if (feature.sign().uint64_feasign_ != 0) {
-          dense_empty[slot] = false;
-        } else if (dense_empty.find(slot) == dense_empty.end() &&
-                   all_dense_uint64.find(slot) == all_dense_uint64.end()) {
-          dense_empty[slot] = true;
-        }
-      }
-      for (auto& feature : recs[k].float_feasigns_) {
-        uint16_t slot = feature.slot();
-        if (!use_slots_is_dense[slot]) {
-          continue;
-        }
-        local_dense_float[slot].push_back(feature);
-        if (fabs(feature.sign().float_feasign_) >= 1e-6) {
-          dense_empty[slot] = false;
-        } else if (dense_empty.find(slot) == dense_empty.end() &&
-                   all_dense_float.find(slot) == all_dense_float.end()) {
-          dense_empty[slot] = true;
-        }
-      }
-      for (auto& p : dense_empty) {
-        if (local_dense_uint64.find(p.first) != local_dense_uint64.end()) {
-          all_dense_uint64[p.first] = std::move(local_dense_uint64[p.first]);
-        } else if (local_dense_float.find(p.first) != local_dense_float.end()) {
-          all_dense_float[p.first] = std::move(local_dense_float[p.first]);
-        }
-      }
-    }
-    for (auto& f : all_dense_uint64) {
-      rec.uint64_feasigns_.insert(
-          rec.uint64_feasigns_.end(), f.second.begin(), f.second.end());
-    }
-    for (auto& f : all_dense_float) {
-      rec.float_feasigns_.insert(
-          rec.float_feasigns_.end(), f.second.begin(), f.second.end());
-    }
 
-    for (size_t k = i; k < j; k++) {
-      local_uint64.clear();
-      local_float.clear();
-      for (auto& feature : recs[k].uint64_feasigns_) {
-        uint16_t slot = feature.slot();
-        if (use_slots_is_dense[slot]) {
-          continue;
-        } else if (all_int64.find(slot) != all_int64.end()) {
-          has_conflict_slot = true;
-          conflict_slot = slot;
-          break;
-        }
-        local_uint64.insert(slot);
-        rec.uint64_feasigns_.push_back(std::move(feature));
-      }
-      if (has_conflict_slot) {
-        break;
-      }
-      all_int64.insert(local_uint64.begin(), local_uint64.end());
-
-      for (auto& feature : recs[k].float_feasigns_) {
-        uint16_t slot = feature.slot();
-        if (use_slots_is_dense[slot]) {
-          continue;
-        } else if (all_float.find(slot) != all_float.end()) {
-          has_conflict_slot = true;
-          conflict_slot = slot;
-          break;
+  // merged partitions go round robin to the output channels, make the
+  // channels take the same number of partitions
+  int thread_num = std::max(thread_num_, 1);
+  int channel_num = static_cast<int>(multi_output_channel_.size());
+  int partition_num =
+      (thread_num * 4 + channel_num - 1) / channel_num * channel_num;
+  auto fleet_ptr = framework::FleetWrapper::GetInstance();
+  std::atomic<uint64_t> merged_num{0};
+  InsIdMerger merger(use_slots, use_slots_is_dense, merge_size_);
+  uint64_t drop_ins_num = merger.Merge(
+      &inputs,
+      partition_num,
+      thread_num,
+      [this, &fleet_ptr, &merged_num, channel_num](
+          int partition, std::vector<Record>* merged) {
+        if (merged->empty()) {
+          return;
         }
-        local_float.insert(slot);
-        rec.float_feasigns_.push_back(std::move(feature));
-      }
-      if (has_conflict_slot) {
-        break;
-      }
-      all_float.insert(local_float.begin(), local_float.end());
-    }
-
-    if (has_conflict_slot) {
-      LOG(WARNING) << "drop ins " << recs[i].ins_id_ << " size=" << j - i
-                   << ", because conflict_slot=" << use_slots[conflict_slot];
-      drop_ins_num += j - i;
-    } else {
-      results.push_back(std::move(rec));
-    }
-    i = j;
-  }
-  std::vector<Record>().swap(recs);
-  VLOG(3) << "results size " << results.size();
+        std::shuffle(
+            merged->begin(), merged->end(), fleet_ptr->LocalRandomEngine());
+        merged_num += merged->size();
+        multi_output_channel_[partition % channel_num]->Write(
+            std::move(*merged));
+      });
+  VLOG(3) << "results size " << merged_num;
   LOG(WARNING) << "total drop ins num: " << drop_ins_num;
-  results.shrink_to_fit();
-
-  auto fleet_ptr = framework::FleetWrapper::GetInstance();
-  std::shuffle(results.begin(), results.end(), fleet_ptr->LocalRandomEngine());
-  channel_data->Open();
-  channel_data->Write(std::move(results));
-  channel_data->Close();
-  results.clear();
-  results.shrink_to_fit();
-  VLOG(3) << "channel data size " << channel_data->Size();
-  channel_data->SetBlockSize(channel_data->Size() / channel_num_ + 1);
-  VLOG(3) << "channel data block size " << channel_data->BlockSize();
-  for (size_t i = 0; i < multi_output_channel_.size(); ++i) {
-    std::vector<Record> vec_data;
-    channel_data->Read(vec_data);
-    multi_output_channel_[i]->Open();
-    multi_output_channel_[i]->Write(std::move(vec_data));
-    vec_data.clear();
-    vec_data.shrink_to_fit();
-  }
-  CHECK(channel_data->Size() == 0);  // NOLINT
-  channel_data->Clear();
   VLOG(3) << "MultiSlotDataset::MergeByInsId end";
 }
 
@@ -1615,6 +1857,8 @@ void MultiSlotDataset::GetRandomData(
 void MultiSlotDataset::PreprocessChannel(
     const std::set<std::string>& slots_to_replace,
     std::unordered_set<uint16_t>& index_slots) {  // NOLINT
+  // the original records are kept in memory for the next slots shuffle
+  RestoreAllSpilled();
   int out_channel_size = 0;
   if (cur_channel_ == 0) {
     for (size_t i = 0; i < multi_output_channel_.size(); ++i) {
@@ -1729,6 +1973,7 @@ void MultiSlotDataset::SlotsShuffle(
                     true,
                     platform::errors::PreconditionNotMet(
                         "fea eval mode off, need to set on for slots shuffle"));
+  WaitShuffleReceived();
   platform::Timer timeline;
   timeline.Start();
   std::unordered_set<uint16_t> index_slots;
@@ -1772,6 +2017,9 @@ void SlotRecordDataset::CreateReaders() {
     return;
   }
   VLOG(3) << "data feed class name: " << data_feed_desc_.name();
+  if (FLAGS_enable_slotrecord_arena && slot_arena_ == nullptr) {
+    slot_arena_.reset(new SlotRecordArena());
+  }
   for (int i = 0; i < thread_num_; ++i) {
     readers_.push_back(DataFeedFactory::CreateDataFeed(data_feed_desc_.name()));
     readers_[i]->Init(data_feed_desc_);
@@ -1787,6 +2035,7 @@ void SlotRecordDataset::CreateReaders() {
     readers_[i]->SetParseLogKey(parse_logkey_);
     readers_[i]->SetEnablePvMerge(enable_pv_merge_);
     readers_[i]->SetCurrentPhase(current_phase_);
+    readers_[i]->SetSlotRecordArena(slot_arena_.get());
     if (input_channel_ != nullptr) {
       readers_[i]->SetInputChannel(input_channel_.get());
     }
@@ -1799,10 +2048,7 @@ void SlotRecordDataset::ReleaseMemory() {
   platform::Timer timeline;
   timeline.Start();
 
-  if (input_channel_) {
-    input_channel_->Clear();
-    input_channel_ = nullptr;
-  }
+  ReleaseChannelRecords(&input_channel_);
   if (enable_heterps_) {
     VLOG(3) << "put pool records size: " << input_records_.size();
     SlotRecordPool().put(&input_records_);
@@ -1812,8 +2058,26 @@ void SlotRecordDataset::ReleaseMemory() {
             << input_records_.size();
   }
 
+  // the readers' output and consume channels are the ones of the dataset
+  for (auto& chan : multi_output_channel_) {
+    ReleaseChannelRecords(&chan);
+  }
+  std::vector<Channel<SlotRecord>>().swap(multi_output_channel_);
+  for (auto& chan : multi_consume_channel_) {
+    ReleaseChannelRecords(&chan);
+  }
+  std::vector<Channel<SlotRecord>>().swap(multi_consume_channel_);
+
   readers_.clear();
   readers_.shrink_to_fit();
+  if (slot_arena_ != nullptr) {
+    // records must drop their arena buffers before the arena is reset
+    SlotRecordPool().put(&input_records_);
+    SlotRecordPool().put(&slots_shuffle_original_data_);
+    VLOG(3) << "release slot record arena size: "
+            << slot_arena_->reserved_bytes() / 1024.0 / 1024.0 << "MB";
+    slot_arena_->Reset();
+  }
 
   std::vector<std::shared_ptr<paddle::framework::DataFeed>>().swap(readers_);
 
@@ -1824,6 +2088,19 @@ void SlotRecordDataset::ReleaseMemory() {
           << " object pool size=" << SlotRecordPool().capacity();  // For Debug
   STAT_SUB(STAT_total_feasign_num_in_mem, total_fea_num_);
 }
+void SlotRecordDataset::ReleaseChannelRecords(Channel<SlotRecord>* chan) {
+  if (*chan == nullptr) {
+    return;
+  }
+  if (slot_arena_ != nullptr) {
+    std::vector<SlotRecord> records;
+    (*chan)->Close();
+    (*chan)->ReadAll(records);
+    SlotRecordPool().put(&records);
+  }
+  (*chan)->Clear();
+  *chan = nullptr;
+}
 void SlotRecordDataset::GlobalShuffle(int thread_num) {
   // TODO(yaoxuefeng)
   return;
@@ -32,6 +32,9 @@
 #endif
 
 #include "paddle/fluid/framework/data_feed.h"
+#include "paddle/fluid/framework/record_spiller.h"
+#include "paddle/fluid/framework/shuffle_codec.h"
+#include "paddle/fluid/framework/shuffle_pipeline.h"
 #include "paddle/fluid/framework/threadpool.h"
 DECLARE_int32(padbox_dataset_shuffle_thread_num);
 DECLARE_int32(padbox_dataset_merge_thread_num);
@@ -172,6 +175,12 @@ class Dataset {
   virtual void DynamicAdjustReadersNum(int thread_num) = 0;
   // set fleet send sleep seconds
   virtual void SetFleetSendSleepSeconds(int seconds) = 0;
+  // keep loaded data within budget_mb, the rest is spilled to spill_dir.
+  // Only MultiSlotDataset supports it, the others throw for budget_mb > 0
+  virtual void SetMemoryBudget(int64_t budget_mb,
+                               const std::string& spill_dir) = 0;
+  // codec of global shuffle messages: "none", "zlib" or "feasign"
+  virtual void SetShuffleCodec(const std::string& codec) = 0;
 
   virtual std::vector<std::string> GetSlots() = 0;
 
@@ -276,6 +285,9 @@ class DatasetImpl : public Dataset {
                                        bool discard_remaining_ins = false);
   virtual void DynamicAdjustReadersNum(int thread_num);
   virtual void SetFleetSendSleepSeconds(int seconds);
+  virtual void SetMemoryBudget(int64_t budget_mb,
+                               const std::string& spill_dir);
+  virtual void SetShuffleCodec(const std::string& codec);
   virtual std::vector<std::string> GetSlots();
   /* for enable_heterps_
   virtual void EnableHeterps(bool enable_heterps) {
@@ -408,11 +420,63 @@ class MultiSlotDataset : public DatasetImpl<Record> {
   virtual void GlobalShuffle(int thread_num = -1);
   virtual void DynamicAdjustReadersNum(int thread_num);
   virtual void PrepareTrain();
+  virtual void CreateReaders();
+  virtual void SetMemoryBudget(int64_t budget_mb,
+                               const std::string& spill_dir);
+  virtual void SetShuffleCodec(const std::string& codec);
+  virtual void LoadIntoMemory();
+  virtual void PreLoadIntoMemory();
+  virtual void WaitPreLoadDone();
+  virtual void LocalShuffle();
+  virtual void DynamicAdjustChannelNum(int channel_num,
+                                       bool discard_remaining_ins = false);
+  virtual int64_t GetMemoryDataSize();
+  virtual int64_t GetShuffleDataSize();
 
  protected:
   virtual int ReceiveFromClient(int msg_type,
                                 int client_id,
                                 const std::string& msg);
+  virtual void ReleaseMemoryFun();
+  // restore spilled records into input_channel_ after loading
+  void FinishSpill();
+  // bring back every spilled record before input_channel_ is closed
+  void RestoreAllSpilled();
+  // move the whole pass to the spill and let the readers stream it from
+  // input_channel_, it is restored again for every epoch
+  void StreamSpilled();
+  // back from streaming, input_channel_ is restored once as after loading
+  void StopStreamSpilled();
+  void SetReadersStreamInput(bool stream_input);
+  // deserializes a global shuffle message into multi_output_channel_, or
+  // into receive_channel_ when there is a memory budget
+  void WriteReceivedRecords(const std::string& msg);
+  // received messages are deserialized by receiver_ threads, wait for them
+  // before multi_output_channel_ is used after the global shuffle barrier
+  void WaitShuffleReceived();
+  // the received records take the place of the sent ones in spiller_ and
+  // input_channel_, or go to multi_output_channel_ if none was spilled
+  void AdoptReceivedSpill(std::unique_ptr<RecordSpiller> spiller,
+                          const Channel<Record>& chan);
+  // brings a pass received into the spill back to multi_output_channel_,
+  // where the global shuffle leaves it without a memory budget
+  void MoveReceivedToOutput();
+  void WriteToOutputChannels(std::vector<Record>* data);
+
+  std::unique_ptr<RecordSpiller> spiller_;
+  std::string spill_dir_;
+  int64_t memory_budget_mb_ = 0;
+  // guarded by receiver_mutex_, records of the global shuffle are received
+  // within a budget of their own while spiller_ restores the ones to send
+  std::unique_ptr<RecordSpiller> receive_spiller_;
+  Channel<Record> receive_channel_;
+  bool received_into_spill_ = false;
+  bool stream_input_ = false;
+  std::mutex receiver_mutex_;
+  std::unique_ptr<ShuffleReceiver> receiver_;
+  ShuffleCodecType shuffle_codec_ = kShuffleCodecNone;
+  ShuffleCodecStat send_codec_stat_;
+  ShuffleCodecStat receive_codec_stat_;
 };
 class SlotRecordDataset : public DatasetImpl<SlotRecord> {
  public:
@@ -431,7 +495,13 @@ class SlotRecordDataset : public DatasetImpl<SlotRecord> {
   virtual void DynamicAdjustReadersNum(int thread_num);
 
  protected:
+  // returns the records of chan to the pool if they may hold arena buffers,
+  // then drops the channel
+  void ReleaseChannelRecords(Channel<SlotRecord>* chan);
+
   bool enable_heterps_ = true;
+  // pass scoped storage of record feasigns, see FLAGS_enable_slotrecord_arena
+  std::unique_ptr<SlotRecordArena> slot_arena_;
 };
 
 #ifdef PADDLE_WITH_BOX_PS
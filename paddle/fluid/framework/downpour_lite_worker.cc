@@ -426,15 +426,7 @@ void DownpourLiteWorker::TrainFilesWithProfiler() {
  * @brief add auc monitor
  */
 inline void AddAucMonitor(const Scope* scope, const platform::Place& place) {
-  auto metric_ptr = Metric::GetInstance();
-  auto& metric_list = metric_ptr->GetMetricList();
-  for (auto iter = metric_list.begin(); iter != metric_list.end(); iter++) {
-    auto* metric_msg = iter->second;
-    if (metric_ptr->Phase() != metric_msg->MetricPhase()) {
-      continue;
-    }
-    metric_msg->add_data(scope, place);
-  }
+  Metric::GetInstance()->AddData(scope, place);
 }
 #endif
 
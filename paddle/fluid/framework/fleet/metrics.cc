@@ -14,6 +14,7 @@
 #include "paddle/fluid/framework/fleet/metrics.h"
 
 #include <algorithm>
+#include <cstring>
 #include <ctime>
 #include <memory>
 #include <numeric>
@@ -30,6 +31,108 @@ namespace framework {
 
 std::shared_ptr<Metric> Metric::s_instance_ = nullptr;
 
+Metric::~Metric() {
+  // the consumer threads use the metrics, they go first
+  std::unique_lock<std::mutex> lock(async_mutex_);
+  async_cond_.wait(lock, [this] { return async_pending_ == 0; });
+  lock.unlock();
+  async_pool_.reset();
+}
+
+void Metric::AddData(const Scope* exe_scope,
+                     const paddle::platform::Place& place) {
+  int phase = Phase();
+  if (async_pool_ == nullptr) {
+    for (auto& iter : metric_lists_) {
+      if (iter.second->MetricPhase() == phase) {
+        iter.second->add_data(exe_scope, place);
+      }
+    }
+    return;
+  }
+  auto varnames = phase_varnames_.find(phase);
+  if (varnames == phase_varnames_.end()) {
+    return;
+  }
+
+  std::unique_ptr<Scope> staging;
+  {
+    std::unique_lock<std::mutex> lock(async_mutex_);
+    async_cond_.wait(lock, [this] { return !free_staging_scopes_.empty(); });
+    staging = std::move(free_staging_scopes_.back());
+    free_staging_scopes_.pop_back();
+    ++async_pending_;
+  }
+  try {
+    // the staging tensors keep their memory from the last batch they held
+    for (auto& varname : varnames->second) {
+      auto* var = exe_scope->FindVar(varname);
+      PADDLE_ENFORCE_NOT_NULL(
+          var,
+          platform::errors::NotFound("Error: var %s is not found in scope.",
+                                     varname.c_str()));
+      TensorCopySync(var->Get<LoDTensor>(),
+                     platform::CPUPlace(),
+                     staging->Var(varname)->GetMutable<LoDTensor>());
+    }
+  } catch (...) {
+    std::lock_guard<std::mutex> lock(async_mutex_);
+    free_staging_scopes_.push_back(std::move(staging));
+    --async_pending_;
+    async_cond_.notify_all();
+    throw;
+  }
+
+  Scope* batch = staging.release();
+  async_pool_->Run([this, batch, phase]() {
+    std::string error;
+    try {
+      for (auto& iter : metric_lists_) {
+        if (iter.second->MetricPhase() == phase) {
+          iter.second->add_data(batch, platform::CPUPlace());
+        }
+      }
+    } catch (const std::exception& e) {
+      error = e.what();
+    }
+    std::lock_guard<std::mutex> lock(async_mutex_);
+    if (!error.empty() && async_error_.empty()) {
+      async_error_ = error;
+    }
+    free_staging_scopes_.emplace_back(batch);
+    --async_pending_;
+    async_cond_.notify_all();
+  });
+}
+
+void Metric::SetAsync(int thread_num, int max_pending) {
+  FlushAsyncData();
+  async_pool_.reset();
+  free_staging_scopes_.clear();
+  if (thread_num <= 0) {
+    return;
+  }
+  for (int i = 0; i < std::max(max_pending, 1); ++i) {
+    free_staging_scopes_.emplace_back(new Scope());
+  }
+  async_pool_.reset(new ThreadPool(thread_num));
+  VLOG(0) << "Metric adds data in " << thread_num << " threads, "
+          << free_staging_scopes_.size() << " batches pending at most";
+}
+
+void Metric::FlushAsyncData() {
+  std::string error;
+  {
+    std::unique_lock<std::mutex> lock(async_mutex_);
+    async_cond_.wait(lock, [this] { return async_pending_ == 0; });
+    error.swap(async_error_);
+  }
+  PADDLE_ENFORCE_EQ(error.empty(),
+                    true,
+                    platform::errors::PreconditionNotMet(
+                        "Metric async add_data failed: %s", error.c_str()));
+}
+
 void BasicAucCalculator::add_unlock_data(double pred, int label) {
   PADDLE_ENFORCE_GE(pred, 0.0,
       platform::errors::PreconditionNotMet("pred should be greater than 0, pred=%f", pred));
@@ -86,6 +189,7 @@ void BasicAucCalculator::add_unlock_data_with_float_label(double pred, double la
 
 void BasicAucCalculator::add_unlock_data_with_continue_label(double pred, double label, const std::vector<double>& bucket_thr_value) {
 
+  init_continue_state();
   int bucket_idx = get_bucket_idx(label, bucket_thr_value);
 
   _continue_bucket_msg[bucket_idx][0] += fabs(pred - label);
@@ -93,7 +197,28 @@ void BasicAucCalculator::add_unlock_data_with_continue_label(double pred, double
   _continue_bucket_msg[bucket_idx][2] += label;
   _continue_bucket_msg[bucket_idx][3] += pred;
   _continue_bucket_msg[bucket_idx][4]++;
-  _continue_bucket_pair[bucket_idx].emplace_back(std::make_pair(pred, label));
+  // reservoir sampling, each pair of the bucket stays with the same chance
+  auto& pairs = _continue_bucket_pair[bucket_idx];
+  if (pairs.size() < kContinuePairNum) {
+    pairs.emplace_back(pred, label);
+    return;
+  }
+  uint64_t seen = static_cast<uint64_t>(_continue_bucket_msg[bucket_idx][4]);
+  uint64_t pos = _continue_engine() % seen;
+  if (pos < pairs.size()) {
+    pairs[pos] = std::make_pair(pred, label);
+  }
+}
+
+void BasicAucCalculator::init_continue_state() {
+  if (!_continue_bucket_msg.empty()) {
+    return;
+  }
+  _continue_bucket_pair.resize(kContinueBucketNum);
+  _continue_bucket_msg.assign(kContinueBucketNum,
+                              std::vector<double>(kContinueMetricSize, 0.0));
+  _continue_bucket_error.assign(kContinueBucketNum,
+                                std::vector<double>(kContinueMetricSize, 0.0));
 }
 
 void BasicAucCalculator::add_data(
@@ -106,16 +231,10 @@ void BasicAucCalculator::add_data(
     h_label.resize(batch_size);
     SyncCopyD2H(h_pred.data(), d_pred, batch_size);
     SyncCopyD2H(h_label.data(), d_label, batch_size);
-
-    std::lock_guard<std::mutex> lock(_table_mutex);
-    for (int i = 0; i < batch_size; ++i) {
-      add_unlock_data(h_pred[i], h_label[i]);
-    }
+    add_batch_data(h_pred.data(), h_label.data(), nullptr, nullptr, nullptr,
+                   batch_size);
   } else {
-    std::lock_guard<std::mutex> lock(_table_mutex);
-    for (int i = 0; i < batch_size; ++i) {
-      add_unlock_data(d_pred[i], d_label[i]);
-    }
+    add_batch_data(d_pred, d_label, nullptr, nullptr, nullptr, batch_size);
   }
 }
 
@@ -130,16 +249,11 @@ void BasicAucCalculator::add_sample_data(
     h_label.resize(batch_size);
     SyncCopyD2H(h_pred.data(), d_pred, batch_size);
     SyncCopyD2H(h_label.data(), d_label, batch_size);
-
-    std::lock_guard<std::mutex> lock(_table_mutex);
-    for (int i = 0; i < batch_size; ++i) {
-      add_unlock_data(h_pred[i], h_label[i], d_sample_scale[i]);
-    }
+    add_batch_data(h_pred.data(), h_label.data(), nullptr, nullptr,
+                   d_sample_scale.data(), batch_size);
   } else {
-    std::lock_guard<std::mutex> lock(_table_mutex);
-    for (int i = 0; i < batch_size; ++i) {
-      add_unlock_data(d_pred[i], d_label[i], d_sample_scale[i]);
-    }
+    add_batch_data(d_pred, d_label, nullptr, nullptr, d_sample_scale.data(),
+                   batch_size);
   }
 }
 
@@ -158,20 +272,10 @@ void BasicAucCalculator::add_mask_data(const float* d_pred,
     SyncCopyD2H(h_pred.data(), d_pred, batch_size);
     SyncCopyD2H(h_label.data(), d_label, batch_size);
     SyncCopyD2H(h_mask.data(), d_mask, batch_size);
-
-    std::lock_guard<std::mutex> lock(_table_mutex);
-    for (int i = 0; i < batch_size; ++i) {
-      if (h_mask[i]) {
-        add_unlock_data(h_pred[i], h_label[i]);
-      }
-    }
+    add_batch_data(h_pred.data(), h_label.data(), nullptr, h_mask.data(),
+                   nullptr, batch_size);
   } else {
-    std::lock_guard<std::mutex> lock(_table_mutex);
-    for (int i = 0; i < batch_size; ++i) {
-      if (d_mask[i]) {
-        add_unlock_data(d_pred[i], d_label[i]);
-      }
-    }
+    add_batch_data(d_pred, d_label, nullptr, d_mask, nullptr, batch_size);
   }
 }
 // add float mask data
@@ -190,20 +294,131 @@ void BasicAucCalculator::add_float_mask_data(const float* d_pred,
     SyncCopyD2H(h_pred.data(), d_pred, batch_size);
     SyncCopyD2H(h_label.data(), d_label, batch_size);
     SyncCopyD2H(h_mask.data(), d_mask, batch_size);
+    add_batch_data(h_pred.data(), nullptr, h_label.data(), h_mask.data(),
+                   nullptr, batch_size);
+  } else {
+    add_batch_data(d_pred, nullptr, d_label, d_mask, nullptr, batch_size);
+  }
+}
 
-    std::lock_guard<std::mutex> lock(_table_mutex);
-    for (int i = 0; i < batch_size; ++i) {
-      if (h_mask[i]) {
-        add_unlock_data_with_float_label(h_pred[i], h_label[i]);
-      }
+std::atomic<uint64_t> BasicAucCalculator::_next_id(0);
+
+BasicAucCalculator::AucShard* BasicAucCalculator::local_shard() {
+  thread_local std::unordered_map<uint64_t, AucShard*> shards;
+  AucShard*& shard = shards[_id];
+  if (shard == nullptr) {
+    std::lock_guard<std::mutex> lock(_shards_mutex);
+    _shards.emplace_back(new AucShard());
+    shard = _shards.back().get();
+  }
+  return shard;
+}
+
+void BasicAucCalculator::add_batch_data(const float* pred,
+                                        const int64_t* label_int,
+                                        const float* label_float,
+                                        const int64_t* mask,
+                                        const float* sample_scale,
+                                        int batch_size) {
+  // the samples of the mask, in a row
+  thread_local std::vector<float> preds;
+  thread_local std::vector<float> labels;
+  thread_local std::vector<float> scales;
+  preds.resize(batch_size);
+  labels.resize(batch_size);
+  scales.resize(batch_size);
+  int num = 0;
+  bool binary = true;
+  bool in_range = true;
+  for (int i = 0; i < batch_size; ++i) {
+    if (mask != nullptr && !mask[i]) {
+      continue;
     }
-  } else {
-    std::lock_guard<std::mutex> lock(_table_mutex);
-    for (int i = 0; i < batch_size; ++i) {
-      if (d_mask[i]) {
-        add_unlock_data_with_float_label(d_pred[i], d_label[i]);
-      }
+    // false for NaN too
+    in_range = in_range && pred[i] >= 0.0f && pred[i] <= 1.0f;
+    preds[num] = pred[i];
+    if (label_int != nullptr) {
+      binary = binary && (label_int[i] == 0 || label_int[i] == 1);
+      labels[num] = static_cast<float>(label_int[i]);
+    } else {
+      labels[num] = label_float[i];
     }
+    scales[num] = sample_scale != nullptr ? sample_scale[i] : 1.0f;
+    ++num;
+  }
+  PADDLE_ENFORCE_EQ(binary, true,
+      platform::errors::PreconditionNotMet(
+          "label must be equal to 0 or 1"));
+  for (int i = 0; !in_range && i < num; ++i) {
+    PADDLE_ENFORCE_GE(preds[i], 0.0,
+        platform::errors::PreconditionNotMet("pred should be greater than 0, pred=%f", preds[i]));
+    PADDLE_ENFORCE_LE(preds[i], 1.0,
+        platform::errors::PreconditionNotMet("pred should be lower than 1, pred=%f", preds[i]));
+  }
+  if (num == 0) {
+    return;
+  }
+
+  AucShard* shard = local_shard();
+  std::lock_guard<std::mutex> lock(shard->mutex);
+  size_t offset = shard->buckets.size();
+  shard->buckets.resize(offset + num);
+  shard->neg.resize(offset + num);
+  shard->pos.resize(offset + num);
+  uint32_t* buckets = shard->buckets.data() + offset;
+  float* neg = shard->neg.data() + offset;
+  float* pos = shard->pos.data() + offset;
+  // branch free loops over plain arrays, for the compiler to vectorize
+  // in double as add_unlock_data, for the samples to fall in the same buckets
+  const double table_size = _table_size;
+  const int max_bucket = _table_size - 1;
+  double abserr = 0;
+  double sqrerr = 0;
+  double pred_sum = 0;
+  for (int i = 0; i < num; ++i) {
+    int bucket = static_cast<int>(preds[i] * table_size);
+    buckets[i] = bucket < max_bucket ? bucket : max_bucket;
+    neg[i] = (1.0f - labels[i]) * scales[i];
+    pos[i] = labels[i] * scales[i];
+  }
+  for (int i = 0; i < num; ++i) {
+    double err = static_cast<double>(preds[i]) - labels[i];
+    abserr += std::fabs(err);
+    sqrerr += err * err;
+    pred_sum += static_cast<double>(preds[i]) * scales[i];
+  }
+  shard->abserr += abserr;
+  shard->sqrerr += sqrerr;
+  shard->pred += pred_sum;
+  if (shard->buckets.size() >= kShardMergeSize) {
+    merge_shard(shard);
+  }
+}
+
+void BasicAucCalculator::merge_shard(AucShard* shard) {
+  std::lock_guard<std::mutex> lock(_table_mutex);
+  double* neg_table = _table[0].data();
+  double* pos_table = _table[1].data();
+  for (size_t i = 0; i < shard->buckets.size(); ++i) {
+    neg_table[shard->buckets[i]] += shard->neg[i];
+    pos_table[shard->buckets[i]] += shard->pos[i];
+  }
+  _local_abserr += shard->abserr;
+  _local_sqrerr += shard->sqrerr;
+  _local_pred += shard->pred;
+  shard->buckets.clear();
+  shard->neg.clear();
+  shard->pos.clear();
+  shard->abserr = 0;
+  shard->sqrerr = 0;
+  shard->pred = 0;
+}
+
+void BasicAucCalculator::merge_shards() {
+  std::lock_guard<std::mutex> lock(_shards_mutex);
+  for (auto& shard : _shards) {
+    std::lock_guard<std::mutex> shard_lock(shard->mutex);
+    merge_shard(shard.get());
   }
 }
 
@@ -267,6 +482,18 @@ void BasicAucCalculator::init(int table_size, int max_batch_size) {
 }
 
 void BasicAucCalculator::reset() {
+  {
+    std::lock_guard<std::mutex> lock(_shards_mutex);
+    for (auto& shard : _shards) {
+      std::lock_guard<std::mutex> shard_lock(shard->mutex);
+      shard->buckets.clear();
+      shard->neg.clear();
+      shard->pos.clear();
+      shard->abserr = 0;
+      shard->sqrerr = 0;
+      shard->pred = 0;
+    }
+  }
   // reset CPU counter
   for (int i = 0; i < 2; i++) {
     _table[i].assign(_table_size, 0.0);
@@ -276,13 +503,14 @@ void BasicAucCalculator::reset() {
   _local_pred = 0;
   _local_label = 0;
   _local_total_num = 0;
-  for (size_t i = 0; i < 100; i++){
-    _continue_bucket_msg[i].assign(6, 0.0); //metric_size = 6
+  for (size_t i = 0; i < _continue_bucket_msg.size(); i++){
+    _continue_bucket_msg[i].assign(kContinueMetricSize, 0.0);
     _continue_bucket_pair[i].clear();
   }
 }
 
 void BasicAucCalculator::compute() {
+  merge_shards();
   int node_size = 1;
   double* table[2] = {&_table[0][0], &_table[1][0]};
 #ifdef PADDLE_WITH_BOX_PS
@@ -456,85 +684,108 @@ void BasicAucCalculator::add_uid_unlock_data(double pred,
   wuauc_records_.emplace_back(std::move(record));
 }
 
+// LSD radix sort of the records by uid, and by pred in descending order
+// within a uid, 11 bits a pass. The passes of a digit all the records share,
+// as the high bits of the uids often are, are skipped.
+static void SortWuaucRecords(
+    std::vector<BasicAucCalculator::WuaucRecord>* records) {
+  const int kRadixBits = 11;
+  const size_t kRadix = 1 << kRadixBits;
+  // 3 digits of the pred then 6 of the uid
+  const int kPredDigits = 3;
+  const int kDigits = 9;
+  auto pred_key = [](float pred) {
+    // pred is in [0, 1], where the bits of a float order as the value, + 0
+    // makes -0 a 0
+    pred += 0.0f;
+    uint32_t bits = 0;
+    memcpy(&bits, &pred, sizeof(bits));
+    return ~bits;
+  };
+  auto digit = [&](const BasicAucCalculator::WuaucRecord& rec, int d) {
+    uint64_t key = d < kPredDigits ? pred_key(rec.pred_) : rec.uid_;
+    int shift = (d < kPredDigits ? d : d - kPredDigits) * kRadixBits;
+    return static_cast<size_t>((key >> shift) & (kRadix - 1));
+  };
+
+  size_t size = records->size();
+  std::vector<size_t> counts(kDigits * kRadix, 0);
+  for (auto& rec : *records) {
+    for (int d = 0; d < kDigits; ++d) {
+      ++counts[d * kRadix + digit(rec, d)];
+    }
+  }
+  std::vector<BasicAucCalculator::WuaucRecord> buffer;
+  for (int d = 0; d < kDigits; ++d) {
+    size_t* count = &counts[d * kRadix];
+    if (size == 0 ||
+        std::find(count, count + kRadix, size) != count + kRadix) {
+      continue;
+    }
+    if (buffer.empty()) {
+      buffer.resize(size);
+    }
+    size_t offset = 0;
+    for (size_t i = 0; i < kRadix; ++i) {
+      size_t n = count[i];
+      count[i] = offset;
+      offset += n;
+    }
+    for (auto& rec : *records) {
+      buffer[count[digit(rec, d)]++] = rec;
+    }
+    records->swap(buffer);
+  }
+}
+
 void BasicAucCalculator::computeWuAuc() {
-  std::sort(wuauc_records_.begin(),
-            wuauc_records_.end(),
-            [](const WuaucRecord& lhs, const WuaucRecord& rhs) {
-              if (lhs.uid_ == rhs.uid_) {
-                if (lhs.pred_ == rhs.pred_) {
-                  return lhs.label_ < rhs.label_;
-                } else {
-                  return lhs.pred_ > rhs.pred_;
-                }
-              } else {
-                return lhs.uid_ > rhs.uid_;
-              }
-            });
+  SortWuaucRecords(&wuauc_records_);
 
   WuaucRocData roc_data;
-  uint64_t prev_uid = 0;
-  size_t prev_pos = 0;
-  for (size_t i = 0; i < wuauc_records_.size(); ++i) {
-    if (wuauc_records_[i].uid_ != prev_uid) {
-      std::vector<WuaucRecord> single_user_recs(
-          wuauc_records_.begin() + prev_pos, wuauc_records_.begin() + i);
-      roc_data = computeSingelUserAuc(single_user_recs);
-      if (roc_data.auc_ != -1) {
-        double ins_num = (roc_data.tp_ + roc_data.fp_);
-        _user_cnt += 1;
-        _size += ins_num;
-        _uauc += roc_data.auc_;
-        _wuauc += roc_data.auc_ * ins_num;
-      }
-
-      prev_uid = wuauc_records_[i].uid_;
-      prev_pos = i;
+  const WuaucRecord* begin = wuauc_records_.data();
+  const WuaucRecord* end = begin + wuauc_records_.size();
+  while (begin < end) {
+    const WuaucRecord* user_end = begin;
+    while (user_end < end && user_end->uid_ == begin->uid_) {
+      ++user_end;
     }
-  }
-
-  std::vector<WuaucRecord> single_user_recs(wuauc_records_.begin() + prev_pos,
-                                            wuauc_records_.end());
-  roc_data = computeSingelUserAuc(single_user_recs);
-  if (roc_data.auc_ != -1) {
-    double ins_num = (roc_data.tp_ + roc_data.fp_);
-    _user_cnt += 1;
-    _size += ins_num;
-    _uauc += roc_data.auc_;
-    _wuauc += roc_data.auc_ * ins_num;
+    roc_data = computeSingelUserAuc(begin, user_end);
+    if (roc_data.auc_ != -1) {
+      double ins_num = (roc_data.tp_ + roc_data.fp_);
+      _user_cnt += 1;
+      _size += ins_num;
+      _uauc += roc_data.auc_;
+      _wuauc += roc_data.auc_ * ins_num;
+    }
+    begin = user_end;
   }
 }
 
 BasicAucCalculator::WuaucRocData BasicAucCalculator::computeSingelUserAuc(
-    const std::vector<WuaucRecord>& records) {
+    const WuaucRecord* begin, const WuaucRecord* end) {
   double tp = 0.0;
   double fp = 0.0;
   double newtp = 0.0;
   double newfp = 0.0;
   double area = 0.0;
   double auc = -1;
-  size_t i = 0;
+  const WuaucRecord* rec = begin;
 
-  while (i < records.size()) {
+  while (rec < end) {
     newtp = tp;
     newfp = fp;
-    if (records[i].label_ == 1) {
-      newtp += 1;
-    } else {
-      newfp += 1;
-    }
-    // check i+1
-    while (i < records.size() - 1 && records[i].pred_ == records[i + 1].pred_) {
-      if (records[i + 1].label_ == 1) {
+    // the records of the same pred make one step of the roc curve
+    float pred = rec->pred_;
+    for (; rec < end && rec->pred_ == pred; ++rec) {
+      if (rec->label_ == 1) {
         newtp += 1;
       } else {
         newfp += 1;
       }
-      i += 1;
     }
     area += (newfp - fp) * (tp + newtp) / 2.0;
     tp = newtp;
     fp = newfp;
-    i += 1;
   }
   if (tp > 0 && fp > 0) {
     auc = area / (fp * tp + 1e-9);
@@ -545,6 +796,8 @@ BasicAucCalculator::WuaucRocData BasicAucCalculator::computeSingelUserAuc(
 }
 
 void BasicAucCalculator::computeContinueMsg() {
+  // a node without continue labels still takes part in the allreduce
+  init_continue_state();
   int node_size = 1;
 #ifdef PADDLE_WITH_BOX_PS
   node_size = boxps::MPICluster::Ins().size();
@@ -614,7 +867,7 @@ void BasicAucCalculator::computeContinueOrderRatio() {
   double label2 = 0.0;
   int max_pair_num = 10000;
   srand((int)time(0)); 
-  for (int i = 0; i < 100; i++) {
+  for (size_t i = 0; i < _continue_bucket_pair.size(); i++) {
     if (_continue_bucket_pair[i].size() <= 0) {
       continue;
     }
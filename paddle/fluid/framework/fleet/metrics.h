@@ -14,10 +14,13 @@ limitations under the License. */
 
 #pragma once
 
+#include <algorithm>
 #include <atomic>
+#include <condition_variable>
 #include <ctime>
 #include <map>
 #include <memory>
+#include <mutex>
 #include <random>
 #include <string>
 #include <unordered_map>
@@ -28,6 +31,7 @@ limitations under the License. */
 #include "paddle/fluid/framework/program_desc.h"
 #include "paddle/fluid/framework/scope.h"
 #include "paddle/fluid/framework/tensor.h"
+#include "paddle/fluid/framework/threadpool.h"
 #include "paddle/fluid/framework/variable_helper.h"
 #include "paddle/fluid/platform/timer.h"
 #include "paddle/fluid/string/string_helper.h"
@@ -55,7 +59,8 @@ class BasicAucCalculator {
     double fp_;
     double auc_;
   };
-  explicit BasicAucCalculator(bool mode_collect_in_gpu = false) {}
+  explicit BasicAucCalculator(bool mode_collect_in_gpu = false)
+      : _id(_next_id++) {}
   void init(int table_size, int max_batch_size = 0);
   void reset();
   // add single data in CPU with LOCK, deprecated
@@ -101,6 +106,7 @@ class BasicAucCalculator {
                     const int64_t* d_uid,
                     int batch_size,
                     const paddle::platform::Place& place);
+  // merges the samples the batch adds left in the shards of the threads first
   void compute();
   void computeContinueMsg();
   void computeContinueOrderRatio();
@@ -111,8 +117,15 @@ class BasicAucCalculator {
   double actual_ctr() const { return _actual_ctr; }
   double predicted_ctr() const { return _predicted_ctr; }
   double predicted_value() const { return _predicted_value; }
-  std::vector<std::vector<double>> continue_bucket_error() const { return _continue_bucket_error; }
   double rmse() const { return _rmse; }
+  // kContinueBucketNum x kContinueMetricSize, zeros before computeContinueMsg
+  std::vector<std::vector<double>> continue_bucket_error() const {
+    if (_continue_bucket_error.empty()) {
+      return std::vector<std::vector<double>>(
+          kContinueBucketNum, std::vector<double>(kContinueMetricSize, 0.0));
+    }
+    return _continue_bucket_error;
+  }
   std::vector<double>& get_negative() { return _table[0]; }
   std::vector<double>& get_postive() { return _table[1]; }
   double& local_abserr() { return _local_abserr; }
@@ -157,8 +170,12 @@ class BasicAucCalculator {
  public:
   void reset_records();
   void add_uid_unlock_data(double pred, int label, uint64_t uid);
+  // radix sorts the records by uid and pred, then computes the auc of each
+  // user on its span of them
   void computeWuAuc();
-  WuaucRocData computeSingelUserAuc(const std::vector<WuaucRecord>& records);
+  // the records of a user, sorted by pred in descending order
+  WuaucRocData computeSingelUserAuc(const WuaucRecord* begin,
+                                    const WuaucRecord* end);
   double uauc() const { return _uauc; }
   double wuauc() const { return _wuauc; }
   double user_cnt() const { return _user_cnt; }
@@ -176,6 +193,34 @@ class BasicAucCalculator {
                           int len);
   void calculate_bucket_error(const double* neg_table, const double* pos_table);
 
+  // The samples a thread added by batch since the last merge, the bucket and
+  // the negative and positive weights of each, and the error sums. Threads
+  // fill their own shard and only merge it into _table under _table_mutex
+  // once it holds kShardMergeSize samples, or when compute() merges them all.
+  struct AucShard {
+    std::mutex mutex;
+    std::vector<uint32_t> buckets;
+    std::vector<float> neg;
+    std::vector<float> pos;
+    double abserr = 0;
+    double sqrerr = 0;
+    double pred = 0;
+  };
+  AucShard* local_shard();
+  // a null label_int takes label_float, a null mask all the samples and a
+  // null sample_scale weights them 1
+  void add_batch_data(const float* pred,
+                      const int64_t* label_int,
+                      const float* label_float,
+                      const int64_t* mask,
+                      const float* sample_scale,
+                      int batch_size);
+  void merge_shard(AucShard* shard);
+  void merge_shards();
+  // allocates the continue label state on the first use, most calculators
+  // never see a continue label
+  void init_continue_state();
+
  protected:
   double _local_abserr = 0;
   double _local_sqrerr = 0;
@@ -195,9 +240,13 @@ class BasicAucCalculator {
   double _uauc = 0;
   double _wuauc = 0;
   std::vector<WuaucRecord> wuauc_records_;
-  std::vector<std::vector<std::pair<double, double>>> _continue_bucket_pair = std::vector<std::vector<std::pair<double, double>>>(100, std::vector<std::pair<double, double>>(10000, std::make_pair<double, double>(0.0, 0.0))); //max bucket_size 100
-  std::vector<std::vector<double>> _continue_bucket_msg = std::vector<std::vector<double>>(100, std::vector<double>(6, 0.0)); //max bucket_size 100 metric_size 6
-  std::vector<std::vector<double>> _continue_bucket_error = std::vector<std::vector<double>>(100, std::vector<double>(6, 0.0)); //max bucket_size 100 metric_size 6
+  // kContinueBucketNum buckets of kContinueMetricSize metrics, empty until
+  // init_continue_state. Each bucket keeps a uniform sample of at most
+  // kContinuePairNum of its (pred, label) pairs for the order ratio.
+  std::vector<std::vector<std::pair<double, double>>> _continue_bucket_pair;
+  std::vector<std::vector<double>> _continue_bucket_msg;
+  std::vector<std::vector<double>> _continue_bucket_error;
+  std::mt19937_64 _continue_engine;
 
  private:
   void set_table_size(int table_size) { _table_size = table_size; }
@@ -211,12 +260,22 @@ class BasicAucCalculator {
   std::vector<double> _table[2];
   static constexpr double kRelativeErrorBound = 0.05;
   static constexpr double kMaxSpan = 0.01;
+  static constexpr size_t kShardMergeSize = 16384;
+  static constexpr size_t kContinueBucketNum = 100;
+  static constexpr size_t kContinueMetricSize = 6;
+  static constexpr size_t kContinuePairNum = 10000;
   std::mutex _table_mutex;
+  // the thread local shards of a calculator are found by its id, which no
+  // other calculator takes even after it is gone
+  static std::atomic<uint64_t> _next_id;
+  const uint64_t _id;
+  std::mutex _shards_mutex;
+  std::vector<std::unique_ptr<AucShard>> _shards;
 };
 
 class Metric {
  public:
-  virtual ~Metric() {}
+  virtual ~Metric();
 
   Metric() { fprintf(stdout, "init fleet Metric\n"); }
 
@@ -237,6 +296,10 @@ class Metric {
 
     int MetricPhase() const { return metric_phase_; }
     BasicAucCalculator* GetCalculator() { return calculator; }
+    // the variables add_data reads
+    virtual std::vector<std::string> VarNames() const {
+      return {label_varname_, pred_varname_};
+    }
 
     // add_data
     virtual void add_data(const Scope* exe_scope,
@@ -338,6 +401,9 @@ class Metric {
       auto cal = GetCalculator();
       cal->add_uid_data(pred_data, label_data, uid_data, label_len, place);
     }
+    std::vector<std::string> VarNames() const override {
+      return {label_varname_, pred_varname_, uid_varname_};
+    }
 
    protected:
     std::string uid_varname_;
@@ -420,6 +486,11 @@ class Metric {
         }
       }
     }
+    std::vector<std::string> VarNames() const override {
+      std::vector<std::string> names = {label_varname_, cmatch_rank_varname_};
+      names.insert(names.end(), pred_v.begin(), pred_v.end());
+      return names;
+    }
 
    protected:
     std::vector<std::pair<int, int>> cmatch_rank_v;
@@ -501,6 +572,9 @@ class Metric {
         }
       }
     }
+    std::vector<std::string> VarNames() const override {
+      return {label_varname_, pred_varname_, cmatch_rank_varname_};
+    }
 
    protected:
     std::vector<std::pair<int, int>> cmatch_rank_v;
@@ -544,6 +618,9 @@ class Metric {
       auto cal = GetCalculator();
       cal->add_mask_data(pred_data, label_data, mask_data, label_len, place);
     }
+    std::vector<std::string> VarNames() const override {
+      return {label_varname_, pred_varname_, mask_varname_};
+    }
 
    protected:
     std::string mask_varname_;
@@ -641,6 +718,14 @@ class Metric {
         }
       }
     }
+    std::vector<std::string> VarNames() const override {
+      std::vector<std::string> names = {
+          label_varname_, pred_varname_, cmatch_rank_varname_};
+      if (!mask_varname_.empty()) {
+        names.push_back(mask_varname_);
+      }
+      return names;
+    }
 
    protected:
     std::vector<std::pair<int, int>> cmatch_rank_v;
@@ -702,6 +787,17 @@ class Metric {
   void FlipPhase() { phase_ = (phase_ + 1) % phase_num_; }
   std::map<std::string, MetricMsg*>& GetMetricList() { return metric_lists_; }
 
+  // adds the batch in exe_scope to the metrics of the current phase. Once
+  // SetAsync is on, the tensors they read are copied to a staging scope and
+  // the consumer threads add them, while the worker goes on with its batches
+  void AddData(const Scope* exe_scope, const paddle::platform::Place& place);
+  // thread_num 0 adds the batches inline in AddData. max_pending staging
+  // scopes are reused, AddData waits for one when all of them are queued
+  void SetAsync(int thread_num, int max_pending = 16);
+  // waits for the batches queued to the consumer threads and throws the
+  // first error they met
+  void FlushAsyncData();
+
   void InitMetric(const std::string& method,
                   const std::string& name,
                   const std::string& label_varname,
@@ -766,6 +862,13 @@ class Metric {
           "CmatchRankMaskAucCalculator"));
     }
     metric_name_list_.emplace_back(name);
+    auto& varnames = phase_varnames_[metric_phase];
+    for (auto& varname : metric_lists_[name]->VarNames()) {
+      if (std::find(varnames.begin(), varnames.end(), varname) ==
+          varnames.end()) {
+        varnames.push_back(varname);
+      }
+    }
   }
 
   const std::vector<float> GetMetricMsg(const std::string& name) {
@@ -774,6 +877,7 @@ class Metric {
                       metric_lists_.end(),
                       platform::errors::InvalidArgument(
                           "The metric name you provided is not registered."));
+    FlushAsyncData();
     std::vector<float> metric_return_values_(8, 0.0);
     auto* auc_cal_ = iter->second->GetCalculator();
     auc_cal_->compute();
@@ -797,6 +901,7 @@ class Metric {
                       platform::errors::InvalidArgument(
                           "The metric name you provided is not registered."));
     VLOG(0) << "begin GetWuAucMetricMsg";
+    FlushAsyncData();
     std::vector<float> metric_return_values_(6, 0.0);
     auto* auc_cal_ = iter->second->GetCalculator();
     auc_cal_->computeWuAuc();
@@ -840,6 +945,16 @@ class Metric {
   int phase_num_ = 2;
   std::map<std::string, MetricMsg*> metric_lists_;
   std::vector<std::string> metric_name_list_;
+  // the variables the metrics of each phase read
+  std::map<int, std::vector<std::string>> phase_varnames_;
+
+  // async metric adds
+  std::unique_ptr<ThreadPool> async_pool_;
+  std::vector<std::unique_ptr<Scope>> free_staging_scopes_;
+  int async_pending_ = 0;
+  std::string async_error_;
+  std::mutex async_mutex_;
+  std::condition_variable async_cond_;
 };
 }  // namespace framework
 }  // namespace paddle
@@ -1064,6 +1064,12 @@ void PSGPUWrapper::EndPass() {
       t.join();
     }
   }
+#ifdef PADDLE_WITH_PSCORE
+  // the values are dumped back, the table can move the ones BuildPull pinned
+  // back to its slabs
+  auto fleet_ptr = paddle::distributed::FleetWrapper::GetInstance();
+  fleet_ptr->worker_ptr_->UnpinSparse(this->table_id_).wait();
+#endif
   if (keysize_max != 0) {
     HeterPs_->end_pass();
   }
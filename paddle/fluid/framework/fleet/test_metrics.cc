@@ -0,0 +1,356 @@
+// Copyright (c) 2022 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <map>
+#include <random>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "paddle/fluid/framework/fleet/metrics.h"
+#include "paddle/fluid/framework/lod_tensor.h"
+#include "paddle/fluid/framework/scope.h"
+
+#if defined(PADDLE_WITH_PSLIB) || defined(PADDLE_WITH_PSCORE) || \
+    defined(PADDLE_WITH_BOX_PS)
+namespace paddle {
+namespace framework {
+
+static void MakeBatch(std::mt19937* engine,
+                      int batch_size,
+                      std::vector<float>* pred,
+                      std::vector<int64_t>* label) {
+  std::uniform_real_distribution<float> uniform(0, 1);
+  pred->resize(batch_size);
+  label->resize(batch_size);
+  for (int i = 0; i < batch_size; ++i) {
+    (*pred)[i] = uniform(*engine);
+    (*label)[i] = uniform(*engine) < (*pred)[i] ? 1 : 0;
+  }
+  (*pred)[0] = 1.0f;
+}
+
+static void ExpectSameMetrics(BasicAucCalculator* lhs,
+                              BasicAucCalculator* rhs) {
+  EXPECT_NEAR(lhs->auc(), rhs->auc(), 1e-9);
+  EXPECT_NEAR(lhs->mae(), rhs->mae(), 1e-9);
+  EXPECT_NEAR(lhs->rmse(), rhs->rmse(), 1e-9);
+  EXPECT_NEAR(lhs->actual_ctr(), rhs->actual_ctr(), 1e-9);
+  EXPECT_NEAR(lhs->predicted_ctr(), rhs->predicted_ctr(), 1e-9);
+  EXPECT_NEAR(lhs->bucket_error(), rhs->bucket_error(), 1e-9);
+  EXPECT_EQ(lhs->size(), rhs->size());
+}
+
+// batches added by many threads at once count as the same samples added one
+// by one
+TEST(BasicAucCalculator, ThreadShards) {
+  const int thread_num = 8;
+  const int batch_num = 50;
+  const int batch_size = 1000;
+  std::vector<std::vector<float>> preds(thread_num * batch_num);
+  std::vector<std::vector<int64_t>> labels(thread_num * batch_num);
+  std::mt19937 engine(0);
+  for (size_t i = 0; i < preds.size(); ++i) {
+    MakeBatch(&engine, batch_size, &preds[i], &labels[i]);
+  }
+
+  BasicAucCalculator sharded;
+  sharded.init(100000);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < thread_num; ++t) {
+    threads.emplace_back([&, t]() {
+      for (int b = 0; b < batch_num; ++b) {
+        int i = t * batch_num + b;
+        sharded.add_data(preds[i].data(),
+                         labels[i].data(),
+                         batch_size,
+                         platform::CPUPlace());
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  sharded.compute();
+
+  BasicAucCalculator expected;
+  expected.init(100000);
+  for (size_t i = 0; i < preds.size(); ++i) {
+    for (int j = 0; j < batch_size; ++j) {
+      // a pred of 1 goes to the last bucket
+      double pred = preds[i][j] == 1.0f ? 0.999995 : preds[i][j];
+      expected.add_unlock_data(pred, labels[i][j]);
+    }
+  }
+  expected.compute();
+  EXPECT_EQ(sharded.size(), thread_num * batch_num * batch_size);
+  EXPECT_GT(sharded.auc(), 0.7);
+  EXPECT_NEAR(sharded.auc(), expected.auc(), 1e-9);
+  EXPECT_NEAR(sharded.actual_ctr(), expected.actual_ctr(), 1e-9);
+  EXPECT_NEAR(sharded.bucket_error(), expected.bucket_error(), 1e-9);
+
+  // nothing is left of the shards after a reset
+  sharded.reset();
+  sharded.compute();
+  EXPECT_EQ(sharded.size(), 0);
+}
+
+TEST(BasicAucCalculator, MaskAndSampleScale) {
+  std::mt19937 engine(1);
+  std::vector<float> pred;
+  std::vector<int64_t> label;
+  MakeBatch(&engine, 3000, &pred, &label);
+  pred[0] = 0.5f;
+  std::vector<int64_t> mask(pred.size());
+  std::vector<float> scale(pred.size());
+  std::vector<float> float_label(pred.size());
+  for (size_t i = 0; i < pred.size(); ++i) {
+    mask[i] = i % 3 != 0;
+    scale[i] = 0.5f + i % 4;
+    float_label[i] = label[i];
+  }
+
+  BasicAucCalculator masked;
+  masked.init(1000);
+  masked.add_mask_data(pred.data(), label.data(), mask.data(), pred.size(),
+                       platform::CPUPlace());
+  masked.compute();
+  BasicAucCalculator float_masked;
+  float_masked.init(1000);
+  float_masked.add_float_mask_data(pred.data(), float_label.data(),
+                                   mask.data(), pred.size(),
+                                   platform::CPUPlace());
+  float_masked.compute();
+  BasicAucCalculator scaled;
+  scaled.init(1000);
+  scaled.add_sample_data(pred.data(), label.data(), scale, pred.size(),
+                         platform::CPUPlace());
+  scaled.compute();
+
+  BasicAucCalculator expected_masked;
+  expected_masked.init(1000);
+  BasicAucCalculator expected_scaled;
+  expected_scaled.init(1000);
+  for (size_t i = 0; i < pred.size(); ++i) {
+    if (mask[i]) {
+      expected_masked.add_unlock_data(pred[i], label[i]);
+    }
+    expected_scaled.add_unlock_data(pred[i], label[i], scale[i]);
+  }
+  expected_masked.compute();
+  expected_scaled.compute();
+  ExpectSameMetrics(&masked, &expected_masked);
+  ExpectSameMetrics(&float_masked, &expected_masked);
+  ExpectSameMetrics(&scaled, &expected_scaled);
+}
+
+TEST(BasicAucCalculator, InvalidData) {
+  BasicAucCalculator calculator;
+  calculator.init(1000);
+  std::vector<float> pred = {0.5f, 1.5f};
+  std::vector<int64_t> label = {0, 1};
+  EXPECT_ANY_THROW(calculator.add_data(
+      pred.data(), label.data(), pred.size(), platform::CPUPlace()));
+  pred[1] = 0.5f;
+  label[1] = 2;
+  EXPECT_ANY_THROW(calculator.add_data(
+      pred.data(), label.data(), pred.size(), platform::CPUPlace()));
+  // masked out samples are not checked
+  std::vector<int64_t> mask = {1, 0};
+  calculator.add_mask_data(pred.data(), label.data(), mask.data(),
+                           pred.size(), platform::CPUPlace());
+  calculator.compute();
+  EXPECT_EQ(calculator.size(), 1);
+}
+
+// the auc of every user counted over its pairs, ties count half
+TEST(BasicAucCalculator, WuAuc) {
+  std::mt19937 engine(1);
+  std::vector<float> pred;
+  std::vector<int64_t> label;
+  std::vector<int64_t> uid;
+  BasicAucCalculator calculator;
+  calculator.init(1000);
+  calculator.reset_records();
+  std::map<int64_t, std::vector<std::pair<float, int64_t>>> users;
+  for (int batch = 0; batch < 20; ++batch) {
+    MakeBatch(&engine, 500, &pred, &label);
+    uid.resize(pred.size());
+    for (size_t i = 0; i < pred.size(); ++i) {
+      // coarse preds for ties, and a few users with one label only
+      pred[i] = static_cast<int>(pred[i] * 20) / 20.0f;
+      uid[i] = engine() % 300;
+      if (uid[i] < 10) {
+        label[i] = 1;
+      }
+      users[uid[i]].emplace_back(pred[i], label[i]);
+    }
+    calculator.add_uid_data(pred.data(), label.data(), uid.data(),
+                            pred.size(), platform::CPUPlace());
+  }
+  calculator.computeWuAuc();
+
+  double user_cnt = 0;
+  double size = 0;
+  double uauc = 0;
+  double wuauc = 0;
+  for (auto& user : users) {
+    double pos = 0;
+    double neg = 0;
+    double area = 0;
+    for (auto& lhs : user.second) {
+      if (lhs.second != 1) {
+        neg += 1;
+        continue;
+      }
+      pos += 1;
+      for (auto& rhs : user.second) {
+        if (rhs.second != 1) {
+          area += lhs.first > rhs.first ? 1 : (lhs.first == rhs.first ? 0.5 : 0);
+        }
+      }
+    }
+    if (pos > 0 && neg > 0) {
+      user_cnt += 1;
+      size += pos + neg;
+      uauc += area / (pos * neg);
+      wuauc += area / (pos * neg) * (pos + neg);
+    }
+  }
+  EXPECT_EQ(calculator.user_cnt(), user_cnt);
+  EXPECT_EQ(calculator.size(), size);
+  EXPECT_NEAR(calculator.uauc(), uauc, 1e-6);
+  EXPECT_NEAR(calculator.wuauc(), wuauc, 1e-6);
+}
+
+// the continue label state comes with the first continue sample, and the
+// order ratio of the pairs sampled past the capacity of a bucket holds
+TEST(BasicAucCalculator, ContinueLabel) {
+  BasicAucCalculator calculator;
+  calculator.init(1000);
+  auto errors = calculator.continue_bucket_error();
+  ASSERT_EQ(errors.size(), 100u);
+  EXPECT_EQ(errors[0], std::vector<double>(6, 0.0));
+
+  std::mt19937 engine(2);
+  std::uniform_real_distribution<float> uniform(0, 10);
+  const int batch_size = 1000;
+  std::vector<float> pred(batch_size);
+  std::vector<float> label(batch_size);
+  std::vector<int64_t> mask(batch_size, 1);
+  double abserr[2] = {0, 0};
+  double count[2] = {0, 0};
+  for (int batch = 0; batch < 30; ++batch) {
+    for (int i = 0; i < batch_size; ++i) {
+      label[i] = uniform(engine);
+      pred[i] = label[i] + uniform(engine) - 5;
+      abserr[label[i] >= 5] += std::fabs(pred[i] - label[i]);
+      count[label[i] >= 5] += 1;
+    }
+    calculator.add_continue_mask_data(pred.data(), label.data(), mask.data(),
+                                      batch_size, platform::CPUPlace(), "5",
+                                      false, batch % 10 == 9);
+  }
+  calculator.computeContinueMsg();
+  errors = calculator.continue_bucket_error();
+  for (int bucket = 0; bucket < 2; ++bucket) {
+    EXPECT_EQ(errors[bucket][4], count[bucket]);
+    EXPECT_NEAR(errors[bucket][0], abserr[bucket] / count[bucket], 1e-4);
+    // pred grows with label by half of the spread of the noise
+    EXPECT_GT(errors[bucket][5], 0.55);
+    EXPECT_LT(errors[bucket][5], 0.85);
+  }
+  EXPECT_EQ(errors[2][4], 0);
+  EXPECT_EQ(calculator.size(), count[0] + count[1]);
+}
+
+template <typename T>
+static void SetVar(Scope* scope,
+                   const std::string& name,
+                   const std::vector<T>& values) {
+  auto* tensor = scope->Var(name)->GetMutable<LoDTensor>();
+  tensor->Resize(phi::make_ddim({static_cast<int64_t>(values.size()), 1}));
+  T* data = tensor->mutable_data<T>(platform::CPUPlace());
+  std::copy(values.begin(), values.end(), data);
+}
+
+// the batches added by the consumer threads give the metrics of the ones
+// added inline, though the worker scope changes right after AddData
+TEST(Metric, AsyncAddData) {
+  Metric inline_metric;
+  Metric async_metric;
+  for (auto* metric : {&inline_metric, &async_metric}) {
+    metric->InitMetric(
+        "AucCalculator", "auc", "label", "pred", "", "", "", 1, "", false,
+        1000);
+    metric->InitMetric(
+        "MaskAucCalculator", "mask_auc", "label", "pred", "", "mask", "", 1,
+        "", false, 1000);
+    metric->InitMetric(
+        "WuAucCalculator", "wuauc", "label", "pred", "", "", "uid", 1, "",
+        false, 1000);
+  }
+  async_metric.SetAsync(2, 3);
+
+  Scope scope;
+  std::mt19937 engine(2);
+  std::vector<float> pred;
+  std::vector<int64_t> label;
+  std::vector<int64_t> mask;
+  std::vector<int64_t> uid;
+  for (int batch = 0; batch < 200; ++batch) {
+    MakeBatch(&engine, 256, &pred, &label);
+    mask.resize(pred.size());
+    uid.resize(pred.size());
+    for (size_t i = 0; i < pred.size(); ++i) {
+      mask[i] = engine() % 2;
+      uid[i] = engine() % 20;
+    }
+    SetVar(&scope, "pred", pred);
+    SetVar(&scope, "label", label);
+    SetVar(&scope, "mask", mask);
+    SetVar(&scope, "uid", uid);
+    inline_metric.AddData(&scope, platform::CPUPlace());
+    async_metric.AddData(&scope, platform::CPUPlace());
+  }
+  for (auto& name : {"auc", "mask_auc"}) {
+    auto expected = inline_metric.GetMetricMsg(name);
+    auto values = async_metric.GetMetricMsg(name);
+    EXPECT_EQ(values[7], expected[7]);
+    for (size_t i = 0; i < values.size(); ++i) {
+      EXPECT_NEAR(values[i], expected[i], 1e-5) << name << " " << i;
+    }
+  }
+  auto expected = inline_metric.GetWuAucMetricMsg("wuauc");
+  auto values = async_metric.GetWuAucMetricMsg("wuauc");
+  for (size_t i = 0; i < values.size(); ++i) {
+    EXPECT_NEAR(values[i], expected[i], 1e-5) << i;
+  }
+
+  // a missing variable fails in AddData, a bad value at the next flush
+  Scope empty_scope;
+  EXPECT_ANY_THROW(async_metric.AddData(&empty_scope, platform::CPUPlace()));
+  pred[0] = 2.0f;
+  SetVar(&scope, "pred", pred);
+  async_metric.AddData(&scope, platform::CPUPlace());
+  EXPECT_ANY_THROW(async_metric.FlushAsyncData());
+  async_metric.FlushAsyncData();
+}
+
+}  // namespace framework
+}  // namespace paddle
+#endif
@@ -0,0 +1,175 @@
+// Copyright (c) 2022 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Throughput of the MergeByInsId merge over synthetic records. Compares the
+// single thread sort by ins_id string the merge used to start with, against
+// InsIdMerger with one thread and with --thread_num threads.
+//   ./ins_id_merge_benchmark --ins_num=1000000 --dup_ratio=0.5 --max_dup=3
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>  // NOLINT
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "gflags/gflags.h"
+#include "glog/logging.h"
+#include "paddle/fluid/framework/ins_id_merger.h"
+
+DEFINE_int64(ins_num, 1000000, "Instances after merging.");
+DEFINE_double(dup_ratio,
+              0.5,
+              "Ratio of instances read as more than one record.");
+DEFINE_int32(max_dup, 3, "Max records of a duplicated instance, at least 2.");
+DEFINE_int32(sparse_slots, 20, "Sparse slots of an instance.");
+DEFINE_int32(feasigns_per_slot, 2, "uint64 feasigns per sparse slot.");
+DEFINE_int32(input_num, 8, "Inputs, the output channels of the dataset.");
+DEFINE_int32(thread_num, 8, "Threads of the parallel merge.");
+DEFINE_int32(partition_num, 0, "Partitions, 4 * thread_num if 0.");
+DEFINE_string(ins_id_prefix,
+              "20221016_search_",
+              "Common prefix of the ins_ids, as with date or source tags.");
+DEFINE_int32(repeat, 3, "Timed runs, the best is reported.");
+
+namespace paddle {
+namespace framework {
+
+static std::vector<std::vector<Record>> MakeInputs(uint64_t* record_num) {
+  std::default_random_engine engine(0);
+  std::uniform_real_distribution<double> uniform(0.0, 1.0);
+  std::vector<Record> records;
+  for (int64_t i = 0; i < FLAGS_ins_num; ++i) {
+    int parts = 1;
+    if (uniform(engine) < FLAGS_dup_ratio) {
+      parts = 2 + engine() % (std::max(FLAGS_max_dup, 2) - 1);
+    }
+    char ins_id[32];
+    snprintf(ins_id,
+             sizeof(ins_id),
+             "%016llx",
+             static_cast<unsigned long long>(  // NOLINT
+                 (static_cast<uint64_t>(engine()) << 32) ^ engine()));
+    // the sparse slots are split between the parts
+    for (int k = 0; k < parts; ++k) {
+      Record r;
+      r.ins_id_ = FLAGS_ins_id_prefix + ins_id;
+      for (int slot = k; slot < FLAGS_sparse_slots; slot += parts) {
+        for (int f = 0; f < FLAGS_feasigns_per_slot; ++f) {
+          FeatureFeasign sign;
+          sign.uint64_feasign_ = (static_cast<uint64_t>(engine()) << 32) ^
+                                 engine();
+          r.uint64_feasigns_.emplace_back(sign, slot);
+        }
+      }
+      records.push_back(std::move(r));
+    }
+  }
+  // the parts of an instance come from different trainers
+  std::shuffle(records.begin(), records.end(), engine);
+  *record_num = records.size();
+  std::vector<std::vector<Record>> inputs(FLAGS_input_num);
+  for (size_t i = 0; i < records.size(); ++i) {
+    inputs[i % FLAGS_input_num].push_back(std::move(records[i]));
+  }
+  return inputs;
+}
+
+static double Seconds(std::chrono::steady_clock::time_point begin) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                       begin)
+      .count();
+}
+
+static double RunStringSort(const std::vector<std::vector<Record>>& inputs) {
+  std::vector<Record> recs;
+  for (auto& input : inputs) {
+    recs.insert(recs.end(), input.begin(), input.end());
+  }
+  auto begin = std::chrono::steady_clock::now();
+  std::sort(recs.begin(), recs.end(), [](const Record& a, const Record& b) {
+    return a.ins_id_ < b.ins_id_;
+  });
+  return Seconds(begin);
+}
+
+static double RunMerger(const std::vector<std::vector<Record>>& inputs,
+                        int thread_num,
+                        int partition_num,
+                        uint64_t* merged_num) {
+  std::vector<std::string> use_slots;
+  for (int i = 0; i < FLAGS_sparse_slots; ++i) {
+    use_slots.push_back("slot_" + std::to_string(i));
+  }
+  std::vector<bool> is_dense(FLAGS_sparse_slots, false);
+  InsIdMerger merger(use_slots, is_dense, 0);
+  auto copy = inputs;
+  std::atomic<uint64_t> num{0};
+  auto begin = std::chrono::steady_clock::now();
+  uint64_t drop = merger.Merge(
+      &copy, partition_num, thread_num, [&num](int, std::vector<Record>* r) {
+        num += r->size();
+      });
+  double seconds = Seconds(begin);
+  CHECK(drop == 0) << "unexpected drop " << drop;
+  *merged_num = num;
+  return seconds;
+}
+
+static void Run() {
+  uint64_t record_num = 0;
+  auto inputs = MakeInputs(&record_num);
+  printf("instances %lld, records %llu, dup_ratio %.2f, max_dup %d\n",
+         static_cast<long long>(FLAGS_ins_num),        // NOLINT
+         static_cast<unsigned long long>(record_num),  // NOLINT
+         FLAGS_dup_ratio,
+         FLAGS_max_dup);
+  int partition_num =
+      FLAGS_partition_num > 0 ? FLAGS_partition_num : 4 * FLAGS_thread_num;
+
+  double sort_best = 1e30;
+  double one_best = 1e30;
+  double parallel_best = 1e30;
+  uint64_t merged_num = 0;
+  for (int i = 0; i < FLAGS_repeat; ++i) {
+    sort_best = std::min(sort_best, RunStringSort(inputs));
+    one_best = std::min(one_best, RunMerger(inputs, 1, 1, &merged_num));
+    CHECK(merged_num == static_cast<uint64_t>(FLAGS_ins_num));
+    parallel_best = std::min(
+        parallel_best,
+        RunMerger(inputs, FLAGS_thread_num, partition_num, &merged_num));
+    CHECK(merged_num == static_cast<uint64_t>(FLAGS_ins_num));
+  }
+  printf("string sort only, 1 thread:   %8.3f s  %8.2f M records/s\n",
+         sort_best,
+         record_num / sort_best / 1e6);
+  printf("InsIdMerger, 1 thread:        %8.3f s  %8.2f M records/s\n",
+         one_best,
+         record_num / one_best / 1e6);
+  printf("InsIdMerger, %3d threads:     %8.3f s  %8.2f M records/s\n",
+         FLAGS_thread_num,
+         parallel_best,
+         record_num / parallel_best / 1e6);
+}
+
+}  // namespace framework
+}  // namespace paddle
+
+int main(int argc, char* argv[]) {
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  google::InitGoogleLogging(argv[0]);
+  paddle::framework::Run();
+  return 0;
+}
@@ -0,0 +1,288 @@
+// Copyright (c) 2022 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "paddle/fluid/framework/ins_id_merger.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <thread>  // NOLINT
+#include <unordered_map>
+
+#include "glog/logging.h"
+#include "xxhash.h"  // NOLINT
+
+namespace paddle {
+namespace framework {
+
+InsIdMerger::InsIdMerger(const std::vector<std::string>& use_slots,
+                         const std::vector<bool>& use_slots_is_dense,
+                         size_t merge_size)
+    : use_slots_(use_slots),
+      use_slots_is_dense_(use_slots_is_dense),
+      merge_size_(merge_size) {
+  has_dense_ = std::find(use_slots_is_dense_.begin(),
+                         use_slots_is_dense_.end(),
+                         true) != use_slots_is_dense_.end();
+}
+
+uint64_t InsIdMerger::Merge(std::vector<std::vector<Record>>* inputs,
+                            int partition_num,
+                            int thread_num,
+                            const OutputFunc& output) {
+  CHECK(partition_num > 0 && thread_num > 0);  // NOLINT
+  // bucket of thread t and partition p at t * partition_num + p, the hash
+  // of each record is kept beside it
+  std::vector<std::vector<Record>> buckets(thread_num * partition_num);
+  std::vector<std::vector<uint64_t>> hashes(thread_num * partition_num);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < thread_num; ++t) {
+    threads.emplace_back([&, t] {
+      size_t slice_num = 0;
+      for (auto& input : *inputs) {
+        slice_num += input.size() / thread_num + 1;
+      }
+      // growing the buckets would move every record again
+      size_t reserve = slice_num / partition_num * 9 / 8 + 16;
+      for (int p = 0; p < partition_num; ++p) {
+        buckets[t * partition_num + p].reserve(reserve);
+        hashes[t * partition_num + p].reserve(reserve);
+      }
+      for (auto& input : *inputs) {
+        size_t begin = input.size() * t / thread_num;
+        size_t end = input.size() * (t + 1) / thread_num;
+        for (size_t i = begin; i < end; ++i) {
+          const std::string& ins_id = input[i].ins_id_;
+          uint64_t hash = XXH64(ins_id.data(), ins_id.length(), 0);
+          // the high bits pick the partition, sorting is on the whole hash
+          size_t b = t * partition_num + (hash >> 32) % partition_num;
+          buckets[b].push_back(std::move(input[i]));
+          hashes[b].push_back(hash);
+        }
+      }
+    });
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+  threads.clear();
+  for (auto& input : *inputs) {
+    std::vector<Record>().swap(input);
+  }
+
+  std::atomic<int> next_partition{0};
+  std::atomic<uint64_t> drop_ins_num{0};
+  for (int t = 0; t < thread_num; ++t) {
+    threads.emplace_back([&] {
+      std::vector<Record*> recs;
+      std::vector<Key> keys;
+      std::vector<Record> results;
+      for (int p = next_partition++; p < partition_num;
+           p = next_partition++) {
+        size_t num = 0;
+        for (int i = 0; i < thread_num; ++i) {
+          num += buckets[i * partition_num + p].size();
+        }
+        recs.clear();
+        keys.clear();
+        recs.reserve(num);
+        keys.reserve(num);
+        for (int i = 0; i < thread_num; ++i) {
+          auto& bucket = buckets[i * partition_num + p];
+          const auto& hash = hashes[i * partition_num + p];
+          for (size_t k = 0; k < bucket.size(); ++k) {
+            keys.push_back(Key{hash[k], recs.size()});
+            recs.push_back(&bucket[k]);
+          }
+        }
+        results.clear();
+        results.reserve(num);
+        drop_ins_num += MergePartition(&recs, &keys, &results);
+        for (int i = 0; i < thread_num; ++i) {
+          std::vector<Record>().swap(buckets[i * partition_num + p]);
+          std::vector<uint64_t>().swap(hashes[i * partition_num + p]);
+        }
+        output(p, &results);
+      }
+    });
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+  return drop_ins_num;
+}
+
+uint64_t InsIdMerger::MergePartition(const std::vector<Record*>* recs,
+                                     std::vector<Key>* keys,
+                                     std::vector<Record>* results) {
+  // a group is merged in input order: content_ comes from its first record
+  // and the feasigns follow the order of the records. The merged records
+  // have no order, MergeByInsId shuffles each partition before writing it.
+  std::sort(keys->begin(), keys->end(), [recs](const Key& a, const Key& b) {
+    if (a.hash != b.hash) {
+      return a.hash < b.hash;
+    }
+    int cmp = (*recs)[a.index]->ins_id_.compare((*recs)[b.index]->ins_id_);
+    return cmp != 0 ? cmp < 0 : a.index < b.index;
+  });
+  auto rec_at = [recs, keys](size_t k) -> Record& {
+    return *(*recs)[(*keys)[k].index];
+  };
+
+  uint64_t drop_ins_num = 0;
+  // the record of the group, plus one, that has each sparse slot
+  std::vector<size_t> uint64_owner(use_slots_.size(), 0);
+  std::vector<size_t> float_owner(use_slots_.size(), 0);
+  std::vector<uint16_t> owned_slots;
+  std::unordered_map<uint16_t, std::vector<FeatureItem>> all_dense_uint64;
+  std::unordered_map<uint16_t, std::vector<FeatureItem>> all_dense_float;
+  std::unordered_map<uint16_t, std::vector<FeatureItem>> local_dense_uint64;
+  std::unordered_map<uint16_t, std::vector<FeatureItem>> local_dense_float;
+  std::unordered_map<uint16_t, bool> dense_empty;
+
+  for (size_t i = 0; i < keys->size();) {
+    size_t j = i + 1;
+    while (j < keys->size() && (*keys)[j].hash == (*keys)[i].hash &&
+           rec_at(j).ins_id_ == rec_at(i).ins_id_) {
+      j++;
+    }
+    if (merge_size_ > 0 && j - i != merge_size_) {
+      drop_ins_num += j - i;
+      LOG(WARNING) << "drop ins " << rec_at(i).ins_id_ << " size=" << j - i
+                   << ", because merge_size=" << merge_size_;
+      i = j;
+      continue;
+    }
+
+    // a single record has no slot to merge, keep its feasigns as they are
+    if (j - i == 1 && !has_dense_) {
+      Record rec;
+      rec.ins_id_ = std::move(rec_at(i).ins_id_);
+      rec.content_ = std::move(rec_at(i).content_);
+      rec.uint64_feasigns_ = std::move(rec_at(i).uint64_feasigns_);
+      rec.float_feasigns_ = std::move(rec_at(i).float_feasigns_);
+      results->push_back(std::move(rec));
+      i = j;
+      continue;
+    }
+
+    all_dense_uint64.clear();
+    all_dense_float.clear();
+    bool has_conflict_slot = false;
+    uint16_t conflict_slot = 0;
+
+    Record rec;
+    rec.ins_id_ = rec_at(i).ins_id_;
+    rec.content_ = rec_at(i).content_;
+
+    for (size_t k = i; has_dense_ && k < j; k++) {
+      dense_empty.clear();
+      local_dense_uint64.clear();
+      local_dense_float.clear();
+      for (auto& feature : rec_at(k).uint64_feasigns_) {
+        uint16_t slot = feature.slot();
+        if (!use_slots_is_dense_[slot]) {
+          continue;
+        }
+        local_dense_uint64[slot].push_back(feature);
+        if (feature.sign().uint64_feasign_ != 0) {
+          dense_empty[slot] = false;
+        } else if (dense_empty.find(slot) == dense_empty.end() &&
+                   all_dense_uint64.find(slot) == all_dense_uint64.end()) {
+          dense_empty[slot] = true;
+        }
+      }
+      for (auto& feature : rec_at(k).float_feasigns_) {
+        uint16_t slot = feature.slot();
+        if (!use_slots_is_dense_[slot]) {
+          continue;
+        }
+        local_dense_float[slot].push_back(feature);
+        if (fabs(feature.sign().float_feasign_) >= 1e-6) {
+          dense_empty[slot] = false;
+        } else if (dense_empty.find(slot) == dense_empty.end() &&
+                   all_dense_float.find(slot) == all_dense_float.end()) {
+          dense_empty[slot] = true;
+        }
+      }
+      for (auto& p : dense_empty) {
+        if (local_dense_uint64.find(p.first) != local_dense_uint64.end()) {
+          all_dense_uint64[p.first] = std::move(local_dense_uint64[p.first]);
+        } else if (local_dense_float.find(p.first) != local_dense_float.end()) {
+          all_dense_float[p.first] = std::move(local_dense_float[p.first]);
+        }
+      }
+    }
+    for (auto& f : all_dense_uint64) {
+      rec.uint64_feasigns_.insert(
+          rec.uint64_feasigns_.end(), f.second.begin(), f.second.end());
+    }
+    for (auto& f : all_dense_float) {
+      rec.float_feasigns_.insert(
+          rec.float_feasigns_.end(), f.second.begin(), f.second.end());
+    }
+
+    for (size_t k = i; k < j && !has_conflict_slot; k++) {
+      for (auto& feature : rec_at(k).uint64_feasigns_) {
+        uint16_t slot = feature.slot();
+        if (use_slots_is_dense_[slot]) {
+          continue;
+        } else if (uint64_owner[slot] == 0) {
+          uint64_owner[slot] = k + 1;
+          owned_slots.push_back(slot);
+        } else if (uint64_owner[slot] != k + 1) {
+          has_conflict_slot = true;
+          conflict_slot = slot;
+          break;
+        }
+        rec.uint64_feasigns_.push_back(std::move(feature));
+      }
+      if (has_conflict_slot) {
+        break;
+      }
+      for (auto& feature : rec_at(k).float_feasigns_) {
+        uint16_t slot = feature.slot();
+        if (use_slots_is_dense_[slot]) {
+          continue;
+        } else if (float_owner[slot] == 0) {
+          float_owner[slot] = k + 1;
+          owned_slots.push_back(slot);
+        } else if (float_owner[slot] != k + 1) {
+          has_conflict_slot = true;
+          conflict_slot = slot;
+          break;
+        }
+        rec.float_feasigns_.push_back(std::move(feature));
+      }
+    }
+    for (uint16_t slot : owned_slots) {
+      uint64_owner[slot] = 0;
+      float_owner[slot] = 0;
+    }
+    owned_slots.clear();
+
+    if (has_conflict_slot) {
+      LOG(WARNING) << "drop ins " << rec_at(i).ins_id_ << " size=" << j - i
+                   << ", because conflict_slot=" << use_slots_[conflict_slot];
+      drop_ins_num += j - i;
+    } else {
+      results->push_back(std::move(rec));
+    }
+    i = j;
+  }
+  return drop_ins_num;
+}
+
+}  // namespace framework
+}  // namespace paddle
@@ -0,0 +1,74 @@
+// Copyright (c) 2022 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "paddle/fluid/framework/data_feed.h"
+
+namespace paddle {
+namespace framework {
+
+// InsIdMerger merges the records sharing an ins_id into one record, the
+// merge step of MultiSlotDataset::MergeByInsId.
+//   - Records are moved into partition_num partitions by the XXH64 hash of
+//     their ins_id, each thread taking a slice of every input.
+//   - Each partition is sorted by (hash, ins_id) on its own thread, ins_ids
+//     are only compared when hashes are equal, and the runs of equal ins_id
+//     are merged.
+//   - The merged records of a partition are handed to output on the thread
+//     that merged them, e.g. to write them into an output channel.
+// A group is dropped if its size is not merge_size (when merge_size > 0), or
+// if two of its records have the same sparse slot. For a dense slot the
+// feasigns of the last record where the slot is not all zero are kept.
+class InsIdMerger {
+ public:
+  typedef std::function<void(int partition, std::vector<Record>* merged)>
+      OutputFunc;
+
+  // use_slots and use_slots_is_dense are indexed by the slot of FeatureItem
+  InsIdMerger(const std::vector<std::string>& use_slots,
+              const std::vector<bool>& use_slots_is_dense,
+              size_t merge_size);
+
+  // inputs are left empty, returns the number of dropped records
+  uint64_t Merge(std::vector<std::vector<Record>>* inputs,
+                 int partition_num,
+                 int thread_num,
+                 const OutputFunc& output);
+
+ private:
+  struct Key {
+    uint64_t hash;
+    size_t index;
+  };
+
+  // recs point to the records of the partition in the buckets, in input
+  // order
+  uint64_t MergePartition(const std::vector<Record*>* recs,
+                          std::vector<Key>* keys,
+                          std::vector<Record>* results);
+
+  std::vector<std::string> use_slots_;
+  std::vector<bool> use_slots_is_dense_;
+  size_t merge_size_;
+  bool has_dense_;
+};
+
+}  // namespace framework
+}  // namespace paddle
@@ -0,0 +1,172 @@
+// Copyright (c) 2022 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "paddle/fluid/framework/ins_id_merger.h"
+
+#include <algorithm>
+#include <map>
+#include <mutex>  // NOLINT
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace paddle {
+namespace framework {
+
+// slots 0-5 are sparse, 6 is a dense uint64 slot
+static const int kDenseSlot = 6;
+
+static FeatureItem MakeItem(uint64_t value, uint16_t slot) {
+  FeatureFeasign sign;
+  sign.uint64_feasign_ = value;
+  return FeatureItem(sign, slot);
+}
+
+// instance i is split into i % 3 + 1 records spread over the inputs, part k
+// has sparse slot 2 * k. The dense slot is zero except in the last part.
+static std::vector<std::vector<Record>> MakeInputs(int ins_num,
+                                                  int input_num) {
+  std::vector<std::vector<Record>> inputs(input_num);
+  int n = 0;
+  for (int i = 0; i < ins_num; ++i) {
+    int parts = i % 3 + 1;
+    for (int k = 0; k < parts; ++k) {
+      Record r;
+      r.ins_id_ = "ins_" + std::to_string(i);
+      r.uint64_feasigns_.push_back(MakeItem(i * 100 + k, 2 * k));
+      r.uint64_feasigns_.push_back(MakeItem(i * 100 + k + 50, 2 * k));
+      r.uint64_feasigns_.push_back(
+          MakeItem(k + 1 == parts && parts > 1 ? i : 0, kDenseSlot));
+      inputs[n++ % input_num].push_back(std::move(r));
+    }
+  }
+  return inputs;
+}
+
+static std::map<std::string, Record> RunMerge(
+    InsIdMerger* merger,
+    std::vector<std::vector<Record>>* inputs,
+    int partition_num,
+    int thread_num,
+    uint64_t* drop_ins_num) {
+  std::map<std::string, Record> merged;
+  std::mutex mutex;
+  *drop_ins_num = merger->Merge(
+      inputs,
+      partition_num,
+      thread_num,
+      [&](int partition, std::vector<Record>* recs) {
+        EXPECT_GE(partition, 0);
+        EXPECT_LT(partition, partition_num);
+        std::lock_guard<std::mutex> lock(mutex);
+        for (auto& r : *recs) {
+          EXPECT_EQ(merged.count(r.ins_id_), 0UL) << r.ins_id_;
+          merged[r.ins_id_] = std::move(r);
+        }
+      });
+  for (auto& input : *inputs) {
+    EXPECT_TRUE(input.empty());
+  }
+  return merged;
+}
+
+TEST(InsIdMerger, Merge) {
+  std::vector<std::string> use_slots = {"s0", "s1", "s2", "s3", "s4", "s5",
+                                        "d6"};
+  std::vector<bool> is_dense = {false, false, false, false, false, false, true};
+  InsIdMerger merger(use_slots, is_dense, 0);
+  const int ins_num = 600;
+  for (int thread_num : {1, 4}) {
+    for (int partition_num : {1, 13}) {
+      auto inputs = MakeInputs(ins_num, 3);
+      uint64_t drop_ins_num = 0;
+      auto merged =
+          RunMerge(&merger, &inputs, partition_num, thread_num, &drop_ins_num);
+      EXPECT_EQ(drop_ins_num, 0UL);
+      ASSERT_EQ(merged.size(), static_cast<size_t>(ins_num));
+      for (int i = 0; i < ins_num; ++i) {
+        const Record& r = merged["ins_" + std::to_string(i)];
+        int parts = i % 3 + 1;
+        std::vector<uint64_t> sparse;
+        std::vector<uint64_t> dense;
+        for (auto& item : r.uint64_feasigns_) {
+          (item.slot() == kDenseSlot ? dense : sparse)
+              .push_back(item.sign().uint64_feasign_);
+        }
+        std::vector<uint64_t> expect;
+        for (int k = 0; k < parts; ++k) {
+          expect.push_back(i * 100 + k);
+          expect.push_back(i * 100 + k + 50);
+        }
+        std::sort(sparse.begin(), sparse.end());
+        std::sort(expect.begin(), expect.end());
+        EXPECT_EQ(sparse, expect) << i;
+        ASSERT_EQ(dense.size(), 1UL) << i;
+        EXPECT_EQ(dense[0], parts > 1 ? static_cast<uint64_t>(i) : 0UL) << i;
+      }
+    }
+  }
+}
+
+TEST(InsIdMerger, Drop) {
+  std::vector<std::string> use_slots = {"s0", "s1", "s2", "s3", "s4", "s5",
+                                        "d6"};
+  std::vector<bool> is_dense = {false, false, false, false, false, false, true};
+  // only the instances of two records are kept
+  InsIdMerger merger(use_slots, is_dense, 2);
+  auto inputs = MakeInputs(300, 2);
+  uint64_t drop_ins_num = 0;
+  auto merged = RunMerge(&merger, &inputs, 8, 3, &drop_ins_num);
+  EXPECT_EQ(merged.size(), 100UL);
+  EXPECT_EQ(drop_ins_num, 100UL * 1 + 100UL * 3);
+
+  // the second record of ins_1 repeats sparse slot 0
+  InsIdMerger conflict_merger(use_slots, is_dense, 0);
+  inputs = MakeInputs(3, 1);
+  for (auto& r : inputs[0]) {
+    if (r.ins_id_ == "ins_1" && r.uint64_feasigns_[0].slot() != 0) {
+      r.uint64_feasigns_.push_back(MakeItem(7, 0));
+    }
+  }
+  merged = RunMerge(&conflict_merger, &inputs, 2, 2, &drop_ins_num);
+  EXPECT_EQ(merged.size(), 2UL);
+  EXPECT_EQ(merged.count("ins_1"), 0UL);
+  EXPECT_EQ(drop_ins_num, 2UL);
+}
+
+TEST(InsIdMerger, SparseOnly) {
+  std::vector<std::string> use_slots = {"s0", "s1", "s2", "s3", "s4", "s5"};
+  std::vector<bool> is_dense(use_slots.size(), false);
+  InsIdMerger merger(use_slots, is_dense, 0);
+  auto inputs = MakeInputs(90, 4);
+  for (auto& input : inputs) {
+    for (auto& r : input) {
+      r.uint64_feasigns_.pop_back();
+      r.content_ = r.ins_id_;
+    }
+  }
+  uint64_t drop_ins_num = 0;
+  auto merged = RunMerge(&merger, &inputs, 5, 2, &drop_ins_num);
+  EXPECT_EQ(drop_ins_num, 0UL);
+  ASSERT_EQ(merged.size(), 90UL);
+  for (auto& p : merged) {
+    EXPECT_EQ(p.second.content_, p.first);
+    int i = std::stoi(p.first.substr(4));
+    EXPECT_EQ(p.second.uint64_feasigns_.size(), 2UL * (i % 3 + 1)) << i;
+  }
+}
+
+}  // namespace framework
+}  // namespace paddle
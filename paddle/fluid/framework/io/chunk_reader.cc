@@ -0,0 +1,441 @@
+// Copyright (c) 2022 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "paddle/fluid/framework/io/chunk_reader.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <exception>
+
+#include "glog/logging.h"
+#include "paddle/fluid/framework/threadpool.h"
+#include "paddle/fluid/platform/enforce.h"
+
+namespace paddle {
+namespace framework {
+
+// gzip member header up to the BSIZE of the BC extra field of BGZF
+static const size_t kBgzfHeaderSize = 18;
+// output of the blocks of a round
+static const size_t kBgzfRoundSize = 4 * 1024 * 1024;
+static const size_t kGzipInputSize = 1024 * 1024;
+static const size_t kGzipOutputSize = 4 * 1024 * 1024;
+
+static inline uint32_t ReadLittleEndian32(const char* p) {
+  const unsigned char* u = reinterpret_cast<const unsigned char*>(p);
+  return u[0] | (u[1] << 8) | (u[2] << 16) | (static_cast<uint32_t>(u[3]) << 24);
+}
+
+static bool IsBgzfHeader(const char* p, size_t len) {
+  const unsigned char* h = reinterpret_cast<const unsigned char*>(p);
+  // gzip magic, deflate, FEXTRA, then the BC subfield of 2 bytes
+  return len >= kBgzfHeaderSize && h[0] == 0x1f && h[1] == 0x8b &&
+         h[2] == 8 && (h[3] & 4) != 0 && h[12] == 'B' && h[13] == 'C' &&
+         h[14] == 2 && h[15] == 0;
+}
+
+FileChunkReader::FileChunkReader(std::shared_ptr<FILE> fp, size_t buffer_size)
+    : fp_(fp), buffer_(buffer_size) {}
+
+bool FileChunkReader::next(const char** data, size_t* len) {
+  *data = buffer_.data();
+  *len = fread(buffer_.data(), 1, buffer_.size(), fp_.get());
+  return *len > 0;
+}
+
+ReadAheadChunkReader::ReadAheadChunkReader(const std::string& path,
+                                           int buffer_num,
+                                           int thread_num,
+                                           size_t buffer_size)
+    : path_(path), buffer_size_(buffer_size) {
+  buffer_num = std::max(buffer_num, 1);
+  thread_num = std::min(std::max(thread_num, 1), buffer_num);
+  fd_ = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd_ < 0) {
+    PADDLE_THROW(platform::errors::Unavailable(
+        "Failed to open file, path[%s]: %s.", path, strerror(errno)));
+  }
+  posix_fadvise(fd_, 0, 0, POSIX_FADV_SEQUENTIAL);
+  buffers_.resize(buffer_num);
+  for (auto& buffer : buffers_) {
+    void* data = nullptr;
+    if (posix_memalign(&data, 4096, buffer_size_) != 0) {
+      for (auto& allocated : buffers_) {
+        free(allocated.data);
+      }
+      close(fd_);
+      PADDLE_THROW(platform::errors::ResourceExhausted(
+          "Failed to allocate the read ahead buffers of file[%s].", path));
+    }
+    buffer.data = reinterpret_cast<char*>(data);
+  }
+  for (int i = 0; i < thread_num; ++i) {
+    threads_.emplace_back([this]() { read_loop(); });
+  }
+}
+
+ReadAheadChunkReader::~ReadAheadChunkReader() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  issue_cond_.notify_all();
+  for (auto& thread : threads_) {
+    thread.join();
+  }
+  VLOG(3) << "read ahead file[" << path_ << "] "
+          << bytes_read() / 1024.0 / 1024.0 << " MB in " << read_seconds()
+          << " s of reads, caller stalled " << stall_seconds() << " s";
+  for (auto& buffer : buffers_) {
+    free(buffer.data);
+  }
+  close(fd_);
+}
+
+void ReadAheadChunkReader::read_loop() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true) {
+    issue_cond_.wait(lock, [this]() {
+      return stop_ || next_seq_ >= end_seq_ ||
+             next_seq_ < released_ + buffers_.size();
+    });
+    if (stop_ || next_seq_ >= end_seq_) {
+      return;
+    }
+    uint64_t seq = next_seq_++;
+    Buffer& buffer = buffers_[seq % buffers_.size()];
+    if (in_flight_++ == 0) {
+      busy_start_ = std::chrono::steady_clock::now();
+    }
+    lock.unlock();
+
+    size_t len = 0;
+    int error = 0;
+    off_t offset = static_cast<off_t>(seq * buffer_size_);
+    while (len < buffer_size_) {
+      ssize_t n = pread(fd_, buffer.data + len, buffer_size_ - len,
+                        offset + len);
+      if (n < 0 && errno == EINTR) {
+        continue;
+      }
+      if (n < 0) {
+        error = errno;
+        break;
+      }
+      if (n == 0) {
+        break;
+      }
+      len += n;
+    }
+
+    lock.lock();
+    if (--in_flight_ == 0) {
+      busy_time_ += std::chrono::steady_clock::now() - busy_start_;
+    }
+    buffer.len = len;
+    buffer.seq = seq;
+    buffer.ready = true;
+    buffer.error = error != 0 ? strerror(error) : "";
+    bytes_ += len;
+    // a short chunk is the last one of the file
+    if (error != 0 || len < buffer_size_) {
+      end_seq_ = std::min(end_seq_, seq + 1);
+    }
+    ready_cond_.notify_all();
+  }
+}
+
+bool ReadAheadChunkReader::next(const char** data, size_t* len) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  // the chunk returned last is given back
+  released_ = consume_seq_;
+  issue_cond_.notify_all();
+  Buffer& buffer = buffers_[consume_seq_ % buffers_.size()];
+  auto ready = [this, &buffer]() {
+    return buffer.ready && buffer.seq == consume_seq_;
+  };
+  if (!ready() && consume_seq_ < end_seq_) {
+    auto start = std::chrono::steady_clock::now();
+    ready_cond_.wait(
+        lock, [this, &ready]() { return ready() || consume_seq_ >= end_seq_; });
+    stall_time_ += std::chrono::steady_clock::now() - start;
+  }
+  if (!ready()) {
+    *len = 0;
+    return false;
+  }
+  buffer.ready = false;
+  ++consume_seq_;
+  if (!buffer.error.empty()) {
+    PADDLE_THROW(platform::errors::Unavailable(
+        "Failed to read file[%s]: %s.", path_, buffer.error));
+  }
+  *data = buffer.data;
+  *len = buffer.len;
+  return buffer.len > 0;
+}
+
+uint64_t ReadAheadChunkReader::bytes_read() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return bytes_;
+}
+
+double ReadAheadChunkReader::read_seconds() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto busy = busy_time_;
+  if (in_flight_ > 0) {
+    busy += std::chrono::steady_clock::now() - busy_start_;
+  }
+  return std::chrono::duration<double>(busy).count();
+}
+
+double ReadAheadChunkReader::stall_seconds() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return std::chrono::duration<double>(stall_time_).count();
+}
+
+GzipChunkReader::GzipChunkReader(std::shared_ptr<FILE> fp,
+                                 const std::string& path,
+                                 int thread_num)
+    : fp_(fp), path_(path), thread_num_(std::max(thread_num, 1)) {
+  memset(&stream_, 0, sizeof(stream_));
+  peek_.resize(kBgzfHeaderSize);
+  // a read error is sticky, read_input reports it once the peek is consumed
+  peek_.resize(fread(peek_.data(), 1, peek_.size(), fp_.get()));
+  bgzf_ = thread_num_ > 1 && IsBgzfHeader(peek_.data(), peek_.size());
+  if (bgzf_) {
+    pool_.reset(new ThreadPool(thread_num_));
+    return;
+  }
+  // 16 for the gzip wrapper
+  if (inflateInit2(&stream_, 16 + MAX_WBITS) != Z_OK) {
+    PADDLE_THROW(platform::errors::ResourceExhausted(
+        "Failed to init zlib for file[%s].", path_));
+  }
+  stream_init_ = true;
+  in_.resize(kGzipInputSize);
+  out_.resize(kGzipOutputSize);
+}
+
+GzipChunkReader::~GzipChunkReader() {
+  for (auto& round : rounds_) {
+    for (auto& task : round.tasks) {
+      task.wait();
+    }
+  }
+  if (stream_init_) {
+    inflateEnd(&stream_);
+  }
+}
+
+bool GzipChunkReader::next(const char** data, size_t* len) {
+  return bgzf_ ? next_bgzf(data, len) : next_stream(data, len);
+}
+
+size_t GzipChunkReader::read_input(char* buf, size_t len) {
+  size_t n = std::min(len, peek_.size() - peek_pos_);
+  memcpy(buf, peek_.data() + peek_pos_, n);
+  peek_pos_ += n;
+  if (n < len) {
+    n += fread(buf + n, 1, len - n, fp_.get());
+    check_input();
+  }
+  return n;
+}
+
+void GzipChunkReader::check_input() {
+  // a short read at a member boundary must not pass for the end of the file
+  if (ferror(fp_.get())) {
+    PADDLE_THROW(platform::errors::Unavailable(
+        "Failed to read gzip file[%s].", path_));
+  }
+}
+
+bool GzipChunkReader::next_stream(const char** data, size_t* len) {
+  *data = out_.data();
+  *len = 0;
+  if (eof_) {
+    return false;
+  }
+  stream_.next_out = reinterpret_cast<Bytef*>(out_.data());
+  stream_.avail_out = out_.size();
+  while (stream_.avail_out > 0) {
+    if (stream_.avail_in == 0) {
+      size_t n = read_input(in_.data(), in_.size());
+      if (n == 0) {
+        // total_in counts from the start of the member
+        if (stream_.total_in > 0) {
+          PADDLE_THROW(platform::errors::Unavailable(
+              "Unexpected end of gzip file[%s].", path_));
+        }
+        eof_ = true;
+        break;
+      }
+      stream_.next_in = reinterpret_cast<Bytef*>(in_.data());
+      stream_.avail_in = n;
+    }
+    int ret = inflate(&stream_, Z_NO_FLUSH);
+    if (ret == Z_STREAM_END) {
+      ++members_;
+      inflateReset(&stream_);
+      continue;
+    }
+    if (ret == Z_DATA_ERROR && members_ > 0 && stream_.total_out == 0) {
+      LOG(WARNING) << "trailing garbage ignored in gzip file[" << path_
+                   << "]";
+      eof_ = true;
+      break;
+    }
+    if (ret != Z_OK) {
+      PADDLE_THROW(platform::errors::Unavailable(
+          "Failed to inflate gzip file[%s]: %s.",
+          path_,
+          stream_.msg ? stream_.msg : zError(ret)));
+    }
+  }
+  *len = out_.size() - stream_.avail_out;
+  return *len > 0;
+}
+
+bool GzipChunkReader::next_bgzf(const char** data, size_t* len) {
+  if (!started_) {
+    started_ = true;
+    start_round(&rounds_[0]);
+  }
+  while (true) {
+    BgzfRound* round = &rounds_[current_];
+    wait_round(round);
+    if (round->blocks.empty()) {
+      *len = 0;
+      return false;
+    }
+    // the caller parses this round while the next one inflates
+    start_round(&rounds_[1 - current_]);
+    current_ = 1 - current_;
+    if (!round->out.empty()) {
+      *data = round->out.data();
+      *len = round->out.size();
+      return true;
+    }
+  }
+}
+
+void GzipChunkReader::start_round(BgzfRound* round) {
+  round->in.clear();
+  round->blocks.clear();
+  round->tasks.clear();
+  size_t out_size = 0;
+  char header[kBgzfHeaderSize];
+  while (!eof_ && out_size < kBgzfRoundSize) {
+    size_t n = read_input(header, kBgzfHeaderSize);
+    if (n == 0) {
+      eof_ = true;
+      break;
+    }
+    if (!IsBgzfHeader(header, n)) {
+      PADDLE_THROW(platform::errors::Unavailable(
+          "Bad BGZF block header in file[%s].", path_));
+    }
+    size_t xlen = (header[10] & 0xff) | ((header[11] & 0xff) << 8);
+    size_t block_size = ((header[16] & 0xff) | ((header[17] & 0xff) << 8)) + 1;
+    // the payload sits between the extra field and the crc and isize
+    if (block_size < 12 + xlen + 8) {
+      PADDLE_THROW(platform::errors::Unavailable(
+          "Bad BGZF block size %d in file[%s].", block_size, path_));
+    }
+    size_t offset = round->in.size();
+    round->in.resize(offset + block_size);
+    memcpy(&round->in[offset], header, kBgzfHeaderSize);
+    size_t rest = block_size - kBgzfHeaderSize;
+    if (read_input(&round->in[offset + kBgzfHeaderSize], rest) != rest) {
+      PADDLE_THROW(platform::errors::Unavailable(
+          "Unexpected end of BGZF file[%s].", path_));
+    }
+    const char* tail = &round->in[offset + block_size - 8];
+    BgzfBlock block;
+    block.in_offset = offset + 12 + xlen;
+    block.in_size = block_size - 12 - xlen - 8;
+    block.out_offset = out_size;
+    block.out_size = ReadLittleEndian32(tail + 4);
+    block.crc = ReadLittleEndian32(tail);
+    round->blocks.push_back(block);
+    out_size += block.out_size;
+  }
+  round->out.resize(out_size);
+
+  size_t block_num = round->blocks.size();
+  size_t per_task = (block_num + thread_num_ - 1) / thread_num_;
+  for (size_t begin = 0; begin < block_num; begin += per_task) {
+    size_t end = std::min(block_num, begin + per_task);
+    round->tasks.push_back(pool_->Run(
+        [this, round, begin, end]() { inflate_blocks(round, begin, end); }));
+  }
+}
+
+void GzipChunkReader::wait_round(BgzfRound* round) {
+  std::exception_ptr error = nullptr;
+  for (auto& task : round->tasks) {
+    try {
+      task.get();
+    } catch (...) {
+      if (!error) {
+        error = std::current_exception();
+      }
+    }
+  }
+  round->tasks.clear();
+  if (error) {
+    std::rethrow_exception(error);
+  }
+}
+
+void GzipChunkReader::inflate_blocks(BgzfRound* round,
+                                     size_t begin,
+                                     size_t end) {
+  z_stream stream;
+  memset(&stream, 0, sizeof(stream));
+  // raw deflate, the headers of the blocks are parsed already
+  if (inflateInit2(&stream, -MAX_WBITS) != Z_OK) {
+    PADDLE_THROW(platform::errors::ResourceExhausted(
+        "Failed to init zlib for file[%s].", path_));
+  }
+  // zlib wants an output pointer even for the empty blocks
+  char empty = 0;
+  for (size_t i = begin; i < end; ++i) {
+    const BgzfBlock& block = round->blocks[i];
+    char* out = block.out_size > 0 ? &round->out[block.out_offset] : &empty;
+    inflateReset(&stream);
+    stream.next_in = reinterpret_cast<Bytef*>(&round->in[block.in_offset]);
+    stream.avail_in = block.in_size;
+    stream.next_out = reinterpret_cast<Bytef*>(out);
+    stream.avail_out = block.out_size;
+    int ret = inflate(&stream, Z_FINISH);
+    bool ok = ret == Z_STREAM_END && stream.avail_out == 0 &&
+              crc32(0, reinterpret_cast<Bytef*>(out), block.out_size) ==
+                  block.crc;
+    if (!ok) {
+      inflateEnd(&stream);
+      PADDLE_THROW(platform::errors::Unavailable(
+          "Failed to inflate a BGZF block of file[%s].", path_));
+    }
+  }
+  inflateEnd(&stream);
+}
+
+}  // namespace framework
+}  // namespace paddle
@@ -0,0 +1,176 @@
+// Copyright (c) 2022 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <stdio.h>
+#include <zlib.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace paddle {
+namespace framework {
+
+class ThreadPool;
+
+// Reads the content of a file as a sequence of chunks. A chunk stays valid
+// until the next call of next, so that the lines in it can be parsed in place.
+class ChunkReader {
+ public:
+  virtual ~ChunkReader() {}
+  // the next chunk [*data, *data + *len), false at the end of the file
+  virtual bool next(const char** data, size_t* len) = 0;
+};
+
+// the content of a FILE as it is, read in chunks of buffer_size
+class FileChunkReader : public ChunkReader {
+ public:
+  explicit FileChunkReader(std::shared_ptr<FILE> fp,
+                           size_t buffer_size = 4 * 1024 * 1024);
+  bool next(const char** data, size_t* len) override;
+
+ private:
+  std::shared_ptr<FILE> fp_;
+  std::vector<char> buffer_;
+};
+
+// Reads a local file ahead of the caller: thread_num threads keep up to
+// buffer_num page aligned buffers in flight with pread, and next hands them
+// out in the order of the file. The bandwidth of the reads and the time the
+// caller waited for them are kept apart, to tell a slow device from a slow
+// parser.
+class ReadAheadChunkReader : public ChunkReader {
+ public:
+  ReadAheadChunkReader(const std::string& path,
+                       int buffer_num,
+                       int thread_num,
+                       size_t buffer_size = 1024 * 1024);
+  ~ReadAheadChunkReader();
+  bool next(const char** data, size_t* len) override;
+
+  uint64_t bytes_read() const;
+  // seconds with at least one read in flight
+  double read_seconds() const;
+  // seconds next waited for a buffer
+  double stall_seconds() const;
+
+ private:
+  struct Buffer {
+    char* data = nullptr;
+    size_t len = 0;
+    uint64_t seq = 0;
+    bool ready = false;
+    std::string error;
+  };
+
+  void read_loop();
+
+  std::string path_;
+  size_t buffer_size_;
+  int fd_ = -1;
+  std::vector<Buffer> buffers_;
+  std::vector<std::thread> threads_;
+
+  mutable std::mutex mutex_;
+  // readers wait for a free buffer, the caller for the next one to be read
+  std::condition_variable issue_cond_;
+  std::condition_variable ready_cond_;
+  bool stop_ = false;
+  // chunk i of the file goes to buffers_[i % buffer_num]. The chunks before
+  // released_ are given back by the caller, the file ends before end_seq_.
+  uint64_t next_seq_ = 0;
+  uint64_t consume_seq_ = 0;
+  uint64_t released_ = 0;
+  uint64_t end_seq_ = UINT64_MAX;
+
+  int in_flight_ = 0;
+  uint64_t bytes_ = 0;
+  std::chrono::steady_clock::time_point busy_start_;
+  std::chrono::steady_clock::duration busy_time_{0};
+  std::chrono::steady_clock::duration stall_time_{0};
+};
+
+// Inflates a gzip file in process. Concatenated members are read one after
+// the other, as zcat does. A BGZF file, made of members of at most 64KB that
+// carry their size in a BC extra field, is inflated by rounds of blocks on
+// thread_num threads, the next round while the caller parses the last one.
+// Corrupt or truncated data throws.
+class GzipChunkReader : public ChunkReader {
+ public:
+  GzipChunkReader(std::shared_ptr<FILE> fp,
+                  const std::string& path,
+                  int thread_num);
+  ~GzipChunkReader();
+  bool next(const char** data, size_t* len) override;
+
+  bool is_bgzf() const { return bgzf_; }
+
+ private:
+  struct BgzfBlock {
+    size_t in_offset;
+    size_t in_size;
+    size_t out_offset;
+    size_t out_size;
+    uint32_t crc;
+  };
+  struct BgzfRound {
+    std::vector<char> in;
+    std::vector<char> out;
+    std::vector<BgzfBlock> blocks;
+    std::vector<std::future<void>> tasks;
+  };
+
+  bool next_stream(const char** data, size_t* len);
+  bool next_bgzf(const char** data, size_t* len);
+  // reads the blocks of a round and starts inflating them
+  void start_round(BgzfRound* round);
+  void wait_round(BgzfRound* round);
+  void inflate_blocks(BgzfRound* round, size_t begin, size_t end);
+  size_t read_input(char* buf, size_t len);
+  // throws if reading fp_ failed
+  void check_input();
+
+  std::shared_ptr<FILE> fp_;
+  std::string path_;
+  int thread_num_;
+  bool bgzf_ = false;
+  bool eof_ = false;
+
+  // gzip stream
+  z_stream stream_;
+  bool stream_init_ = false;
+  size_t members_ = 0;
+  std::vector<char> in_;
+  std::vector<char> out_;
+
+  // BGZF, the round returned last and the one being inflated
+  std::unique_ptr<ThreadPool> pool_;
+  BgzfRound rounds_[2];
+  int current_ = 0;
+  bool started_ = false;
+  // the header bytes read to detect BGZF, consumed before the file
+  std::vector<char> peek_;
+  size_t peek_pos_ = 0;
+};
+
+}  // namespace framework
+}  // namespace paddle
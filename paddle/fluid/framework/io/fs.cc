@@ -14,13 +14,21 @@ limitations under the License. */
 
 #include "paddle/fluid/framework/io/fs.h"
 
+#include <errno.h>
 #include <sys/stat.h>
 
+#include <algorithm>
 #include <memory>
 
+#include "gflags/gflags.h"
 #include "glog/logging.h"
 #include "paddle/fluid/platform/enforce.h"
 
+DECLARE_bool(enable_fs_native_gzip);
+DECLARE_int32(fs_gzip_thread_num);
+DECLARE_int32(fs_read_ahead_buffer_num);
+DECLARE_int32(fs_read_ahead_thread_num);
+
 namespace paddle {
 namespace framework {
 
@@ -56,6 +64,21 @@ static void fs_add_write_converter_internal(std::string& path,  // NOLINT
   }
 }
 
+static std::shared_ptr<FILE> fs_set_buffer_internal(std::shared_ptr<FILE> fp,
+                                                    size_t buffer_size) {
+  if (buffer_size > 0) {
+    char* buffer = new char[buffer_size];
+    CHECK_EQ(0, setvbuf(&*fp, buffer, _IOFBF, buffer_size));
+    fp = {&*fp, [fp, buffer](FILE*) mutable {  // NOLINT
+            CHECK(fp.unique());                // NOLINT
+            fp = nullptr;
+            delete[] buffer;
+          }};
+  }
+
+  return fp;
+}
+
 static std::shared_ptr<FILE> fs_open_internal(const std::string& path,
                                               bool is_pipe,
                                               const std::string& mode,
@@ -69,17 +92,7 @@ static std::shared_ptr<FILE> fs_open_internal(const std::string& path,
     fp = shell_popen(path, mode, err_no);
   }
 
-  if (buffer_size > 0) {
-    char* buffer = new char[buffer_size];
-    CHECK_EQ(0, setvbuf(&*fp, buffer, _IOFBF, buffer_size));
-    fp = {&*fp, [fp, buffer](FILE*) mutable {  // NOLINT
-            CHECK(fp.unique());                // NOLINT
-            fp = nullptr;
-            delete[] buffer;
-          }};
-  }
-
-  return fp;
+  return fs_set_buffer_internal(fp, buffer_size);
 }
 
 static bool fs_begin_with_internal(const std::string& path,
@@ -95,6 +108,89 @@ static bool fs_end_with_internal(const std::string& path,
                  str.length()) == 0;
 }
 
+// a converter that leaves the content as it is
+static bool fs_plain_converter_internal(const std::string& converter) {
+  std::string trimmed = string::trim_spaces(converter);
+  return trimmed == "" || trimmed == "cat";
+}
+
+// .gz files read with no converter but cat are inflated in process instead of
+// through zcat or hadoop -text
+static bool fs_native_gzip_internal(const std::string& path,
+                                    const std::string& converter) {
+#if defined(_WIN32) || defined(__APPLE__) || defined(PADDLE_ARM)
+  return false;
+#else
+  return FLAGS_enable_fs_native_gzip && fs_end_with_internal(path, ".gz") &&
+         fs_plain_converter_internal(converter);
+#endif
+}
+
+#if !defined(_WIN32) && !defined(__APPLE__) && !defined(PADDLE_ARM)
+struct ChunkFileCookie {
+  std::shared_ptr<ChunkReader> reader;
+  const char* data = nullptr;
+  size_t len = 0;
+  // a reader is not called again once it threw, the reads fail with EIO and
+  // ferror of the FILE reports it
+  bool failed = false;
+};
+
+static ssize_t fs_chunk_file_read_internal(void* cookie,
+                                           char* buf,
+                                           size_t size) {
+  auto* file = reinterpret_cast<ChunkFileCookie*>(cookie);
+  if (file->failed) {
+    errno = EIO;
+    return -1;
+  }
+  // an exception can not go through the stdio of the caller
+  try {
+    if (file->len == 0 && !file->reader->next(&file->data, &file->len)) {
+      return 0;
+    }
+  } catch (const std::exception& e) {
+    LOG(ERROR) << e.what();
+    file->failed = true;
+    errno = EIO;
+    return -1;
+  }
+  size_t n = std::min(size, file->len);
+  memcpy(buf, file->data, n);
+  file->data += n;
+  file->len -= n;
+  return n;
+}
+
+static int fs_chunk_file_close_internal(void* cookie) {
+  delete reinterpret_cast<ChunkFileCookie*>(cookie);
+  return 0;
+}
+#endif
+
+// a FILE that reads the chunks of reader, ferror is set if the reader fails
+static std::shared_ptr<FILE> fs_open_chunk_file_internal(
+    std::shared_ptr<ChunkReader> reader, size_t buffer_size) {
+#if defined(_WIN32) || defined(__APPLE__) || defined(PADDLE_ARM)
+  return nullptr;
+#else
+  auto* cookie = new ChunkFileCookie;
+  cookie->reader = reader;
+  cookie_io_functions_t funcs;
+  memset(&funcs, 0, sizeof(funcs));
+  funcs.read = fs_chunk_file_read_internal;
+  funcs.close = fs_chunk_file_close_internal;
+  FILE* fp = fopencookie(cookie, "r", funcs);
+  if (fp == nullptr) {
+    delete cookie;
+    PADDLE_THROW(platform::errors::Unavailable(
+        "Failed to open a stream on the chunks of a file."));
+  }
+  return fs_set_buffer_internal({fp, [](FILE* fp) { fclose(fp); }},
+                                buffer_size);
+#endif
+}
+
 static size_t& localfs_buffer_size_internal() {
   static size_t x = 0;
   return x;
@@ -104,8 +200,43 @@ size_t localfs_buffer_size() { return localfs_buffer_size_internal(); }
 
 void localfs_set_buffer_size(size_t x) { localfs_buffer_size_internal() = x; }
 
+// nullptr if read ahead is off
+static std::shared_ptr<ChunkReader> localfs_open_read_ahead_internal(
+    const std::string& path) {
+#if defined(_WIN32) || defined(__APPLE__) || defined(PADDLE_ARM)
+  return nullptr;
+#else
+  if (FLAGS_fs_read_ahead_buffer_num <= 0) {
+    return nullptr;
+  }
+  return std::make_shared<ReadAheadChunkReader>(
+      path, FLAGS_fs_read_ahead_buffer_num, FLAGS_fs_read_ahead_thread_num);
+#endif
+}
+
+static std::shared_ptr<ChunkReader> localfs_open_read_gzip_internal(
+    const std::string& path, const std::string& converter) {
+  if (!fs_native_gzip_internal(path, converter)) {
+    return nullptr;
+  }
+  // the compressed data is read ahead while the last of it is inflated
+  std::shared_ptr<FILE> fp = nullptr;
+  auto ahead = localfs_open_read_ahead_internal(path);
+  if (ahead != nullptr) {
+    fp = fs_open_chunk_file_internal(ahead, 0);
+  } else {
+    fp = shell_fopen(path, "r");
+  }
+  return std::make_shared<GzipChunkReader>(fp, path, FLAGS_fs_gzip_thread_num);
+}
+
 std::shared_ptr<FILE> localfs_open_read(std::string path,
                                         const std::string& converter) {
+  auto reader = localfs_open_read_gzip_internal(path, converter);
+  if (reader != nullptr) {
+    return fs_open_chunk_file_internal(reader, localfs_buffer_size());
+  }
+
   bool is_pipe = false;
 
   if (fs_end_with_internal(path, ".gz")) {
@@ -255,10 +386,33 @@ void set_download_command(const std::string& x) {
   customized_download_cmd_internal() = x;
 }
 
+static std::shared_ptr<ChunkReader> hdfs_open_read_gzip_internal(
+    const std::string& path,
+    int* err_no,
+    const std::string& converter,
+    bool read_data) {
+  if (download_cmd() != "" || !fs_native_gzip_internal(path, converter)) {
+    return nullptr;
+  }
+  std::string cmd = string::format_string(
+      "%s -cat \"%s\"",
+      read_data ? dataset_hdfs_command().c_str() : hdfs_command().c_str(),
+      path.c_str());
+  return std::make_shared<GzipChunkReader>(
+      fs_open_internal(cmd, true, "r", 0, err_no),
+      path,
+      FLAGS_fs_gzip_thread_num);
+}
+
 std::shared_ptr<FILE> hdfs_open_read(std::string path,
                                      int* err_no,
                                      const std::string& converter,
                                      bool read_data) {
+  auto reader = hdfs_open_read_gzip_internal(path, err_no, converter, read_data);
+  if (reader != nullptr) {
+    return fs_open_chunk_file_internal(reader, hdfs_buffer_size());
+  }
+
   if (download_cmd() != "") {  // use customized download command
     path = string::format_string(
         "%s \"%s\"", download_cmd().c_str(), path.c_str());
@@ -413,6 +567,32 @@ std::shared_ptr<FILE> fs_open_read(const std::string& path,
   return {};
 }
 
+std::shared_ptr<ChunkReader> fs_open_read_chunks(const std::string& path,
+                                                 int* err_no,
+                                                 const std::string& converter,
+                                                 bool read_data) {
+  std::shared_ptr<ChunkReader> reader = nullptr;
+  switch (fs_select_internal(path)) {
+    case 0:
+      reader = localfs_open_read_gzip_internal(path, converter);
+      if (reader == nullptr && !fs_end_with_internal(path, ".gz") &&
+          fs_plain_converter_internal(converter)) {
+        reader = localfs_open_read_ahead_internal(path);
+      }
+      break;
+
+    case 1:
+      reader = hdfs_open_read_gzip_internal(path, err_no, converter, read_data);
+      break;
+  }
+
+  if (reader == nullptr) {
+    reader = std::make_shared<FileChunkReader>(
+        fs_open_read(path, err_no, converter, read_data));
+  }
+  return reader;
+}
+
 std::shared_ptr<FILE> fs_open_write(const std::string& path,
                                     int* err_no,
                                     const std::string& converter) {
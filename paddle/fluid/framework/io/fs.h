@@ -22,6 +22,7 @@
 #include <vector>
 
 #include "glog/logging.h"
+#include "paddle/fluid/framework/io/chunk_reader.h"
 #include "paddle/fluid/framework/io/shell.h"
 #include "paddle/fluid/string/string_helper.h"
 
@@ -94,11 +95,21 @@ extern void hdfs_mkdir(const std::string& path);
 extern void hdfs_mv(const std::string& src, const std::string& dest);
 
 // aut-detect fs
+// a cut or corrupt .gz file inflated in process fails the reads, ferror of
+// the FILE is set
 extern std::shared_ptr<FILE> fs_open_read(const std::string& path,
                                           int* err_no,
                                           const std::string& converter,
                                           bool read_data = false);
 
+// the content of fs_open_read as chunks that can be parsed in place, without
+// the copy through the buffer of a FILE
+extern std::shared_ptr<ChunkReader> fs_open_read_chunks(
+    const std::string& path,
+    int* err_no,
+    const std::string& converter,
+    bool read_data = false);
+
 extern std::shared_ptr<FILE> fs_open_write(const std::string& path,
                                            int* err_no,
                                            const std::string& converter);
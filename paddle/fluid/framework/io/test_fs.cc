@@ -13,9 +13,17 @@
 // limitations under the License.
 
 #include <gtest/gtest.h>
+#include <zlib.h>
 
+#include <algorithm>
+#include <cstdio>
 #include <fstream>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
 
+#include "gflags/gflags.h"
 #include "paddle/fluid/framework/io/fs.h"
 
 #if defined _WIN32 || defined __APPLE__
@@ -23,6 +31,10 @@
 #define _LINUX
 #endif
 
+DECLARE_bool(enable_fs_native_gzip);
+DECLARE_int32(fs_gzip_thread_num);
+DECLARE_int32(fs_read_ahead_buffer_num);
+
 TEST(FS, mv) {
 #ifdef _LINUX
   std::ofstream out("src.txt");
@@ -60,3 +72,252 @@ TEST(FS, mv) {
 
 #endif
 }
+
+#ifdef _LINUX
+static std::string MakeLines(int num) {
+  std::string content;
+  for (int i = 0; i < num; ++i) {
+    content += "line " + std::to_string(i) + " " +
+               std::string(i % 97, 'a' + i % 26) + "\n";
+  }
+  return content;
+}
+
+static void WriteFile(const std::string& path, const std::string& content) {
+  int err_no = 0;
+  auto fp = paddle::framework::fs_open_write(path, &err_no, "");
+  ASSERT_EQ(fwrite(content.data(), 1, content.size(), fp.get()),
+            content.size());
+}
+
+static std::string ReadFile(std::shared_ptr<FILE> fp) {
+  std::string content;
+  std::vector<char> buf(100000);
+  size_t n = 0;
+  while ((n = fread(buf.data(), 1, buf.size(), fp.get())) > 0) {
+    content.append(buf.data(), n);
+  }
+  return content;
+}
+
+// whether the reads of fp up to its end fail
+static bool ReadFileFails(std::shared_ptr<FILE> fp) {
+  ReadFile(fp);
+  return ferror(fp.get()) != 0;
+}
+
+static std::string ReadChunks(
+    std::shared_ptr<paddle::framework::ChunkReader> reader) {
+  std::string content;
+  const char* data = nullptr;
+  size_t len = 0;
+  while (reader->next(&data, &len)) {
+    content.append(data, len);
+  }
+  return content;
+}
+
+// BGZF blocks of at most 65280 bytes of content, then the empty block that
+// ends the file
+static void WriteBgzf(const std::string& path, const std::string& content) {
+  FILE* fp = fopen(path.c_str(), "w");
+  ASSERT_NE(fp, nullptr);
+  auto write_block = [fp](const char* data, size_t len) {
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    deflateInit2(&stream, 6, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY);
+    std::vector<unsigned char> out(deflateBound(&stream, len));
+    stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+    stream.avail_in = len;
+    stream.next_out = out.data();
+    stream.avail_out = out.size();
+    deflate(&stream, Z_FINISH);
+    size_t size = out.size() - stream.avail_out;
+    deflateEnd(&stream);
+    unsigned char header[18] = {
+        0x1f, 0x8b, 8, 4, 0, 0, 0, 0, 0, 0xff, 6, 0, 'B', 'C', 2, 0, 0, 0};
+    size_t block_size = 18 + size + 8 - 1;
+    header[16] = block_size & 0xff;
+    header[17] = block_size >> 8;
+    uint32_t footer[2] = {
+        static_cast<uint32_t>(
+            crc32(0, reinterpret_cast<const Bytef*>(data), len)),
+        static_cast<uint32_t>(len)};
+    fwrite(header, 1, sizeof(header), fp);
+    fwrite(out.data(), 1, size, fp);
+    fwrite(footer, 1, sizeof(footer), fp);
+  };
+  for (size_t offset = 0; offset < content.size(); offset += 65280) {
+    write_block(content.data() + offset,
+                std::min<size_t>(65280, content.size() - offset));
+  }
+  write_block("", 0);
+  fclose(fp);
+}
+#endif
+
+// .gz files read through zcat and inflated in process give the same content,
+// concatenated members included
+TEST(FS, gzip) {
+#ifdef _LINUX
+  std::string first = MakeLines(100000);
+  std::string second = MakeLines(1000);
+  WriteFile("test_fs_first.gz", first);
+  WriteFile("test_fs_second.gz", second);
+  WriteFile("test_fs_plain.txt", first);
+  paddle::framework::shell_execute(
+      "cat test_fs_first.gz test_fs_second.gz > test_fs_concat.gz");
+
+  int err_no = 0;
+  for (bool native : {false, true}) {
+    FLAGS_enable_fs_native_gzip = native;
+    for (auto& converter : {"", "cat"}) {
+      EXPECT_EQ(ReadFile(paddle::framework::fs_open_read(
+                    "test_fs_first.gz", &err_no, converter)),
+                first);
+      EXPECT_EQ(ReadChunks(paddle::framework::fs_open_read_chunks(
+                    "test_fs_first.gz", &err_no, converter)),
+                first);
+      EXPECT_EQ(ReadFile(paddle::framework::fs_open_read(
+                    "test_fs_concat.gz", &err_no, converter)),
+                first + second);
+    }
+    EXPECT_EQ(ReadChunks(paddle::framework::fs_open_read_chunks(
+                  "test_fs_plain.txt", &err_no, "")),
+              first);
+    // a converter still goes through the shell after zcat
+    EXPECT_EQ(ReadFile(paddle::framework::fs_open_read(
+                  "test_fs_second.gz", &err_no, "head -n 1")),
+              "line 0 \n");
+  }
+
+  // a truncated stream throws instead of looking like the end of the file
+  paddle::framework::shell_execute(
+      "head -c 20000 test_fs_first.gz > test_fs_truncated.gz");
+  EXPECT_ANY_THROW(ReadChunks(paddle::framework::fs_open_read_chunks(
+      "test_fs_truncated.gz", &err_no, "")));
+  // through fs_open_read the reads of the FILE fail
+  for (auto& converter : {"", "cat"}) {
+    EXPECT_TRUE(ReadFileFails(paddle::framework::fs_open_read(
+        "test_fs_truncated.gz", &err_no, converter)));
+  }
+  EXPECT_FALSE(ReadFileFails(
+      paddle::framework::fs_open_read("test_fs_first.gz", &err_no, "")));
+
+  for (auto& path : {"test_fs_first.gz",
+                     "test_fs_second.gz",
+                     "test_fs_plain.txt",
+                     "test_fs_concat.gz",
+                     "test_fs_truncated.gz"}) {
+    std::remove(path);
+  }
+#endif
+}
+
+// the blocks of a BGZF file inflate in parallel, in order, and a corrupt
+// block throws
+TEST(FS, bgzf) {
+#ifdef _LINUX
+  std::string content = MakeLines(200000);
+  WriteBgzf("test_fs_bgzf.gz", content);
+  FLAGS_enable_fs_native_gzip = true;
+  int err_no = 0;
+  for (int thread_num : {1, 4}) {
+    FLAGS_fs_gzip_thread_num = thread_num;
+    paddle::framework::GzipChunkReader reader(
+        paddle::framework::shell_fopen("test_fs_bgzf.gz", "r"),
+        "test_fs_bgzf.gz",
+        thread_num);
+    EXPECT_EQ(reader.is_bgzf(), thread_num > 1);
+    EXPECT_EQ(ReadChunks(paddle::framework::fs_open_read_chunks(
+                  "test_fs_bgzf.gz", &err_no, "")),
+              content);
+    EXPECT_EQ(ReadFile(paddle::framework::fs_open_read(
+                  "test_fs_bgzf.gz", &err_no, "")),
+              content);
+  }
+  // zcat reads BGZF as concatenated members
+  FLAGS_enable_fs_native_gzip = false;
+  EXPECT_EQ(ReadFile(paddle::framework::fs_open_read(
+                "test_fs_bgzf.gz", &err_no, "")),
+            content);
+
+  FLAGS_enable_fs_native_gzip = true;
+  FLAGS_fs_gzip_thread_num = 4;
+  {
+    std::fstream file("test_fs_bgzf.gz",
+                      std::ios::in | std::ios::out | std::ios::binary);
+    file.seekp(1000000);
+    file.put('x');
+  }
+  EXPECT_ANY_THROW(ReadChunks(paddle::framework::fs_open_read_chunks(
+      "test_fs_bgzf.gz", &err_no, "")));
+  EXPECT_TRUE(ReadFileFails(
+      paddle::framework::fs_open_read("test_fs_bgzf.gz", &err_no, "")));
+  std::remove("test_fs_bgzf.gz");
+#endif
+}
+
+// a file read ahead in small buffers comes back whole and in order, whether
+// it ends in the middle of a buffer, at the end of one or is empty
+TEST(FS, read_ahead) {
+#ifdef _LINUX
+  std::string content = MakeLines(20000);
+  std::string aligned = content.substr(0, content.size() / 4096 * 4096);
+  WriteFile("test_fs_ahead.txt", content);
+  WriteFile("test_fs_aligned.txt", aligned);
+  WriteFile("test_fs_empty.txt", "");
+  WriteFile("test_fs_ahead.gz", content);
+
+  for (int thread_num : {1, 4}) {
+    for (auto& file : std::vector<std::pair<std::string, std::string>>{
+             {"test_fs_ahead.txt", content},
+             {"test_fs_aligned.txt", aligned},
+             {"test_fs_empty.txt", ""}}) {
+      auto reader = std::make_shared<paddle::framework::ReadAheadChunkReader>(
+          file.first, 8, thread_num, 4096);
+      EXPECT_EQ(ReadChunks(reader), file.second);
+      EXPECT_EQ(reader->bytes_read(), file.second.size());
+      // the end of the file reads as the end again
+      const char* data = nullptr;
+      size_t len = 0;
+      EXPECT_FALSE(reader->next(&data, &len));
+      EXPECT_GE(reader->read_seconds(), 0);
+      EXPECT_GE(reader->stall_seconds(), 0);
+    }
+  }
+  // stopped in the middle of the file
+  {
+    paddle::framework::ReadAheadChunkReader reader(
+        "test_fs_ahead.txt", 4, 2, 4096);
+    const char* data = nullptr;
+    size_t len = 0;
+    ASSERT_TRUE(reader.next(&data, &len));
+    EXPECT_EQ(std::string(data, len), content.substr(0, 4096));
+  }
+  EXPECT_ANY_THROW(paddle::framework::ReadAheadChunkReader(
+      "test_fs_not_exist.txt", 4, 2));
+
+  int err_no = 0;
+  FLAGS_enable_fs_native_gzip = true;
+  for (int buffer_num : {0, 8}) {
+    FLAGS_fs_read_ahead_buffer_num = buffer_num;
+    EXPECT_EQ(ReadChunks(paddle::framework::fs_open_read_chunks(
+                  "test_fs_ahead.txt", &err_no, "")),
+              content);
+    EXPECT_EQ(ReadChunks(paddle::framework::fs_open_read_chunks(
+                  "test_fs_ahead.gz", &err_no, "")),
+              content);
+    EXPECT_EQ(ReadFile(paddle::framework::fs_open_read(
+                  "test_fs_ahead.gz", &err_no, "")),
+              content);
+  }
+
+  for (auto& path : {"test_fs_ahead.txt",
+                     "test_fs_aligned.txt",
+                     "test_fs_empty.txt",
+                     "test_fs_ahead.gz"}) {
+    std::remove(path);
+  }
+#endif
+}
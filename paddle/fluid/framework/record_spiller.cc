@@ -0,0 +1,415 @@
+// Copyright (c) 2022 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "paddle/fluid/framework/record_spiller.h"
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>  // NOLINT
+
+#include "paddle/fluid/framework/archive.h"
+#include "paddle/fluid/framework/io/fs.h"
+#include "paddle/fluid/platform/timer.h"
+
+namespace paddle {
+namespace framework {
+
+// records moved to disk or restored at a time
+static const size_t kSpillBlockNum = 8192;
+// records sampled to get the first size estimate
+static const size_t kSampleRecordNum = 1024;
+static const int kPollMillis = 5;
+
+RecordSpiller::RecordSpiller(const std::string& spill_dir,
+                             int64_t memory_budget)
+    : spill_dir_(spill_dir), memory_budget_(memory_budget) {
+  CHECK(memory_budget_ > 0) << "memory budget must be > 0";
+  if (spill_dir_.empty()) {
+    spill_dir_ = "./";
+  }
+  localfs_mkdir(spill_dir_);
+  spill_path_ = spill_dir_ + "/record_spill." + std::to_string(getpid()) +
+                "." + std::to_string(reinterpret_cast<uintptr_t>(this)) +
+                ".bin";
+}
+
+RecordSpiller::~RecordSpiller() { Clear(); }
+
+int64_t RecordSpiller::EstimateBytes(const Record& r) {
+  return sizeof(Record) +
+         (r.uint64_feasigns_.capacity() + r.float_feasigns_.capacity()) *
+             sizeof(FeatureItem) +
+         r.ins_id_.capacity() + r.content_.capacity() + r.uid_.capacity();
+}
+
+void RecordSpiller::StartSpill(ChannelObject<Record>* chan) {
+  CHECK(spill_thread_.joinable() == false) << "spill thread already running";
+  spill_chan_ = chan;
+  stop_spill_ = false;
+  spill_thread_ = std::thread([this]() { SpillLoop(); });
+}
+
+void RecordSpiller::StopSpill() {
+  stop_spill_ = true;
+  if (spill_thread_.joinable()) {
+    spill_thread_.join();
+  }
+  spill_chan_ = nullptr;
+}
+
+void RecordSpiller::SpillLoop() {
+  std::vector<Record> records;
+  while (true) {
+    // read the flag first, the channel stays within the budget when stopped
+    bool stopping = stop_spill_;
+    size_t resident = spill_chan_->Size();
+    if (avg_record_bytes_ == 0) {
+      if (resident < kSampleRecordNum) {
+        if (stopping) {
+          break;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(kPollMillis));
+        continue;
+      }
+      spill_chan_->ReadOnce(records, kSampleRecordNum);
+      int64_t total = 0;
+      for (auto& r : records) {
+        total += EstimateBytes(r);
+      }
+      avg_record_bytes_ = std::max<int64_t>(total / records.size(), 1);
+      spill_chan_->Write(std::move(records));
+      records.clear();
+      continue;
+    }
+    if (!ResidentOverBudget(resident)) {
+      if (stopping) {
+        break;
+      }
+      std::this_thread::sleep_for(std::chrono::milliseconds(kPollMillis));
+      continue;
+    }
+    // the loader threads are the only other users of the channel, they
+    // only write, so the read below never waits on an empty channel
+    // go down to half of the budget, so that the spill does not run for a
+    // few records at a time, and keep blocks small enough to be restored
+    // within the budget
+    size_t half_num =
+        static_cast<size_t>(memory_budget_ / avg_record_bytes_ / 2);
+    size_t num = std::min(resident - half_num, kSpillBlockNum);
+    num = std::max<size_t>(std::min(num, half_num), 1);
+    spill_chan_->ReadOnce(records, num);
+    SpillBlockToFile(&records);
+  }
+}
+
+void RecordSpiller::SpillBlockToFile(std::vector<Record>* records) {
+  if (records->empty()) {
+    return;
+  }
+  if (spill_file_ == nullptr) {
+    // SpillAll() appends to the blocks of the first spill
+    spill_file_ = fopen(spill_path_.c_str(), file_size_ > 0 ? "ab" : "wb");
+    CHECK(spill_file_ != nullptr) << "open spill file failed: " << spill_path_;
+  }
+  BinaryArchive ar;
+  int64_t total = 0;
+  for (auto& r : *records) {
+    total += EstimateBytes(r);
+    // the Record operators only cover what GlobalShuffle sends, keep the
+    // rest here so a spilled record comes back unchanged
+    ar << r;
+    ar << r.content_;
+    ar << r.search_id;
+    ar << r.rank;
+    ar << r.cmatch;
+    ar << r.uid_;
+  }
+  // keep the estimate moving with the data, loaders may read several files
+  // with different record sizes
+  avg_record_bytes_ =
+      std::max<int64_t>((avg_record_bytes_ * 3 + total / records->size()) / 4,
+                        1);
+  size_t len = ar.Length();
+  CHECK(fwrite(ar.Buffer(), 1, len, spill_file_) == len)
+      << "write spill file failed: " << spill_path_;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    blocks_.push_back(SpillBlock{file_size_, len, records->size()});
+  }
+  file_size_ += len;
+  spilled_bytes_ += len;
+  records->clear();
+  std::vector<Record>().swap(*records);
+}
+
+void RecordSpiller::StartRestore(ChannelObject<Record>* chan) {
+  CHECK(restore_thread_.joinable() == false)
+      << "restore thread already running";
+  CHECK(spill_thread_.joinable() == false) << "call StopSpill first";
+  if (spill_file_ != nullptr) {
+    CHECK(fclose(spill_file_) == 0) << "close spill file failed";
+    spill_file_ = nullptr;
+  }
+  if (mapped_ != nullptr && mapped_size_ != file_size_) {
+    munmap(mapped_, mapped_size_);
+    mapped_ = nullptr;
+    mapped_size_ = 0;
+  }
+  if (file_size_ > 0 && mapped_ == nullptr) {
+    FILE* fp = fopen(spill_path_.c_str(), "rb");
+    CHECK(fp != nullptr) << "open spill file failed: " << spill_path_;
+    void* addr =
+        mmap(nullptr, file_size_, PROT_READ, MAP_PRIVATE, fileno(fp), 0);
+    fclose(fp);
+    CHECK(addr != MAP_FAILED) << "mmap spill file failed: " << spill_path_;
+    madvise(addr, file_size_, MADV_SEQUENTIAL);
+    mapped_ = reinterpret_cast<char*>(addr);
+    mapped_size_ = file_size_;
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (replay_) {
+      next_block_ = 0;
+    }
+  }
+  restore_chan_ = chan;
+  stop_restore_ = false;
+  restore_thread_ = std::thread([this]() { RestoreLoop(); });
+}
+
+void RecordSpiller::RestoreLoop() {
+  static const size_t page_size = sysconf(_SC_PAGESIZE);
+  platform::Timer timer;
+  while (!stop_restore_) {
+    SpillBlock block;
+    bool shuffle = false;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      if (next_block_ >= blocks_.size()) {
+        break;
+      }
+      block = blocks_[next_block_];
+      // follow the consumers: wait until the block fits in the budget, an
+      // empty channel always takes one block so a small budget cannot stall
+      size_t resident = restore_chan_->Size();
+      if (!unbounded_ && resident > 0 &&
+          ResidentOverBudget(resident + block.record_num)) {
+        cond_.wait_for(lock, std::chrono::milliseconds(kPollMillis));
+        continue;
+      }
+      ++next_block_;
+      restoring_block_ = true;
+      restoring_num_ = block.record_num;
+      shuffle = shuffle_in_block_;
+    }
+    timer.Start();
+    std::vector<Record> records;
+    records.reserve(block.record_num);
+    BinaryArchive ar;
+    ar.SetReadBuffer(mapped_ + block.offset, block.length, nullptr);
+    while (ar.Cursor() < ar.Finish()) {
+      records.emplace_back();
+      Record& r = records.back();
+      ar >> r;
+      ar >> r.content_;
+      ar >> r.search_id;
+      ar >> r.rank;
+      ar >> r.cmatch;
+      ar >> r.uid_;
+    }
+    CHECK(records.size() == block.record_num)
+        << "spill block corrupted, expect " << block.record_num << " got "
+        << records.size();
+    // the block is not read again before the next replay, give back its
+    // page cache
+    size_t begin = block.offset / page_size * page_size;
+    madvise(mapped_ + begin, block.offset + block.length - begin,
+            MADV_DONTNEED);
+    timer.Pause();
+    reread_bytes_ += block.length;
+    reread_usec_ += static_cast<int64_t>(timer.ElapsedUS());
+    timer.Reset();
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (shuffle) {
+        std::shuffle(records.begin(), records.end(), engine_);
+      }
+    }
+    restore_chan_->Write(std::move(records));
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      restoring_block_ = false;
+    }
+    cond_.notify_all();
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (next_block_ >= blocks_.size()) {
+    restore_chan_->Close();
+  }
+}
+
+void RecordSpiller::RestoreAll() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    unbounded_ = true;
+  }
+  cond_.notify_all();
+  if (restore_thread_.joinable()) {
+    restore_thread_.join();
+  }
+}
+
+void RecordSpiller::StopRestore() {
+  stop_restore_ = true;
+  cond_.notify_all();
+  if (restore_thread_.joinable()) {
+    restore_thread_.join();
+  }
+  restore_chan_ = nullptr;
+  stop_restore_ = false;
+}
+
+void RecordSpiller::SpillAll(ChannelObject<Record>* chan) {
+  CHECK(restore_thread_.joinable() == false) << "call StopRestore first";
+  CHECK(spill_thread_.joinable() == false) << "call StopSpill first";
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    CHECK(!replay_) << "records already spilled for replay";
+    blocks_.erase(blocks_.begin(), blocks_.begin() + next_block_);
+    next_block_ = 0;
+    unbounded_ = false;
+    replay_ = true;
+  }
+  // blocks of half the budget, as the spill thread writes them
+  size_t num = kSpillBlockNum;
+  if (avg_record_bytes_ > 0) {
+    num = std::min<size_t>(
+        num, static_cast<size_t>(memory_budget_ / avg_record_bytes_ / 2));
+  }
+  num = std::max<size_t>(num, 1);
+  std::vector<Record> records;
+  while (chan->Size() > 0) {
+    chan->ReadOnce(records, num);
+    SpillBlockToFile(&records);
+  }
+}
+
+void RecordSpiller::StopReplay() {
+  CHECK(restore_thread_.joinable() == false) << "call StopRestore first";
+  std::lock_guard<std::mutex> lock(mutex_);
+  replay_ = false;
+  next_block_ = 0;
+}
+
+bool RecordSpiller::Replaying() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return replay_;
+}
+
+void RecordSpiller::Shuffle(ChannelObject<Record>* chan,
+                            std::default_random_engine* engine) {
+  // holding mutex_ keeps the restore thread from writing or closing chan
+  std::unique_lock<std::mutex> lock(mutex_);
+  cond_.wait(lock, [this] { return !restoring_block_; });
+  std::vector<Record> data;
+  std::vector<Record> block;
+  while (chan->Size() > 0) {
+    chan->ReadOnce(block, chan->BlockSize());
+    for (auto& r : block) {
+      data.push_back(std::move(r));
+    }
+  }
+  std::shuffle(data.begin(), data.end(), *engine);
+  bool closed = chan->Closed();
+  if (closed) {
+    chan->Open();
+  }
+  if (!data.empty()) {
+    chan->Write(std::move(data));
+  }
+  if (closed) {
+    chan->Close();
+  }
+  std::shuffle(blocks_.begin() + next_block_, blocks_.end(), *engine);
+  engine_.seed((*engine)());
+  shuffle_in_block_ = true;
+}
+
+bool RecordSpiller::HasSpilled() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return !blocks_.empty();
+}
+
+int64_t RecordSpiller::PendingRecordNum() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  int64_t num = restoring_block_ ? restoring_num_ : 0;
+  for (size_t i = next_block_; i < blocks_.size(); ++i) {
+    num += blocks_[i].record_num;
+  }
+  return num;
+}
+
+int64_t RecordSpiller::SpilledRecordNum() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  int64_t num = 0;
+  for (auto& block : blocks_) {
+    num += block.record_num;
+  }
+  return num;
+}
+
+double RecordSpiller::RereadBandwidth() const {
+  int64_t usec = reread_usec_;
+  if (usec == 0) {
+    return 0.0;
+  }
+  return static_cast<double>(reread_bytes_) * 1000000.0 / usec;
+}
+
+void RecordSpiller::PrintStat(const char* name) {
+  VLOG(0) << name << " spill stat: budget=" << (memory_budget_ >> 20)
+          << "MB, avg record=" << avg_record_bytes_
+          << " bytes, spilled=" << (spilled_bytes_ >> 20)
+          << "MB, reread=" << (reread_bytes_ >> 20)
+          << "MB, reread bandwidth=" << (RereadBandwidth() / 1048576.0)
+          << "MB/s, pending records=" << PendingRecordNum();
+}
+
+void RecordSpiller::Clear() {
+  StopSpill();
+  StopRestore();
+  if (spill_file_ != nullptr) {
+    fclose(spill_file_);
+    spill_file_ = nullptr;
+  }
+  if (mapped_ != nullptr) {
+    munmap(mapped_, mapped_size_);
+    mapped_ = nullptr;
+    mapped_size_ = 0;
+  }
+  unlink(spill_path_.c_str());
+  file_size_ = 0;
+  std::lock_guard<std::mutex> lock(mutex_);
+  blocks_.clear();
+  next_block_ = 0;
+  unbounded_ = false;
+  shuffle_in_block_ = false;
+  replay_ = false;
+  restoring_block_ = false;
+}
+
+}  // namespace framework
+}  // namespace paddle
@@ -0,0 +1,154 @@
+// Copyright (c) 2022 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <atomic>
+#include <cstdio>
+#include <condition_variable>  // NOLINT
+#include <mutex>               // NOLINT
+#include <random>
+#include <string>
+#include <thread>  // NOLINT
+#include <vector>
+
+#include "paddle/fluid/framework/channel.h"
+#include "paddle/fluid/framework/data_feed.h"
+
+namespace paddle {
+namespace framework {
+
+// RecordSpiller keeps the records held by a dataset channel within a memory
+// budget.
+//   - While the channel is filled (LoadIntoMemory), a spill thread moves the
+//     oldest records, one block at a time, to a local spill file. Blocks are
+//     serialized with the Record Archive operators, as in GlobalShuffle.
+//   - After loading, a restore thread mmaps the file and writes the blocks
+//     back into the channel, following its consumers so the resident part
+//     stays around the budget. The channel is closed when all blocks are
+//     restored.
+//   - Shuffle() shuffles the resident records, permutes the order of the
+//     pending blocks and makes every block shuffled when it is restored,
+//     instead of one in-memory shuffle of the whole pass.
+//   - SpillAll() moves the resident records to the file too and keeps the
+//     blocks once restored, so every StartRestore() replays the whole pass
+//     from the first block. Training reads the pass once per epoch this way
+//     and never holds more than the budget.
+// Usage:
+//   spiller.StartSpill(chan);  ... fill chan ...  spiller.StopSpill();
+//   spiller.StartRestore(chan);  ... consume chan ...  spiller.Clear();
+// or, for several passes over the records:
+//   spiller.StopRestore();  spiller.SpillAll(chan);
+//   spiller.StartRestore(chan);  ... consume chan ...  spiller.StopRestore();
+//   spiller.StartRestore(chan);  ... consume chan ...
+// Nothing else may close chan while it is restored, RestoreAll() brings
+// every record back into memory when a caller needs the whole channel.
+class RecordSpiller {
+ public:
+  RecordSpiller(const std::string& spill_dir, int64_t memory_budget);
+  ~RecordSpiller();
+
+  void StartSpill(ChannelObject<Record>* chan);
+  void StopSpill();
+
+  // chan must be open, it will be closed by the restore thread
+  void StartRestore(ChannelObject<Record>* chan);
+  // restore the remaining blocks without the budget and wait until done
+  void RestoreAll();
+  // stop the restore thread, the blocks not restored yet stay pending and
+  // chan stays open unless every block was restored
+  void StopRestore();
+  // move every record of chan to the spill file and start replaying, chan
+  // must have no other user. The records restored before are in chan, or
+  // consumed, and their blocks are dropped.
+  void SpillAll(ChannelObject<Record>* chan);
+  // the next restore brings every record back once, as before SpillAll().
+  // The caller drops the copies restored by the replay.
+  void StopReplay();
+  bool Replaying();
+  // chan must be the restored channel, and have no reader meanwhile
+  void Shuffle(ChannelObject<Record>* chan,
+               std::default_random_engine* engine);
+  // stop threads, drop all spilled records and remove the spill file
+  void Clear();
+
+  bool HasSpilled();
+  // spilled records not written back to the channel yet
+  int64_t PendingRecordNum();
+  // records in the spill file, restored or not
+  int64_t SpilledRecordNum();
+  // estimated memory size of one resident record
+  int64_t AvgRecordBytes() const { return avg_record_bytes_; }
+
+  int64_t SpilledBytes() const { return spilled_bytes_; }
+  int64_t RereadBytes() const { return reread_bytes_; }
+  // bytes per second of reading and decoding spilled blocks
+  double RereadBandwidth() const;
+  void PrintStat(const char* name);
+
+  static int64_t EstimateBytes(const Record& r);
+
+ private:
+  struct SpillBlock {
+    size_t offset;
+    size_t length;
+    size_t record_num;
+  };
+
+  void SpillLoop();
+  void RestoreLoop();
+  void SpillBlockToFile(std::vector<Record>* records);
+  bool ResidentOverBudget(size_t resident_num) const {
+    return static_cast<int64_t>(resident_num) * avg_record_bytes_ >
+           memory_budget_;
+  }
+
+  std::string spill_dir_;
+  std::string spill_path_;
+  int64_t memory_budget_;
+  std::atomic<int64_t> avg_record_bytes_{0};
+
+  ChannelObject<Record>* spill_chan_ = nullptr;
+  ChannelObject<Record>* restore_chan_ = nullptr;
+  std::thread spill_thread_;
+  std::thread restore_thread_;
+  std::atomic<bool> stop_spill_{false};
+  std::atomic<bool> stop_restore_{false};
+
+  // guards the blocks and restore states below, and the close of
+  // restore_chan_
+  std::mutex mutex_;
+  std::condition_variable cond_;
+  std::vector<SpillBlock> blocks_;
+  size_t next_block_ = 0;
+  bool unbounded_ = false;
+  bool restoring_block_ = false;
+  size_t restoring_num_ = 0;
+  bool shuffle_in_block_ = false;
+  // blocks are kept after they are restored, see SpillAll()
+  bool replay_ = false;
+  std::default_random_engine engine_;
+
+  FILE* spill_file_ = nullptr;
+  size_t file_size_ = 0;
+  char* mapped_ = nullptr;
+  size_t mapped_size_ = 0;
+
+  std::atomic<int64_t> spilled_bytes_{0};
+  std::atomic<int64_t> reread_bytes_{0};
+  std::atomic<int64_t> reread_usec_{0};
+};
+
+}  // namespace framework
+}  // namespace paddle
@@ -0,0 +1,228 @@
+// Copyright (c) 2022 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "paddle/fluid/framework/record_spiller.h"
+
+#include <algorithm>
+#include <set>
+#include <string>
+#include <unordered_set>
+#include <thread>  // NOLINT
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "paddle/fluid/framework/data_set.h"
+#include "paddle/fluid/framework/shuffle_codec.h"
+
+namespace paddle {
+namespace framework {
+
+static Record MakeRecord(uint64_t id) {
+  Record r;
+  FeatureFeasign sign;
+  sign.uint64_feasign_ = id;
+  for (uint16_t slot = 0; slot < 10; ++slot) {
+    r.uint64_feasigns_.emplace_back(sign, slot);
+  }
+  r.ins_id_ = "ins" + std::to_string(id);
+  r.content_ = "content";
+  r.search_id = id;
+  r.rank = 1;
+  r.cmatch = 2;
+  r.uid_ = "uid";
+  return r;
+}
+
+static void FillChannel(ChannelObject<Record>* chan, int num, int threads) {
+  std::vector<std::thread> writers;
+  for (int t = 0; t < threads; ++t) {
+    writers.emplace_back([chan, num, threads, t]() {
+      for (int i = t; i < num; i += threads) {
+        std::vector<Record> data{MakeRecord(i)};
+        chan->Write(std::move(data));
+      }
+    });
+  }
+  for (auto& t : writers) {
+    t.join();
+  }
+}
+
+TEST(RecordSpiller, SpillShuffleRestore) {
+  const int num = 50000;
+  const int64_t budget = 64 << 10;
+  auto chan = MakeChannel<Record>();
+  RecordSpiller spiller("./record_spiller_test", budget);
+  spiller.StartSpill(chan.get());
+  FillChannel(chan.get(), num, 4);
+  chan->Close();
+  spiller.StopSpill();
+
+  ASSERT_TRUE(spiller.HasSpilled());
+  EXPECT_LE(static_cast<int64_t>(chan->Size()) * spiller.AvgRecordBytes(),
+            budget);
+  EXPECT_EQ(static_cast<int64_t>(chan->Size()) + spiller.PendingRecordNum(),
+            num);
+
+  chan->Open();
+  spiller.StartRestore(chan.get());
+  std::default_random_engine engine(0);
+  spiller.Shuffle(chan.get(), &engine);
+
+  std::set<uint64_t> seen;
+  std::vector<Record> data;
+  while (chan->Read(data)) {
+    for (auto& r : data) {
+      EXPECT_TRUE(seen.insert(r.search_id).second);
+      EXPECT_EQ(r.ins_id_, "ins" + std::to_string(r.search_id));
+      EXPECT_EQ(r.content_, "content");
+      EXPECT_EQ(r.uid_, "uid");
+      EXPECT_EQ(r.rank, 1u);
+      EXPECT_EQ(r.cmatch, 2u);
+      ASSERT_EQ(r.uint64_feasigns_.size(), 10u);
+      EXPECT_EQ(r.uint64_feasigns_[9].slot(), 9);
+    }
+  }
+  EXPECT_EQ(seen.size(), static_cast<size_t>(num));
+  EXPECT_EQ(spiller.PendingRecordNum(), 0);
+  EXPECT_GT(spiller.RereadBytes(), 0);
+  spiller.Clear();
+  EXPECT_FALSE(spiller.HasSpilled());
+}
+
+TEST(RecordSpiller, RestoreAllIgnoresBudget) {
+  const int num = 20000;
+  auto chan = MakeChannel<Record>();
+  RecordSpiller spiller("./record_spiller_test", 16 << 10);
+  spiller.StartSpill(chan.get());
+  FillChannel(chan.get(), num, 1);
+  chan->Close();
+  spiller.StopSpill();
+  ASSERT_TRUE(spiller.HasSpilled());
+
+  chan->Open();
+  spiller.StartRestore(chan.get());
+  spiller.RestoreAll();
+  EXPECT_TRUE(chan->Closed());
+  EXPECT_EQ(chan->Size(), static_cast<size_t>(num));
+  EXPECT_EQ(spiller.PendingRecordNum(), 0);
+}
+
+// a pass ten times larger than the budget is read twice, as by two training
+// epochs. The channel never holds more than the budget and every record comes
+// once per epoch.
+TEST(RecordSpiller, ReplayLargerThanBudget) {
+  const int num = 50000;
+  const int64_t budget = 256 << 10;
+  auto chan = MakeChannel<Record>();
+  RecordSpiller spiller("./record_spiller_test", budget);
+  spiller.StartSpill(chan.get());
+  FillChannel(chan.get(), num, 4);
+  chan->Close();
+  spiller.StopSpill();
+  ASSERT_TRUE(spiller.HasSpilled());
+  ASSERT_GT(num * spiller.AvgRecordBytes(), budget * 10);
+
+  // some records are restored already when training starts
+  chan->Open();
+  spiller.StartRestore(chan.get());
+  std::vector<Record> data;
+  chan->ReadOnce(data, 100);
+  spiller.StopRestore();
+  spiller.SpillAll(chan.get());
+  EXPECT_TRUE(spiller.Replaying());
+  EXPECT_EQ(chan->Size(), 0u);
+  EXPECT_EQ(spiller.SpilledRecordNum(), num - 100);
+
+  for (int epoch = 0; epoch < 2; ++epoch) {
+    chan->Open();
+    spiller.StartRestore(chan.get());
+    std::set<uint64_t> seen;
+    size_t max_resident = 0;
+    while (chan->ReadOnce(data, 64) > 0) {
+      max_resident = std::max(max_resident, chan->Size() + data.size());
+      for (auto& r : data) {
+        EXPECT_TRUE(seen.insert(r.search_id).second);
+      }
+    }
+    EXPECT_EQ(seen.size(), static_cast<size_t>(num - 100));
+    EXPECT_LE(static_cast<int64_t>(max_resident) * spiller.AvgRecordBytes(),
+              budget);
+    EXPECT_EQ(spiller.PendingRecordNum(), 0);
+    spiller.StopRestore();
+  }
+
+  // out of replay, the records are restored once more
+  spiller.StopReplay();
+  chan->Open();
+  spiller.StartRestore(chan.get());
+  spiller.RestoreAll();
+  EXPECT_EQ(chan->Size(), static_cast<size_t>(num - 100));
+  spiller.Clear();
+  EXPECT_FALSE(spiller.HasSpilled());
+}
+
+class StreamDataset : public MultiSlotDataset {
+ public:
+  using MultiSlotDataset::ReceiveFromClient;
+  ChannelObject<Record>* InputChannel() { return input_channel_.get(); }
+  bool StreamInput() const { return stream_input_; }
+};
+
+// a pass received by the global shuffle is larger than the memory budget of
+// the dataset. It is spilled while received, and the readers stream it from
+// input_channel_ for every epoch without holding more than the budget.
+TEST(RecordSpiller, DatasetStreamsReceivedPass) {
+  const int num = 50000;
+  const int64_t budget_mb = 1;
+  StreamDataset dataset;
+  dataset.SetThreadNum(2);
+  dataset.SetChannelNum(1);
+  dataset.CreateChannel();
+  dataset.SetMemoryBudget(budget_mb, "./record_spiller_test");
+  ShuffleRecordEncoder encoder(kShuffleCodecNone);
+  std::string msg;
+  for (int i = 0; i < num; ++i) {
+    encoder.Add(MakeRecord(i));
+    if ((i + 1) % 1000 == 0) {
+      encoder.Encode(&msg);
+      EXPECT_EQ(dataset.ReceiveFromClient(0, i / 1000 % 4, msg), 0);
+    }
+  }
+  EXPECT_EQ(dataset.GetShuffleDataSize(), num);
+  int64_t record_bytes = RecordSpiller::EstimateBytes(MakeRecord(num));
+  ASSERT_GT(num * record_bytes, (budget_mb << 20) * 10);
+
+  for (int epoch = 0; epoch < 2; ++epoch) {
+    dataset.DynamicAdjustChannelNum(1);
+    EXPECT_TRUE(dataset.StreamInput());
+    EXPECT_EQ(dataset.GetMemoryDataSize(), num);
+    auto* chan = dataset.InputChannel();
+    std::unordered_set<std::string> seen;
+    size_t max_resident = 0;
+    std::vector<Record> data;
+    while (chan->ReadOnce(data, 64) > 0) {
+      max_resident = std::max(max_resident, chan->Size() + data.size());
+      for (auto& r : data) {
+        EXPECT_TRUE(seen.insert(r.ins_id_).second);
+      }
+    }
+    EXPECT_EQ(seen.size(), static_cast<size_t>(num));
+    EXPECT_LE(static_cast<int64_t>(max_resident) * record_bytes,
+              (budget_mb << 20) * 2);
+  }
+}
+
+}  // namespace framework
+}  // namespace paddle
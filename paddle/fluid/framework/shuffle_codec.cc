@@ -0,0 +1,367 @@
+// Copyright (c) 2022 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "paddle/fluid/framework/shuffle_codec.h"
+
+#include <zlib.h>
+
+#include <algorithm>
+#include <cstring>
+
+#include "glog/logging.h"
+
+namespace paddle {
+namespace framework {
+
+// "SHUFCD" and 0xFF, the low byte is the codec
+static const uint64_t kShuffleCodecMagic = 0xFF44434655485300ULL;
+static const uint64_t kShuffleCodecMagicMask = 0xFFFFFFFFFFFFFF00ULL;
+
+static inline void PutVarint(uint64_t v, std::string* out) {
+  while (v >= 0x80) {
+    out->push_back(static_cast<char>(v | 0x80));
+    v >>= 7;
+  }
+  out->push_back(static_cast<char>(v));
+}
+
+static inline uint64_t GetVarint(const char** p, const char* end) {
+  const uint8_t* s = reinterpret_cast<const uint8_t*>(*p);
+  uint64_t v = 0;
+  int shift = 0;
+  while (true) {
+    CHECK(reinterpret_cast<const char*>(s) < end && shift < 64)
+        << "bad varint in shuffle message";
+    uint8_t b = *s++;
+    v |= static_cast<uint64_t>(b & 0x7f) << shift;
+    if (b < 0x80) {
+      break;
+    }
+    shift += 7;
+  }
+  *p = reinterpret_cast<const char*>(s);
+  return v;
+}
+
+static inline uint64_t ZigZag(int64_t v) {
+  return (static_cast<uint64_t>(v) << 1) ^ static_cast<uint64_t>(v >> 63);
+}
+
+static inline int64_t UnZigZag(uint64_t v) {
+  return static_cast<int64_t>((v >> 1) ^ (~(v & 1) + 1));
+}
+
+static inline void GetBytes(const char** p,
+                            const char* end,
+                            void* dst,
+                            size_t n) {
+  CHECK(static_cast<size_t>(end - *p) >= n) << "truncated shuffle message";
+  memcpy(dst, *p, n);
+  *p += n;
+}
+
+static void PutHeader(ShuffleCodecType type,
+                      size_t raw_bytes,
+                      std::string* msg) {
+  uint64_t header = kShuffleCodecMagic | type;
+  msg->assign(reinterpret_cast<const char*>(&header), sizeof(header));
+  PutVarint(raw_bytes, msg);
+}
+
+bool ParseShuffleCodec(const std::string& name, ShuffleCodecType* type) {
+  for (auto t : {kShuffleCodecNone, kShuffleCodecZlib, kShuffleCodecFeasign}) {
+    if (name == ShuffleCodecName(t)) {
+      *type = t;
+      return true;
+    }
+  }
+  return false;
+}
+
+const char* ShuffleCodecName(ShuffleCodecType type) {
+  switch (type) {
+    case kShuffleCodecNone:
+      return "none";
+    case kShuffleCodecZlib:
+      return "zlib";
+    case kShuffleCodecFeasign:
+      return "feasign";
+  }
+  return "unknown";
+}
+
+struct ShuffleRecordEncoder::ZStream {
+  z_stream stream;
+  ZStream() {
+    memset(&stream, 0, sizeof(stream));
+    CHECK(deflateInit(&stream, Z_BEST_SPEED) == Z_OK) << "deflateInit failed";
+  }
+  ~ZStream() { deflateEnd(&stream); }
+};
+
+ShuffleRecordEncoder::ShuffleRecordEncoder(ShuffleCodecType type)
+    : type_(type) {
+  if (type_ == kShuffleCodecZlib) {
+    zstream_.reset(new ZStream());
+  }
+}
+
+ShuffleRecordEncoder::~ShuffleRecordEncoder() {}
+
+uint32_t ShuffleRecordEncoder::FindOrInsert(uint64_t feasign) {
+  if ((dict_size_ + 1) * 2 > dict_keys_.size()) {
+    std::vector<uint64_t> keys;
+    std::vector<uint32_t> values;
+    keys.swap(dict_keys_);
+    values.swap(dict_values_);
+    size_t cap = std::max<size_t>(1024, keys.size() * 2);
+    dict_keys_.resize(cap);
+    dict_values_.assign(cap, 0);
+    for (size_t i = 0; i < keys.size(); ++i) {
+      if (values[i] != 0) {
+        size_t pos = (keys[i] * 0x9E3779B97F4A7C15ULL) >> 32;
+        while (dict_values_[pos & (cap - 1)] != 0) {
+          ++pos;
+        }
+        dict_keys_[pos & (cap - 1)] = keys[i];
+        dict_values_[pos & (cap - 1)] = values[i];
+      }
+    }
+  }
+  const size_t mask = dict_keys_.size() - 1;
+  size_t pos = (feasign * 0x9E3779B97F4A7C15ULL) >> 32;
+  while (true) {
+    uint32_t value = dict_values_[pos & mask];
+    if (value == 0) {
+      dict_keys_[pos & mask] = feasign;
+      dict_values_[pos & mask] = ++dict_size_;
+      return 0;
+    }
+    if (dict_keys_[pos & mask] == feasign) {
+      return value;
+    }
+    ++pos;
+  }
+}
+
+static inline char* WriteVarint(uint64_t v, char* out) {
+  while (v >= 0x80) {
+    *out++ = static_cast<char>(v | 0x80);
+    v >>= 7;
+  }
+  *out++ = static_cast<char>(v);
+  return out;
+}
+
+void ShuffleRecordEncoder::AddFeasigns(
+    const std::vector<FeatureItem>& feasigns, bool is_uint64) {
+  // count, then at most a 3 + 10 byte slot run and a 5 + 8 byte value per
+  // feasign
+  size_t old_size = body_.size();
+  body_.resize(old_size + 10 + feasigns.size() * 26);
+  char* out = &body_[old_size];
+  out = WriteVarint(feasigns.size(), out);
+  // slot runs
+  size_t i = 0;
+  int64_t prev_slot = 0;
+  while (i < feasigns.size()) {
+    size_t j = i + 1;
+    while (j < feasigns.size() && feasigns[j].slot() == feasigns[i].slot()) {
+      ++j;
+    }
+    out = WriteVarint(
+        ZigZag(static_cast<int64_t>(feasigns[i].slot()) - prev_slot), out);
+    out = WriteVarint(j - i, out);
+    prev_slot = feasigns[i].slot();
+    i = j;
+  }
+  for (const auto& fea : feasigns) {
+    if (is_uint64) {
+      uint64_t sign = fea.sign().uint64_feasign_;
+      uint32_t index = FindOrInsert(sign);
+      out = WriteVarint(index, out);
+      if (index == 0) {
+        memcpy(out, &sign, sizeof(sign));
+        out += sizeof(sign);
+      }
+    } else {
+      float sign = fea.sign().float_feasign_;
+      memcpy(out, &sign, sizeof(sign));
+      out += sizeof(sign);
+    }
+  }
+  body_.resize(out - body_.data());
+}
+
+void ShuffleRecordEncoder::Add(const Record& r) {
+  ++record_num_;
+  if (type_ != kShuffleCodecFeasign) {
+    ar_ << r;
+    return;
+  }
+  raw_bytes_ += 3 * sizeof(size_t) +
+                (r.uint64_feasigns_.size() + r.float_feasigns_.size()) *
+                    (sizeof(uint64_t) + sizeof(float) + sizeof(uint16_t)) +
+                r.ins_id_.size();
+  AddFeasigns(r.uint64_feasigns_, true);
+  AddFeasigns(r.float_feasigns_, false);
+  PutVarint(r.ins_id_.size(), &body_);
+  body_.append(r.ins_id_);
+}
+
+size_t ShuffleRecordEncoder::Encode(std::string* msg) {
+  size_t raw_bytes = 0;
+  if (type_ == kShuffleCodecNone) {
+    raw_bytes = ar_.Length();
+    msg->assign(ar_.Buffer(), ar_.Length());
+  } else if (type_ == kShuffleCodecZlib) {
+    raw_bytes = ar_.Length();
+    PutHeader(type_, raw_bytes, msg);
+    z_stream* zs = &zstream_->stream;
+    CHECK(deflateReset(zs) == Z_OK);
+    size_t header_len = msg->size();
+    msg->resize(header_len + deflateBound(zs, raw_bytes));
+    zs->next_in = reinterpret_cast<Bytef*>(ar_.Buffer());
+    zs->avail_in = static_cast<uInt>(raw_bytes);
+    zs->next_out = reinterpret_cast<Bytef*>(&(*msg)[header_len]);
+    zs->avail_out = static_cast<uInt>(msg->size() - header_len);
+    CHECK(deflate(zs, Z_FINISH) == Z_STREAM_END) << "deflate failed";
+    msg->resize(header_len + zs->total_out);
+  } else {
+    raw_bytes = raw_bytes_;
+    PutHeader(type_, raw_bytes, msg);
+    PutVarint(record_num_, msg);
+    msg->append(body_);
+    body_.clear();
+    raw_bytes_ = 0;
+    if (dict_size_ > 0) {
+      std::fill(dict_values_.begin(), dict_values_.end(), 0);
+      dict_size_ = 0;
+    }
+  }
+  ar_.Clear();
+  record_num_ = 0;
+  return raw_bytes;
+}
+
+static void DecodeArchive(char* data,
+                          size_t len,
+                          std::vector<Record>* records) {
+  BinaryArchive ar;
+  ar.SetReadBuffer(data, len, nullptr);
+  while (ar.Cursor() < ar.Finish()) {
+    records->push_back(ar.Get<Record>());
+  }
+  CHECK(ar.Cursor() == ar.Finish());
+}
+
+static void DecodeFeasigns(const char** p,
+                           const char* end,
+                           bool is_uint64,
+                           std::vector<uint64_t>* dict,
+                           std::vector<FeatureItem>* feasigns) {
+  size_t num = GetVarint(p, end);
+  CHECK(num <= static_cast<size_t>(end - *p)) << "bad shuffle message";
+  feasigns->resize(num);
+  int64_t slot = 0;
+  for (size_t i = 0; i < num;) {
+    slot += UnZigZag(GetVarint(p, end));
+    size_t run = GetVarint(p, end);
+    CHECK(run > 0 && run <= num - i) << "bad slot run in shuffle message";
+    for (size_t j = 0; j < run; ++j) {
+      (*feasigns)[i++].slot() = static_cast<uint16_t>(slot);
+    }
+  }
+  for (auto& fea : *feasigns) {
+    FeatureFeasign& sign = fea.sign();
+    sign.uint64_feasign_ = 0;
+    if (is_uint64) {
+      uint64_t index = GetVarint(p, end);
+      if (index == 0) {
+        GetBytes(p, end, &sign.uint64_feasign_, sizeof(uint64_t));
+        dict->push_back(sign.uint64_feasign_);
+      } else {
+        CHECK(index <= dict->size()) << "bad feasign index in shuffle message";
+        sign.uint64_feasign_ = (*dict)[index - 1];
+      }
+    } else {
+      GetBytes(p, end, &sign.float_feasign_, sizeof(float));
+    }
+  }
+}
+
+size_t DecodeShuffleRecords(const char* data,
+                            size_t len,
+                            std::vector<Record>* records) {
+  uint64_t header = 0;
+  if (len >= sizeof(header)) {
+    memcpy(&header, data, sizeof(header));
+  }
+  if ((header & kShuffleCodecMagicMask) != kShuffleCodecMagic) {
+    DecodeArchive(const_cast<char*>(data), len, records);
+    return len;
+  }
+  const char* p = data + sizeof(header);
+  const char* end = data + len;
+  size_t raw_bytes = GetVarint(&p, end);
+  int type = static_cast<int>(header & 0xFF);
+  if (type == kShuffleCodecZlib) {
+    std::unique_ptr<char[]> raw(new char[raw_bytes]);
+    uLongf raw_len = raw_bytes;
+    CHECK(uncompress(reinterpret_cast<Bytef*>(raw.get()),
+                     &raw_len,
+                     reinterpret_cast<const Bytef*>(p),
+                     end - p) == Z_OK &&
+          raw_len == raw_bytes)
+        << "bad zlib shuffle message";
+    DecodeArchive(raw.get(), raw_bytes, records);
+    return raw_bytes;
+  }
+  CHECK(type == kShuffleCodecFeasign)
+      << "unknown shuffle codec " << type << ", the sender is newer";
+  size_t record_num = GetVarint(&p, end);
+  CHECK(record_num <= static_cast<size_t>(end - p)) << "bad shuffle message";
+  std::vector<uint64_t> dict;
+  size_t first = records->size();
+  records->resize(first + record_num);
+  for (size_t i = first; i < records->size(); ++i) {
+    Record& r = (*records)[i];
+    DecodeFeasigns(&p, end, true, &dict, &r.uint64_feasigns_);
+    DecodeFeasigns(&p, end, false, &dict, &r.float_feasigns_);
+    size_t ins_id_len = GetVarint(&p, end);
+    CHECK(ins_id_len <= static_cast<size_t>(end - p))
+        << "truncated shuffle message";
+    r.ins_id_.assign(p, ins_id_len);
+    p += ins_id_len;
+  }
+  CHECK(p == end) << "trailing bytes in shuffle message";
+  return raw_bytes;
+}
+
+void ShuffleCodecStat::Print(const char* name, const char* what) {
+  int64_t raw = raw_bytes.exchange(0);
+  int64_t encoded = encoded_bytes.exchange(0);
+  int64_t num = messages.exchange(0);
+  int64_t us = codec_us.exchange(0);
+  if (num == 0) {
+    return;
+  }
+  VLOG(0) << name << " " << what << " " << num << " messages, raw "
+          << (raw >> 20) << "MB, encoded " << (encoded >> 20) << "MB, ratio "
+          << (encoded > 0 ? static_cast<double>(raw) / encoded : 0.0)
+          << ", codec time " << us / 1e6 << "s";
+}
+
+}  // namespace framework
+}  // namespace paddle
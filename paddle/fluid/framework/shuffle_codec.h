@@ -0,0 +1,105 @@
+// Copyright (c) 2022 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "paddle/fluid/framework/archive.h"
+#include "paddle/fluid/framework/data_feed.h"
+
+namespace paddle {
+namespace framework {
+
+// Codecs of the Record messages of the global shuffle. Every codec keeps
+// what the Record Archive operators keep: uint64_feasigns_, float_feasigns_
+// and ins_id_.
+//   - none: the BinaryArchive bytes, the message format of old versions;
+//   - zlib: the BinaryArchive bytes deflated at the fastest level;
+//   - feasign: records re-encoded with the feasign layout in mind. Slot ids
+//     become (slot delta, run length) pairs, and a uint64 feasign seen before
+//     in the message is replaced by the varint index of its first occurrence.
+// An encoded message starts with an 8 byte header whose last byte is 0xFF,
+// which a BinaryArchive message can not start with (it would be the size of
+// the first feasign vector), so the receiver tells the codec from the
+// message itself and reads the messages of old senders as well.
+enum ShuffleCodecType {
+  kShuffleCodecNone = 0,
+  kShuffleCodecZlib = 1,
+  kShuffleCodecFeasign = 2,
+};
+
+// "none", "zlib" or "feasign", returns false for other names
+bool ParseShuffleCodec(const std::string& name, ShuffleCodecType* type);
+const char* ShuffleCodecName(ShuffleCodecType type);
+
+// Collects the records of one message. Not thread safe, the global shuffle
+// threads have one encoder per destination.
+class ShuffleRecordEncoder {
+ public:
+  explicit ShuffleRecordEncoder(ShuffleCodecType type);
+  ~ShuffleRecordEncoder();
+
+  void Add(const Record& r);
+  bool Empty() const { return record_num_ == 0; }
+  // encodes the records added since the last call into msg, returns their
+  // BinaryArchive size
+  size_t Encode(std::string* msg);
+
+ private:
+  void AddFeasigns(const std::vector<FeatureItem>& feasigns, bool is_uint64);
+  uint32_t FindOrInsert(uint64_t feasign);
+
+  ShuffleCodecType type_;
+  size_t record_num_ = 0;
+  size_t raw_bytes_ = 0;
+  BinaryArchive ar_;
+  std::string body_;
+  // feasign -> index + 1 in the message, open addressing
+  std::vector<uint64_t> dict_keys_;
+  std::vector<uint32_t> dict_values_;
+  uint32_t dict_size_ = 0;
+  struct ZStream;
+  std::unique_ptr<ZStream> zstream_;
+};
+
+// Appends the records of a message of any codec to records, returns their
+// BinaryArchive size.
+size_t DecodeShuffleRecords(const char* data,
+                            size_t len,
+                            std::vector<Record>* records);
+
+// bytes before and after encoding, summed over threads
+struct ShuffleCodecStat {
+  std::atomic<int64_t> raw_bytes{0};
+  std::atomic<int64_t> encoded_bytes{0};
+  std::atomic<int64_t> messages{0};
+  std::atomic<int64_t> codec_us{0};
+
+  void Add(size_t raw, size_t encoded, int64_t us) {
+    raw_bytes += raw;
+    encoded_bytes += encoded;
+    ++messages;
+    codec_us += us;
+  }
+  // logs and resets the statistics
+  void Print(const char* name, const char* what);
+};
+
+}  // namespace framework
+}  // namespace paddle
@@ -0,0 +1,180 @@
+// Copyright (c) 2022 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "paddle/fluid/framework/shuffle_codec.h"
+
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "paddle/fluid/framework/data_set.h"
+
+namespace paddle {
+namespace framework {
+
+static std::vector<Record> MakeRecords(int num) {
+  std::default_random_engine engine(0);
+  std::vector<Record> records(num);
+  for (int i = 0; i < num; ++i) {
+    Record& r = records[i];
+    for (uint16_t slot = 0; slot < 30; slot += 1 + engine() % 3) {
+      int feasign_num = 1 + engine() % 3;
+      for (int k = 0; k < feasign_num; ++k) {
+        FeatureFeasign sign;
+        // a few feasigns repeat across records, as popular features do
+        sign.uint64_feasign_ = (engine() % 4 == 0)
+                                   ? slot * 1000ULL + engine() % 8
+                                   : (static_cast<uint64_t>(engine()) << 32) ^
+                                         engine();
+        r.uint64_feasigns_.emplace_back(sign, slot);
+      }
+    }
+    for (uint16_t slot = 30; slot < 33; ++slot) {
+      FeatureFeasign sign;
+      sign.uint64_feasign_ = 0;
+      sign.float_feasign_ = static_cast<float>(engine() % 1000) / 7;
+      r.float_feasigns_.emplace_back(sign, slot);
+    }
+    r.ins_id_ = "ins_" + std::to_string(i) + "_" + std::to_string(engine());
+  }
+  // an empty record and an unsorted one
+  records[1].uint64_feasigns_.clear();
+  records[1].float_feasigns_.clear();
+  std::swap(records[2].uint64_feasigns_.front(),
+            records[2].uint64_feasigns_.back());
+  return records;
+}
+
+static void ExpectSameRecords(const std::vector<Record>& expect,
+                              const std::vector<Record>& actual) {
+  ASSERT_EQ(expect.size(), actual.size());
+  auto same_feasigns = [](const std::vector<FeatureItem>& a,
+                          const std::vector<FeatureItem>& b,
+                          bool is_uint64) {
+    if (a.size() != b.size()) {
+      return false;
+    }
+    for (size_t i = 0; i < a.size(); ++i) {
+      if (a[i].slot() != b[i].slot() ||
+          (is_uint64 ? a[i].sign().uint64_feasign_ !=
+                           b[i].sign().uint64_feasign_
+                     : a[i].sign().float_feasign_ !=
+                           b[i].sign().float_feasign_)) {
+        return false;
+      }
+    }
+    return true;
+  };
+  for (size_t i = 0; i < expect.size(); ++i) {
+    EXPECT_TRUE(same_feasigns(
+        expect[i].uint64_feasigns_, actual[i].uint64_feasigns_, true))
+        << i;
+    EXPECT_TRUE(same_feasigns(
+        expect[i].float_feasigns_, actual[i].float_feasigns_, false))
+        << i;
+    EXPECT_EQ(expect[i].ins_id_, actual[i].ins_id_);
+  }
+}
+
+TEST(ShuffleCodec, RoundTrip) {
+  std::vector<Record> records = MakeRecords(500);
+  BinaryArchive ar;
+  for (auto& r : records) {
+    ar << r;
+  }
+  for (auto type :
+       {kShuffleCodecNone, kShuffleCodecZlib, kShuffleCodecFeasign}) {
+    ShuffleCodecType parsed = kShuffleCodecNone;
+    ASSERT_TRUE(ParseShuffleCodec(ShuffleCodecName(type), &parsed));
+    EXPECT_EQ(parsed, type);
+    ShuffleRecordEncoder encoder(type);
+    // twice, the encoder is reused from message to message
+    for (int round = 0; round < 2; ++round) {
+      EXPECT_TRUE(encoder.Empty());
+      for (auto& r : records) {
+        encoder.Add(r);
+      }
+      std::string msg;
+      EXPECT_EQ(encoder.Encode(&msg), ar.Length());
+      if (type != kShuffleCodecNone) {
+        EXPECT_LT(msg.size(), ar.Length()) << ShuffleCodecName(type);
+      }
+      std::vector<Record> decoded;
+      EXPECT_EQ(DecodeShuffleRecords(msg.data(), msg.size(), &decoded),
+                ar.Length());
+      ExpectSameRecords(records, decoded);
+    }
+  }
+  ShuffleCodecType type = kShuffleCodecNone;
+  EXPECT_FALSE(ParseShuffleCodec("lz4", &type));
+}
+
+class LoopbackDataset : public MultiSlotDataset {
+ public:
+  using MultiSlotDataset::ReceiveFromClient;
+
+  std::vector<Record> TakeOutput() {
+    std::vector<Record> all;
+    for (auto& chan : multi_output_channel_) {
+      std::vector<Record> part;
+      chan->Close();
+      chan->ReadAll(part);
+      chan->Clear();
+      chan->Open();
+      all.insert(all.end(), part.begin(), part.end());
+    }
+    // the receiver threads write the messages in any order
+    std::sort(all.begin(), all.end(), [](const Record& a, const Record& b) {
+      return a.ins_id_ < b.ins_id_;
+    });
+    return all;
+  }
+};
+
+// messages of every codec go through the client to client handler, the
+// records come out of the output channels
+TEST(ShuffleCodec, ReceiveFromClient) {
+  std::vector<Record> records = MakeRecords(300);
+  std::sort(records.begin(), records.end(),
+            [](const Record& a, const Record& b) {
+              return a.ins_id_ < b.ins_id_;
+            });
+  LoopbackDataset dataset;
+  dataset.SetChannelNum(1);
+  dataset.CreateChannel();
+  for (auto type :
+       {kShuffleCodecNone, kShuffleCodecZlib, kShuffleCodecFeasign}) {
+    dataset.SetShuffleCodec(ShuffleCodecName(type));
+    ShuffleRecordEncoder encoder(type);
+    std::vector<std::string> msgs(3);
+    for (size_t i = 0; i < records.size(); ++i) {
+      encoder.Add(records[i]);
+      if ((i + 1) % 100 == 0) {
+        encoder.Encode(&msgs[i / 100]);
+      }
+    }
+    for (int i = 0; i < 3; ++i) {
+      EXPECT_EQ(dataset.ReceiveFromClient(0, i, msgs[i]), 0);
+    }
+    EXPECT_EQ(dataset.GetShuffleDataSize(),
+              static_cast<int64_t>(records.size()));
+    ExpectSameRecords(records, dataset.TakeOutput());
+  }
+  EXPECT_THROW(dataset.SetShuffleCodec("lz4"), paddle::platform::EnforceNotMet);
+}
+
+}  // namespace framework
+}  // namespace paddle
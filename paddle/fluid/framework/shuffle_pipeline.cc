@@ -0,0 +1,316 @@
+// Copyright (c) 2022 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "paddle/fluid/framework/shuffle_pipeline.h"
+
+#include <chrono>  // NOLINT
+#include <utility>
+
+#include "glog/logging.h"
+
+namespace paddle {
+namespace framework {
+
+static double SecondsSince(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                       start)
+      .count();
+}
+
+// the peer with the largest stall, and the sums over all peers
+static void PrintPeerStat(const char* name,
+                          const char* what,
+                          const std::vector<ShufflePeerStat>& stats) {
+  ShufflePeerStat total;
+  size_t slowest = 0;
+  for (size_t i = 0; i < stats.size(); ++i) {
+    total.bytes += stats[i].bytes;
+    total.messages += stats[i].messages;
+    total.failed += stats[i].failed;
+    total.stall_seconds += stats[i].stall_seconds;
+    if (stats[i].stall_seconds > stats[slowest].stall_seconds) {
+      slowest = i;
+    }
+    VLOG(3) << name << " " << what << " peer " << i
+            << ": bytes=" << stats[i].bytes
+            << ", messages=" << stats[i].messages
+            << ", failed=" << stats[i].failed
+            << ", stall=" << stats[i].stall_seconds << "s";
+  }
+  std::string most_stalled;
+  if (!stats.empty()) {
+    most_stalled = ", most stalled peer=" + std::to_string(slowest) + " (" +
+                   std::to_string(stats[slowest].stall_seconds) + "s)";
+  }
+  VLOG(0) << name << " " << what << " stat: peers=" << stats.size()
+          << ", bytes=" << (total.bytes >> 20)
+          << "MB, messages=" << total.messages << ", failed=" << total.failed
+          << ", stall=" << total.stall_seconds << "s" << most_stalled;
+}
+
+ShuffleSender::ShuffleSender(int peer_num,
+                             int64_t max_inflight_bytes,
+                             SendFunc send_func)
+    : max_inflight_bytes_(max_inflight_bytes),
+      send_func_(std::move(send_func)),
+      peers_(peer_num) {
+  CHECK(peer_num > 0) << "peer_num must be > 0";
+  complete_thread_ = std::thread([this] { CompleteLoop(); });
+}
+
+ShuffleSender::~ShuffleSender() { Finish(); }
+
+void ShuffleSender::Send(int peer, const std::string& msg) {
+  CHECK(peer >= 0 && peer < static_cast<int>(peers_.size()))
+      << "bad peer " << peer;
+  const int64_t bytes = msg.size();
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    Peer& p = peers_[peer];
+    if (p.inflight_bytes > 0 &&
+        p.inflight_bytes + bytes > max_inflight_bytes_) {
+      auto start = std::chrono::steady_clock::now();
+      complete_cond_.wait(lock, [this, &p, bytes] {
+        return p.inflight_bytes == 0 ||
+               p.inflight_bytes + bytes <= max_inflight_bytes_;
+      });
+      p.stat.stall_seconds += SecondsSince(start);
+    }
+    p.inflight_bytes += bytes;
+    ++inflight_messages_;
+  }
+  Pending pending{peer, bytes, send_func_(peer, msg)};
+  // a wrapper without transport returns no future
+  if (!pending.status.valid()) {
+    Complete(peer, bytes, 0);
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    pending_.push_back(std::move(pending));
+  }
+  pending_cond_.notify_one();
+}
+
+void ShuffleSender::Complete(int peer, int64_t bytes, int32_t ret) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Peer& p = peers_[peer];
+    p.inflight_bytes -= bytes;
+    p.stat.bytes += bytes;
+    ++p.stat.messages;
+    if (ret != 0) {
+      ++p.stat.failed;
+      LOG(WARNING) << "global shuffle send to peer " << peer
+                   << " failed, ret=" << ret;
+    }
+    --inflight_messages_;
+  }
+  complete_cond_.notify_all();
+}
+
+void ShuffleSender::CompleteLoop() {
+  std::vector<Pending> waiting;
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      if (waiting.empty()) {
+        pending_cond_.wait(lock,
+                           [this] { return stop_ || !pending_.empty(); });
+        if (pending_.empty()) {
+          break;
+        }
+      }
+      for (auto& p : pending_) {
+        waiting.push_back(std::move(p));
+      }
+      pending_.clear();
+    }
+    // acknowledgements come back in any order, so poll them all and sleep on
+    // the oldest only when none is ready
+    size_t left = 0;
+    for (size_t i = 0; i < waiting.size(); ++i) {
+      if (waiting[i].status.wait_for(std::chrono::seconds(0)) !=
+          std::future_status::timeout) {
+        Complete(waiting[i].peer, waiting[i].bytes, waiting[i].status.get());
+      } else {
+        if (left != i) {
+          waiting[left] = std::move(waiting[i]);
+        }
+        ++left;
+      }
+    }
+    bool none_ready = (left == waiting.size());
+    waiting.resize(left);
+    if (none_ready && !waiting.empty()) {
+      waiting.front().status.wait_for(std::chrono::milliseconds(1));
+    }
+  }
+}
+
+int64_t ShuffleSender::Finish() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  complete_cond_.wait(lock, [this] { return inflight_messages_ == 0; });
+  stop_ = true;
+  lock.unlock();
+  pending_cond_.notify_all();
+  if (complete_thread_.joinable()) {
+    complete_thread_.join();
+  }
+  lock.lock();
+  int64_t failed = 0;
+  for (auto& p : peers_) {
+    failed += p.stat.failed;
+  }
+  return failed;
+}
+
+ShufflePeerStat ShuffleSender::GetPeerStat(int peer) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return peers_.at(peer).stat;
+}
+
+void ShuffleSender::PrintStat(const char* name) {
+  std::vector<ShufflePeerStat> stats;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto& p : peers_) {
+      stats.push_back(p.stat);
+    }
+  }
+  PrintPeerStat(name, "send", stats);
+}
+
+ShuffleReceiver::ShuffleReceiver(int thread_num,
+                                 int64_t max_pending_bytes,
+                                 HandleFunc handle_func)
+    : max_pending_bytes_(max_pending_bytes),
+      handle_func_(std::move(handle_func)) {
+  for (int i = 0; i < thread_num; ++i) {
+    threads_.emplace_back([this] { HandleLoop(); });
+  }
+}
+
+ShuffleReceiver::~ShuffleReceiver() {
+  Wait();
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  pop_cond_.notify_all();
+  for (auto& t : threads_) {
+    t.join();
+  }
+}
+
+ShufflePeerStat* ShuffleReceiver::MutablePeerStat(int peer) {
+  CHECK(peer >= 0) << "bad peer " << peer;
+  if (static_cast<size_t>(peer) >= peers_.size()) {
+    peers_.resize(peer + 1);
+  }
+  return &peers_[peer];
+}
+
+void ShuffleReceiver::Push(int peer, const std::string& msg) {
+  const int64_t bytes = msg.size();
+  if (threads_.empty()) {
+    auto start = std::chrono::steady_clock::now();
+    handle_func_(peer, msg);
+    std::lock_guard<std::mutex> lock(mutex_);
+    handle_seconds_ += SecondsSince(start);
+    ShufflePeerStat* stat = MutablePeerStat(peer);
+    stat->bytes += bytes;
+    ++stat->messages;
+    return;
+  }
+  // copied before taking the lock, the rpc threads copy in parallel
+  Message message{peer, msg};
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    ShufflePeerStat* stat = MutablePeerStat(peer);
+    if (pending_bytes_ > 0 && pending_bytes_ + bytes > max_pending_bytes_) {
+      auto start = std::chrono::steady_clock::now();
+      push_cond_.wait(lock, [this, bytes] {
+        return pending_bytes_ == 0 ||
+               pending_bytes_ + bytes <= max_pending_bytes_;
+      });
+      // peers_ may have grown meanwhile
+      stat = MutablePeerStat(peer);
+      stat->stall_seconds += SecondsSince(start);
+    }
+    stat->bytes += bytes;
+    ++stat->messages;
+    pending_bytes_ += bytes;
+    ++unhandled_;
+    queue_.push_back(std::move(message));
+  }
+  pop_cond_.notify_one();
+}
+
+void ShuffleReceiver::HandleLoop() {
+  while (true) {
+    Message message;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      pop_cond_.wait(lock, [this] { return stop_ || !queue_.empty(); });
+      if (queue_.empty()) {
+        return;
+      }
+      message = std::move(queue_.front());
+      queue_.pop_front();
+      pending_bytes_ -= message.data.size();
+    }
+    push_cond_.notify_all();
+    auto start = std::chrono::steady_clock::now();
+    handle_func_(message.peer, message.data);
+    double seconds = SecondsSince(start);
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      handle_seconds_ += seconds;
+      --unhandled_;
+    }
+    push_cond_.notify_all();
+  }
+}
+
+void ShuffleReceiver::Wait() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  push_cond_.wait(lock, [this] { return unhandled_ == 0; });
+}
+
+ShufflePeerStat ShuffleReceiver::GetPeerStat(int peer) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return static_cast<size_t>(peer) < peers_.size() ? peers_[peer]
+                                                   : ShufflePeerStat();
+}
+
+void ShuffleReceiver::PrintStat(const char* name) {
+  std::vector<ShufflePeerStat> stats;
+  double handle_seconds = 0;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stats.swap(peers_);
+    handle_seconds = handle_seconds_;
+    handle_seconds_ = 0;
+  }
+  if (stats.empty()) {
+    return;
+  }
+  PrintPeerStat(name, "receive", stats);
+  VLOG(0) << name << " receive threads=" << threads_.size()
+          << ", handle time=" << handle_seconds << "s";
+}
+
+}  // namespace framework
+}  // namespace paddle
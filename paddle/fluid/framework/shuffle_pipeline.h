@@ -0,0 +1,144 @@
+// Copyright (c) 2022 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <condition_variable>  // NOLINT
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>  // NOLINT
+#include <mutex>   // NOLINT
+#include <string>
+#include <thread>  // NOLINT
+#include <vector>
+
+namespace paddle {
+namespace framework {
+
+// traffic with one peer of the global shuffle
+struct ShufflePeerStat {
+  int64_t bytes = 0;
+  int64_t messages = 0;
+  int64_t failed = 0;
+  // time spent blocked on the bytes limit
+  double stall_seconds = 0;
+};
+
+// ShuffleSender sends the messages of the global shuffle threads without
+// waiting for each of them. Every peer has its own queue of messages in
+// flight, bounded by max_inflight_bytes: Send() returns as soon as the
+// message is handed to send_func, and only blocks while the peer already has
+// max_inflight_bytes unacknowledged. A completion thread collects the
+// futures of send_func in any order and frees their bytes, so the callers
+// serialize their next block while the previous ones are on the wire.
+// send_func must copy msg before it returns, as
+// FleetWrapper::SendClientToClientMsg does.
+class ShuffleSender {
+ public:
+  typedef std::function<std::future<int32_t>(int peer, const std::string& msg)>
+      SendFunc;
+
+  ShuffleSender(int peer_num, int64_t max_inflight_bytes, SendFunc send_func);
+  ~ShuffleSender();
+
+  // thread safe, a message larger than the limit is sent alone
+  void Send(int peer, const std::string& msg);
+  // waits until every message is acknowledged, returns the failed ones.
+  // Send() must not be called after it.
+  int64_t Finish();
+
+  ShufflePeerStat GetPeerStat(int peer);
+  void PrintStat(const char* name);
+
+ private:
+  struct Pending {
+    int peer;
+    int64_t bytes;
+    std::future<int32_t> status;
+  };
+  struct Peer {
+    int64_t inflight_bytes = 0;
+    ShufflePeerStat stat;
+  };
+
+  void CompleteLoop();
+  void Complete(int peer, int64_t bytes, int32_t ret);
+
+  int64_t max_inflight_bytes_;
+  SendFunc send_func_;
+  std::thread complete_thread_;
+
+  std::mutex mutex_;
+  // wakes the completion thread
+  std::condition_variable pending_cond_;
+  // wakes the senders blocked on a peer, and Finish()
+  std::condition_variable complete_cond_;
+  std::vector<Pending> pending_;
+  std::vector<Peer> peers_;
+  int64_t inflight_messages_ = 0;
+  bool stop_ = false;
+};
+
+// ShuffleReceiver takes the messages out of the rpc threads: Push() copies a
+// message into a queue and returns, thread_num threads run handle_func on
+// them, e.g. deserialize and write into the output channels. Push() blocks
+// while max_pending_bytes are queued, which holds back the senders instead of
+// growing the queue. With thread_num 0 messages are handled in Push().
+// Messages may still be queued after the senders are done, Wait() before the
+// output of handle_func is used.
+class ShuffleReceiver {
+ public:
+  typedef std::function<void(int peer, const std::string& msg)> HandleFunc;
+
+  ShuffleReceiver(int thread_num,
+                  int64_t max_pending_bytes,
+                  HandleFunc handle_func);
+  ~ShuffleReceiver();
+
+  void Push(int peer, const std::string& msg);
+  // waits until every pushed message is handled
+  void Wait();
+
+  ShufflePeerStat GetPeerStat(int peer);
+  // logs and resets the statistics, if any message came since the last call
+  void PrintStat(const char* name);
+
+ private:
+  struct Message {
+    int peer;
+    std::string data;
+  };
+
+  void HandleLoop();
+  ShufflePeerStat* MutablePeerStat(int peer);
+
+  int64_t max_pending_bytes_;
+  HandleFunc handle_func_;
+  std::vector<std::thread> threads_;
+
+  std::mutex mutex_;
+  std::condition_variable push_cond_;
+  std::condition_variable pop_cond_;
+  std::deque<Message> queue_;
+  int64_t pending_bytes_ = 0;
+  // queued or being handled
+  int64_t unhandled_ = 0;
+  double handle_seconds_ = 0;
+  std::vector<ShufflePeerStat> peers_;
+  bool stop_ = false;
+};
+
+}  // namespace framework
+}  // namespace paddle
@@ -0,0 +1,166 @@
+// Copyright (c) 2022 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "paddle/fluid/framework/shuffle_pipeline.h"
+
+#include <atomic>
+#include <chrono>  // NOLINT
+#include <memory>
+#include <string>
+#include <thread>  // NOLINT
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace paddle {
+namespace framework {
+
+// in-process trainers: a send is acknowledged after the receiver of the peer
+// took the message, a few ms later like an rpc
+TEST(ShufflePipeline, Trainers) {
+  const int trainer_num = 4;
+  const int threads_per_trainer = 3;
+  const int messages_per_thread = 40;
+  const int64_t max_inflight_bytes = 4096;
+
+  std::vector<std::atomic<int64_t>> received_sum(trainer_num);
+  std::vector<std::atomic<int64_t>> inflight(trainer_num);
+  std::atomic<int64_t> max_inflight{0};
+  std::vector<std::unique_ptr<ShuffleReceiver>> receivers;
+  for (int i = 0; i < trainer_num; ++i) {
+    received_sum[i] = 0;
+    inflight[i] = 0;
+    receivers.emplace_back(new ShuffleReceiver(
+        2, 8192, [&received_sum, i](int peer, const std::string& msg) {
+          std::this_thread::sleep_for(std::chrono::microseconds(200));
+          received_sum[i] += std::stoll(msg.substr(0, msg.find(' ')));
+        }));
+  }
+
+  auto run_trainer = [&](int trainer) {
+    // inflight of a destination adds up over the senders of all trainers,
+    // each sender keeps its own below max_inflight_bytes
+    ShuffleSender sender(
+        trainer_num,
+        max_inflight_bytes,
+        [&, trainer](int peer, const std::string& msg) {
+          int64_t now = (inflight[peer] += msg.size());
+          int64_t max = max_inflight.load();
+          while (now > max && !max_inflight.compare_exchange_weak(max, now)) {
+          }
+          return std::async(std::launch::async, [&, trainer, peer, msg] {
+            std::this_thread::sleep_for(std::chrono::milliseconds(2));
+            receivers[peer]->Push(trainer, msg);
+            inflight[peer] -= msg.size();
+            return peer == trainer_num - 1 && msg.size() > 1000 ? -1 : 0;
+          });
+        });
+    std::vector<std::thread> threads;
+    for (int t = 0; t < threads_per_trainer; ++t) {
+      threads.emplace_back([&, t] {
+        for (int m = 0; m < messages_per_thread; ++m) {
+          int value = t * messages_per_thread + m;
+          std::string msg = std::to_string(value) + " ";
+          // the last message of each thread is over the limit, and fails
+          // on the last peer
+          msg.resize(m + 1 == messages_per_thread ? 5000 : 100 + value % 300,
+                     'x');
+          sender.Send(value % trainer_num, msg);
+        }
+      });
+    }
+    for (auto& t : threads) {
+      t.join();
+    }
+    int64_t failed = sender.Finish();
+    int64_t messages = 0;
+    for (int i = 0; i < trainer_num; ++i) {
+      messages += sender.GetPeerStat(i).messages;
+      EXPECT_EQ(sender.GetPeerStat(i).failed,
+                i == trainer_num - 1 ? threads_per_trainer : 0);
+    }
+    EXPECT_EQ(messages, threads_per_trainer * messages_per_thread);
+    EXPECT_EQ(failed, threads_per_trainer);
+    sender.PrintStat("trainer");
+  };
+
+  std::vector<std::thread> trainers;
+  for (int i = 0; i < trainer_num; ++i) {
+    trainers.emplace_back(run_trainer, i);
+  }
+  for (auto& t : trainers) {
+    t.join();
+  }
+  // the barrier after the shuffle, then wait for the deserialization
+  int64_t expect_sum = 0;
+  for (int i = 0; i < trainer_num; ++i) {
+    receivers[i]->Wait();
+    EXPECT_EQ(receivers[i]->GetPeerStat(0).messages,
+              threads_per_trainer * messages_per_thread / trainer_num);
+    expect_sum += received_sum[i];
+    receivers[i]->PrintStat("trainer");
+  }
+  int values = threads_per_trainer * messages_per_thread;
+  EXPECT_EQ(expect_sum, static_cast<int64_t>(values) * (values - 1) / 2 *
+                            trainer_num);
+  EXPECT_LE(max_inflight.load(), trainer_num * (max_inflight_bytes + 5000));
+}
+
+TEST(ShufflePipeline, NoTransport) {
+  // FleetWrapper without pslib returns no future
+  ShuffleSender sender(2, 100, [](int peer, const std::string& msg) {
+    return std::future<int32_t>();
+  });
+  for (int i = 0; i < 10; ++i) {
+    sender.Send(i % 2, std::string(60, 'x'));
+  }
+  EXPECT_EQ(sender.Finish(), 0);
+  EXPECT_EQ(sender.GetPeerStat(1).messages, 5);
+}
+
+TEST(ShufflePipeline, ReceiverBound) {
+  std::atomic<bool> release{false};
+  std::atomic<int> handled{0};
+  ShuffleReceiver receiver(1, 100, [&](int peer, const std::string& msg) {
+    while (!release) {
+      std::this_thread::yield();
+    }
+    ++handled;
+  });
+  std::atomic<int> pushed{0};
+  std::thread rpc([&] {
+    for (int i = 0; i < 4; ++i) {
+      receiver.Push(i, std::string(60, 'x'));
+      ++pushed;
+    }
+  });
+  // one message is being handled and one is queued, the third one waits
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  EXPECT_EQ(pushed.load(), 2);
+  release = true;
+  rpc.join();
+  receiver.Wait();
+  EXPECT_EQ(handled.load(), 4);
+  EXPECT_GT(receiver.GetPeerStat(2).stall_seconds, 0);
+  EXPECT_EQ(receiver.GetPeerStat(3).bytes, 60);
+
+  ShuffleReceiver inline_receiver(0, 0, [&](int peer, const std::string& msg) {
+    ++handled;
+  });
+  inline_receiver.Push(0, "x");
+  EXPECT_EQ(handled.load(), 5);
+}
+
+}  // namespace framework
+}  // namespace paddle
@@ -0,0 +1,149 @@
+/* Copyright (c) 2022 PaddlePaddle Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License. */
+
+#include <chrono>  // NOLINT
+#include <mutex>   // NOLINT
+#include <random>
+#include <thread>  // NOLINT
+#include <unordered_set>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "paddle/fluid/framework/data_feed.h"
+
+namespace paddle {
+namespace framework {
+
+// the free threads work in the background, wait for them to get the pool
+// down to capacity
+static bool WaitCapacity(SlotObjPool* pool, size_t capacity) {
+  for (int i = 0; i < 1000; ++i) {
+    if (pool->capacity() <= capacity) {
+      return true;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  return false;
+}
+
+// threads get, fill and put records back, some through other threads, while
+// the caches are trimmed. No record is handed out twice and all of them can
+// be freed at the end.
+TEST(SlotObjPool, MultiThreadGetPutTrim) {
+  SlotObjPool pool;
+  pool.set_max_capacity(20000);
+  std::mutex mutex;
+  std::unordered_set<SlotRecord> outstanding;
+  // records got by one thread and put by the next one
+  std::vector<std::vector<SlotRecord>> handoff(8);
+  std::vector<std::mutex> handoff_mutex(8);
+  std::atomic<bool> stop{false};
+
+  std::thread trimmer([&pool, &stop]() {
+    while (!stop) {
+      pool.trim();
+      std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+  });
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 8; ++t) {
+    threads.emplace_back([&, t]() {
+      std::mt19937 engine(t);
+      std::uniform_int_distribution<size_t> num(1, 5000);
+      std::vector<SlotRecord> records;
+      for (int round = 0; round < 20; ++round) {
+        pool.get(&records, num(engine));
+        {
+          std::lock_guard<std::mutex> lock(mutex);
+          for (auto rec : records) {
+            ASSERT_TRUE(outstanding.insert(rec).second);
+          }
+        }
+        for (auto rec : records) {
+          // put resets the feasigns
+          EXPECT_TRUE(rec->slot_uint64_feasigns_.slot_values.empty());
+          rec->slot_uint64_feasigns_.slot_values.push_back(t);
+        }
+        std::vector<SlotRecord> others;
+        {
+          std::lock_guard<std::mutex> lock(handoff_mutex[t]);
+          others.swap(handoff[t]);
+        }
+        {
+          std::lock_guard<std::mutex> lock(handoff_mutex[(t + 1) % 8]);
+          auto& next = handoff[(t + 1) % 8];
+          next.insert(next.end(), records.begin(),
+                      records.begin() + records.size() / 2);
+        }
+        records.erase(records.begin(), records.begin() + records.size() / 2);
+        records.insert(records.end(), others.begin(), others.end());
+        {
+          std::lock_guard<std::mutex> lock(mutex);
+          for (auto rec : records) {
+            ASSERT_EQ(outstanding.erase(rec), 1u);
+          }
+        }
+        pool.put(&records);
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  for (auto& records : handoff) {
+    for (auto rec : records) {
+      ASSERT_EQ(outstanding.erase(rec), 1u);
+    }
+    pool.put(&records);
+  }
+  stop = true;
+  trimmer.join();
+  EXPECT_TRUE(outstanding.empty());
+
+  auto stat = pool.stat();
+  EXPECT_GT(stat.cross_thread_put, 0u);
+  EXPECT_GT(stat.depot_transfer, 0u);
+  // the caches count for max_capacity once trimmed
+  pool.trim();
+  EXPECT_TRUE(WaitCapacity(&pool, 20000));
+  pool.set_max_capacity(0);
+  pool.trim();
+  EXPECT_TRUE(WaitCapacity(&pool, 0));
+}
+
+// a disabled pool does not keep the records cached by the threads, and the
+// caches of threads that went idle are drained by the free threads
+TEST(SlotObjPool, DrainCaches) {
+  SlotObjPool pool;
+  std::thread([&pool]() {
+    std::vector<SlotRecord> records;
+    pool.get(&records, 5000);
+    pool.put(&records);
+  }).join();
+  EXPECT_EQ(pool.capacity(), 5000u);
+  pool.disable_pool(true);
+  EXPECT_TRUE(WaitCapacity(&pool, 0));
+  pool.disable_pool(false);
+
+  pool.set_max_capacity(0);
+  std::thread([&pool]() {
+    std::vector<SlotRecord> records;
+    pool.get(&records, 5000);
+    pool.put(&records);
+  }).join();
+  EXPECT_TRUE(WaitCapacity(&pool, 0));
+}
+
+}  // namespace framework
+}  // namespace paddle
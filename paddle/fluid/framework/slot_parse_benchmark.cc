@@ -0,0 +1,306 @@
+// Copyright (c) 2022 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Parse throughput of the MultiSlot text format over a synthetic file.
+// Compares the strtoull parser of SlotRecordInMemoryDataFeed (a string per
+// line, values staged per slot and then copied) with ParseSlotText working
+// in place on the read buffer.
+//   ./slot_parse_benchmark --lines=50000 --uint64_slots=200 --used_ratio=0.5
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>  // NOLINT
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "gflags/gflags.h"
+#include "glog/logging.h"
+#include "paddle/fluid/framework/slot_text_parser.h"
+
+DEFINE_string(file, "", "Text file to parse, a synthetic one if empty.");
+DEFINE_int64(lines, 50000, "Lines of the synthetic file.");
+DEFINE_int32(uint64_slots, 200, "uint64 slots of the synthetic file.");
+DEFINE_int32(float_slots, 10, "float slots of the synthetic file.");
+DEFINE_int32(max_feasigns, 4, "Max feasigns per slot, at least 1.");
+DEFINE_double(used_ratio, 0.5, "Ratio of slots the model uses.");
+DEFINE_int32(repeat, 3, "Timed passes over the file, the best is reported.");
+
+namespace paddle {
+namespace framework {
+
+struct BenchSlotValues {
+  template <typename T>
+  struct Values {
+    std::vector<T> slot_values;
+    std::vector<uint32_t> slot_offsets;
+  };
+  Values<uint64_t> uint64_values;
+  Values<float> float_values;
+};
+
+static std::string WriteSyntheticFile(std::vector<SlotTextInfo>* slots) {
+  std::default_random_engine engine(0);
+  std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+  int slot_num = FLAGS_uint64_slots + FLAGS_float_slots;
+  for (int i = 0; i < slot_num; ++i) {
+    slots->emplace_back();
+    slots->back().type = (i < FLAGS_uint64_slots) ? 'u' : 'f';
+  }
+  std::string path = FLAGS_file;
+  if (path.empty()) {
+    path = "./slot_parse_benchmark." + std::to_string(getpid()) + ".txt";
+    FILE* fp = fopen(path.c_str(), "w");
+    CHECK(fp != nullptr) << "can not open " << path;
+    std::string line;
+    for (int64_t n = 0; n < FLAGS_lines; ++n) {
+      line.clear();
+      for (int i = 0; i < slot_num; ++i) {
+        int num = 1 + engine() % FLAGS_max_feasigns;
+        line += std::to_string(num);
+        for (int j = 0; j < num; ++j) {
+          line += ' ';
+          if (i < FLAGS_uint64_slots) {
+            line += std::to_string((static_cast<uint64_t>(engine()) << 32) ^
+                                   engine());
+          } else {
+            char buf[32];
+            snprintf(buf, sizeof(buf), "%.6f", uniform(engine));
+            line += buf;
+          }
+        }
+        line += (i + 1 < slot_num) ? ' ' : '\n';
+      }
+      CHECK(fwrite(line.data(), 1, line.size(), fp) == line.size());
+    }
+    fclose(fp);
+  }
+  int uint64_idx = 0;
+  int float_idx = 0;
+  for (auto& slot : *slots) {
+    // the strtoull parser can not skip the last slot
+    slot.used =
+        (&slot == &slots->back()) || uniform(engine) < FLAGS_used_ratio;
+    if (slot.used) {
+      slot.slot_value_idx = (slot.type == 'u') ? uint64_idx++ : float_idx++;
+    }
+  }
+  return path;
+}
+
+// reads fp in 4MB chunks like BufferedLineFileReader, copy_line gives every
+// line as a std::string as the LineFunc readers did
+static size_t ReadLines(FILE* fp,
+                        bool copy_line,
+                        const std::function<void(const char*, size_t)>& f) {
+  static const size_t kBuffSize = 4 * 1024 * 1024;
+  std::vector<char> buff(kBuffSize + 1, 0);
+  std::string x;
+  size_t total = 0;
+  size_t ret = 0;
+  while ((ret = fread(buff.data(), 1, kBuffSize, fp)) > 0) {
+    total += ret;
+    char* ptr = buff.data();
+    char* eol = reinterpret_cast<char*>(memchr(ptr, '\n', ret));
+    while (eol != nullptr) {
+      size_t size = eol - ptr + 1;
+      if (x.empty() && !copy_line) {
+        f(ptr, size - 1);
+      } else {
+        x.append(ptr, size - 1);
+        f(x.c_str(), x.size());
+      }
+      x.clear();
+      ptr += size;
+      ret -= size;
+      eol = reinterpret_cast<char*>(memchr(ptr, '\n', ret));
+    }
+    x.append(ptr, ret);
+  }
+  if (!x.empty()) {
+    f(x.c_str(), x.size());
+  }
+  return total;
+}
+
+// the strtoull parser of SlotRecordInMemoryDataFeed before ParseSlotText
+static bool ParseWithStrtoull(const char* str,
+                              const std::vector<SlotTextInfo>& slots,
+                              int uint64_slot_num,
+                              int float_slot_num,
+                              BenchSlotValues* rec) {
+  char* endptr = const_cast<char*>(str);
+  int pos = 0;
+  thread_local std::vector<std::vector<float>> slot_float_feasigns;
+  thread_local std::vector<std::vector<uint64_t>> slot_uint64_feasigns;
+  slot_float_feasigns.resize(float_slot_num);
+  slot_uint64_feasigns.resize(uint64_slot_num);
+  int uint64_total = 0;
+  for (const auto& info : slots) {
+    int num = strtol(&str[pos], &endptr, 10);
+    if (info.used) {
+      if (info.type == 'f') {
+        auto& slot_fea = slot_float_feasigns[info.slot_value_idx];
+        slot_fea.clear();
+        for (int j = 0; j < num; ++j) {
+          float feasign = strtof(endptr, &endptr);
+          if (fabs(feasign) < 1e-6 && !info.dense) {
+            continue;
+          }
+          slot_fea.push_back(feasign);
+        }
+      } else {
+        auto& slot_fea = slot_uint64_feasigns[info.slot_value_idx];
+        slot_fea.clear();
+        for (int j = 0; j < num; ++j) {
+          slot_fea.push_back(strtoull(endptr, &endptr, 10));
+          ++uint64_total;
+        }
+      }
+      pos = endptr - str;
+    } else {
+      // the skip loop of SlotRecordInMemoryDataFeed, which stopped at the
+      // first space
+      for (int j = 0; j <= num; ++j) {
+        pos = strchr(str + pos + 1, ' ') - str;
+      }
+    }
+  }
+  auto add = [](const auto& slot_feasigns, auto* values) {
+    values->slot_values.clear();
+    values->slot_offsets.resize(slot_feasigns.size() + 1);
+    for (size_t i = 0; i < slot_feasigns.size(); ++i) {
+      values->slot_offsets[i] = values->slot_values.size();
+      values->slot_values.insert(values->slot_values.end(),
+                                 slot_feasigns[i].begin(),
+                                 slot_feasigns[i].end());
+    }
+    values->slot_offsets.back() = values->slot_values.size();
+  };
+  add(slot_uint64_feasigns, &rec->uint64_values);
+  add(slot_float_feasigns, &rec->float_values);
+  return uint64_total > 0;
+}
+
+static uint64_t Checksum(const BenchSlotValues& rec) {
+  uint64_t sum = 0;
+  for (auto v : rec.uint64_values.slot_values) {
+    sum = sum * 31 + v;
+  }
+  for (auto v : rec.float_values.slot_values) {
+    uint32_t bits = 0;
+    memcpy(&bits, &v, sizeof(bits));
+    sum = sum * 31 + bits;
+  }
+  for (auto v : rec.uint64_values.slot_offsets) {
+    sum = sum * 31 + v;
+  }
+  return sum;
+}
+
+static void RunAll() {
+  std::vector<SlotTextInfo> slots;
+  std::string path = WriteSyntheticFile(&slots);
+  int uint64_slot_num = 0;
+  int float_slot_num = 0;
+  for (const auto& slot : slots) {
+    if (slot.used) {
+      ++(slot.type == 'u' ? uint64_slot_num : float_slot_num);
+    }
+  }
+
+  BenchSlotValues rec;
+  SlotTextBuffer buffer;
+  double best[2] = {0, 0};
+  uint64_t checksum[2] = {0, 0};
+  size_t bytes = 0;
+  size_t lines = 0;
+  // the first pass checks that both parsers give the same records, the
+  // others are timed
+  for (int r = 0; r <= FLAGS_repeat; ++r) {
+    const bool verify = (r == 0);
+    for (int k = 0; k < 2; ++k) {
+      FILE* fp = fopen(path.c_str(), "r");
+      CHECK(fp != nullptr) << "can not open " << path;
+      uint64_t sum = 0;
+      lines = 0;
+      auto start = std::chrono::steady_clock::now();
+      if (k == 0) {
+        bytes = ReadLines(fp, true, [&](const char* str, size_t len) {
+          CHECK(ParseWithStrtoull(
+              str, slots, uint64_slot_num, float_slot_num, &rec));
+          sum += verify ? Checksum(rec) : 0;
+          ++lines;
+        });
+      } else {
+        bytes = ReadLines(fp, false, [&](const char* str, size_t len) {
+          size_t bad_slot = 0;
+          CHECK(ParseSlotText(str,
+                              str + len,
+                              slots,
+                              uint64_slot_num,
+                              float_slot_num,
+                              &rec.uint64_values,
+                              &rec.float_values,
+                              &buffer,
+                              &bad_slot) == kSlotTextOk);
+          sum += verify ? Checksum(rec) : 0;
+          ++lines;
+        });
+      }
+      std::chrono::duration<double> cost =
+          std::chrono::steady_clock::now() - start;
+      fclose(fp);
+      if (verify) {
+        checksum[k] = sum;
+      } else {
+        best[k] = std::max(best[k], bytes / cost.count());
+      }
+    }
+  }
+  CHECK(checksum[0] == checksum[1]) << "parsers disagree";
+  if (FLAGS_file.empty()) {
+    unlink(path.c_str());
+  }
+  printf("%zu lines, %.1f MB, %d slots, %d used\n",
+         lines,
+         bytes / 1048576.0,
+         static_cast<int>(slots.size()),
+         uint64_slot_num + float_slot_num);
+  printf("%12s %12s %12s %8s\n", "parser", "MB/s", "lines/s", "speedup");
+  const char* names[2] = {"strtoull", "in place"};
+  for (int k = 0; k < 2; ++k) {
+    printf("%12s %12.1f %12.0f %8.2f\n",
+           names[k],
+           best[k] / 1048576.0,
+           best[k] / bytes * lines,
+           best[k] / best[0]);
+  }
+}
+
+}  // namespace framework
+}  // namespace paddle
+
+int main(int argc, char* argv[]) {
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  google::InitGoogleLogging(argv[0]);
+  paddle::framework::RunAll();
+  return 0;
+}
@@ -0,0 +1,117 @@
+/* Copyright (c) 2022 PaddlePaddle Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License. */
+
+#include <thread>  // NOLINT
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "paddle/fluid/framework/data_feed.h"
+
+namespace paddle {
+namespace framework {
+
+static void FillRecord(SlotRecord rec, uint64_t base, uint32_t num) {
+  std::vector<uint64_t> values(num);
+  for (uint32_t i = 0; i < num; ++i) {
+    values[i] = base + i;
+  }
+  rec->slot_uint64_feasigns_.add_values(values.data(), num);
+  float value = static_cast<float>(base);
+  rec->slot_float_feasigns_.add_values(&value, 1);
+}
+
+static void CheckRecord(SlotRecord rec, uint64_t base, uint32_t num) {
+  size_t size = 0;
+  uint64_t* values = rec->slot_uint64_feasigns_.get_values(0, &size);
+  ASSERT_EQ(size, num);
+  for (uint32_t i = 0; i < num; ++i) {
+    EXPECT_EQ(values[i], base + i);
+  }
+}
+
+// Records filled in an arena scope go back to the pool, which drops their
+// arena buffers, the arena is reset and the same records are filled from the
+// new chunks. Built with ASan, any buffer left pointing into a freed chunk is
+// reported when the records are cleared or destroyed.
+TEST(SlotRecordArena, AllocateReleaseResetReuse) {
+  SlotObjPool pool;
+  SlotRecordArena arena;
+  const int kThreads = 4;
+  const int kRecords = 1000;
+
+  for (int pass = 0; pass < 3; ++pass) {
+    std::vector<std::vector<SlotRecord>> records(kThreads);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < kThreads; ++t) {
+      threads.emplace_back([&, t]() {
+        SlotRecordArenaScope arena_scope(&arena);
+        pool.get(&records[t], kRecords);
+        for (int i = 0; i < kRecords; ++i) {
+          FillRecord(records[t][i], pass * 100000 + i, i % 17 + 1);
+        }
+      });
+    }
+    for (auto& thread : threads) {
+      thread.join();
+    }
+    EXPECT_GT(arena.reserved_bytes(), 0u);
+
+    for (int t = 0; t < kThreads; ++t) {
+      for (int i = 0; i < kRecords; ++i) {
+        SlotRecord rec = records[t][i];
+        EXPECT_TRUE(SlotArenaAllocator<uint64_t>::from_arena(
+            rec->slot_uint64_feasigns_.slot_values.data()));
+        CheckRecord(rec, pass * 100000 + i, i % 17 + 1);
+      }
+      pool.put(&records[t]);
+    }
+    arena.Reset();
+    EXPECT_EQ(arena.reserved_bytes(), 0u);
+  }
+  pool.set_max_capacity(0);
+  pool.trim();
+}
+
+// a buffer grown outside the arena scope moves to the heap and is not
+// touched by Reset
+TEST(SlotRecordArena, GrowOutsideScopeMovesToHeap) {
+  SlotObjPool pool;
+  SlotRecordArena arena;
+  std::vector<SlotRecord> records;
+  pool.get(&records, 1);
+  SlotRecord rec = records[0];
+  {
+    SlotRecordArenaScope arena_scope(&arena);
+    FillRecord(rec, 0, 4);
+  }
+  auto& values = rec->slot_uint64_feasigns_.slot_values;
+  EXPECT_TRUE(SlotArenaAllocator<uint64_t>::from_arena(values.data()));
+  values.reserve(values.capacity() * 2);
+  EXPECT_FALSE(SlotArenaAllocator<uint64_t>::from_arena(values.data()));
+  // the offsets still live in the arena
+  rec->slot_uint64_feasigns_.slot_offsets.clear();
+  SlotVector<uint32_t>().swap(rec->slot_uint64_feasigns_.slot_offsets);
+  rec->slot_float_feasigns_.clear(true);
+
+  arena.Reset();
+  for (uint64_t i = 0; i < 4; ++i) {
+    EXPECT_EQ(values[i], i);
+  }
+  pool.put(&records);
+  pool.set_max_capacity(0);
+  pool.trim();
+}
+
+}  // namespace framework
+}  // namespace paddle
@@ -0,0 +1,301 @@
+// Copyright (c) 2022 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "paddle/fluid/framework/slot_text_parser.h"
+
+#include <cfloat>
+#include <cstring>
+
+#include "paddle/fluid/platform/cpu_info.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && \
+    defined(__SSE2__)
+#define SLOT_TEXT_PARSER_SIMD
+#include <immintrin.h>
+#endif
+
+namespace paddle {
+namespace framework {
+
+// the tokens left after the last full vector, num > 0
+static inline const char* SkipTokensTail(const char* begin,
+                                         const char* p,
+                                         const char* end,
+                                         size_t num) {
+  for (; p < end; ++p) {
+    if (*p == ' ' && --num == 0) {
+      return p;
+    }
+  }
+  // the last token ends the line
+  return (num == 1 && end > begin && end[-1] != ' ') ? end : nullptr;
+}
+
+// the bytes left after the last full vector, prev_space tells if the byte
+// before p is a space (or p is the line begin)
+static inline size_t FindTokenStartsTail(const char* begin,
+                                         const char* p,
+                                         const char* end,
+                                         bool prev_space,
+                                         uint32_t* starts,
+                                         size_t n) {
+  for (; p < end; ++p) {
+    bool space = (*p == ' ');
+    if (!space && prev_space) {
+      starts[n++] = static_cast<uint32_t>(p - begin);
+    }
+    prev_space = space;
+  }
+  return n;
+}
+
+#ifdef SLOT_TEXT_PARSER_SIMD
+// token starts of 64 bytes at offset from their space mask
+static inline size_t AppendTokenStarts(uint64_t space,
+                                       uint64_t* prev_space,
+                                       uint32_t offset,
+                                       uint32_t* starts,
+                                       size_t n) {
+  uint64_t mask = ~space & ((space << 1) | *prev_space);
+  *prev_space = space >> 63;
+  while (mask != 0) {
+    starts[n++] = offset + __builtin_ctzll(mask);
+    mask &= mask - 1;
+  }
+  return n;
+}
+
+// position of the n-th set bit of mask, n >= 1
+static inline int NthSetBit(uint32_t mask, size_t n) {
+  while (--n > 0) {
+    mask &= mask - 1;
+  }
+  return __builtin_ctz(mask);
+}
+
+static const char* SkipTokensSse2(const char* begin,
+                                  const char* end,
+                                  size_t num) {
+  const __m128i space = _mm_set1_epi8(' ');
+  const char* p = begin;
+  for (; end - p >= 16; p += 16) {
+    __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    uint32_t mask = static_cast<uint32_t>(
+        _mm_movemask_epi8(_mm_cmpeq_epi8(chunk, space)));
+    size_t cnt = __builtin_popcount(mask);
+    if (cnt >= num) {
+      return p + NthSetBit(mask, num);
+    }
+    num -= cnt;
+  }
+  return SkipTokensTail(begin, p, end, num);
+}
+
+__attribute__((target("avx2,popcnt"))) static const char* SkipTokensAvx2(
+    const char* begin, const char* end, size_t num) {
+  const __m256i space = _mm256_set1_epi8(' ');
+  const char* p = begin;
+  for (; end - p >= 32; p += 32) {
+    __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+    uint32_t mask = static_cast<uint32_t>(
+        _mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, space)));
+    size_t cnt = __builtin_popcount(mask);
+    if (cnt >= num) {
+      return p + NthSetBit(mask, num);
+    }
+    num -= cnt;
+  }
+  return SkipTokensTail(begin, p, end, num);
+}
+static size_t FindTokenStartsSse2(const char* begin,
+                                  const char* end,
+                                  uint32_t* starts) {
+  const __m128i space = _mm_set1_epi8(' ');
+  const char* p = begin;
+  uint64_t prev_space = 1;
+  size_t n = 0;
+  for (; end - p >= 64; p += 64) {
+    uint64_t mask = 0;
+    for (int i = 0; i < 4; ++i) {
+      __m128i chunk =
+          _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i * 16));
+      uint64_t bits = static_cast<uint32_t>(
+          _mm_movemask_epi8(_mm_cmpeq_epi8(chunk, space)));
+      mask |= bits << (i * 16);
+    }
+    n = AppendTokenStarts(
+        mask, &prev_space, static_cast<uint32_t>(p - begin), starts, n);
+  }
+  return FindTokenStartsTail(begin, p, end, prev_space != 0, starts, n);
+}
+
+__attribute__((target("avx2,bmi"))) static size_t FindTokenStartsAvx2(
+    const char* begin, const char* end, uint32_t* starts) {
+  const __m256i space = _mm256_set1_epi8(' ');
+  const char* p = begin;
+  uint64_t prev_space = 1;
+  size_t n = 0;
+  for (; end - p >= 64; p += 64) {
+    __m256i lo = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+    __m256i hi = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + 32));
+    uint64_t mask =
+        static_cast<uint32_t>(
+            _mm256_movemask_epi8(_mm256_cmpeq_epi8(lo, space))) |
+        (static_cast<uint64_t>(static_cast<uint32_t>(
+             _mm256_movemask_epi8(_mm256_cmpeq_epi8(hi, space))))
+         << 32);
+    n = AppendTokenStarts(
+        mask, &prev_space, static_cast<uint32_t>(p - begin), starts, n);
+  }
+  return FindTokenStartsTail(begin, p, end, prev_space != 0, starts, n);
+}
+#else
+static const char* SkipTokensScalar(const char* begin,
+                                    const char* end,
+                                    size_t num) {
+  return SkipTokensTail(begin, begin, end, num);
+}
+#endif
+
+typedef const char* (*SkipTokensFunc)(const char*, const char*, size_t);
+
+static SkipTokensFunc GetSkipTokensFunc() {
+#ifdef SLOT_TEXT_PARSER_SIMD
+  if (platform::MayIUse(platform::avx2)) {
+    return SkipTokensAvx2;
+  }
+  return SkipTokensSse2;
+#else
+  return SkipTokensScalar;
+#endif
+}
+
+typedef size_t (*FindTokenStartsFunc)(const char*, const char*, uint32_t*);
+
+static FindTokenStartsFunc GetFindTokenStartsFunc() {
+#ifdef SLOT_TEXT_PARSER_SIMD
+  if (platform::MayIUse(platform::avx2)) {
+    return FindTokenStartsAvx2;
+  }
+  return FindTokenStartsSse2;
+#else
+  return [](const char* begin, const char* end, uint32_t* starts) {
+    return FindTokenStartsTail(begin, begin, end, true, starts, 0);
+  };
+#endif
+}
+
+size_t FindTokenStarts(const char* begin, const char* end, uint32_t* starts) {
+  static const FindTokenStartsFunc func = GetFindTokenStartsFunc();
+  return func(begin, end, starts);
+}
+
+const char* SkipTokens(const char* p, const char* end, size_t num) {
+  if (num == 0) {
+    return p;
+  }
+  static const SkipTokensFunc func = GetSkipTokensFunc();
+  return func(p, end, num);
+}
+
+static const double kPow10[] = {1e0,  1e1,  1e2,  1e3,  1e4,  1e5,
+                                1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+                                1e12, 1e13, 1e14, 1e15, 1e16, 1e17,
+                                1e18, 1e19, 1e20, 1e21, 1e22};
+
+// Clinger's fast path: with m < 2^53 and 10^|e| exact, m * 10^e is one
+// correctly rounded double operation. Rounding that double again to float
+// gives the strtof result unless it falls exactly halfway between two
+// floats, those and the values out of the normal float range go to strtof.
+static inline bool FastDecimalToFloat(uint64_t m,
+                                      int exp10,
+                                      bool negative,
+                                      float* value) {
+  if (m == 0) {
+    *value = negative ? -0.0f : 0.0f;
+    return true;
+  }
+  if (m > (1ULL << 53) || exp10 < -22 || exp10 > 22) {
+    return false;
+  }
+  double d = static_cast<double>(m);
+  d = (exp10 < 0) ? d / kPow10[-exp10] : d * kPow10[exp10];
+  if (d < FLT_MIN || d > FLT_MAX) {
+    return false;
+  }
+  uint64_t bits = 0;
+  memcpy(&bits, &d, sizeof(bits));
+  // the 29 mantissa bits a float drops
+  if ((bits & ((1ULL << 29) - 1)) == (1ULL << 28)) {
+    return false;
+  }
+  *value = static_cast<float>(negative ? -d : d);
+  return true;
+}
+
+bool ParseFloat(const char** p, const char* end, float* value) {
+  const char* s = SkipSpaces(*p, end);
+  if (s == end) {
+    return false;
+  }
+  const char* t = s;
+  bool negative = false;
+  if (*t == '-' || *t == '+') {
+    negative = (*t == '-');
+    ++t;
+  }
+  uint64_t m = 0;
+  int digits = 0;
+  int exp10 = 0;
+  bool any_digit = false;
+  bool exact = true;
+  unsigned d = 0;
+  for (; t < end && (d = static_cast<unsigned>(*t - '0')) <= 9; ++t) {
+    any_digit = true;
+    if (digits < 19) {
+      m = m * 10 + d;
+      digits += (m != 0);
+    } else {
+      exact = false;
+    }
+  }
+  if (t < end && *t == '.') {
+    for (++t; t < end && (d = static_cast<unsigned>(*t - '0')) <= 9; ++t) {
+      any_digit = true;
+      if (digits < 19) {
+        m = m * 10 + d;
+        digits += (m != 0);
+        --exp10;
+      } else {
+        exact = false;
+      }
+    }
+  }
+  // exponents, hex, inf and nan are left to strtof
+  if (exact && any_digit && (t == end || *t == ' ') &&
+      FastDecimalToFloat(m, exp10, negative, value)) {
+    *p = t;
+    return true;
+  }
+  char* endptr = nullptr;
+  *value = strtof(s, &endptr);
+  if (endptr == s || endptr > end) {
+    return false;
+  }
+  *p = endptr;
+  return true;
+}
+
+}  // namespace framework
+}  // namespace paddle
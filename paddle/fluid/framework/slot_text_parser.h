@@ -0,0 +1,255 @@
+// Copyright (c) 2022 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+namespace paddle {
+namespace framework {
+
+// Tokenizer of the MultiSlot text format
+//   [1 ins_id] [1 logkey] num v_1 ... v_num num v_1 ... v_num ...
+// working in place on a line [begin, end) of the read buffer. Tokens are
+// separated by one space, and *end must not belong to a number, which holds
+// for the '\n' of a buffered line and the '\0' of a string. Integers are
+// parsed without strtoull, and floats without strtof when the value allows
+// an exact fast path, so the results are the same as the libc functions.
+
+// Skips num tokens starting at p, returns the end of the last one (the space
+// after it, or end), or nullptr if the line has fewer tokens. Spaces are
+// searched with SSE2, or AVX2 when the CPU has it.
+const char* SkipTokens(const char* p, const char* end, size_t num);
+
+inline const char* SkipSpaces(const char* p, const char* end) {
+  while (p < end && *p == ' ') {
+    ++p;
+  }
+  return p;
+}
+
+// Eight ASCII digits at s to their value, in a few multiplies instead of
+// eight dependent ones (the SWAR trick of fast_float).
+inline bool ParseEightDigits(const char* s, uint64_t* value) {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+  uint64_t v = 0;
+  memcpy(&v, s, sizeof(v));
+  if (((v & 0xF0F0F0F0F0F0F0F0ULL) |
+       (((v + 0x0606060606060606ULL) & 0xF0F0F0F0F0F0F0F0ULL) >> 4)) !=
+      0x3333333333333333ULL) {
+    return false;
+  }
+  v -= 0x3030303030303030ULL;
+  v = (v * 10) + (v >> 8);
+  *value = (((v & 0x000000FF000000FFULL) * 0x000F424000000064ULL) +
+            (((v >> 16) & 0x000000FF000000FFULL) * 0x0000271000000001ULL)) >>
+           32;
+  return true;
+#else
+  return false;
+#endif
+}
+
+// parses the next uint64 token at *p, as strtoull does
+inline bool ParseUint64(const char** p, const char* end, uint64_t* value) {
+  const char* s = SkipSpaces(*p, end);
+  if (s == end) {
+    return false;
+  }
+  unsigned d = static_cast<unsigned>(*s - '0');
+  if (d > 9) {
+    if (*s != '-' && *s != '+') {
+      return false;
+    }
+    char* endptr = nullptr;
+    *value = strtoull(s, &endptr, 10);
+    if (endptr == s || endptr > end) {
+      return false;
+    }
+    *p = endptr;
+    return true;
+  }
+  const char* begin = s;
+  uint64_t v = 0;
+  uint64_t eight = 0;
+  // 19 digits never overflow
+  while (end - s >= 8 && s - begin <= 11 && ParseEightDigits(s, &eight)) {
+    v = v * 100000000 + eight;
+    s += 8;
+  }
+  const char* fast_end = (end - begin > 19) ? begin + 19 : end;
+  while (s < fast_end && (d = static_cast<unsigned>(*s - '0')) <= 9) {
+    v = v * 10 + d;
+    ++s;
+  }
+  if (s == fast_end && s < end &&
+      (d = static_cast<unsigned>(*s - '0')) <= 9) {
+    // saturate as strtoull does
+    bool overflow = false;
+    for (; s < end && (d = static_cast<unsigned>(*s - '0')) <= 9; ++s) {
+      overflow = overflow || __builtin_mul_overflow(v, 10, &v) ||
+                 __builtin_add_overflow(v, d, &v);
+    }
+    if (overflow) {
+      v = UINT64_MAX;
+    }
+  }
+  *value = v;
+  *p = s;
+  return true;
+}
+
+// parses the next float token at *p, as strtof does
+bool ParseFloat(const char** p, const char* end, float* value);
+
+// a slot of the data feed desc, in the order of the text columns
+struct SlotTextInfo {
+  char type = 'u';  // 'u' or 'f'
+  bool used = false;
+  bool dense = false;
+  int slot_value_idx = -1;  // destination slot in SlotValues, if used
+};
+
+enum SlotTextStatus {
+  kSlotTextOk = 0,
+  kSlotTextEmptySlot,  // a slot with 0 feasigns, see bad_slot
+  kSlotTextBadLine,
+};
+
+// Offsets of the token starts of [begin, end) go to starts, which must hold
+// (end - begin + 1) / 2 + 1 of them, returns the token number. The spaces of
+// the whole line are found with SSE2, or AVX2 when the CPU has it.
+size_t FindTokenStarts(const char* begin, const char* end, uint32_t* starts);
+
+// values of one slot in a line, found by the first pass of ParseSlotText
+struct SlotTextSpan {
+  uint32_t token;  // index of the first value
+  uint32_t num;
+};
+
+// scratch buffers of ParseSlotText, reused from line to line
+struct SlotTextBuffer {
+  std::vector<uint32_t> token_starts;
+  std::vector<SlotTextSpan> spans;
+};
+
+// Parses the slot columns of a line straight into the slot_values and
+// slot_offsets of two SlotValues (any type with those vector members), as
+// SlotValues::add_slot_feasigns lays them out. The tokens of the line are
+// indexed first, then a pass over the feasign counts sizes the destination
+// once, and only the values of the used slots are parsed. Zero values of
+// sparse float slots are dropped.
+template <typename U, typename F>
+SlotTextStatus ParseSlotText(const char* p,
+                             const char* end,
+                             const std::vector<SlotTextInfo>& slots,
+                             int uint64_slot_num,
+                             int float_slot_num,
+                             U* uint64_values,
+                             F* float_values,
+                             SlotTextBuffer* buffer,
+                             size_t* bad_slot) {
+  size_t max_tokens = (end - p + 1) / 2 + 1;
+  if (buffer->token_starts.size() < max_tokens) {
+    buffer->token_starts.resize(max_tokens);
+  }
+  const uint32_t* starts = buffer->token_starts.data();
+  const size_t token_num =
+      FindTokenStarts(p, end, buffer->token_starts.data());
+  auto& spans = buffer->spans;
+  spans.resize(slots.size());
+
+  size_t token = 0;
+  size_t uint64_total = 0;
+  size_t float_total = 0;
+  for (size_t i = 0; i < slots.size(); ++i) {
+    if (token >= token_num) {
+      return kSlotTextBadLine;
+    }
+    uint64_t num = 0;
+    const char* s = p + starts[token];
+    if (!ParseUint64(&s, end, &num) || num > token_num) {
+      return kSlotTextBadLine;
+    }
+    if (num == 0) {
+      *bad_slot = i;
+      return kSlotTextEmptySlot;
+    }
+    spans[i] = SlotTextSpan{static_cast<uint32_t>(token + 1),
+                            static_cast<uint32_t>(num)};
+    token += num + 1;
+    if (token > token_num) {
+      return kSlotTextBadLine;
+    }
+    if (slots[i].used) {
+      if (slots[i].type == 'u') {
+        uint64_total += num;
+      } else {
+        float_total += num;
+      }
+    }
+  }
+
+  auto& uint64_offsets = uint64_values->slot_offsets;
+  auto& float_offsets = float_values->slot_offsets;
+  uint64_values->slot_values.resize(uint64_total);
+  float_values->slot_values.resize(float_total);
+  uint64_offsets.resize(uint64_slot_num + 1);
+  float_offsets.resize(float_slot_num + 1);
+  uint64_t* uint64_dst = uint64_values->slot_values.data();
+  float* float_dst = float_values->slot_values.data();
+  size_t uint64_num = 0;
+  size_t float_num = 0;
+  for (size_t i = 0; i < slots.size(); ++i) {
+    const SlotTextInfo& info = slots[i];
+    if (!info.used) {
+      continue;
+    }
+    const uint32_t* value_starts = starts + spans[i].token;
+    const uint32_t num = spans[i].num;
+    if (info.type == 'u') {
+      uint64_offsets[info.slot_value_idx] = uint64_num;
+      for (uint32_t j = 0; j < num; ++j) {
+        const char* s = p + value_starts[j];
+        if (!ParseUint64(&s, end, &uint64_dst[uint64_num++])) {
+          return kSlotTextBadLine;
+        }
+      }
+    } else {
+      float_offsets[info.slot_value_idx] = float_num;
+      for (uint32_t j = 0; j < num; ++j) {
+        const char* s = p + value_starts[j];
+        float value = 0;
+        if (!ParseFloat(&s, end, &value)) {
+          return kSlotTextBadLine;
+        }
+        if (fabs(value) < 1e-6 && !info.dense) {
+          continue;
+        }
+        float_dst[float_num++] = value;
+      }
+    }
+  }
+  uint64_offsets[uint64_slot_num] = uint64_num;
+  float_offsets[float_slot_num] = float_num;
+  float_values->slot_values.resize(float_num);
+  return kSlotTextOk;
+}
+
+}  // namespace framework
+}  // namespace paddle
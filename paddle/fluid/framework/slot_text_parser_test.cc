@@ -0,0 +1,204 @@
+// Copyright (c) 2022 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "paddle/fluid/framework/slot_text_parser.h"
+
+#include <cstring>
+#include <random>
+#include <string>
+
+#include "gtest/gtest.h"
+
+namespace paddle {
+namespace framework {
+
+template <typename T>
+struct TestSlotValues {
+  std::vector<T> slot_values;
+  std::vector<uint32_t> slot_offsets;
+};
+
+TEST(SlotTextParser, SkipTokens) {
+  std::default_random_engine engine(0);
+  for (int round = 0; round < 200; ++round) {
+    std::string line;
+    std::vector<size_t> ends;
+    int tokens = 1 + engine() % 40;
+    for (int i = 0; i < tokens; ++i) {
+      if (i > 0) {
+        line += ' ';
+      }
+      line += std::to_string(engine() % 1000000007ULL * (engine() % 1000));
+      ends.push_back(line.size());
+    }
+    const char* begin = line.data();
+    const char* end = begin + line.size();
+    for (int n = 1; n <= tokens; ++n) {
+      const char* p = SkipTokens(begin, end, n);
+      ASSERT_NE(p, nullptr);
+      EXPECT_EQ(static_cast<size_t>(p - begin), ends[n - 1]);
+    }
+    EXPECT_EQ(SkipTokens(begin, end, tokens + 1), nullptr);
+    EXPECT_EQ(SkipTokens(begin, end, 0), begin);
+  }
+  std::string trailing = "1 2 ";
+  EXPECT_EQ(SkipTokens(trailing.data(), trailing.data() + 4, 3), nullptr);
+}
+
+TEST(SlotTextParser, FindTokenStarts) {
+  std::default_random_engine engine(0);
+  for (int round = 0; round < 200; ++round) {
+    std::string line;
+    std::vector<uint32_t> expect;
+    int tokens = engine() % 80;
+    for (int i = 0; i < tokens; ++i) {
+      // runs of spaces are allowed between tokens
+      line.append(engine() % 3 == 0 ? 2 : (i > 0 ? 1 : engine() % 2), ' ');
+      expect.push_back(line.size());
+      line += std::to_string(engine());
+    }
+    std::vector<uint32_t> starts((line.size() + 1) / 2 + 1);
+    size_t n = FindTokenStarts(line.data(), line.data() + line.size(),
+                               starts.data());
+    starts.resize(n);
+    EXPECT_EQ(starts, expect);
+  }
+}
+
+TEST(SlotTextParser, SameAsLibc) {
+  std::default_random_engine engine(0);
+  std::vector<std::string> tokens = {"0",
+                                     "18446744073709551615",
+                                     "18446744073709551616",
+                                     "99999999999999999999999",
+                                     "00000000000000000000000042",
+                                     "-1",
+                                     "+7",
+                                     "0.5",
+                                     "-0",
+                                     "1e-3",
+                                     "3.4028235e38",
+                                     "1.17549435e-38",
+                                     "0.000001",
+                                     "123456789.123456789",
+                                     ".25",
+                                     "7.",
+                                     "0.1000000000000000055511151231257827"};
+  for (int i = 0; i < 20000; ++i) {
+    tokens.push_back(std::to_string(engine()) + std::to_string(engine()));
+    char buf[64];
+    snprintf(buf,
+             sizeof(buf),
+             "%.*f",
+             static_cast<int>(engine() % 9),
+             static_cast<double>(engine()) / (1 + engine() % 100000) - 1000);
+    tokens.push_back(buf);
+    snprintf(buf, sizeof(buf), "%.9g", static_cast<double>(engine()) * 1e-9);
+    tokens.push_back(buf);
+  }
+  for (const auto& token : tokens) {
+    std::string line = " " + token + " ";
+    const char* end = line.data() + line.size();
+    const char* p = line.data();
+    char* endptr = nullptr;
+    uint64_t u = 0;
+    uint64_t expect_u = strtoull(line.c_str(), &endptr, 10);
+    if (ParseUint64(&p, end, &u)) {
+      EXPECT_EQ(u, expect_u) << token;
+      EXPECT_EQ(p, endptr) << token;
+    }
+    p = line.data();
+    float f = 0;
+    float expect_f = strtof(line.c_str(), &endptr);
+    ASSERT_TRUE(ParseFloat(&p, end, &f)) << token;
+    EXPECT_EQ(memcmp(&f, &expect_f, sizeof(f)), 0)
+        << token << " " << f << " " << expect_f;
+    EXPECT_EQ(p, endptr) << token;
+  }
+  std::string bad = "abc";
+  const char* p = bad.data();
+  uint64_t u = 0;
+  float f = 0;
+  EXPECT_FALSE(ParseUint64(&p, bad.data() + bad.size(), &u));
+  EXPECT_FALSE(ParseFloat(&p, bad.data() + bad.size(), &f));
+}
+
+TEST(SlotTextParser, ParseSlotText) {
+  // slots: u used, f unused, f used sparse, u unused, u used, f used dense
+  std::vector<SlotTextInfo> slots(6);
+  const char types[] = {'u', 'f', 'f', 'u', 'u', 'f'};
+  const bool used[] = {true, false, true, false, true, true};
+  int uint64_slot_num = 0;
+  int float_slot_num = 0;
+  for (size_t i = 0; i < slots.size(); ++i) {
+    slots[i].type = types[i];
+    slots[i].used = used[i];
+    slots[i].dense = (i == 5);
+    if (used[i]) {
+      slots[i].slot_value_idx =
+          (types[i] == 'u') ? uint64_slot_num++ : float_slot_num++;
+    }
+  }
+  TestSlotValues<uint64_t> uint64_values;
+  TestSlotValues<float> float_values;
+  SlotTextBuffer buffer;
+  size_t bad_slot = 0;
+
+  // a line as it sits in the read buffer, followed by the next one
+  std::string text =
+      "2 11 12 1 0.5 3 0 1.5 0 2 7 8 1 9 2 0 2.5\n1 1 1 1 1 1 1 1 1 1 1 1";
+  const char* end = text.data() + text.find('\n');
+  ASSERT_EQ(ParseSlotText(text.data(),
+                          end,
+                          slots,
+                          uint64_slot_num,
+                          float_slot_num,
+                          &uint64_values,
+                          &float_values,
+                          &buffer,
+                          &bad_slot),
+            kSlotTextOk);
+  EXPECT_EQ(uint64_values.slot_values, (std::vector<uint64_t>{11, 12, 9}));
+  EXPECT_EQ(uint64_values.slot_offsets, (std::vector<uint32_t>{0, 2, 3}));
+  EXPECT_EQ(float_values.slot_values, (std::vector<float>{1.5, 0, 2.5}));
+  EXPECT_EQ(float_values.slot_offsets, (std::vector<uint32_t>{0, 1, 3}));
+
+  std::string empty_slot = "1 5 1 0.5 0 1 2 1 3 1 4 1 0.5";
+  EXPECT_EQ(ParseSlotText(empty_slot.data(),
+                          empty_slot.data() + empty_slot.size(),
+                          slots,
+                          uint64_slot_num,
+                          float_slot_num,
+                          &uint64_values,
+                          &float_values,
+                          &buffer,
+                          &bad_slot),
+            kSlotTextEmptySlot);
+  EXPECT_EQ(bad_slot, 2UL);
+
+  std::string short_line = "1 5 1 0.5 1 1 1 2 1 3 2 4";
+  EXPECT_EQ(ParseSlotText(short_line.data(),
+                          short_line.data() + short_line.size(),
+                          slots,
+                          uint64_slot_num,
+                          float_slot_num,
+                          &uint64_values,
+                          &float_values,
+                          &buffer,
+                          &bad_slot),
+            kSlotTextBadLine);
+}
+
+}  // namespace framework
+}  // namespace paddle
@@ -960,6 +960,31 @@ PADDLE_DEFINE_EXPORTED_int32(padbox_slotrecord_extend_dim,
 PADDLE_DEFINE_EXPORTED_int32(fix_dayid, 0, "Whether fix dayid in PaddleBox");
 PADDLE_DEFINE_EXPORTED_int32(padbox_slotpool_thread_num, 1,
              "PadBoxSlotDataset slot pool thread num");
+PADDLE_DEFINE_EXPORTED_int32(padbox_slotpool_thread_cache_size, 20000,
+             "slot record pool objects cached per thread, 0 disables cache");
+PADDLE_DEFINE_EXPORTED_bool(enable_slotrecord_arena, false,
+            "SlotRecordDataset keeps feasigns of a pass in large arena "
+            "chunks freed at ReleaseMemory, default false");
+PADDLE_DEFINE_EXPORTED_int32(global_shuffle_inflight_mb, 64,
+             "bytes in flight to each trainer during global shuffle, "
+             "in MB");
+PADDLE_DEFINE_EXPORTED_int32(global_shuffle_recv_thread_num, 4,
+             "threads deserializing global shuffle messages, 0 "
+             "deserializes in the rpc thread");
+PADDLE_DEFINE_EXPORTED_int32(global_shuffle_recv_pending_mb, 256,
+             "received global shuffle bytes queued for deserialization "
+             "before the rpc threads block, in MB");
+PADDLE_DEFINE_EXPORTED_bool(enable_fs_native_gzip, true,
+            "inflate .gz files read with no converter but cat in process, "
+            "instead of through zcat or hadoop -text");
+PADDLE_DEFINE_EXPORTED_int32(fs_gzip_thread_num, 4,
+             "threads inflating the blocks of a BGZF file in parallel, 1 "
+             "inflates them in the reading thread");
+PADDLE_DEFINE_EXPORTED_int32(fs_read_ahead_buffer_num, 8,
+             "1MB buffers a local file read in chunks is read ahead into, 0 "
+             "reads it in the reading thread");
+PADDLE_DEFINE_EXPORTED_int32(fs_read_ahead_thread_num, 2,
+             "threads reading a local file ahead, the reads in flight");
 PADDLE_DEFINE_EXPORTED_bool(use_gpu_replica_cache, false,
             "if true ,will open use_gpu_replica_cache");
 PADDLE_DEFINE_EXPORTED_int32(gpu_replica_cache_dim, 8, "use_gpu_replica_cache,the dim");
@@ -366,6 +366,12 @@ void BindDataset(py::module *m) {
       .def("set_fleet_send_sleep_seconds",
            &framework::Dataset::SetFleetSendSleepSeconds,
            py::call_guard<py::gil_scoped_release>())
+      .def("set_memory_budget",
+           &framework::Dataset::SetMemoryBudget,
+           py::call_guard<py::gil_scoped_release>())
+      .def("set_shuffle_codec",
+           &framework::Dataset::SetShuffleCodec,
+           py::call_guard<py::gil_scoped_release>())
       .def("enable_pv_merge",
            &framework::Dataset::EnablePvMerge,
            py::call_guard<py::gil_scoped_release>())
@@ -53,6 +53,11 @@ void BindMetrics(py::module* m) {
            py::call_guard<py::gil_scoped_release>())
       .def("get_metric_name_list",
            &framework::Metric::GetMetricNameList,
+           py::call_guard<py::gil_scoped_release>())
+      .def("set_async",
+           &framework::Metric::SetAsync,
+           py::arg("thread_num"),
+           py::arg("max_pending") = 16,
            py::call_guard<py::gil_scoped_release>());
 }  // end Metrics
 }  // end namespace pybind
@@ -141,6 +141,16 @@ class DatasetBase(object):
     def _set_input_type(self, input_type):
         self.proto_desc.input_type = input_type
 
+    def _set_input_format(self, input_format):
+        """
+        Set the file format read by SlotRecordInMemoryDataFeed, "text" or
+        "columnar" for files written by columnar_converter.
+
+        Args:
+            input_format(str): "text" or "columnar", default is "text"
+        """
+        self.proto_desc.input_format = input_format
+
     def _set_uid_slot(self, uid_slot):
         """
         Set user slot name.
@@ -737,6 +747,64 @@ class InMemoryDataset(DatasetBase):
         """
         self.fleet_send_sleep_seconds = fleet_send_sleep_seconds
 
+    def _set_memory_budget(self, budget_mb, spill_dir="./"):
+        """
+        Keep at most budget_mb MB of loaded records in memory, the rest is
+        spilled to files in spill_dir. It covers load_into_memory,
+        preload_into_memory, local_shuffle, global_shuffle and training,
+        which reads the spilled records back once per epoch. 0 disables it.
+
+        Only datasets of MultiSlotInMemoryDataFeed support it. Datasets of
+        SlotRecordInMemoryDataFeed, and the PadBox datasets, keep the whole
+        pass in memory and raise an error for a budget above 0.
+
+        Known gaps, these bring every spilled record back into memory and so
+        need memory for the whole pass:
+
+        - training with PS-GPU (use_ps_gpu), which batches the pass by
+          offset
+        - enable_pv_merge, which sorts the pass by search_id
+        - slots_shuffle, which keeps the original records
+        - _set_merge_by_lineid and _set_generate_unique_feasigns after
+          global_shuffle
+
+        Args:
+            budget_mb(int): memory budget in MB
+            spill_dir(str): local directory of spill files, default is "./"
+
+        Examples:
+            .. code-block:: python
+
+              import paddle
+              paddle.enable_static()
+              dataset = paddle.distributed.InMemoryDataset()
+              dataset._set_memory_budget(4096, "/tmp/spill")
+
+        """
+        self.dataset.set_memory_budget(budget_mb, spill_dir)
+
+    def _set_shuffle_codec(self, codec="none"):
+        """
+        Set the codec of the messages sent by global_shuffle. "zlib" deflates
+        them, "feasign" encodes slot ids as runs and repeated feasigns as
+        references, and "none" sends them as they are. Receivers read every
+        codec, so trainers may use different ones. Only MultiSlotDataset
+        supports it.
+
+        Args:
+            codec(str): "none", "zlib" or "feasign", default is "none"
+
+        Examples:
+            .. code-block:: python
+
+              import paddle
+              paddle.enable_static()
+              dataset = paddle.distributed.InMemoryDataset()
+              dataset._set_shuffle_codec("feasign")
+
+        """
+        self.dataset.set_shuffle_codec(codec)
+
     def _set_merge_by_lineid(self, merge_size=2):
         """
         Set merge by line id, instances of same line id will be merged after